@@ -3,6 +3,7 @@
 #include "poModule.h"
 
 #include <vector>
+#include <algorithm>
 #include <iostream>
 
 using namespace po;
@@ -19,7 +20,7 @@ static const int align(const int size)
     return 24 - remainder;
 }
 
-void poAnalyzer:: checkCallSites(poModule& module, po_x86_64_flow_graph& cfg)
+void poAnalyzer:: checkCallSites(po_x86_64_flow_graph& cfg, const std::unordered_map<int, poCallLayout>& callLayouts, const int redZone)
 {
     // We need to align function calls to the calling convention. This involves passing in arguments via the stack.
     // 1) Loop through basic blocks and find call instructions
@@ -50,11 +51,12 @@ void poAnalyzer:: checkCallSites(poModule& module, po_x86_64_flow_graph& cfg)
             }
 
             const int id = instr.id();
-            argStackSize = std::max(argStackSize, checkFunction(module, id)); 
+            argStackSize = std::max(argStackSize, checkFunction(callLayouts, id));
         }
     }
 
-    int stackAdjustment = 32 /* register homes */;
+    // A leaf function may keep its frame in the red zone, which is addressed below the stack pointer
+    int stackAdjustment = VM_REGISTER_HOMES - redZone;
     if (basicBlocks.size() > 0)
     {
         po_x86_64_basic_block* bb = basicBlocks.front();
@@ -131,6 +133,20 @@ void poAnalyzer:: checkCallSites(poModule& module, po_x86_64_flow_graph& cfg)
                 instr.setImm32(stackSize);
             }
         }
+
+        // Without locals or stack arguments the stack pointer is left alone
+        if (stackSize == 0)
+        {
+            for (size_t i = 0; i < basicBlocks.size(); i++)
+            {
+                std::vector<po_x86_64_instruction>& ins = basicBlocks[i]->instructions();
+                ins.erase(std::remove_if(ins.begin(), ins.end(), [](const po_x86_64_instruction& instr) {
+                    return !instr.isSSE() &&
+                        (instr.opcode() == VMI_SUB64_SRC_IMM_DST_REG || instr.opcode() == VMI_ADD64_SRC_IMM_DST_REG) &&
+                        instr.dstReg() == VM_REGISTER_ESP;
+                }), ins.end());
+            }
+        }
     }
 
     // Fixup MOV instructions
@@ -209,6 +225,24 @@ void poAnalyzer:: checkCallSites(poModule& module, po_x86_64_flow_graph& cfg)
                     continue;
                 }
 
+                instr.setImm32(instr.imm32() + stackAdjustment);
+            }
+            else if (instr.opcode() == VMI_SSE_MOVDQU_SRC_REG_DST_MEM)
+            {
+                if (instr.dstReg() != VM_REGISTER_ESP)
+                {
+                    continue;
+                }
+
+                instr.setImm32(instr.imm32() + stackAdjustment);
+            }
+            else if (instr.opcode() == VMI_SSE_MOVDQU_SRC_MEM_DST_REG)
+            {
+                if (instr.srcReg() != VM_REGISTER_ESP)
+                {
+                    continue;
+                }
+
                 instr.setImm32(instr.imm32() + stackAdjustment);
             }
         }
@@ -255,15 +289,12 @@ void poAnalyzer:: checkCallSites(poModule& module, po_x86_64_flow_graph& cfg)
         }
     }
 
-    fixFunctionCalls(module, cfg);
+    fixFunctionCalls(cfg, callLayouts);
 }
 
-void poAnalyzer::fixFunctionCalls(poModule& module, po_x86_64_flow_graph& cfg)
+void poAnalyzer::fixFunctionCalls(po_x86_64_flow_graph& cfg, const std::unordered_map<int, poCallLayout>& callLayouts)
 {
-    const int registerHomes = 32; // 8 * 4 for the register homes
-
-    static const int generalArgs[] = { VM_ARG1, VM_ARG2, VM_ARG3, VM_ARG4, VM_ARG5, VM_ARG6 };
-    static const int sseArgs[] = { VM_SSE_ARG1, VM_SSE_ARG2, VM_SSE_ARG3, VM_SSE_ARG4, VM_SSE_ARG5, VM_SSE_ARG6, VM_SSE_ARG7, VM_SSE_ARG8 };
+    const int registerHomes = VM_REGISTER_HOMES;
 
     std::vector<po_x86_64_basic_block*>& basicBlocks = cfg.basicBlocks();
     for (size_t i = 0; i < basicBlocks.size(); i++)
@@ -283,146 +314,46 @@ void poAnalyzer::fixFunctionCalls(poModule& module, po_x86_64_flow_graph& cfg)
                 continue;
             }
 
-            const int id = instr.id();
-            std::string symbol;
-            if (!module.getSymbol(id, symbol)) { continue; }
-            
-            for (poFunction& func : module.functions())
+            const auto& it = callLayouts.find(instr.id());
+            if (it == callLayouts.end()) { continue; }
+
+            // TOOO: there are still some issues this doesn't handle,
+            // such as return values which are structs being passed via the stack
+
+            const std::vector<poCallArg>& args = it->second.args();
+            size_t argsDone = 0;
+            size_t pos = k - 1;
+            while (argsDone < args.size())
             {
-                if (func.fullname() != symbol)
+                const poCallArg& arg = args[args.size() - argsDone - 1];
+                auto& instr = ins[pos];
+
+                if (arg.isStack() &&
+                    instr.dstReg() == VM_REGISTER_ESP)
                 {
-                    continue;
+                    instr.setImm32(registerHomes + arg.stackSlot() * 8);
+                    argsDone++;
                 }
-
-                // TOOO: there are still some issues this doesn't handle,
-                // such as return values which are structs being passed via the stack
-                // and class instance methods where the "this" pointer is passed
-
-                const std::vector<int>& args = func.args();
-                size_t argsDone = 0;
-                size_t pos = k - 1;
-                int stackPos = registerHomes + (int(args.size()) - VM_MAX_ARGS - 1) * 8;
-                while (argsDone < args.size())
+                else if (!arg.isStack() && instr.dstReg() == arg.reg())
                 {
-                    const int argIndex = int(args.size() - argsDone) - 1;
-                    const int typeId = args[argIndex];
-                    const poType& type = module.types()[typeId];
-                    auto& instr = ins[pos];
-
-                    switch (typeId)
-                    {
-                        case TYPE_BOOLEAN:
-                        case TYPE_I64:
-                        case TYPE_I32:
-                        case TYPE_I16:
-                        case TYPE_I8:
-                        case TYPE_U64:
-                        case TYPE_U32:
-                        case TYPE_U16:
-                        case TYPE_U8:
-                            if (argIndex >= VM_MAX_ARGS &&
-                                instr.dstReg() == VM_REGISTER_ESP)
-                            {
-                                instr.setImm32(stackPos);
-                                stackPos -= 8;
-                                argsDone++;
-                            }
-                            else if (instr.dstReg() == generalArgs[argIndex])
-                            {
-                                argsDone++;
-                            }
-                            break;
-                        case TYPE_F32:
-                        case TYPE_F64:
-                            if (argIndex >= VM_MAX_SSE_ARGS &&
-                                instr.dstReg() == VM_REGISTER_ESP)
-                            {
-                                instr.setImm32(stackPos);
-                                stackPos -= 8;
-                                argsDone++;
-                            }
-                            else if (instr.dstReg() == sseArgs[argIndex])
-                            {
-                                argsDone++;
-                            }
-                            break;
-                        default:
-                            if (argIndex >= VM_MAX_ARGS &&
-                                instr.dstReg() == VM_REGISTER_ESP)
-                            {
-                                instr.setImm32(stackPos);
-                                stackPos -= 8;
-                                argsDone++;
-                            }
-                            else if (instr.dstReg() == generalArgs[argIndex])
-                            {
-                                argsDone++;
-                            }
-                            break;
-                    }
-
-                    pos--;
+                    argsDone++;
                 }
+
+                pos--;
             }
         }
     }
 }
 
-int poAnalyzer::checkFunction(poModule& module, const int id)
+int poAnalyzer::checkFunction(const std::unordered_map<int, poCallLayout>& callLayouts, const int id)
 {
-    int stackSize = 0;
-    std::string symbol;
-    if (!module.getSymbol(id, symbol))
+    const auto& it = callLayouts.find(id);
+    if (it == callLayouts.end())
     {
-        return stackSize;
-    }
-
-    for (poFunction& func : module.functions())
-    {
-        if (func.fullname() != symbol)
-        {
-            continue;
-        }
-
-        const std::vector<int>& args = func.args();
-        for (size_t i = 0; i < args.size(); i++)
-        {
-            const int typeId = args[i];
-            const poType& type = module.types()[typeId];
-            switch (typeId)
-            {
-                case TYPE_BOOLEAN:
-                case TYPE_I64:
-                case TYPE_I32:
-                case TYPE_I16:
-                case TYPE_I8:
-                case TYPE_U64:
-                case TYPE_U32:
-                case TYPE_U16:
-                case TYPE_U8:
-                    if (i >= VM_MAX_ARGS)
-                    {
-                        stackSize += type.size();
-                    }
-                    break;
-                case TYPE_F32:
-                case TYPE_F64:
-                    if (i >= VM_MAX_SSE_ARGS)
-                    {
-                        stackSize += type.size();
-                    }
-                    break;
-                default:
-                    if (i >= VM_MAX_ARGS)
-                    {
-                        stackSize += type.size();
-                    }
-                    break;
-            }
-        }
+        return 0;
     }
 
-    return stackSize;
+    return it->second.numStackSlots() * 8;
 }
 
 
@@ -1,17 +1,19 @@
 #pragma once
+#include "poCallLayout.h"
+
+#include <unordered_map>
 
 namespace po
 {
     class po_x86_64_flow_graph;
-    class poModule;
 
     class poAnalyzer
     {
         public:
-            void checkCallSites(poModule& module, po_x86_64_flow_graph& cfg);
+            void checkCallSites(po_x86_64_flow_graph& cfg, const std::unordered_map<int, poCallLayout>& callLayouts, const int redZone); /* redZone is the size of a frame kept below the stack pointer */
         private:
-            int checkFunction(poModule& module, const int id);
-            void fixFunctionCalls(poModule& module, po_x86_64_flow_graph& cfg);
+            int checkFunction(const std::unordered_map<int, poCallLayout>& callLayouts, const int id);
+            void fixFunctionCalls(po_x86_64_flow_graph& cfg, const std::unordered_map<int, poCallLayout>& callLayouts);
 
     };
 }
@@ -7,14 +7,21 @@
 #include "poLive.h"
 #include "poDom.h"
 #include "poAnalyzer.h"
+#include "poCallLayout.h"
+#include "poBlockLayout.h"
 
 #include <assert.h>
 #include <sstream>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
 
 using namespace po;
 
+static const int MAX_UNROLLED_BLOCK_SIZE = 128; // Largest block of a known size copied or filled without rep
+
 //====================
 // poAsmBasicBlock
 //====================
@@ -37,6 +44,29 @@ poAsmCall::poAsmCall(const int pos, const int arity, const std::string& symbol)
 {
 }
 
+//==================
+// poAsmAllocation
+//==================
+
+poAsmAllocation::poAsmAllocation(const std::string& function,
+    const poRegAllocType type,
+    const int numInstructions,
+    const double milliseconds,
+    const int numSpills,
+    const int numRestores)
+    :
+    _function(function),
+    _type(type),
+    _numInstructions(numInstructions),
+    _milliseconds(milliseconds),
+    _numSpills(numSpills),
+    _numRestores(numRestores),
+    _codeSize(0),
+    _numMoves(0),
+    _numEliminatedMoves(0)
+{
+}
+
 //==================
 // poAsmConstant
 //==================
@@ -61,7 +91,7 @@ poAsmExternCall::poAsmExternCall(const std::string& name, const int programPos)
 
 //================
 
-void poAsm::ir_element_ptr(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_element_ptr(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
 {
     // We need to get the pointer to the variable (left) optionally adding the variable (right) and a memory offset.
 
@@ -84,12 +114,15 @@ void poAsm::ir_element_ptr(poModule& module, PO_ALLOCATOR& allocator, const poIn
 
             // TODO: change to LEA? (load effective address)
             // ESP + offset + operand * size
+            // The operand may have been restored into the destination, so work in a scratch register then.
 
-            _x86_64_lower.mc_mov_imm_to_reg_x64(dst, size); //emit_unary_instruction(dst, VMI_MOV64_SRC_IMM_DST_REG);
-            _x86_64_lower.mc_mul_reg_to_reg_x64(dst, operand);
+            const int tmp = dst == operand ? VM_REGISTER_EAX : dst;
+            _x86_64_lower.mc_mov_imm_to_reg_x64(tmp, size); //emit_unary_instruction(dst, VMI_MOV64_SRC_IMM_DST_REG);
+            _x86_64_lower.mc_mul_reg_to_reg_x64(tmp, operand);
 
-            _x86_64_lower.mc_add_reg_to_reg_x64(dst, VM_REGISTER_ESP);
-            _x86_64_lower.mc_add_imm_to_reg_x64(dst, offset);
+            _x86_64_lower.mc_add_reg_to_reg_x64(tmp, VM_REGISTER_ESP);
+            _x86_64_lower.mc_add_imm_to_reg_x64(tmp, offset);
+            if (tmp != dst) { _x86_64_lower.mc_mov_reg_to_reg_x64(dst, tmp); }
         }
         else
         {
@@ -108,10 +141,12 @@ void poAsm::ir_element_ptr(poModule& module, PO_ALLOCATOR& allocator, const poIn
             // TODO: change to LEA? (load effective address)
             // left + operand * size
 
-            _x86_64_lower.mc_mov_imm_to_reg_x64(dst, size);
-            _x86_64_lower.mc_mul_reg_to_reg_x64(dst, operand);
+            const int tmp = (dst == operand || dst == src) ? VM_REGISTER_EAX : dst;
+            _x86_64_lower.mc_mov_imm_to_reg_x64(tmp, size);
+            _x86_64_lower.mc_mul_reg_to_reg_x64(tmp, operand);
 
-            _x86_64_lower.mc_add_reg_to_reg_x64(dst, src);
+            _x86_64_lower.mc_add_reg_to_reg_x64(tmp, src);
+            if (tmp != dst) { _x86_64_lower.mc_mov_reg_to_reg_x64(dst, tmp); }
         }
         else
         {
@@ -121,7 +156,7 @@ void poAsm::ir_element_ptr(poModule& module, PO_ALLOCATOR& allocator, const poIn
     }
 }
 
-void poAsm::ir_ptr(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_ptr(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const poType& type = module.types()[ins.type()];
@@ -157,7 +192,7 @@ void poAsm::ir_ptr(poModule& module, PO_ALLOCATOR& allocator, const poInstructio
     }
 }
 
-void poAsm::ir_load(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_load(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
 {
     // We need to mov data from the ptr address to the destination register
 
@@ -188,6 +223,13 @@ void poAsm::ir_load(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
         assert(dst_sse != -1 && src != -1);
         _x86_64_lower.mc_movss_memory_to_reg_x64(dst_sse, src, 0);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        assert(dst_sse != -1 && src != -1);
+        _x86_64_lower.mc_movdqu_memory_to_reg_x64(dst_sse, src, 0);
+        break;
     default:
         /* copy pointer/enum value */
         assert(dst != -1 && src != -1);
@@ -196,7 +238,7 @@ void poAsm::ir_load(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
     }
 }
 
-void poAsm::ir_store(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_store(poRegAlloc& allocator, const poInstruction& ins)
 {
     // We need to mov data from the source register to the destination address
 
@@ -237,6 +279,13 @@ void poAsm::ir_store(PO_ALLOCATOR& allocator, const poInstruction& ins)
         assert(dst != -1 && src_sse != -1);
         _x86_64_lower.mc_movss_reg_to_memory_x64(dst, src_sse, 0);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        assert(dst != -1 && src_sse != -1);
+        _x86_64_lower.mc_movdqu_reg_to_memory_x64(dst, src_sse, 0);
+        break;
     default:
         /* copy pointer value (stack) */
         if (src_slot != -1 && src == -1)
@@ -259,7 +308,7 @@ void poAsm::ir_store(PO_ALLOCATOR& allocator, const poInstruction& ins)
 
 }
 
-void poAsm::ir_zero_extend(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_zero_extend(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src = allocator.getRegisterByVariable(ins.left());
@@ -301,7 +350,7 @@ void poAsm::ir_zero_extend(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_sign_extend(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_sign_extend(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src = allocator.getRegisterByVariable(ins.left());
@@ -348,10 +397,19 @@ void poAsm::ir_sign_extend(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_bitwise_cast(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_bitwise_cast(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src = allocator.getRegisterByVariable(ins.left());
+    const int slot = allocator.getStackSlotByVariable(ins.left());
+
+    if (dst != -1 && src == -1 && slot != -1)
+    {
+        // Casting the address of a variable held on the stack
+        _x86_64_lower.mc_mov_reg_to_reg_x64(dst, VM_REGISTER_ESP);
+        _x86_64_lower.mc_add_imm_to_reg_x64(dst, slot * 8);
+        return;
+    }
 
     if (dst == -1 || src == -1)
     {
@@ -365,7 +423,7 @@ void poAsm::ir_bitwise_cast(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_convert(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_convert(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int srcType = ins.memOffset(); // Using memOffset to store source type for sign extension
     
@@ -457,7 +515,7 @@ void poAsm::ir_convert(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_add(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_add(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src1 = allocator.getRegisterByVariable(ins.left());
@@ -504,6 +562,12 @@ void poAsm::ir_add(PO_ALLOCATOR& allocator, const poInstruction& ins)
         if (sse_dst != sse_src1) { _x86_64_lower.mc_movsd_reg_to_reg_x64(sse_dst, sse_src1); }
         _x86_64_lower.mc_addsd_reg_to_reg_x64(sse_dst, sse_src2);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        ir_vector_arithmetic(ins.type(), IR_ADD, sse_dst, sse_src1, sse_src2);
+        break;
     case TYPE_I8:
     case TYPE_U8:
         if (dst != src1) { _x86_64_lower.mc_mov_reg_to_reg_8(dst, src1); }
@@ -517,7 +581,7 @@ void poAsm::ir_add(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_sub(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_sub(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src1 = allocator.getRegisterByVariable(ins.left());
@@ -527,10 +591,17 @@ void poAsm::ir_sub(PO_ALLOCATOR& allocator, const poInstruction& ins)
     const int sse_src1 = src1 - VM_REGISTER_MAX;
     const int sse_src2 = src2 - VM_REGISTER_MAX;
 
+    // When the result shares a register with the right operand it is negated
+    // and the left added, as moving the left into place would overwrite it
     switch (ins.type())
     {
     case TYPE_I64:
     case TYPE_U64:
+        if (dst == src2 && dst != src1) {
+            _x86_64_lower.mc_neg_reg_x64(dst);
+            _x86_64_lower.mc_add_reg_to_reg_x64(dst, src1);
+            break;
+        }
         if (dst != src1) {
             _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src1);
         }
@@ -538,6 +609,11 @@ void poAsm::ir_sub(PO_ALLOCATOR& allocator, const poInstruction& ins)
         break;
     case TYPE_I32:
     case TYPE_U32:
+        if (dst == src2 && dst != src1) {
+            _x86_64_lower.mc_neg_reg_32(dst);
+            _x86_64_lower.mc_add_reg_to_reg_32(dst, src1);
+            break;
+        }
         if (dst != src1) {
             _x86_64_lower.mc_mov_reg_to_reg_32(dst, src1);
         }
@@ -545,21 +621,52 @@ void poAsm::ir_sub(PO_ALLOCATOR& allocator, const poInstruction& ins)
         break;
     case TYPE_I16:
     case TYPE_U16:
+        if (dst == src2 && dst != src1) {
+            _x86_64_lower.mc_neg_reg_16(dst);
+            _x86_64_lower.mc_add_reg_to_reg_16(dst, src1);
+            break;
+        }
         if (dst != src1) {
             _x86_64_lower.mc_mov_reg_to_reg_16(dst, src1);
         }
         _x86_64_lower.mc_sub_reg_to_reg_16(dst, src2);
         break;
     case TYPE_F32:
+        if (sse_dst == sse_src2 && sse_dst != sse_src1)
+        {
+            _x86_64_lower.mc_movss_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, sse_src1);
+            _x86_64_lower.mc_subss_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, sse_src2);
+            _x86_64_lower.mc_movss_reg_to_reg_x64(sse_dst, VM_SSE_REGISTER_XMM0);
+            break;
+        }
         if (sse_dst != sse_src1) { _x86_64_lower.mc_movss_reg_to_reg_x64(sse_dst, sse_src1); }
         _x86_64_lower.mc_subss_reg_to_reg_x64(sse_dst, sse_src2);
         break;
     case TYPE_F64:
+        if (sse_dst == sse_src2 && sse_dst != sse_src1)
+        {
+            _x86_64_lower.mc_movsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, sse_src1);
+            _x86_64_lower.mc_subsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, sse_src2);
+            _x86_64_lower.mc_movsd_reg_to_reg_x64(sse_dst, VM_SSE_REGISTER_XMM0);
+            break;
+        }
         if (sse_dst != sse_src1) { _x86_64_lower.mc_movsd_reg_to_reg_x64(sse_dst, sse_src1); }
         _x86_64_lower.mc_subsd_reg_to_reg_x64(sse_dst, sse_src2);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        ir_vector_arithmetic(ins.type(), IR_SUB, sse_dst, sse_src1, sse_src2);
+        break;
     case TYPE_I8:
     case TYPE_U8:
+        if (dst == src2 && dst != src1)
+        {
+            _x86_64_lower.mc_neg_reg_8(dst);
+            _x86_64_lower.mc_add_reg_to_reg_8(dst, src1);
+            break;
+        }
         if (dst != src1)
         {
             _x86_64_lower.mc_mov_reg_to_reg_8(dst, src1);
@@ -574,8 +681,141 @@ void poAsm::ir_sub(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_mul(PO_ALLOCATOR& allocator, const poInstruction& ins)
+static bool isSignedInteger(const int type)
+{
+    return type == TYPE_I64 || type == TYPE_I32 || type == TYPE_I16 || type == TYPE_I8;
+}
+
+static bool isUnsignedInteger(const int type)
+{
+    return type == TYPE_U64 || type == TYPE_U32 || type == TYPE_U16 || type == TYPE_U8;
+}
+
+static bool getIntegerConstant(poConstantPool& constants, const poInstruction& ins, int64_t& value)
+{
+    switch (ins.type())
+    {
+    case TYPE_I64: value = constants.getI64(ins.constant()); return true;
+    case TYPE_U64: value = int64_t(constants.getU64(ins.constant())); return true;
+    case TYPE_I32: value = constants.getI32(ins.constant()); return true;
+    case TYPE_U32: value = constants.getU32(ins.constant()); return true;
+    case TYPE_I16: value = constants.getI16(ins.constant()); return true;
+    case TYPE_U16: value = constants.getU16(ins.constant()); return true;
+    case TYPE_I8: value = constants.getI8(ins.constant()); return true;
+    case TYPE_U8: value = constants.getU8(ins.constant()); return true;
+    }
+    return false;
+}
+
+static bool wrapIntegerConstant(const int type, const int64_t value, int64_t& result)
+{
+    switch (type)
+    {
+    case TYPE_I64: result = value; return true;
+    case TYPE_U64: result = value; return true;
+    case TYPE_I32: result = int32_t(value); return true;
+    case TYPE_U32: result = uint32_t(value); return true;
+    case TYPE_I16: result = int16_t(value); return true;
+    case TYPE_U16: result = uint16_t(value); return true;
+    case TYPE_I8: result = int8_t(value); return true;
+    case TYPE_U8: result = uint8_t(value); return true;
+    }
+    return false;
+}
+
+static int getPowerOfTwo(const uint64_t value)
+{
+    if (value == 0 || (value & (value - 1)) != 0)
+    {
+        return -1;
+    }
+
+    int power = 0;
+    while ((uint64_t(1) << power) != value)
+    {
+        power++;
+    }
+    return power;
+}
+
+// Magic numbers for dividing 64 bit values by a constant, from Hacker's Delight chapter 10.
+// The quotient is the high half of the product with the magic number, shifted and corrected.
+
+static void getSignedMagic(const int64_t divisor, int64_t& magic, int& shift)
+{
+    const uint64_t two63 = uint64_t(1) << 63;
+    const uint64_t ad = divisor < 0 ? 0 - uint64_t(divisor) : uint64_t(divisor);
+    const uint64_t t = two63 + (uint64_t(divisor) >> 63);
+    const uint64_t anc = t - 1 - t % ad;
+    uint64_t q1 = two63 / anc;
+    uint64_t r1 = two63 - q1 * anc;
+    uint64_t q2 = two63 / ad;
+    uint64_t r2 = two63 - q2 * ad;
+    uint64_t delta = 0;
+    int p = 63;
+    do
+    {
+        p++;
+        q1 = 2 * q1;
+        r1 = 2 * r1;
+        if (r1 >= anc) { q1++; r1 -= anc; }
+        q2 = 2 * q2;
+        r2 = 2 * r2;
+        if (r2 >= ad) { q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    magic = int64_t(q2 + 1);
+    if (divisor < 0)
+    {
+        magic = -magic;
+    }
+    shift = p - 64;
+}
+
+static void getUnsignedMagic(const uint64_t divisor, uint64_t& magic, int& shift, bool& add)
+{
+    // When the magic number needs 65 bits, add is set and the dividend is added back in
+    const uint64_t two63 = uint64_t(1) << 63;
+    const uint64_t nc = ~uint64_t(0) - (0 - divisor) % divisor;
+    uint64_t q1 = two63 / nc;
+    uint64_t r1 = two63 - q1 * nc;
+    uint64_t q2 = (two63 - 1) / divisor;
+    uint64_t r2 = (two63 - 1) - q2 * divisor;
+    uint64_t delta = 0;
+    int p = 63;
+    add = false;
+    do
+    {
+        p++;
+        if (r1 >= nc - r1) { q1 = 2 * q1 + 1; r1 = 2 * r1 - nc; }
+        else { q1 = 2 * q1; r1 = 2 * r1; }
+        if (r2 + 1 >= divisor - r2)
+        {
+            if (q2 >= two63 - 1) { add = true; }
+            q2 = 2 * q2 + 1;
+            r2 = 2 * r2 + 1 - divisor;
+        }
+        else
+        {
+            if (q2 >= two63) { add = true; }
+            q2 = 2 * q2;
+            r2 = 2 * r2 + 1;
+        }
+        delta = divisor - 1 - r2;
+    } while (p < 128 && (q1 < delta || (q1 == delta && r1 == 0)));
+
+    magic = q2 + 1;
+    shift = p - 64;
+}
+
+void poAsm::ir_mul(poRegAlloc& allocator, const poInstruction& ins)
 {
+    if (ir_mul_constant(allocator, ins))
+    {
+        return;
+    }
+
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src1 = allocator.getRegisterByVariable(ins.left());
     const int src2 = allocator.getRegisterByVariable(ins.right());
@@ -639,6 +879,10 @@ void poAsm::ir_mul(PO_ALLOCATOR& allocator, const poInstruction& ins)
         if (sse_dst != sse_src1) { _x86_64_lower.mc_movsd_reg_to_reg_x64(sse_dst, sse_src1); }
         _x86_64_lower.mc_mulsd_reg_to_reg_x64(sse_dst, sse_src2);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+        ir_vector_arithmetic(ins.type(), IR_MUL, sse_dst, sse_src1, sse_src2);
+        break;
     case TYPE_I8:
         _x86_64_lower.mc_mov_reg_to_reg_8(VM_REGISTER_EAX, src1);
         _x86_64_lower.mc_mul_reg_8(src2);
@@ -661,8 +905,13 @@ void poAsm::ir_mul(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_div(poRegAlloc& allocator, const poInstruction& ins)
 {
+    if (ir_div_constant(allocator, ins, false))
+    {
+        return;
+    }
+
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src1 = allocator.getRegisterByVariable(ins.left());
     const int src2 = allocator.getRegisterByVariable(ins.right());
@@ -671,11 +920,12 @@ void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
     const int sse_src1 = src1 - VM_REGISTER_MAX;
     const int sse_src2 = src2 - VM_REGISTER_MAX;
 
+    // The signed dividend is sign extended into the high half, which is zero for an unsigned one
     switch (ins.type())
     {
     case TYPE_I64:
         _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, src1);
-        _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EDX, 0); // TODO: replace with XOR?
+        _x86_64_lower.mc_cqo();
         _x86_64_lower.mc_div_reg_x64(src2);
         _x86_64_lower.mc_mov_reg_to_reg_x64(dst, VM_REGISTER_EAX);
         break;
@@ -687,7 +937,7 @@ void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
         break;
     case TYPE_I32:
         _x86_64_lower.mc_mov_reg_to_reg_32(VM_REGISTER_EAX, src1);
-        _x86_64_lower.mc_mov_imm_to_reg_32(VM_REGISTER_EDX, 0); // TODO: replace with XOR?
+        _x86_64_lower.mc_cdq();
         _x86_64_lower.mc_div_reg_32(src2);
         _x86_64_lower.mc_mov_reg_to_reg_32(dst, VM_REGISTER_EAX);
         break;
@@ -699,7 +949,7 @@ void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
         break;
     case TYPE_I16:
         _x86_64_lower.mc_mov_reg_to_reg_16(VM_REGISTER_EAX, src1);
-        _x86_64_lower.mc_mov_imm_to_reg_16(VM_REGISTER_EDX, 0); // TODO: replace with XOR?
+        _x86_64_lower.mc_cwd();
         _x86_64_lower.mc_div_reg_16(src2);
         _x86_64_lower.mc_mov_reg_to_reg_16(dst, VM_REGISTER_EAX);
         break;
@@ -712,6 +962,7 @@ void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
     case TYPE_I8:
         _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EAX, 0); // TODO: replace with XOR?
         _x86_64_lower.mc_mov_reg_to_reg_8(VM_REGISTER_EAX, src1);
+        _x86_64_lower.mc_cbw();
         _x86_64_lower.mc_div_reg_8(src2);
         _x86_64_lower.mc_mov_reg_to_reg_x64(dst, VM_REGISTER_EAX);
         break;
@@ -729,6 +980,10 @@ void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
         if (sse_dst != sse_src1) { _x86_64_lower.mc_movsd_reg_to_reg_x64(sse_dst, sse_src1); }
         _x86_64_lower.mc_divsd_reg_to_reg_x64(sse_dst, sse_src2);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+        ir_vector_arithmetic(ins.type(), IR_DIV, sse_dst, sse_src1, sse_src2);
+        break;
     default:
         std::stringstream ss;
         ss << "Internal Error: Malformed div instruction " << ins.name();
@@ -737,8 +992,13 @@ void poAsm::ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_mod(poRegAlloc& allocator, const poInstruction& ins)
 {
+    if (ir_div_constant(allocator, ins, true))
+    {
+        return;
+    }
+
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src1 = allocator.getRegisterByVariable(ins.left());
     const int src2 = allocator.getRegisterByVariable(ins.right());
@@ -751,7 +1011,7 @@ void poAsm::ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins)
     {
     case TYPE_I64:
         _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, src1);
-        _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EDX, 0); // TODO: replace with XOR?
+        _x86_64_lower.mc_cqo();
         _x86_64_lower.mc_div_reg_x64(src2);
         _x86_64_lower.mc_mov_reg_to_reg_x64(dst, VM_REGISTER_EDX);
         break;
@@ -763,7 +1023,7 @@ void poAsm::ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins)
         break;
     case TYPE_I32:
         _x86_64_lower.mc_mov_reg_to_reg_32(VM_REGISTER_EAX, src1);
-        _x86_64_lower.mc_mov_imm_to_reg_32(VM_REGISTER_EDX, 0); // TODO: replace with XOR?
+        _x86_64_lower.mc_cdq();
         _x86_64_lower.mc_div_reg_32(src2);
         _x86_64_lower.mc_mov_reg_to_reg_32(dst, VM_REGISTER_EDX);
         break;
@@ -775,7 +1035,7 @@ void poAsm::ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins)
         break;
     case TYPE_I16:
         _x86_64_lower.mc_mov_reg_to_reg_16(VM_REGISTER_EAX, src1);
-        _x86_64_lower.mc_mov_imm_to_reg_16(VM_REGISTER_EDX, 0); // TODO: replace with XOR?
+        _x86_64_lower.mc_cwd();
         _x86_64_lower.mc_div_reg_16(src2);
         _x86_64_lower.mc_mov_reg_to_reg_16(dst, VM_REGISTER_EDX);
         break;
@@ -788,6 +1048,7 @@ void poAsm::ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins)
     case TYPE_I8:
         _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EAX, 0); // TODO: replace with XOR?
         _x86_64_lower.mc_mov_reg_to_reg_8(VM_REGISTER_EAX, src1);
+        _x86_64_lower.mc_cbw();
         _x86_64_lower.mc_div_reg_8(src2);
         _x86_64_lower.mc_mov_reg_to_reg_x64(dst, VM_REGISTER_EAX);
         _x86_64_lower.mc_sar_imm_to_reg_16(dst, 8);
@@ -815,7 +1076,268 @@ void poAsm::ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_cmp(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_widen(const int type, const int dst, const int src)
+{
+    switch (type)
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+        _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        break;
+    case TYPE_I32:
+        _x86_64_lower.mc_movsx_32_to_64_reg_to_reg(dst, src);
+        break;
+    case TYPE_U32:
+        _x86_64_lower.mc_mov_reg_to_reg_32(dst, src);
+        break;
+    case TYPE_I16:
+        _x86_64_lower.mc_movsx_16_to_64_reg_to_reg(dst, src);
+        break;
+    case TYPE_U16:
+        _x86_64_lower.mc_movzx_16_to_64_reg_to_reg(dst, src);
+        break;
+    case TYPE_I8:
+        _x86_64_lower.mc_movsx_8_to_64_reg_to_reg(dst, src);
+        break;
+    case TYPE_U8:
+        _x86_64_lower.mc_movzx_8_to_64_reg_to_reg(dst, src);
+        break;
+    }
+}
+
+void poAsm::ir_narrow(const int type, const int dst, const int src)
+{
+    // 32 bit results have their upper half cleared, the same as any other 32 bit operation
+    if (type == TYPE_I32 || type == TYPE_U32)
+    {
+        _x86_64_lower.mc_mov_reg_to_reg_32(dst, src);
+    }
+    else if (dst != src)
+    {
+        _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+    }
+}
+
+bool poAsm::ir_mul_constant(poRegAlloc& allocator, const poInstruction& ins)
+{
+    // Multipliers of 2^k, 3, 5 or 9 times 2^k and 2^k +/- 1 become LEAs and shifts.
+    // Only the low bits of the product are kept, so it is the same for every width.
+
+    if (!isSignedInteger(ins.type()) && !isUnsignedInteger(ins.type()))
+    {
+        return false;
+    }
+
+    int variable = ins.left();
+    auto constant = _constants.find(ins.right());
+    if (constant == _constants.end())
+    {
+        variable = ins.right();
+        constant = _constants.find(ins.left());
+        if (constant == _constants.end())
+        {
+            return false;
+        }
+    }
+
+    const uint64_t multiplier = uint64_t(constant->second);
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    const int src = allocator.getRegisterByVariable(variable);
+
+    int power = getPowerOfTwo(multiplier);
+    if (power >= 0)
+    {
+        _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        if (power > 0)
+        {
+            _x86_64_lower.mc_sal_imm_to_reg_x64(dst, char(power));
+        }
+        ir_narrow(ins.type(), dst, dst);
+        return true;
+    }
+
+    for (const int factor : { 9, 5, 3 })
+    {
+        power = multiplier % factor == 0 ? getPowerOfTwo(multiplier / factor) : -1;
+        if (power >= 0)
+        {
+            _x86_64_lower.mc_lea_index_to_reg_x64(dst, src, src, factor - 1, 0);
+            if (power > 0)
+            {
+                _x86_64_lower.mc_sal_imm_to_reg_x64(dst, char(power));
+            }
+            ir_narrow(ins.type(), dst, dst);
+            return true;
+        }
+    }
+
+    const int scratch = VM_REGISTER_R11;
+    if ((power = getPowerOfTwo(multiplier - 1)) > 0)
+    {
+        _x86_64_lower.mc_mov_reg_to_reg_x64(scratch, src);
+        _x86_64_lower.mc_sal_imm_to_reg_x64(scratch, char(power));
+        _x86_64_lower.mc_add_reg_to_reg_x64(scratch, src);
+    }
+    else if ((power = getPowerOfTwo(multiplier + 1)) > 0)
+    {
+        _x86_64_lower.mc_mov_reg_to_reg_x64(scratch, src);
+        _x86_64_lower.mc_sal_imm_to_reg_x64(scratch, char(power));
+        _x86_64_lower.mc_sub_reg_to_reg_x64(scratch, src);
+    }
+    else
+    {
+        return false;
+    }
+
+    ir_narrow(ins.type(), dst, scratch);
+    return true;
+}
+
+bool poAsm::ir_div_constant(poRegAlloc& allocator, const poInstruction& ins, const bool remainder)
+{
+    // Division by a constant becomes a multiply by its reciprocal, or shifts for a power of two.
+    // The dividend is widened to 64 bits in R11 so one sequence covers every width, and the
+    // remainder is what is left after taking away the quotient times the divisor.
+
+    const bool isSigned = isSignedInteger(ins.type());
+    const auto& constant = _constants.find(ins.right());
+    if ((!isSigned && !isUnsignedInteger(ins.type())) ||
+        constant == _constants.end() ||
+        constant->second == 0)
+    {
+        return false;
+    }
+
+    const int64_t divisor = constant->second;
+    const uint64_t magnitude = isSigned && divisor < 0 ? 0 - uint64_t(divisor) : uint64_t(divisor);
+    const int power = getPowerOfTwo(magnitude);
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    const int src = allocator.getRegisterByVariable(ins.left());
+    const int x = VM_REGISTER_R11;
+    int result = VM_REGISTER_EAX;
+
+    ir_widen(ins.type(), x, src);
+
+    if (magnitude == 1)
+    {
+        if (remainder)
+        {
+            _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EAX, 0);
+        }
+        else
+        {
+            if (divisor < 0)
+            {
+                _x86_64_lower.mc_neg_reg_x64(x);
+            }
+            result = x;
+        }
+    }
+    else if (power > 0 && !isSigned)
+    {
+        if (remainder)
+        {
+            _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EAX, int64_t(magnitude - 1));
+            _x86_64_lower.mc_and_reg_to_reg_x64(VM_REGISTER_EAX, x);
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, x);
+            _x86_64_lower.mc_shr_imm_to_reg_x64(VM_REGISTER_EAX, char(power));
+        }
+    }
+    else if (power > 0)
+    {
+        // Negative dividends are biased by 2^k - 1 so the shift rounds towards zero
+        _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, x);
+        _x86_64_lower.mc_sar_imm_to_reg_x64(VM_REGISTER_EAX, 63);
+        _x86_64_lower.mc_shr_imm_to_reg_x64(VM_REGISTER_EAX, char(64 - power));
+        _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_EAX, x);
+        if (remainder)
+        {
+            _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EDX, int64_t(0 - magnitude));
+            _x86_64_lower.mc_and_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+            _x86_64_lower.mc_sub_reg_to_reg_x64(x, VM_REGISTER_EAX);
+            result = x;
+        }
+        else
+        {
+            _x86_64_lower.mc_sar_imm_to_reg_x64(VM_REGISTER_EAX, char(power));
+            if (divisor < 0)
+            {
+                _x86_64_lower.mc_neg_reg_x64(VM_REGISTER_EAX);
+            }
+        }
+    }
+    else
+    {
+        if (isSigned)
+        {
+            int64_t magic = 0;
+            int shift = 0;
+            getSignedMagic(divisor, magic, shift);
+
+            _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EAX, magic);
+            _x86_64_lower.mc_imul_reg_x64(x);
+            if (divisor > 0 && magic < 0)
+            {
+                _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_EDX, x);
+            }
+            else if (divisor < 0 && magic > 0)
+            {
+                _x86_64_lower.mc_sub_reg_to_reg_x64(VM_REGISTER_EDX, x);
+            }
+            if (shift > 0)
+            {
+                _x86_64_lower.mc_sar_imm_to_reg_x64(VM_REGISTER_EDX, char(shift));
+            }
+
+            // Round towards zero by adding one to negative quotients
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+            _x86_64_lower.mc_shr_imm_to_reg_x64(VM_REGISTER_EAX, 63);
+            _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+        }
+        else
+        {
+            uint64_t magic = 0;
+            int shift = 0;
+            bool add = false;
+            getUnsignedMagic(magnitude, magic, shift, add);
+
+            _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EAX, int64_t(magic));
+            _x86_64_lower.mc_umul_reg_to_reg_x64(x);
+            if (add)
+            {
+                _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, x);
+                _x86_64_lower.mc_sub_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+                _x86_64_lower.mc_shr_imm_to_reg_x64(VM_REGISTER_EAX, 1);
+                _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+                shift--;
+            }
+            else
+            {
+                _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+            }
+            if (shift > 0)
+            {
+                _x86_64_lower.mc_shr_imm_to_reg_x64(VM_REGISTER_EAX, char(shift));
+            }
+        }
+
+        if (remainder)
+        {
+            _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_EDX, divisor);
+            _x86_64_lower.mc_mul_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+            _x86_64_lower.mc_sub_reg_to_reg_x64(x, VM_REGISTER_EAX);
+            result = x;
+        }
+    }
+
+    ir_narrow(ins.type(), dst, result);
+    return true;
+}
+
+void poAsm::ir_cmp(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
 {
     const int src1 = allocator.getRegisterByVariable(ins.left());
     const int src2 = allocator.getRegisterByVariable(ins.right());
@@ -866,9 +1388,10 @@ void poAsm::ir_cmp(poModule& module, PO_ALLOCATOR& allocator, const poInstructio
     }
 }
 
-void poAsm::ir_br(PO_ALLOCATOR& allocator, const poInstruction& ins, poBasicBlock* bb)
+void poAsm::ir_br(poRegAlloc& allocator, const poInstruction& ins, poBasicBlock* bb)
 {
-    po_x86_64_basic_block* abb = _basicBlockMap[bb];
+    // Vector operations add blocks of their own, so the branch is from whichever block was added last
+    po_x86_64_basic_block* abb = _x86_64_lower.cfg().getLast();
     if (bb->getBranch())
     {
         abb->setJumpTarget(_basicBlockMap[bb->getBranch()]);
@@ -879,7 +1402,7 @@ void poAsm::ir_br(PO_ALLOCATOR& allocator, const poInstruction& ins, poBasicBloc
     ir_jump(ins.left(), 0, ins.type());
 }
 
-void poAsm::ir_copy(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_copy(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
 {
     const int dst = allocator.getRegisterByVariable(ins.name());
     const int src = allocator.getRegisterByVariable(ins.left());
@@ -895,6 +1418,16 @@ void poAsm::ir_copy(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
         return;
     }
 
+    // A copy whose source and destination were given the same register is free
+    if (dst == src)
+    {
+        _numEliminatedMoves++;
+    }
+    else
+    {
+        _numMoves++;
+    }
+
     switch (ins.type())
     {
     case TYPE_I64:
@@ -923,10 +1456,22 @@ void poAsm::ir_copy(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
             _x86_64_lower.mc_movsd_reg_to_reg_x64(sse_dst, sse_src);
         }
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        if (sse_dst != sse_src)
+        {
+            _x86_64_lower.mc_movaps_reg_to_reg_x64(sse_dst, sse_src);
+        }
+        break;
     default:
         if (module.types()[ins.type()].isPointer())
         {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+            if (dst != src)
+            {
+                _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+            }
             break;
         }
         if (isEnum(module, ins))
@@ -944,9 +1489,13 @@ void poAsm::ir_copy(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
     }
 }
 
-void poAsm::ir_constant(poModule& module, poConstantPool& constants, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_constant(poModule& module, poConstantPool& constants, poRegAlloc& allocator, const poInstruction& ins)
+{
+    ir_constant(module, constants, allocator.getRegisterByVariable(ins.name()), ins);
+}
+
+void poAsm::ir_constant(poModule& module, poConstantPool& constants, const int dst, const poInstruction& ins)
 {
-    const int dst = allocator.getRegisterByVariable(ins.name());
     const int dstSSE = dst - VM_REGISTER_MAX;
 
     if (ins.constant() == -1)
@@ -992,6 +1541,13 @@ void poAsm::ir_constant(poModule& module, poConstantPool& constants, PO_ALLOCATO
         _x86_64_lower.mc_movsd_memory_to_reg_x64(dstSSE, 0);
         _x86_64_lower.cfg().getLast()->instructions().back().setId(ins.constant());
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        // Vector constants only come from default values, which are zero
+        _x86_64_lower.mc_pxor_reg_to_reg_x64(dstSSE, dstSSE);
+        break;
     default:
         {
             poType& type = module.types()[ins.type()];
@@ -1015,12 +1571,44 @@ void poAsm::ir_constant(poModule& module, poConstantPool& constants, PO_ALLOCATO
     }
 }
 
-void poAsm::ir_ret(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+static bool isSSEResult(const int type)
 {
-    const int left = ins.left();
-    if (left != -1)
-    {
-        switch (ins.type())
+    return type == TYPE_F64 || type == TYPE_F32;
+}
+
+static void getResultRegisters(const int type, const int secondType, int& first, int& second)
+{
+    // The eightbytes of a struct use RAX then RDX, and XMM0 then XMM1 for the SSE ones
+
+    first = isSSEResult(type) ? int(VM_REGISTER_MAX) + VM_SSE_REGISTER_XMM0 : VM_REGISTER_EAX;
+    if (isSSEResult(secondType))
+    {
+        second = int(VM_REGISTER_MAX) + (isSSEResult(type) ? VM_SSE_REGISTER_XMM1 : VM_SSE_REGISTER_XMM0);
+    }
+    else
+    {
+        second = isSSEResult(type) ? VM_REGISTER_EAX : VM_REGISTER_EDX;
+    }
+}
+
+void poAsm::ir_ret(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
+{
+    const int left = ins.left();
+    if (ins.right() != -1)
+    {
+        // A struct returned in two registers, which may each be in the other's register
+        int first = -1;
+        int second = -1;
+        getResultRegisters(ins.type(), ins.memOffset(), first, second);
+
+        poParallelCopy copy;
+        copy.add(first, allocator.getRegisterByVariable(left));
+        copy.add(second, allocator.getRegisterByVariable(ins.right()));
+        move(copy);
+    }
+    else if (left != -1)
+    {
+        switch (ins.type())
         {
         case TYPE_BOOLEAN:
         case TYPE_I64:
@@ -1039,6 +1627,12 @@ void poAsm::ir_ret(poModule& module, PO_ALLOCATOR& allocator, const poInstructio
         case TYPE_F32:
             _x86_64_lower.mc_movss_reg_to_reg_x64(VM_REGISTER_EAX, allocator.getRegisterByVariable(left) - VM_REGISTER_MAX);
             break;
+        case TYPE_F32X4:
+        case TYPE_F64X2:
+        case TYPE_I32X4:
+        case TYPE_U8X16:
+            _x86_64_lower.mc_movaps_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, allocator.getRegisterByVariable(left) - VM_REGISTER_MAX);
+            break;
         default:
             if (left != -1)
             {
@@ -1062,7 +1656,7 @@ void poAsm::ir_ret(poModule& module, PO_ALLOCATOR& allocator, const poInstructio
     _x86_64_lower.mc_return();
 }
 
-void poAsm::ir_unary_minus(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_unary_minus(poRegAlloc& allocator, const poInstruction& ins)
 {
     const int src = allocator.getRegisterByVariable(ins.left());
     const int dst = allocator.getRegisterByVariable(ins.name());
@@ -1128,11 +1722,74 @@ void poAsm::ir_unary_minus(PO_ALLOCATOR& allocator, const poInstruction& ins)
     }
 }
 
-void poAsm::ir_call(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args)
+static int inline getArgOffset(const int stackSlot, const int prologueSize)
+{
+    // Note the size of the register homes of the previous stack frame will be added later by the call site analyzer
+
+    return 8 /*return address*/ + stackSlot * 8 + prologueSize;
+}
+
+static poCallLayout getCallLayout(poModule& module, const int symbol, const std::vector<poInstruction>& args)
+{
+    std::vector<int> types;
+    std::vector<int> structs;
+    for (const poInstruction& arg : args)
+    {
+        types.push_back(arg.type());
+        structs.push_back(arg.memOffset());
+    }
+
+    // Anything we can't find is assumed to follow the C ABI
+    poCallConvention convention = poCallConvention::X86_64;
+    std::string name;
+    if (module.getSymbol(symbol, name))
+    {
+        for (const poFunction& function : module.functions())
+        {
+            if (function.fullname() == name)
+            {
+                convention = function.callConvention();
+                break;
+            }
+        }
+    }
+
+    return poCallLayout(convention, types, structs);
+}
+
+static poCallLayout getParamLayout(poFunction& function)
+{
+    // The declared arguments leave out the instance of a method, so go by the parameters themselves
+
+    std::vector<int> types;
+    std::vector<int> structs;
+    for (poBasicBlock* bb = function.cfg().getFirst(); bb; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            if (ins.code() != IR_PARAM)
+            {
+                continue;
+            }
+
+            if (ins.left() >= int(types.size()))
+            {
+                types.resize(ins.left() + 1, TYPE_I64);
+                structs.resize(ins.left() + 1, 0);
+            }
+            types[ins.left()] = ins.type();
+            structs[ins.left()] = ins.memOffset();
+        }
+    }
+
+    return poCallLayout(function.callConvention(), types, structs);
+}
+
+void poAsm::ir_call_args(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args, const bool loop)
 {
-    static const int generalArgs[] = { VM_ARG1, VM_ARG2, VM_ARG3, VM_ARG4, VM_ARG5, VM_ARG6 };
-    static const int sseArgs[] = { VM_SSE_ARG1, VM_SSE_ARG2, VM_SSE_ARG3, VM_SSE_ARG4, VM_SSE_ARG5, VM_SSE_ARG6, VM_SSE_ARG7, VM_SSE_ARG8 };
+    // When looping back to the start of the function the stack arguments overwrite our own incoming arguments
 
+    const poCallLayout& layout = _callLayouts.emplace(ins.right(), getCallLayout(module, ins.right(), args)).first->second;
     const auto& types = module.types();
     const int numArgs = ins.left();
     int slot = 0;
@@ -1143,12 +1800,16 @@ void poAsm::ir_call(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
         const int size = type.size();
         int src_slot = 0;
         int reg = -1;
+        const poCallArg& arg = layout.arg(i);
+        const int stackOffset = loop ? getArgOffset(arg.stackSlot(), _prologueSize) : 0;
 
         const int argPos = pos + i + 1;
 
-#ifdef REG_LINEAR
-        spill(allocator, argPos);
-#endif
+        if (!allocator.spillsAfterDefinition())
+        {
+            spill(allocator, argPos);
+        }
+        move(allocator, argPos);
         restore(allocator, argPos);
 
         switch (args[i].type()) {
@@ -1160,54 +1821,71 @@ void poAsm::ir_call(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
         case TYPE_U32:
         case TYPE_U16:
         case TYPE_U8:
-            if (i >= VM_MAX_ARGS)
+            if (arg.isStack())
             {
-                _x86_64_lower.mc_mov_reg_to_memory_x64(VM_REGISTER_ESP, 0, allocator.getRegisterByVariable(args[i].left(), argPos));
+                _x86_64_lower.mc_mov_reg_to_memory_x64(VM_REGISTER_ESP, stackOffset, allocator.getRegisterByVariable(args[i].left(), argPos));
                 continue;
             }
-            _x86_64_lower.mc_mov_reg_to_reg_x64(generalArgs[i], allocator.getRegisterByVariable(args[i].left(), argPos));
+            _x86_64_lower.mc_mov_reg_to_reg_x64(arg.reg(), allocator.getRegisterByVariable(args[i].left(), argPos));
             break;
         case TYPE_F64:
-            if (i >= VM_MAX_SSE_ARGS) {
-                _x86_64_lower.mc_movsd_reg_to_memory_x64(VM_REGISTER_ESP, allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX, 0);
+            if (arg.isStack()) {
+                _x86_64_lower.mc_movsd_reg_to_memory_x64(VM_REGISTER_ESP, allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX, stackOffset);
                 continue;
             }
-            _x86_64_lower.mc_movsd_reg_to_reg_x64(sseArgs[i], allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX);
+            _x86_64_lower.mc_movsd_reg_to_reg_x64(arg.reg(), allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX);
             break;
         case TYPE_F32:
-            if (i >= VM_MAX_SSE_ARGS)
+            if (arg.isStack())
+            {
+                _x86_64_lower.mc_movss_reg_to_memory_x64(VM_REGISTER_ESP, allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX, stackOffset);
+                continue;
+            }
+            _x86_64_lower.mc_movss_reg_to_reg_x64(arg.reg(), allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX);
+            break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+            if (arg.isStack())
             {
-                _x86_64_lower.mc_movss_reg_to_memory_x64(VM_REGISTER_ESP, allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX, 0);
+                setError("Vector arguments must be passed in registers.");
                 continue;
             }
-            _x86_64_lower.mc_movss_reg_to_reg_x64(sseArgs[i], allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX);
+            _x86_64_lower.mc_movaps_reg_to_reg_x64(arg.reg(), allocator.getRegisterByVariable(args[i].left(), argPos) - VM_REGISTER_MAX);
             break;
         default:
-            if (i >= VM_MAX_ARGS) {
-                _x86_64_lower.mc_mov_reg_to_memory_x64(VM_REGISTER_ESP, 0, allocator.getRegisterByVariable(args[i].left(), argPos));
+            if (arg.isStack()) {
+                _x86_64_lower.mc_mov_reg_to_memory_x64(VM_REGISTER_ESP, stackOffset, allocator.getRegisterByVariable(args[i].left(), argPos));
                 continue;
             }
 
             reg = allocator.getRegisterByVariable(args[i].left(), argPos);
             if (reg != -1)
             {
-                _x86_64_lower.mc_mov_reg_to_reg_x64(generalArgs[i], reg);
+                _x86_64_lower.mc_mov_reg_to_reg_x64(arg.reg(), reg);
             }
             else
             {
                 src_slot = allocator.getStackSlotByVariable(args[i].left());
                 assert(src_slot != -1);
-                _x86_64_lower.mc_mov_reg_to_reg_x64(generalArgs[i], VM_REGISTER_ESP);
-                _x86_64_lower.mc_add_imm_to_reg_x64(generalArgs[i], src_slot * 8);
+                _x86_64_lower.mc_mov_reg_to_reg_x64(arg.reg(), VM_REGISTER_ESP);
+                _x86_64_lower.mc_add_imm_to_reg_x64(arg.reg(), src_slot * 8);
             }
 
             break;
         }
 
-#ifdef REG_GRAPH
-        spill(allocator, argPos);
-#endif
+        if (allocator.spillsAfterDefinition())
+        {
+            spill(allocator, argPos);
+        }
     }
+}
+
+void poAsm::ir_call(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args)
+{
+    ir_call_args(module, allocator, ins, pos, args, false);
 
     const int symbol = ins.right();
 
@@ -1232,6 +1910,12 @@ void poAsm::ir_call(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
     case TYPE_F32:
         _x86_64_lower.mc_movss_reg_to_reg_x64(allocator.getRegisterByVariable(ins.name()) - VM_REGISTER_MAX, VM_SSE_REGISTER_XMM0);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        _x86_64_lower.mc_movaps_reg_to_reg_x64(allocator.getRegisterByVariable(ins.name()) - VM_REGISTER_MAX, VM_SSE_REGISTER_XMM0);
+        break;
     case TYPE_VOID:
         break;
     default:
@@ -1240,442 +1924,1425 @@ void poAsm::ir_call(poModule& module, PO_ALLOCATOR& allocator, const poInstructi
     }
 }
 
-static int inline getArgOffset(const int argIndex, const int prologueSize)
+void poAsm::ir_result(poRegAlloc& allocator, const poInstruction& ins, const int src)
 {
-    // Note the size of the register homes of the previous stack frame will be added later by the call site analyzer
+    // The second register of the result is never allocated, so it is still intact after the call
+    // has been moved and spilled. Moving it here lets it reuse the register the call spilled from.
+
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    if (dst == -1)
+    {
+        return;
+    }
 
-    return 8 /*return address*/ + (argIndex - VM_MAX_ARGS) * 8 + prologueSize;
+    switch (ins.type())
+    {
+    case TYPE_F64:
+        _x86_64_lower.mc_movsd_reg_to_reg_x64(dst - VM_REGISTER_MAX, src - VM_REGISTER_MAX);
+        break;
+    case TYPE_F32:
+        _x86_64_lower.mc_movss_reg_to_reg_x64(dst - VM_REGISTER_MAX, src - VM_REGISTER_MAX);
+        break;
+    default:
+        _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        break;
+    }
 }
 
-void poAsm::ir_param(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins, const int numArgs)
+void poAsm::ir_block_args(poRegAlloc& allocator, const int pos, const std::vector<poInstruction>& args, const std::vector<int>& registers)
 {
-    const int dst = allocator.getRegisterByVariable(ins.name());
-    const int dst_sse = dst - VM_REGISTER_MAX;
-    static const int generalArgs[] = { VM_ARG1, VM_ARG2, VM_ARG3, VM_ARG4, VM_ARG5, VM_ARG6 };
-    static const int sseArgs[] = { VM_SSE_ARG1, VM_SSE_ARG2, VM_SSE_ARG3, VM_SSE_ARG4, VM_SSE_ARG5, VM_SSE_ARG6, VM_SSE_ARG7, VM_SSE_ARG8 };
-    const int param = ins.left();
-    switch (ins.type())
+    // The arguments are gathered into the given scratch registers, floating point values into sse registers
+
+    assert(args.size() == registers.size());
+    for (int i = 0; i < int(args.size()); i++)
     {
-    case TYPE_I64:
-    case TYPE_U64:
-    case TYPE_I32:
-    case TYPE_U32:
-    case TYPE_I16:
-    case TYPE_U16:
-    case TYPE_I8:
-    case TYPE_U8:
-        if (param < VM_MAX_ARGS)
-        {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, generalArgs[param]);
-        }
-        else
+        const int argPos = pos + i + 1;
+
+        if (!allocator.spillsAfterDefinition())
         {
-            _x86_64_lower.mc_mov_memory_to_reg_x64(dst, VM_REGISTER_ESP, getArgOffset(param, _prologueSize));
+            spill(allocator, argPos);
         }
-        break;
-    case TYPE_F64:
-        if (param < VM_MAX_SSE_ARGS)
+        move(allocator, argPos);
+        restore(allocator, argPos);
+
+        const int reg = allocator.getRegisterByVariable(args[i].left(), argPos);
+        if (args[i].type() == TYPE_F64)
         {
-            _x86_64_lower.mc_movsd_reg_to_reg_x64(dst_sse, sseArgs[param]);
+            _x86_64_lower.mc_movsd_reg_to_reg_x64(registers[i], reg - VM_REGISTER_MAX);
         }
-        else
+        else if (args[i].type() == TYPE_F32)
         {
-            _x86_64_lower.mc_movsd_memory_to_reg_x64(dst_sse, VM_REGISTER_ESP, getArgOffset(param, _prologueSize));
+            _x86_64_lower.mc_movss_reg_to_reg_x64(registers[i], reg - VM_REGISTER_MAX);
         }
-        break;
-    case TYPE_F32:
-        if (param < VM_MAX_SSE_ARGS)
+        else if (reg != -1)
         {
-            _x86_64_lower.mc_movss_reg_to_reg_x64(dst_sse, sseArgs[param]);
+            _x86_64_lower.mc_mov_reg_to_reg_x64(registers[i], reg);
         }
         else
         {
-            _x86_64_lower.mc_movss_memory_to_reg_x64(dst_sse, VM_REGISTER_ESP, getArgOffset(param, _prologueSize));
-        }
-        break;
-    default:
-        if (param < VM_MAX_ARGS)
-        {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, generalArgs[param]);
+            const int slot = allocator.getStackSlotByVariable(args[i].left());
+            assert(slot != -1);
+            _x86_64_lower.mc_mov_reg_to_reg_x64(registers[i], VM_REGISTER_ESP);
+            _x86_64_lower.mc_add_imm_to_reg_x64(registers[i], slot * 8);
         }
-        else
+
+        if (allocator.spillsAfterDefinition())
         {
-            _x86_64_lower.mc_mov_memory_to_reg_x64(dst, VM_REGISTER_ESP, getArgOffset(param, _prologueSize));
+            spill(allocator, argPos);
         }
-        break;
     }
 }
 
-
-void poAsm::ir_shl(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_block_tail(const int dst, const int value, const int offset, const int size)
 {
-    const int dst = allocator.getRegisterByVariable(ins.name());
-    const int src = allocator.getRegisterByVariable(ins.left());
-    const int count = allocator.getRegisterByVariable(ins.right());
+    // Copy (or fill from the value register) the final bytes which are too few for a 16 byte move
 
-    switch (ins.type())
+    int pos = offset;
+    while (pos < size)
     {
-    case TYPE_I64:
-    case TYPE_U64:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
-        }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
-        }
-        _x86_64_lower.mc_sal_reg_x64(dst);
-        break;
-    case TYPE_I32:
-    case TYPE_U32:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
-        }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
-        }
-        _x86_64_lower.mc_sal_reg_32(dst);
-        break;
-    case TYPE_I16:
-    case TYPE_U16:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        const int remaining = size - pos;
+        if (remaining >= 8)
+        {
+            if (value == -1) { _x86_64_lower.mc_mov_memory_to_reg_x64(VM_REGISTER_ECX, VM_REGISTER_EDX, pos); }
+            _x86_64_lower.mc_mov_reg_to_memory_x64(dst, pos, VM_REGISTER_ECX);
+            pos += 8;
         }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        else if (remaining >= 4)
+        {
+            if (value == -1) { _x86_64_lower.mc_mov_mem_to_reg_32(VM_REGISTER_ECX, VM_REGISTER_EDX, pos); }
+            _x86_64_lower.mc_mov_reg_to_mem_32(dst, VM_REGISTER_ECX, pos);
+            pos += 4;
         }
-        _x86_64_lower.mc_sal_reg_16(dst);
-        break;
-    case TYPE_I8:
-    case TYPE_U8:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        else if (remaining >= 2)
+        {
+            if (value == -1) { _x86_64_lower.mc_mov_mem_to_reg_16(VM_REGISTER_ECX, VM_REGISTER_EDX, pos); }
+            _x86_64_lower.mc_mov_reg_to_mem_16(dst, VM_REGISTER_ECX, pos);
+            pos += 2;
         }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        else
+        {
+            if (value == -1) { _x86_64_lower.mc_mov_memory_to_reg_8(VM_REGISTER_ECX, VM_REGISTER_EDX, pos); }
+            _x86_64_lower.mc_mov_reg_to_memory_8(dst, VM_REGISTER_ECX, pos);
+            pos += 1;
         }
-        _x86_64_lower.mc_sal_reg_8(dst);
-        break;
     }
 }
 
-void poAsm::ir_shr(PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_copy_memory(poRegAlloc& allocator, const int pos, const std::vector<poInstruction>& args)
 {
-    const int dst = allocator.getRegisterByVariable(ins.name());
-    const int src = allocator.getRegisterByVariable(ins.left());
-    const int count = allocator.getRegisterByVariable(ins.right());
+    // The destination, source and the number of bytes are gathered into rax, rdx and rcx
+    ir_block_args(allocator, pos, args, { VM_REGISTER_EAX, VM_REGISTER_EDX, VM_REGISTER_ECX });
 
-    switch (ins.type())
+    const auto& size = _constants.find(args[2].left());
+    if (size != _constants.end() && size->second >= 0 && size->second <= MAX_UNROLLED_BLOCK_SIZE)
     {
-    case TYPE_I64:
-    case TYPE_U64:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
-        }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
-        }
-        _x86_64_lower.mc_sar_reg_x64(dst);
-        break;
-    case TYPE_I32:
-    case TYPE_U32:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
-        }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
-        }
-        _x86_64_lower.mc_sar_reg_32(dst);
-        break;
-    case TYPE_I16:
-    case TYPE_U16:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
-        }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
-        }
-        _x86_64_lower.mc_sar_reg_16(dst);
-        break;
-    case TYPE_I8:
-    case TYPE_U8:
-        if (dst != src) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
-        }
-        if (count != VM_REGISTER_ECX) {
-            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        // Small copies of a known size are unrolled into 16 byte moves through xmm0
+
+        const int numBytes = int(size->second);
+        int offset = 0;
+        for (; offset + 16 <= numBytes; offset += 16)
+        {
+            _x86_64_lower.mc_movdqu_memory_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_REGISTER_EDX, offset);
+            _x86_64_lower.mc_movdqu_reg_to_memory_x64(VM_REGISTER_EAX, VM_SSE_REGISTER_XMM0, offset);
         }
-        _x86_64_lower.mc_sar_reg_8(dst);
-        break;
+        ir_block_tail(VM_REGISTER_EAX, -1, offset, numBytes);
+        return;
     }
-}
 
+#ifdef WIN32
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_ESI);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_EDI);
+#endif
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EDI, VM_REGISTER_EAX);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ESI, VM_REGISTER_EDX);
+    _x86_64_lower.mc_rep_movsb();
+#ifdef WIN32
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ESI, VM_REGISTER_R10);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EDI, VM_REGISTER_R11);
+#endif
+}
 
-void poAsm::ir_load_global(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+void poAsm::ir_fill_memory(poRegAlloc& allocator, const int pos, const std::vector<poInstruction>& args)
 {
-    const int value = ins.constant();
-    const int dst = allocator.getRegisterByVariable(ins.name());
+    // The destination, fill value and the number of bytes are gathered into rax, rdx and rcx
+    ir_block_args(allocator, pos, args, { VM_REGISTER_EAX, VM_REGISTER_EDX, VM_REGISTER_ECX });
 
-    switch (ins.type())
+    const auto& size = _constants.find(args[2].left());
+    if (size != _constants.end() && size->second >= 0 && size->second <= MAX_UNROLLED_BLOCK_SIZE)
     {
-    case TYPE_I64:
-    case TYPE_U64:
-        _x86_64_lower.mc_mov_memory_to_reg_x64(dst, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    case TYPE_I32:
-    case TYPE_U32:
-        _x86_64_lower.mc_mov_mem_to_reg_32(dst, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    case TYPE_I16:
-    case TYPE_U16:
-        _x86_64_lower.mc_mov_mem_to_reg_16(dst, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    case TYPE_I8:
-    case TYPE_U8:
-    case TYPE_BOOLEAN:
-        _x86_64_lower.mc_mov_memory_to_reg_8(dst, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    default:
-        if (module.types()[ins.type()].isPointer())
+        // Small fills of a known size repeat the byte across rcx and xmm0 and store those
+
+        const int numBytes = int(size->second);
+        _x86_64_lower.mc_movzx_8_to_64_reg_to_reg(VM_REGISTER_ECX, VM_REGISTER_EDX);
+        _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_R11, 0x0101010101010101LL);
+        _x86_64_lower.mc_mul_reg_to_reg_x64(VM_REGISTER_ECX, VM_REGISTER_R11);
+
+        int offset = 0;
+        if (numBytes >= 16)
         {
-            _x86_64_lower.mc_mov_memory_to_reg_x64(dst, 0);
-            _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-            break;
+            _x86_64_lower.mc_movq_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_REGISTER_ECX);
+            _x86_64_lower.mc_punpcklqdq_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM0);
+            for (; offset + 16 <= numBytes; offset += 16)
+            {
+                _x86_64_lower.mc_movdqu_reg_to_memory_x64(VM_REGISTER_EAX, VM_SSE_REGISTER_XMM0, offset);
+            }
         }
-        setError("Internal Error: Malformed load global instruction");
-        break;
+        ir_block_tail(VM_REGISTER_EAX, VM_REGISTER_ECX, offset, numBytes);
+        return;
     }
+
+#ifdef WIN32
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_EDI);
+#endif
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EDI, VM_REGISTER_EAX);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+    _x86_64_lower.mc_rep_stosb();
+#ifdef WIN32
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EDI, VM_REGISTER_R11);
+#endif
 }
 
-void poAsm::ir_store_global(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins)
+po_x86_64_basic_block* poAsm::ir_vector_block(po_x86_64_basic_block* bb)
 {
-    const int value = ins.constant();
-    const int right = allocator.getRegisterByVariable(ins.right());
+    // Start a new lowered block, which may already be the target of a jump
 
-    switch (ins.type())
+    if (bb == nullptr)
     {
-    case TYPE_I64:
-    case TYPE_U64:
-        _x86_64_lower.mc_mov_reg_to_memory_x64(right, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    case TYPE_I32:
-    case TYPE_U32:
-        _x86_64_lower.mc_mov_reg_to_mem_32(right, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    case TYPE_I16:
-    case TYPE_U16:
-        _x86_64_lower.mc_mov_reg_to_mem_16(right, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    case TYPE_I8:
-    case TYPE_U8:
-    case TYPE_BOOLEAN:
-        _x86_64_lower.mc_mov_reg_to_memory_8(right, 0);
-        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-        break;
-    default:
-        if (module.types()[ins.type()].isPointer())
-        {
-            _x86_64_lower.mc_mov_reg_to_memory_x64(right, 0);
-            _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
-            break;
-        }
-        setError("Internal Error: Malformed store global instruction");
-        break;
+        bb = new po_x86_64_basic_block();
     }
+    _x86_64_lower.cfg().addBasicBlock(bb);
+    return bb;
 }
 
-//================
+void poAsm::ir_vector_jump(po_x86_64_basic_block* target, const int jump)
+{
+    // Pointers and counts are compared unsigned
 
-void poAsmDataBuffer::addData(const int id, const float f32, const size_t programDataSize, const int programDataOffset)
+    po_x86_64_basic_block* bb = _x86_64_lower.cfg().getLast();
+    bb->setJumpTarget(target);
+    target->incomingBlocks().push_back(bb);
+    ir_jump(jump, 0, TYPE_U64);
+}
+
+void poAsm::ir_vector_sum(poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args)
 {
-    if (!cache(id, programDataSize, programDataOffset))
+    // Sum the rcx elements at rax into r10, 16 bytes at a time in xmm0 followed by any remaining elements
+
+    ir_block_args(allocator, pos, args, { VM_REGISTER_EAX, VM_REGISTER_ECX });
+
+    const bool is64 = ins.type() == TYPE_I64 || ins.type() == TYPE_U64;
+    const int size = is64 ? 8 : 4;
+    const char scale = is64 ? 3 : 2;
+
+    // r9 is the end of the whole vectors and r8 the end of the array
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_ECX);
+    _x86_64_lower.mc_sar_imm_to_reg_x64(VM_REGISTER_R9, 4 - scale);
+    _x86_64_lower.mc_sal_imm_to_reg_x64(VM_REGISTER_R9, 4);
+    _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_EAX);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R8, VM_REGISTER_ECX);
+    _x86_64_lower.mc_sal_imm_to_reg_x64(VM_REGISTER_R8, scale);
+    _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_R8, VM_REGISTER_EAX);
+
+    po_x86_64_basic_block* reduce = new po_x86_64_basic_block();
+    po_x86_64_basic_block* done = new po_x86_64_basic_block();
+
+    _x86_64_lower.mc_pxor_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM0);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R9);
+    ir_vector_jump(reduce, IR_JUMP_GREATER_EQUALS);
+
+    po_x86_64_basic_block* loop = ir_vector_block();
+    _x86_64_lower.mc_movdqu_memory_to_reg_x64(VM_SSE_REGISTER_XMM1, VM_REGISTER_EAX, 0);
+    ir_vector_op(ins.type(), IR_ADD, VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM1);
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EAX, 16);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R9);
+    ir_vector_jump(loop, IR_JUMP_LESS);
+
+    // Fold the lanes together by adding the upper half to the lower half
+    ir_vector_block(reduce);
+    _x86_64_lower.mc_pshufd_reg_to_reg_x64(VM_SSE_REGISTER_XMM1, VM_SSE_REGISTER_XMM0, 0x4E);
+    ir_vector_op(ins.type(), IR_ADD, VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM1);
+    if (!is64)
     {
-        const int32_t data = *reinterpret_cast<const int32_t*>(&f32);
-        _data.push_back(data & 0xFF);
-        _data.push_back((data >> 8) & 0xFF);
-        _data.push_back((data >> 16) & 0xFF);
-        _data.push_back((data >> 24) & 0xFF);
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(VM_SSE_REGISTER_XMM1, VM_SSE_REGISTER_XMM0, char(0xB1));
+        ir_vector_op(ins.type(), IR_ADD, VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM1);
     }
-}
+    _x86_64_lower.mc_movq_sse_to_reg_x64(VM_REGISTER_R10, VM_SSE_REGISTER_XMM0);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R8);
+    ir_vector_jump(done, IR_JUMP_GREATER_EQUALS);
 
-void poAsmDataBuffer::addData(const int id, const double f64, const size_t programDataSize, const int programDataOffset)
-{
-    if (!cache(id, programDataSize, programDataOffset))
+    po_x86_64_basic_block* tail = ir_vector_block();
+    if (is64)
     {
-        const int64_t data = *reinterpret_cast<const int64_t*>(&f64);
-        _data.push_back(data & 0xFF);
-        _data.push_back((data >> 8) & 0xFF);
-        _data.push_back((data >> 16) & 0xFF);
-        _data.push_back((data >> 24) & 0xFF);
-        _data.push_back((data >> 32) & 0xFF);
-        _data.push_back((data >> 40) & 0xFF);
-        _data.push_back((data >> 48) & 0xFF);
-        _data.push_back((data >> 56) & 0xFF);
+        _x86_64_lower.mc_add_memory_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_EAX, 0);
+    }
+    else
+    {
+        _x86_64_lower.mc_add_mem_to_reg_32(VM_REGISTER_R10, VM_REGISTER_EAX, 0);
     }
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EAX, size);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R8);
+    ir_vector_jump(tail, IR_JUMP_LESS);
+
+    ir_vector_block(done);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(allocator.getRegisterByVariable(ins.name()), VM_REGISTER_R10);
 }
 
-void poAsmDataBuffer::addData(const int id, const std::string& str, const size_t programDataSize, const int programDataOffset)
+void poAsm::ir_vector_map(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args)
 {
-    if (!cache(id, programDataSize, programDataOffset))
+    // Apply the operation to the rcx elements at rdx and at r8 (or to the scalar in r8 or xmm1), storing to rax.
+    // Whole vectors go through xmm0 and xmm2 before the remaining elements are done one at a time.
+
+    const int type = module.types()[args[0].type()].baseType();
+    const int size = module.types()[type].size();
+    const bool isFloat = type == TYPE_F64 || type == TYPE_F32;
+    const bool isArray = args[2].type() != type;
+
+    int scalarRegister = VM_REGISTER_R8;
+    if (isFloat && !isArray)
     {
-        for (char c : str)
-        {
-            _data.push_back(c);
-        }
-        _data.push_back(0); // null terminator
+        scalarRegister = VM_SSE_REGISTER_XMM1;
     }
-}
+    ir_block_args(allocator, pos, args, { VM_REGISTER_EAX, VM_REGISTER_EDX, scalarRegister, VM_REGISTER_ECX });
 
-void poAsmDataBuffer::addData(const int id, const int64_t i64, const size_t programDataSize, const int programDataOffset)
-{
-    if (!cache(id, programDataSize, programDataOffset))
+    char scale = 0;
+    while ((1 << scale) < size)
     {
-        _data.push_back(i64 & 0xFF);
-        _data.push_back((i64 >> 8) & 0xFF);
-        _data.push_back((i64 >> 16) & 0xFF);
-        _data.push_back((i64 >> 24) & 0xFF);
-        _data.push_back((i64 >> 32) & 0xFF);
-        _data.push_back((i64 >> 40) & 0xFF);
-        _data.push_back((i64 >> 48) & 0xFF);
-        _data.push_back((i64 >> 56) & 0xFF);
+        scale++;
     }
-}
 
-void poAsmDataBuffer::addData(const int id, const uint64_t u64, const size_t programDataSize, const int programDataOffset)
-{
-    if (!cache(id, programDataSize, programDataOffset))
+    // r9 is the end of the whole vectors and rcx the end of the destination
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_ECX);
+    _x86_64_lower.mc_sar_imm_to_reg_x64(VM_REGISTER_R9, 4 - scale);
+    _x86_64_lower.mc_sal_imm_to_reg_x64(VM_REGISTER_R9, 4);
+    _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_EAX);
+    if (scale > 0)
     {
-        _data.push_back(u64 & 0xFF);
-        _data.push_back((u64 >> 8) & 0xFF);
-        _data.push_back((u64 >> 16) & 0xFF);
-        _data.push_back((u64 >> 24) & 0xFF);
-        _data.push_back((u64 >> 32) & 0xFF);
-        _data.push_back((u64 >> 40) & 0xFF);
-        _data.push_back((u64 >> 48) & 0xFF);
-        _data.push_back((u64 >> 56) & 0xFF);
+        _x86_64_lower.mc_sal_imm_to_reg_x64(VM_REGISTER_ECX, scale);
     }
-}
+    _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_ECX, VM_REGISTER_EAX);
 
-void poAsmDataBuffer::addData(const int id, const int32_t i32, const size_t programDataSize, const int programDataOffset)
-{
-    if (!cache(id, programDataSize, programDataOffset))
+    // A destination less than 16 bytes past a source would read elements which the scalar loop
+    // would already have written, so those are left entirely to the scalar loop
+    const int sources[] = { VM_REGISTER_EDX, VM_REGISTER_R8 };
+    for (int i = 0; i < (isArray ? 2 : 1); i++)
     {
-        _data.push_back(i32 & 0xFF);
-        _data.push_back((i32 >> 8) & 0xFF);
-        _data.push_back((i32 >> 16) & 0xFF);
-        _data.push_back((i32 >> 24) & 0xFF);
+        po_x86_64_basic_block* safe = new po_x86_64_basic_block();
+        _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_EAX);
+        _x86_64_lower.mc_sub_reg_to_reg_x64(VM_REGISTER_R10, sources[i]);
+        _x86_64_lower.mc_sub_imm_to_reg_x64(VM_REGISTER_R10, 1);
+        _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_R11, 15);
+        _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_R11);
+        ir_vector_jump(safe, IR_JUMP_GREATER_EQUALS);
+
+        ir_vector_block();
+        _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_EAX);
+        ir_vector_block(safe);
     }
-}
 
-void poAsmDataBuffer::addData(const int id, const uint32_t u32, const size_t programDataSize, const int programDataOffset)
-{
-    if (!cache(id, programDataSize, programDataOffset))
+    if (!isArray)
     {
-        _data.push_back(u32 & 0xFF);
-        _data.push_back((u32 >> 8) & 0xFF);
-        _data.push_back((u32 >> 16) & 0xFF);
-        _data.push_back((u32 >> 24) & 0xFF);
+        ir_vector_broadcast(type, VM_SSE_REGISTER_XMM1, scalarRegister);
+    }
+
+    po_x86_64_basic_block* tail = new po_x86_64_basic_block();
+    po_x86_64_basic_block* done = new po_x86_64_basic_block();
+
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R9);
+    ir_vector_jump(tail, IR_JUMP_GREATER_EQUALS);
+
+    po_x86_64_basic_block* loop = ir_vector_block();
+    _x86_64_lower.mc_movdqu_memory_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_REGISTER_EDX, 0);
+    if (isArray)
+    {
+        _x86_64_lower.mc_movdqu_memory_to_reg_x64(VM_SSE_REGISTER_XMM2, VM_REGISTER_R8, 0);
+        ir_vector_op(type, ins.right(), VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2);
+    }
+    else
+    {
+        ir_vector_op(type, ins.right(), VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM1);
+    }
+    _x86_64_lower.mc_movdqu_reg_to_memory_x64(VM_REGISTER_EAX, VM_SSE_REGISTER_XMM0, 0);
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EAX, 16);
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EDX, 16);
+    if (isArray)
+    {
+        _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_R8, 16);
     }
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R9);
+    ir_vector_jump(loop, IR_JUMP_LESS);
+
+    ir_vector_block(tail);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_ECX);
+    ir_vector_jump(done, IR_JUMP_GREATER_EQUALS);
+
+    po_x86_64_basic_block* scalar = ir_vector_block();
+    ir_vector_scalar_op(type, ins.right(), isArray);
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EAX, size);
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EDX, size);
+    if (isArray)
+    {
+        _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_R8, size);
+    }
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_ECX);
+    ir_vector_jump(scalar, IR_JUMP_LESS);
+
+    ir_vector_block(done);
 }
 
-void poAsmDataBuffer::addData(const int id, const int16_t i16, const size_t programDataSize, const int programDataOffset)
+void poAsm::ir_vector_find(poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args)
 {
-    if (!cache(id, programDataSize, programDataOffset))
+    // Find the index of the first byte equal to dl in the rcx bytes at rax, or rcx when there is none.
+    // Whole vectors are compared against the byte repeated in xmm1 and the remainder one at a time.
+
+    ir_block_args(allocator, pos, args, { VM_REGISTER_EAX, VM_REGISTER_EDX, VM_REGISTER_ECX });
+
+    // r8 is the start, r9 the end and r10 the last address a whole vector can be loaded from,
+    // set once the broadcast is done with r10
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R8, VM_REGISTER_EAX);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_EAX);
+    _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_R9, VM_REGISTER_ECX);
+
+    _x86_64_lower.mc_movzx_8_to_64_reg_to_reg(VM_REGISTER_ECX, VM_REGISTER_EDX);
+    ir_vector_broadcast(TYPE_U8, VM_SSE_REGISTER_XMM1, VM_REGISTER_ECX);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_R9);
+    _x86_64_lower.mc_sub_imm_to_reg_x64(VM_REGISTER_R10, 16);
+    _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_R11, 0);
+
+    po_x86_64_basic_block* tail = new po_x86_64_basic_block();
+    po_x86_64_basic_block* found = new po_x86_64_basic_block();
+    po_x86_64_basic_block* done = new po_x86_64_basic_block();
+
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R10);
+    ir_vector_jump(tail, IR_JUMP_GREATER);
+
+    po_x86_64_basic_block* loop = ir_vector_block();
+    _x86_64_lower.mc_movdqu_memory_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_REGISTER_EAX, 0);
+    _x86_64_lower.mc_pcmpeqb_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM1);
+    _x86_64_lower.mc_pmovmskb_reg_to_reg_x64(VM_REGISTER_EDX, VM_SSE_REGISTER_XMM0);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EDX, VM_REGISTER_R11);
+    ir_vector_jump(found, IR_JUMP_NOT_EQUALS);
+
+    ir_vector_block();
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EAX, 16);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R10);
+    ir_vector_jump(loop, IR_JUMP_LESS_EQUALS);
+
+    ir_vector_block(tail);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R9);
+    ir_vector_jump(done, IR_JUMP_GREATER_EQUALS);
+
+    po_x86_64_basic_block* scalar = ir_vector_block();
+    _x86_64_lower.mc_cmp_memory_to_reg_8(VM_REGISTER_ECX, VM_REGISTER_EAX, 0);
+    ir_vector_jump(done, IR_JUMP_EQUALS);
+
+    ir_vector_block();
+    _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_EAX, 1);
+    _x86_64_lower.mc_cmp_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R9);
+    ir_vector_jump(scalar, IR_JUMP_LESS);
+
+    ir_vector_block();
+    ir_vector_jump(done, IR_JUMP_UNCONDITIONAL);
+
+    // The lowest set bit of the mask is the first matching byte of the vector
+    ir_vector_block(found);
+    _x86_64_lower.mc_bsf_reg_to_reg_x64(VM_REGISTER_EDX, VM_REGISTER_EDX);
+    _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_EDX);
+
+    ir_vector_block(done);
+    _x86_64_lower.mc_sub_reg_to_reg_x64(VM_REGISTER_EAX, VM_REGISTER_R8);
+    _x86_64_lower.mc_mov_reg_to_reg_x64(allocator.getRegisterByVariable(ins.name()), VM_REGISTER_EAX);
+}
+
+void poAsm::ir_vector_broadcast(const int type, const int dst, const int src)
+{
+    // Repeat the scalar across the sse register dst. Floating point scalars are already in an
+    // sse register and bytes and words are first repeated across r10 (using r11).
+
+    switch (type)
     {
-        _data.push_back(i16 & 0xFF);
-        _data.push_back((i16 >> 8) & 0xFF);
+    case TYPE_F64:
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, src, 0x44);
+        break;
+    case TYPE_F32:
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, src, 0x0);
+        break;
+    case TYPE_I64:
+    case TYPE_U64:
+        _x86_64_lower.mc_movq_reg_to_reg_x64(dst, src);
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, dst, 0x44);
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        _x86_64_lower.mc_movq_reg_to_reg_x64(dst, src);
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, dst, 0x0);
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        _x86_64_lower.mc_movzx_16_to_64_reg_to_reg(VM_REGISTER_R10, src);
+        _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_R11, 0x0001000100010001LL);
+        _x86_64_lower.mc_mul_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_R11);
+        _x86_64_lower.mc_movq_reg_to_reg_x64(dst, VM_REGISTER_R10);
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, dst, 0x44);
+        break;
+    default:
+        _x86_64_lower.mc_movzx_8_to_64_reg_to_reg(VM_REGISTER_R10, src);
+        _x86_64_lower.mc_mov_imm_to_reg_x64(VM_REGISTER_R11, 0x0101010101010101LL);
+        _x86_64_lower.mc_mul_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_R11);
+        _x86_64_lower.mc_movq_reg_to_reg_x64(dst, VM_REGISTER_R10);
+        _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, dst, 0x44);
+        break;
     }
 }
 
-void poAsmDataBuffer::addData(const int id, const uint16_t u16, const size_t programDataSize, const int programDataOffset)
+void poAsm::ir_vector_op(const int type, const int op, const int dst, const int src)
 {
-    if (!cache(id, programDataSize, programDataOffset))
+    switch (type)
     {
-        _data.push_back(u16 & 0xFF);
-        _data.push_back((u16 >> 8) & 0xFF);
+    case TYPE_F64:
+        switch (op)
+        {
+        case IR_ADD: _x86_64_lower.mc_addpd_reg_to_reg_x64(dst, src); break;
+        case IR_SUB: _x86_64_lower.mc_subpd_reg_to_reg_x64(dst, src); break;
+        case IR_MUL: _x86_64_lower.mc_mulpd_reg_to_reg_x64(dst, src); break;
+        case IR_DIV: _x86_64_lower.mc_divpd_reg_to_reg_x64(dst, src); break;
+        }
+        break;
+    case TYPE_F32:
+        switch (op)
+        {
+        case IR_ADD: _x86_64_lower.mc_addps_reg_to_reg_x64(dst, src); break;
+        case IR_SUB: _x86_64_lower.mc_subps_reg_to_reg_x64(dst, src); break;
+        case IR_MUL: _x86_64_lower.mc_mulps_reg_to_reg_x64(dst, src); break;
+        case IR_DIV: _x86_64_lower.mc_divps_reg_to_reg_x64(dst, src); break;
+        }
+        break;
+    case TYPE_I64:
+    case TYPE_U64:
+        if (op == IR_ADD) { _x86_64_lower.mc_paddq_reg_to_reg_x64(dst, src); }
+        else { _x86_64_lower.mc_psubq_reg_to_reg_x64(dst, src); }
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        if (op == IR_ADD) { _x86_64_lower.mc_paddd_reg_to_reg_x64(dst, src); }
+        else { _x86_64_lower.mc_psubd_reg_to_reg_x64(dst, src); }
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        if (op == IR_ADD) { _x86_64_lower.mc_paddw_reg_to_reg_x64(dst, src); }
+        else { _x86_64_lower.mc_psubw_reg_to_reg_x64(dst, src); }
+        break;
+    default:
+        if (op == IR_ADD) { _x86_64_lower.mc_paddb_reg_to_reg_x64(dst, src); }
+        else { _x86_64_lower.mc_psubb_reg_to_reg_x64(dst, src); }
+        break;
     }
 }
 
-void poAsmDataBuffer::addData(const int id, const int8_t i8, const size_t programDataSize, const int programDataOffset)
+static int getLaneType(const int type)
 {
-    if (!cache(id, programDataSize, programDataOffset))
+    switch (type)
     {
-        _data.push_back(i8 & 0xFF);
+    case TYPE_F32X4: return TYPE_F32;
+    case TYPE_F64X2: return TYPE_F64;
+    case TYPE_I32X4: return TYPE_I32;
+    default: return TYPE_U8;
     }
 }
 
-void poAsmDataBuffer::addData(const int id, const uint8_t u8, const size_t programDataSize, const int programDataOffset)
+void poAsm::ir_vector_arithmetic(const int type, const int op, const int dst, const int src1, const int src2)
 {
-    if (!cache(id, programDataSize, programDataOffset))
+    // As with the scalar instructions the left operand is moved into the result first. When the result
+    // shares a register with the right operand the operands are swapped for add and multiply,
+    // otherwise the work is done in xmm0.
+
+    const int lane = getLaneType(type);
+    if (dst == src2 && dst != src1)
     {
-        _data.push_back(u8 & 0xFF);
+        if (op == IR_ADD || op == IR_MUL)
+        {
+            ir_vector_op(lane, op, dst, src1);
+            return;
+        }
+
+        _x86_64_lower.mc_movaps_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src1);
+        ir_vector_op(lane, op, VM_SSE_REGISTER_XMM0, src2);
+        _x86_64_lower.mc_movaps_reg_to_reg_x64(dst, VM_SSE_REGISTER_XMM0);
+        return;
     }
+
+    if (dst != src1)
+    {
+        _x86_64_lower.mc_movaps_reg_to_reg_x64(dst, src1);
+    }
+    ir_vector_op(lane, op, dst, src2);
 }
 
-bool poAsmDataBuffer::cache(const int id, const size_t programDataSize, const int programDataOffset)
+void poAsm::ir_vector_splat(poRegAlloc& allocator, const poInstruction& ins)
 {
-    const auto& it = _dataMap.find(id);
-    if (it != _dataMap.end())
+    const int dst = allocator.getRegisterByVariable(ins.name()) - VM_REGISTER_MAX;
+    int src = allocator.getRegisterByVariable(ins.left());
+
+    const int lane = getLaneType(ins.type());
+    if (lane == TYPE_F32 || lane == TYPE_F64)
     {
-        _patchPoints.push_back(poAsmConstant(it->second, int(programDataSize) + programDataOffset));
-        return true;
+        src -= VM_REGISTER_MAX;
     }
 
-    _patchPoints.push_back(poAsmConstant(int(_data.size()), int(programDataSize) + programDataOffset));
-    _dataMap.insert(std::pair<int, int>(id, int(_data.size())));
-    return false;
+    ir_vector_broadcast(lane, dst, src);
 }
 
-//================
-
-poAsm::poAsm()
-    :
-    _entryPoint(-1),
-    _isError(false),
-    _prologueSize(0),
-    _debugDump(false)
+void poAsm::ir_vector_compare(poRegAlloc& allocator, const poInstruction& ins)
 {
+    // Each lane of the result is all ones where the comparison holds and zero where it does not.
+    // SSE2 only has a greater than for integers, for floating point the operands are swapped
+    // and a less than used instead.
+
+    const int dst = allocator.getRegisterByVariable(ins.name()) - VM_REGISTER_MAX;
+    int src1 = allocator.getRegisterByVariable(ins.left()) - VM_REGISTER_MAX;
+    int src2 = allocator.getRegisterByVariable(ins.right()) - VM_REGISTER_MAX;
+
+    const bool isFloat = ins.type() == TYPE_F32X4 || ins.type() == TYPE_F64X2;
+    char predicate = 0; /* equal */
+    if (ins.code() == IR_VECTOR_GREATER && isFloat)
+    {
+        std::swap(src1, src2);
+        predicate = 1; /* less than */
+    }
+
+    _x86_64_lower.mc_movaps_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src1);
+    switch (ins.type())
+    {
+    case TYPE_F32X4:
+        _x86_64_lower.mc_cmpps_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src2, predicate);
+        break;
+    case TYPE_F64X2:
+        _x86_64_lower.mc_cmppd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src2, predicate);
+        break;
+    case TYPE_I32X4:
+        if (ins.code() == IR_VECTOR_GREATER)
+        {
+            _x86_64_lower.mc_pcmpgtd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src2);
+        }
+        else
+        {
+            _x86_64_lower.mc_pcmpeqd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src2);
+        }
+        break;
+    default:
+        _x86_64_lower.mc_pcmpeqb_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, src2);
+        break;
+    }
+    _x86_64_lower.mc_movaps_reg_to_reg_x64(dst, VM_SSE_REGISTER_XMM0);
 }
 
-bool poAsm::isEnum(poModule& module, const poInstruction& ins)
+void poAsm::ir_vector_shuffle(poRegAlloc& allocator, const poInstruction& ins)
 {
-    return module.types()[ins.type()].baseType() == TYPE_ENUM;
+    // The order holds two bits per lane. Doubles are moved as pairs of dwords.
+
+    const int dst = allocator.getRegisterByVariable(ins.name()) - VM_REGISTER_MAX;
+    const int src = allocator.getRegisterByVariable(ins.left()) - VM_REGISTER_MAX;
+
+    int order = ins.memOffset() & 0xFF;
+    if (ins.type() == TYPE_F64X2)
+    {
+        const int low = order & 0x1;
+        const int high = (order >> 1) & 0x1;
+        order = (low * 2) | ((low * 2 + 1) << 2) | ((high * 2) << 4) | ((high * 2 + 1) << 6);
+    }
+
+    _x86_64_lower.mc_pshufd_reg_to_reg_x64(dst, src, char(order));
 }
 
-bool poAsm::ir_jump(int jump, int imm, int type)
+void poAsm::ir_vector_movemask(poRegAlloc& allocator, const poInstruction& ins)
 {
-    if (jump == IR_JUMP_UNCONDITIONAL)
+    // Gather the top bit of each lane of the vector into the bits of an integer
+
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    const int src = allocator.getRegisterByVariable(ins.left()) - VM_REGISTER_MAX;
+
+    switch (ins.memOffset())
     {
-        _x86_64_lower.mc_jump_unconditional(imm);
-        return true;
+    case TYPE_F32X4:
+    case TYPE_I32X4:
+        _x86_64_lower.mc_movmskps_reg_to_reg_x64(dst, src);
+        break;
+    case TYPE_F64X2:
+        _x86_64_lower.mc_movmskpd_reg_to_reg_x64(dst, src);
+        break;
+    default:
+        _x86_64_lower.mc_pmovmskb_reg_to_reg_x64(dst, src);
+        break;
     }
+}
+
+void poAsm::ir_vector_scalar_op(const int type, const int op, const bool isArray)
+{
+    // A single element of the map, from rdx and r8 (or the scalar in r8 or xmm1) to rax
 
     switch (type)
     {
-    case TYPE_I64:
-    case TYPE_I32:
-    case TYPE_I16:
-    case TYPE_I8:
-        switch (jump)
+    case TYPE_F64:
+        _x86_64_lower.mc_movsd_memory_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_REGISTER_EDX, 0);
+        if (isArray)
         {
-        case IR_JUMP_EQUALS:
-            _x86_64_lower.mc_jump_equals(imm);
-            break;
-        case IR_JUMP_GREATER:
-            _x86_64_lower.mc_jump_greater(imm);
-            break;
-        case IR_JUMP_LESS:
-            _x86_64_lower.mc_jump_less(imm);
-            break;
-        case IR_JUMP_GREATER_EQUALS:
-            _x86_64_lower.mc_jump_greater_equal(imm);
-            break;
+            _x86_64_lower.mc_movsd_memory_to_reg_x64(VM_SSE_REGISTER_XMM2, VM_REGISTER_R8, 0);
+        }
+        else
+        {
+            _x86_64_lower.mc_movsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM2, VM_SSE_REGISTER_XMM1);
+        }
+        switch (op)
+        {
+        case IR_ADD: _x86_64_lower.mc_addsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        case IR_SUB: _x86_64_lower.mc_subsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        case IR_MUL: _x86_64_lower.mc_mulsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        case IR_DIV: _x86_64_lower.mc_divsd_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        }
+        _x86_64_lower.mc_movsd_reg_to_memory_x64(VM_REGISTER_EAX, VM_SSE_REGISTER_XMM0, 0);
+        break;
+    case TYPE_F32:
+        _x86_64_lower.mc_movss_memory_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_REGISTER_EDX, 0);
+        if (isArray)
+        {
+            _x86_64_lower.mc_movss_memory_to_reg_x64(VM_SSE_REGISTER_XMM2, VM_REGISTER_R8, 0);
+        }
+        else
+        {
+            _x86_64_lower.mc_movss_reg_to_reg_x64(VM_SSE_REGISTER_XMM2, VM_SSE_REGISTER_XMM1);
+        }
+        switch (op)
+        {
+        case IR_ADD: _x86_64_lower.mc_addss_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        case IR_SUB: _x86_64_lower.mc_subss_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        case IR_MUL: _x86_64_lower.mc_mulss_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        case IR_DIV: _x86_64_lower.mc_divss_reg_to_reg_x64(VM_SSE_REGISTER_XMM0, VM_SSE_REGISTER_XMM2); break;
+        }
+        _x86_64_lower.mc_movss_reg_to_memory_x64(VM_REGISTER_EAX, VM_SSE_REGISTER_XMM0, 0);
+        break;
+    case TYPE_I64:
+    case TYPE_U64:
+        _x86_64_lower.mc_mov_memory_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_EDX, 0);
+        if (isArray)
+        {
+            _x86_64_lower.mc_mov_memory_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_R8, 0);
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_R8);
+        }
+        if (op == IR_ADD) { _x86_64_lower.mc_add_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_R11); }
+        else { _x86_64_lower.mc_sub_reg_to_reg_x64(VM_REGISTER_R10, VM_REGISTER_R11); }
+        _x86_64_lower.mc_mov_reg_to_memory_x64(VM_REGISTER_EAX, 0, VM_REGISTER_R10);
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        _x86_64_lower.mc_mov_mem_to_reg_32(VM_REGISTER_R10, VM_REGISTER_EDX, 0);
+        if (isArray)
+        {
+            _x86_64_lower.mc_mov_mem_to_reg_32(VM_REGISTER_R11, VM_REGISTER_R8, 0);
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_R8);
+        }
+        if (op == IR_ADD) { _x86_64_lower.mc_add_reg_to_reg_32(VM_REGISTER_R10, VM_REGISTER_R11); }
+        else { _x86_64_lower.mc_sub_reg_to_reg_32(VM_REGISTER_R10, VM_REGISTER_R11); }
+        _x86_64_lower.mc_mov_reg_to_mem_32(VM_REGISTER_EAX, VM_REGISTER_R10, 0);
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        _x86_64_lower.mc_mov_mem_to_reg_16(VM_REGISTER_R10, VM_REGISTER_EDX, 0);
+        if (isArray)
+        {
+            _x86_64_lower.mc_mov_mem_to_reg_16(VM_REGISTER_R11, VM_REGISTER_R8, 0);
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_R8);
+        }
+        if (op == IR_ADD) { _x86_64_lower.mc_add_reg_to_reg_16(VM_REGISTER_R10, VM_REGISTER_R11); }
+        else { _x86_64_lower.mc_sub_reg_to_reg_16(VM_REGISTER_R10, VM_REGISTER_R11); }
+        _x86_64_lower.mc_mov_reg_to_mem_16(VM_REGISTER_EAX, VM_REGISTER_R10, 0);
+        break;
+    default:
+        _x86_64_lower.mc_mov_memory_to_reg_8(VM_REGISTER_R10, VM_REGISTER_EDX, 0);
+        if (isArray)
+        {
+            _x86_64_lower.mc_mov_memory_to_reg_8(VM_REGISTER_R11, VM_REGISTER_R8, 0);
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_R11, VM_REGISTER_R8);
+        }
+        if (op == IR_ADD) { _x86_64_lower.mc_add_reg_to_reg_8(VM_REGISTER_R10, VM_REGISTER_R11); }
+        else { _x86_64_lower.mc_sub_reg_to_reg_8(VM_REGISTER_R10, VM_REGISTER_R11); }
+        _x86_64_lower.mc_mov_reg_to_memory_8(VM_REGISTER_EAX, VM_REGISTER_R10, 0);
+        break;
+    }
+}
+
+void poAsm::ir_tail_call(poRegAlloc& allocator, const poInstruction& ins, const poTailCall tailCall, poBasicBlock* bb, poFlowGraph& cfg)
+{
+    if (tailCall == poTailCall::Loop)
+    {
+        // The first block after the prologue picks the arguments up again
+
+        po_x86_64_basic_block* abb = _x86_64_lower.cfg().getLast();
+        abb->setJumpTarget(_basicBlockMap[cfg.getFirst()]);
+        abb->jumpBlock()->incomingBlocks().push_back(abb);
+        _x86_64_lower.mc_jump_unconditional(0);
+        return;
+    }
+
+    // The callee returns straight to our caller
+    generateEpilogue(allocator);
+
+    _x86_64_lower.mc_tail_call(0);
+    _x86_64_lower.cfg().getLast()->instructions().back().setId(ins.right());
+}
+
+void poAsm::ir_param(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const poCallLayout& params)
+{
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    const int dst_sse = dst - VM_REGISTER_MAX;
+    const poCallArg& param = params.arg(ins.left());
+    switch (ins.type())
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+    case TYPE_I32:
+    case TYPE_U32:
+    case TYPE_I16:
+    case TYPE_U16:
+    case TYPE_I8:
+    case TYPE_U8:
+        if (!param.isStack())
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, param.reg());
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_memory_to_reg_x64(dst, VM_REGISTER_ESP, getArgOffset(param.stackSlot(), _prologueSize));
+        }
+        break;
+    case TYPE_F64:
+        if (!param.isStack())
+        {
+            _x86_64_lower.mc_movsd_reg_to_reg_x64(dst_sse, param.reg());
+        }
+        else
+        {
+            _x86_64_lower.mc_movsd_memory_to_reg_x64(dst_sse, VM_REGISTER_ESP, getArgOffset(param.stackSlot(), _prologueSize));
+        }
+        break;
+    case TYPE_F32:
+        if (!param.isStack())
+        {
+            _x86_64_lower.mc_movss_reg_to_reg_x64(dst_sse, param.reg());
+        }
+        else
+        {
+            _x86_64_lower.mc_movss_memory_to_reg_x64(dst_sse, VM_REGISTER_ESP, getArgOffset(param.stackSlot(), _prologueSize));
+        }
+        break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        if (!param.isStack())
+        {
+            _x86_64_lower.mc_movaps_reg_to_reg_x64(dst_sse, param.reg());
+        }
+        else
+        {
+            setError("Vector arguments must be passed in registers.");
+        }
+        break;
+    default:
+        if (!param.isStack())
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, param.reg());
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_memory_to_reg_x64(dst, VM_REGISTER_ESP, getArgOffset(param.stackSlot(), _prologueSize));
+        }
+        break;
+    }
+}
+
+
+void poAsm::ir_shl(poRegAlloc& allocator, const poInstruction& ins)
+{
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    const int src = allocator.getRegisterByVariable(ins.left());
+    const int count = allocator.getRegisterByVariable(ins.right());
+
+    switch (ins.type())
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sal_reg_x64(dst);
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sal_reg_32(dst);
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sal_reg_16(dst);
+        break;
+    case TYPE_I8:
+    case TYPE_U8:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sal_reg_8(dst);
+        break;
+    }
+}
+
+void poAsm::ir_shr(poRegAlloc& allocator, const poInstruction& ins)
+{
+    const int dst = allocator.getRegisterByVariable(ins.name());
+    const int src = allocator.getRegisterByVariable(ins.left());
+    const int count = allocator.getRegisterByVariable(ins.right());
+
+    switch (ins.type())
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sar_reg_x64(dst);
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sar_reg_32(dst);
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sar_reg_16(dst);
+        break;
+    case TYPE_I8:
+    case TYPE_U8:
+        if (dst != src) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, src);
+        }
+        if (count != VM_REGISTER_ECX) {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ECX, count);
+        }
+        _x86_64_lower.mc_sar_reg_8(dst);
+        break;
+    }
+}
+
+
+void poAsm::ir_load_global(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
+{
+    const int value = ins.constant();
+    const int dst = allocator.getRegisterByVariable(ins.name());
+
+    switch (ins.type())
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+        _x86_64_lower.mc_mov_memory_to_reg_x64(dst, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        _x86_64_lower.mc_mov_mem_to_reg_32(dst, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        _x86_64_lower.mc_mov_mem_to_reg_16(dst, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+        _x86_64_lower.mc_mov_memory_to_reg_8(dst, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    default:
+        if (module.types()[ins.type()].isPointer())
+        {
+            _x86_64_lower.mc_mov_memory_to_reg_x64(dst, 0);
+            _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+            break;
+        }
+        setError("Internal Error: Malformed load global instruction");
+        break;
+    }
+}
+
+void poAsm::ir_store_global(poModule& module, poRegAlloc& allocator, const poInstruction& ins)
+{
+    const int value = ins.constant();
+    const int right = allocator.getRegisterByVariable(ins.right());
+
+    switch (ins.type())
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+        _x86_64_lower.mc_mov_reg_to_memory_x64(right, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    case TYPE_I32:
+    case TYPE_U32:
+        _x86_64_lower.mc_mov_reg_to_mem_32(right, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    case TYPE_I16:
+    case TYPE_U16:
+        _x86_64_lower.mc_mov_reg_to_mem_16(right, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+        _x86_64_lower.mc_mov_reg_to_memory_8(right, 0);
+        _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+        break;
+    default:
+        if (module.types()[ins.type()].isPointer())
+        {
+            _x86_64_lower.mc_mov_reg_to_memory_x64(right, 0);
+            _x86_64_lower.cfg().getLast()->instructions().back().setId(value);
+            break;
+        }
+        setError("Internal Error: Malformed store global instruction");
+        break;
+    }
+}
+
+//================
+
+void poAsmDataBuffer::addData(const int id, const float f32, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        const int32_t data = *reinterpret_cast<const int32_t*>(&f32);
+        _data.push_back(data & 0xFF);
+        _data.push_back((data >> 8) & 0xFF);
+        _data.push_back((data >> 16) & 0xFF);
+        _data.push_back((data >> 24) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const double f64, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        const int64_t data = *reinterpret_cast<const int64_t*>(&f64);
+        _data.push_back(data & 0xFF);
+        _data.push_back((data >> 8) & 0xFF);
+        _data.push_back((data >> 16) & 0xFF);
+        _data.push_back((data >> 24) & 0xFF);
+        _data.push_back((data >> 32) & 0xFF);
+        _data.push_back((data >> 40) & 0xFF);
+        _data.push_back((data >> 48) & 0xFF);
+        _data.push_back((data >> 56) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const std::string& str, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        for (char c : str)
+        {
+            _data.push_back(c);
+        }
+        _data.push_back(0); // null terminator
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const int64_t i64, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(i64 & 0xFF);
+        _data.push_back((i64 >> 8) & 0xFF);
+        _data.push_back((i64 >> 16) & 0xFF);
+        _data.push_back((i64 >> 24) & 0xFF);
+        _data.push_back((i64 >> 32) & 0xFF);
+        _data.push_back((i64 >> 40) & 0xFF);
+        _data.push_back((i64 >> 48) & 0xFF);
+        _data.push_back((i64 >> 56) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const uint64_t u64, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(u64 & 0xFF);
+        _data.push_back((u64 >> 8) & 0xFF);
+        _data.push_back((u64 >> 16) & 0xFF);
+        _data.push_back((u64 >> 24) & 0xFF);
+        _data.push_back((u64 >> 32) & 0xFF);
+        _data.push_back((u64 >> 40) & 0xFF);
+        _data.push_back((u64 >> 48) & 0xFF);
+        _data.push_back((u64 >> 56) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const int32_t i32, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(i32 & 0xFF);
+        _data.push_back((i32 >> 8) & 0xFF);
+        _data.push_back((i32 >> 16) & 0xFF);
+        _data.push_back((i32 >> 24) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const uint32_t u32, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(u32 & 0xFF);
+        _data.push_back((u32 >> 8) & 0xFF);
+        _data.push_back((u32 >> 16) & 0xFF);
+        _data.push_back((u32 >> 24) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const int16_t i16, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(i16 & 0xFF);
+        _data.push_back((i16 >> 8) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const uint16_t u16, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(u16 & 0xFF);
+        _data.push_back((u16 >> 8) & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const int8_t i8, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(i8 & 0xFF);
+    }
+}
+
+void poAsmDataBuffer::addData(const int id, const uint8_t u8, const size_t programDataSize, const int programDataOffset)
+{
+    if (!cache(id, programDataSize, programDataOffset))
+    {
+        _data.push_back(u8 & 0xFF);
+    }
+}
+
+bool poAsmDataBuffer::cache(const int id, const size_t programDataSize, const int programDataOffset)
+{
+    const auto& it = _dataMap.find(id);
+    if (it != _dataMap.end())
+    {
+        _patchPoints.push_back(poAsmConstant(it->second, int(programDataSize) + programDataOffset));
+        return true;
+    }
+
+    _patchPoints.push_back(poAsmConstant(int(_data.size()), int(programDataSize) + programDataOffset));
+    _dataMap.insert(std::pair<int, int>(id, int(_data.size())));
+    return false;
+}
+
+//================
+
+poAsm::poAsm()
+    :
+    _entryPoint(-1),
+    _isError(false),
+    _prologueSize(0),
+    _frameSize(0),
+    _isLeaf(false),
+    _isRedZone(false),
+    _numMoves(0),
+    _numEliminatedMoves(0),
+    _debugDump(false),
+    _blockLayout(false),
+    _branchRelaxation(false),
+    _peephole(false),
+    _tailCalls(false),
+    _omitFramePointer(false),
+    _allocator(poRegAllocType::Graph),
+    _linearScanThreshold(0),
+    _module(nullptr)
+{
+}
+
+bool poAsm::isEnum(poModule& module, const poInstruction& ins)
+{
+    return module.types()[ins.type()].baseType() == TYPE_ENUM;
+}
+
+static bool isRegisterType(poModule& module, const int type)
+{
+    switch (type)
+    {
+    case TYPE_I64:
+    case TYPE_I32:
+    case TYPE_I16:
+    case TYPE_I8:
+    case TYPE_U64:
+    case TYPE_U32:
+    case TYPE_U16:
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+    case TYPE_F64:
+    case TYPE_F32:
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        return true;
+    }
+
+    const poType& info = module.types()[type];
+    return info.isPointer() || info.baseType() == TYPE_ENUM;
+}
+
+static bool hasAlloca(poFlowGraph& cfg)
+{
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            if (ins.code() == IR_ALLOCA)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool isLeafFunction(poFlowGraph& cfg)
+{
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            if (ins.code() == IR_CALL)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+poTailCall poAsm::findTailCall(poModule& module, const poFunction& function, const std::vector<poInstruction>& instructions, const int pos)
+{
+    // The call must be followed by its arguments and a return of its result, which ends the block
+
+    const poInstruction& call = instructions[pos];
+    const int numArgs = call.left();
+    const int retPos = pos + numArgs + 1;
+    if (retPos != int(instructions.size()) - 1)
+    {
+        return poTailCall::None;
+    }
+
+    const poInstruction& ret = instructions[retPos];
+    if (ret.code() != IR_RETURN ||
+        ret.right() != -1 ||
+        (ret.left() != -1 && ret.left() != call.name()))
+    {
+        return poTailCall::None;
+    }
+
+    if (call.type() != TYPE_VOID && !isRegisterType(module, call.type()))
+    {
+        return poTailCall::None;
+    }
+
+    std::string symbol;
+    if (!module.getSymbol(call.right(), symbol))
+    {
+        return poTailCall::None;
+    }
+
+    if (symbol == function.fullname())
+    {
+        // Stack arguments are written over our own incoming arguments
+        for (int i = 0; i < numArgs; i++)
+        {
+            if (!isRegisterType(module, instructions[pos + i + 1].type()))
+            {
+                return poTailCall::None;
+            }
+        }
+
+        return poTailCall::Loop;
+    }
+
+    // Our frame is gone by the time the callee runs, so every argument must go in a register
+    for (const poFunction& callee : module.functions())
+    {
+        if (callee.fullname() != symbol)
+        {
+            continue;
+        }
+
+        const std::vector<int>& args = callee.args();
+        if (callee.callConvention() != function.callConvention() ||
+            int(args.size()) != numArgs)
+        {
+            return poTailCall::None;
+        }
+
+        std::vector<int> types;
+        std::vector<int> structs;
+        for (int i = 0; i < numArgs; i++)
+        {
+            types.push_back(instructions[pos + i + 1].type());
+            structs.push_back(instructions[pos + i + 1].memOffset());
+        }
+
+        const poCallLayout layout(callee.callConvention(), types, structs);
+        for (int i = 0; i < numArgs; i++)
+        {
+            if (!isRegisterType(module, args[i]) || layout.arg(i).isStack())
+            {
+                return poTailCall::None;
+            }
+        }
+
+        return poTailCall::Sibling;
+    }
+
+    return poTailCall::None;
+}
+
+static int jumpSize(const int opcode)
+{
+    switch (opcode)
+    {
+    case VMI_J8:
+    case VMI_JE8:
+    case VMI_JNE8:
+    case VMI_JL8:
+    case VMI_JG8:
+    case VMI_JLE8:
+    case VMI_JGE8:
+    case VMI_JNAE8:
+    case VMI_JNBE8:
+    case VMI_JNA8:
+    case VMI_JNB8:
+        return 2;
+    case VMI_J32:
+        return 5;
+    }
+
+    return 6;
+}
+
+static int shortJump(const int opcode)
+{
+    switch (opcode)
+    {
+    case VMI_J32: return VMI_J8;
+    case VMI_JE32: return VMI_JE8;
+    case VMI_JNE32: return VMI_JNE8;
+    case VMI_JL32: return VMI_JL8;
+    case VMI_JG32: return VMI_JG8;
+    case VMI_JLE32: return VMI_JLE8;
+    case VMI_JGE32: return VMI_JGE8;
+    case VMI_JNAE32: return VMI_JNAE8;
+    case VMI_JNBE32: return VMI_JNBE8;
+    case VMI_JNA32: return VMI_JNA8;
+    case VMI_JNB32: return VMI_JNB8;
+    }
+
+    return opcode;
+}
+
+static inline bool fitsShortJump(const int imm)
+{
+    return imm >= -128 && imm <= 127;
+}
+
+bool poAsm::ir_jump(int jump, int imm, int type)
+{
+    if (jump == IR_JUMP_UNCONDITIONAL)
+    {
+        _x86_64_lower.mc_jump_unconditional(imm);
+        return true;
+    }
+
+    switch (type)
+    {
+    case TYPE_I64:
+    case TYPE_I32:
+    case TYPE_I16:
+    case TYPE_I8:
+        switch (jump)
+        {
+        case IR_JUMP_EQUALS:
+            _x86_64_lower.mc_jump_equals(imm);
+            break;
+        case IR_JUMP_GREATER:
+            _x86_64_lower.mc_jump_greater(imm);
+            break;
+        case IR_JUMP_LESS:
+            _x86_64_lower.mc_jump_less(imm);
+            break;
+        case IR_JUMP_GREATER_EQUALS:
+            _x86_64_lower.mc_jump_greater_equal(imm);
+            break;
         case IR_JUMP_LESS_EQUALS:
             _x86_64_lower.mc_jump_less_equal(imm);
             break;
@@ -1752,6 +3419,10 @@ void poAsm::patchJump(po_x86_64_basic_block* jump)
     const int pos = int(_x86_64.programData().size());
     const int size = jump->jump().getSize();
     const int imm = pos - (jump->jump().getProgramDataPos() + size);
+    if (size == 2 && !fitsShortJump(imm))
+    {
+        setError("Internal Error: Short jump out of range");
+    }
 
     _x86_64.emit_jump(jump->jump().getJumpType(), imm);
 
@@ -1800,11 +3471,17 @@ static const int align(const int size)
     return 8;
 }
 
-void poAsm::generatePrologue(PO_ALLOCATOR& allocator)
+void poAsm::generatePrologue(poRegAlloc& allocator)
 {
-    int numPushed = 1;
-    _x86_64_lower.mc_push_reg(VM_REGISTER_EBP);
-    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EBP, VM_REGISTER_ESP);
+    // Leaf functions make no calls, so they need neither a frame pointer nor an aligned stack
+
+    int numPushed = 0;
+    if (!_isLeaf)
+    {
+        _x86_64_lower.mc_push_reg(VM_REGISTER_EBP);
+        _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_EBP, VM_REGISTER_ESP);
+        numPushed++;
+    }
 
     // Push all non-volatile general purpose registers which are used
     for (int i = 0; i < VM_REGISTER_MAX; i++)
@@ -1825,14 +3502,26 @@ void poAsm::generatePrologue(PO_ALLOCATOR& allocator)
         }
     }
 
-    const int size = 8 * numPushed + 8 * allocator.stackSize() + 32 /* register homes */ + sseRegisters * 8;
-    const int alignment = align(size);
-    _prologueSize = alignment + size;
-    const int resize = _prologueSize - 8 * numPushed;
+    const int frameSize = 8 * allocator.stackSize() + sseRegisters * 16;
+    if (_isLeaf)
+    {
+        // A small leaf frame is kept below the stack pointer, in the red zone
+        _frameSize = frameSize > 0 ? frameSize + VM_REGISTER_HOMES : 0;
+        _isRedZone = _frameSize > 0 && _frameSize <= VM_RED_ZONE;
+    }
+    else
+    {
+        const int size = 8 * numPushed + frameSize + VM_REGISTER_HOMES;
+        _frameSize = align(size) + size - 8 * numPushed;
+        _isRedZone = false;
+    }
+    _prologueSize = 8 * numPushed + _frameSize;
 
-    if (resize > 0)
+    // Functions which make calls always adjust the stack, as the call site analyzer
+    // reserves the space for stack arguments there and drops an adjustment which is still zero
+    if (hasStackAdjustment())
     {
-        _x86_64_lower.mc_sub_imm_to_reg_x64(VM_REGISTER_ESP, resize);
+        _x86_64_lower.mc_sub_imm_to_reg_x64(VM_REGISTER_ESP, _frameSize);
     }
 
     int count = 0;
@@ -1840,7 +3529,8 @@ void poAsm::generatePrologue(PO_ALLOCATOR& allocator)
     {
         if (!allocator.isVolatile(i) && allocator.isRegisterSet(i))
         {
-            _x86_64_lower.mc_movsd_reg_to_memory_x64(VM_REGISTER_ESP, i - VM_REGISTER_MAX, resize - 8 * count - 8 - 32/*register homes*/);
+            // Saved whole, as the register may hold a vector
+            _x86_64_lower.mc_movdqu_reg_to_memory_x64(VM_REGISTER_ESP, i - VM_REGISTER_MAX, _frameSize - 16 * count - 16 - VM_REGISTER_HOMES);
             count++;
         }
     }
@@ -1849,31 +3539,29 @@ void poAsm::generatePrologue(PO_ALLOCATOR& allocator)
 void poAsm::emitJump(po_x86_64_basic_block* bb)
 {
     po_x86_64_basic_block* targetBB =  bb->jumpBlock();
+    const int jumpType = bb->instructions().back().opcode();
 
     // Check if the targetBB has been visited already, is which case we know its position
 
     if (targetBB->programDataPos() != -1)
     {
-        const int imm = targetBB->programDataPos() - (int(_x86_64.programData().size()) + 5/*TODO*/);
+        const int size = jumpSize(jumpType);
+        const int imm = targetBB->programDataPos() - (int(_x86_64.programData().size()) + size);
+        if (size == 2 && !fitsShortJump(imm))
+        {
+            setError("Internal Error: Short jump out of range");
+        }
 
-        _x86_64.emit_jump(bb->instructions().back().opcode(), imm);
+        _x86_64.emit_jump(jumpType, imm);
     }
     else
     {
         // Insert patch
 
         const int pos = int(_x86_64.programData().size());
-        const int jumpType = bb->instructions().back().opcode();
 
         /* Insert after we have got the position */
-        if (jumpType == VMI_J32)
-        {
-            _x86_64.mc_jump_unconditional(0);
-        }
-        else
-        {
-            _x86_64.mc_jump_equals(0);
-        }
+        _x86_64.emit_jump(jumpType, 0);
 
         const int size = int(_x86_64.programData().size()) - pos;
 
@@ -1885,49 +3573,102 @@ void poAsm::emitJump(po_x86_64_basic_block* bb)
     }
 }
 
-void poAsm::generateEpilogue(PO_ALLOCATOR& allocator)
+void poAsm::generateEpilogue(poRegAlloc& allocator)
 {
-    // Calculate how many non-volatile registers we need to pop
-    int numToPop = 0;
-    for (int i = VM_REGISTER_MAX - 1; i >= 0; i--)
+    int count = 0;
+    for (int i = VM_REGISTER_MAX; i < VM_REGISTER_MAX + VM_SSE_REGISTER_MAX; i++)
     {
         if (!allocator.isVolatile(i) && allocator.isRegisterSet(i))
         {
-            numToPop++;
+            _x86_64_lower.mc_movdqu_memory_to_reg_x64(i - VM_REGISTER_MAX, VM_REGISTER_ESP, _frameSize - 16 * count - 16 - VM_REGISTER_HOMES);
+            count++;
         }
     }
 
-    const int size = _prologueSize - 8 * numToPop;
+    if (hasStackAdjustment())
+    {
+        _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_ESP, _frameSize);
+    }
 
-    int count = 1;
-    for (int i = VM_REGISTER_MAX; i < VM_REGISTER_MAX + VM_SSE_REGISTER_MAX; i++)
+    // Pop all non-volatile general purpose registers which are used (in backwards order)
+    for (int i = VM_REGISTER_MAX - 1; i >= 0; i--)
     {
         if (!allocator.isVolatile(i) && allocator.isRegisterSet(i))
         {
-            _x86_64_lower.mc_movsd_memory_to_reg_x64(i - VM_REGISTER_MAX, VM_REGISTER_ESP, size - 8 * count - 8 - 32/*register homes*/);
-            count++;
+            _x86_64_lower.mc_pop_reg(i);
         }
     }
 
-    if (size > 0)
+    // The stack pointer is back at the frame pointer once everything is popped
+    if (!_isLeaf)
     {
-        _x86_64_lower.mc_add_imm_to_reg_x64(VM_REGISTER_ESP, size);
+        _x86_64_lower.mc_pop_reg(VM_REGISTER_EBP);
     }
+}
 
-    // Pop all non-volatile general purpose registers which are used (in backwards order)
-    for (int i = VM_REGISTER_MAX - 1; i >= 0; i--)
+void poAsm::dumpAllocations(const bool functions) const
+{
+    const char* const names[] = { "graph", "linear" };
+    std::cout << "Register allocation:" << std::endl;
+    if (functions)
     {
-        if (!allocator.isVolatile(i) && allocator.isRegisterSet(i))
+        // One row per function: name, allocator, instructions, time (ms), spills, restores, moves, eliminated moves, code size
+        for (const poAsmAllocation& allocation : _allocations)
         {
-            _x86_64_lower.mc_pop_reg(i);
+            std::cout << "    " << std::left << std::setw(40) << allocation.function()
+                << " " << std::setw(8) << names[int(allocation.type())]
+                << " " << std::setw(8) << allocation.numInstructions()
+                << " " << std::setw(10) << std::fixed << std::setprecision(3) << allocation.milliseconds()
+                << " " << std::setw(8) << allocation.numSpills()
+                << " " << std::setw(8) << allocation.numRestores()
+                << " " << std::setw(8) << allocation.numMoves()
+                << " " << std::setw(8) << allocation.numEliminatedMoves()
+                << " " << allocation.codeSize() << std::endl;
         }
     }
- 
-    _x86_64_lower.mc_mov_reg_to_reg_x64(VM_REGISTER_ESP, VM_REGISTER_EBP);
-    _x86_64_lower.mc_pop_reg(VM_REGISTER_EBP);
+
+    for (const poRegAllocType type : { poRegAllocType::Graph, poRegAllocType::Linear })
+    {
+        int numFunctions = 0;
+        double milliseconds = 0.0;
+        int numSpills = 0;
+        int numRestores = 0;
+        int numMoves = 0;
+        int numEliminatedMoves = 0;
+        int codeSize = 0;
+        for (const poAsmAllocation& allocation : _allocations)
+        {
+            if (allocation.type() != type)
+            {
+                continue;
+            }
+
+            numFunctions++;
+            milliseconds += allocation.milliseconds();
+            numSpills += allocation.numSpills();
+            numRestores += allocation.numRestores();
+            numMoves += allocation.numMoves();
+            numEliminatedMoves += allocation.numEliminatedMoves();
+            codeSize += allocation.codeSize();
+        }
+
+        if (numFunctions == 0)
+        {
+            continue;
+        }
+
+        std::cout << "    " << names[int(type)] << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "functions" << numFunctions << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "time (ms)" << std::fixed << std::setprecision(3) << milliseconds << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "spills" << numSpills << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "restores" << numRestores << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "moves" << numMoves << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "eliminated" << numEliminatedMoves << std::endl;
+        std::cout << "        " << std::left << std::setw(16) << "code size" << codeSize << std::endl;
+    }
 }
 
-void poAsm::dump(const PO_ALLOCATOR& allocator, poRegLinearIterator& iterator, poFlowGraph& cfg)
+void poAsm::dump(const poRegAlloc& allocator, poRegLinearIterator& iterator, poFlowGraph& cfg)
 {
     std::cout << "###############" << std::endl;
     std::cout << "Stack Size: " << allocator.stackSize() << std::endl;
@@ -1976,7 +3717,7 @@ void poAsm::dump(const PO_ALLOCATOR& allocator, poRegLinearIterator& iterator, p
     std::cout << "###############" << std::endl;
 }
 
-void poAsm::spill(PO_ALLOCATOR& allocator, const int pos)
+void poAsm::spill(poRegAlloc& allocator, const int pos)
 {
     poRegSpill spill;
     int spillPos = 0;
@@ -1987,6 +3728,10 @@ void poAsm::spill(PO_ALLOCATOR& allocator, const int pos)
         {
             _x86_64_lower.mc_mov_reg_to_memory_x64(VM_REGISTER_ESP, 8 * slot, spill.spillRegister());
         }
+        else if (_vectors.find(spill.spillVariable()) != _vectors.end())
+        {
+            _x86_64_lower.mc_movdqu_reg_to_memory_x64(VM_REGISTER_ESP, spill.spillRegister() - VM_REGISTER_MAX, slot * 8);
+        }
         else
         {
             _x86_64_lower.mc_movsd_reg_to_memory_x64(VM_REGISTER_ESP, spill.spillRegister() - VM_REGISTER_MAX, slot * 8);
@@ -1994,7 +3739,7 @@ void poAsm::spill(PO_ALLOCATOR& allocator, const int pos)
     }
 }
 
-void poAsm::restore(PO_ALLOCATOR& allocator, const int pos)
+void poAsm::restore(poRegAlloc& allocator, const int pos)
 {
     /* if a variable we want to use has been spilled, we need to restore it */
 
@@ -2003,12 +3748,20 @@ void poAsm::restore(PO_ALLOCATOR& allocator, const int pos)
     while (allocator.restoreAt(pos, restorePos++, &restore))
     {
         const int restoreSlot = restore.restoreStackSlot();
-        if (restoreSlot != -1)
+        if (restore.isRematerialized())
+        {
+            rematerialize(allocator, restore);
+        }
+        else if (restoreSlot != -1)
         {
             if (restore.restoreRegister() < VM_REGISTER_MAX)
             {
                 _x86_64_lower.mc_mov_memory_to_reg_x64(restore.restoreRegister(), VM_REGISTER_ESP, restoreSlot * 8);
             }
+            else if (_vectors.find(restore.restoreVariable()) != _vectors.end())
+            {
+                _x86_64_lower.mc_movdqu_memory_to_reg_x64(restore.restoreRegister() - VM_REGISTER_MAX, VM_REGISTER_ESP, restoreSlot * 8);
+            }
             else
             {
                 _x86_64_lower.mc_movsd_memory_to_reg_x64(restore.restoreRegister() - VM_REGISTER_MAX, VM_REGISTER_ESP, restoreSlot * 8);
@@ -2017,9 +3770,114 @@ void poAsm::restore(PO_ALLOCATOR& allocator, const int pos)
     }
 }
 
-void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
+void poAsm::move(poRegAlloc& allocator, const int pos)
+{
+    /* moves between registers, in an order which doesn't overwrite a register before it is read */
+
+    poRegMove regMove;
+    int movePos = 0;
+    while (allocator.moveAt(pos, movePos++, &regMove))
+    {
+        _numMoves++;
+        move(regMove);
+    }
+}
+
+void poAsm::move(const poRegMove& move)
+{
+    if (move.dst() < VM_REGISTER_MAX)
+    {
+        if (move.isSwap())
+        {
+            _x86_64_lower.mc_xchg_reg_to_reg_x64(move.dst(), move.src());
+        }
+        else
+        {
+            _x86_64_lower.mc_mov_reg_to_reg_x64(move.dst(), move.src());
+        }
+    }
+    else if (move.isSwap())
+    {
+        // There is no exchange of SSE registers, so swap them with three xors
+        const int dst = move.dst() - VM_REGISTER_MAX;
+        const int src = move.src() - VM_REGISTER_MAX;
+        _x86_64_lower.mc_xorps_reg_to_reg_x64(dst, src);
+        _x86_64_lower.mc_xorps_reg_to_reg_x64(src, dst);
+        _x86_64_lower.mc_xorps_reg_to_reg_x64(dst, src);
+    }
+    else
+    {
+        _x86_64_lower.mc_movaps_reg_to_reg_x64(move.dst() - VM_REGISTER_MAX, move.src() - VM_REGISTER_MAX);
+    }
+}
+
+void poAsm::move(poParallelCopy& copy)
+{
+    std::vector<poRegMove> moves;
+    copy.sequentialize(moves);
+    for (const poRegMove& regMove : moves)
+    {
+        move(regMove);
+    }
+}
+
+void poAsm::rematerialize(poRegAlloc& allocator, const poRegRestore& restore)
+{
+    /* repeat the definition of a constant or stack address into the restore register */
+
+    const auto& it = _rematerialized.find(restore.restoreVariable());
+    if (it == _rematerialized.end())
+    {
+        std::stringstream ss;
+        ss << "Internal Error: Unable to rematerialize variable " << restore.restoreVariable();
+        setError(ss.str());
+        return;
+    }
+
+    const poInstruction& ins = *it->second;
+    const int dst = restore.restoreRegister();
+    switch (ins.code())
+    {
+    case IR_CONSTANT:
+        ir_constant(*_module, _module->constants(), dst, ins);
+        break;
+    case IR_PTR:
+    case IR_ELEMENT_PTR:
+        {
+            const int slot = allocator.getStackSlotByVariable(ins.left());
+            const int offset = slot * 8 + (ins.code() == IR_PTR ? ins.memOffset() : 0);
+            _x86_64_lower.mc_mov_reg_to_reg_x64(dst, VM_REGISTER_ESP);
+            _x86_64_lower.mc_add_imm_to_reg_x64(dst, offset);
+        }
+        break;
+    }
+}
+
+void poAsm::generate(poModule& module, poFunction& function)
 {
-    PO_ALLOCATOR allocator(module);
+    poFlowGraph& cfg = function.cfg();
+    const poCallLayout params = getParamLayout(function);
+    _callLayouts.clear();
+
+    // Graph coloring is too slow for very large functions, so those fall back to linear scan
+
+    int numInstructions = 0;
+    for (poBasicBlock* countBB = cfg.getFirst(); countBB != nullptr; countBB = countBB->getNext())
+    {
+        numInstructions += int(countBB->numInstructions());
+    }
+
+    poRegAllocType allocatorType = _allocator;
+    if (allocatorType == poRegAllocType::Graph &&
+        _linearScanThreshold > 0 &&
+        numInstructions > _linearScanThreshold)
+    {
+        allocatorType = poRegAllocType::Linear;
+    }
+
+    poRegGraph graph(module);
+    poRegLinear linear(module);
+    poRegAlloc& allocator = allocatorType == poRegAllocType::Graph ? static_cast<poRegAlloc&>(graph) : static_cast<poRegAlloc&>(linear);
     allocator.setNumRegisters(VM_REGISTER_MAX + VM_SSE_REGISTER_MAX);
     
     allocator.setVolatile(VM_REGISTER_ESP, true);
@@ -2043,7 +3901,7 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
     allocator.setVolatile(VM_SSE_ARG3 + VM_REGISTER_MAX, true);
     allocator.setVolatile(VM_SSE_ARG4 + VM_REGISTER_MAX, true);
 
-#ifdef _WIN32
+#ifdef WIN32
     allocator.setVolatile(VM_SSE_REGISTER_XMM4 + VM_REGISTER_MAX, true);
     allocator.setVolatile(VM_SSE_REGISTER_XMM5 + VM_REGISTER_MAX, true);
 #endif
@@ -2060,9 +3918,64 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
         allocator.setType(i, i < VM_REGISTER_MAX ? poRegType::General : poRegType::SSE);
     }
 
+    const auto allocationStart = std::chrono::steady_clock::now();
     allocator.allocateRegisters(cfg);
+    const std::chrono::duration<double, std::milli> allocationTime = std::chrono::steady_clock::now() - allocationStart;
+    _allocations.push_back(poAsmAllocation(function.fullname(),
+        allocatorType,
+        numInstructions,
+        allocationTime.count(),
+        allocator.numSpills(),
+        allocator.numRestores()));
     
     scanBasicBlocks(cfg);
+
+    // Block operations of a small known size are unrolled, arithmetic by a constant is
+    // strength reduced, and vectors are spilled whole. Constants are only trusted when
+    // nothing else assigns the same variable.
+    _module = &module;
+    _constants.clear();
+    _vectors.clear();
+    _rematerialized.clear();
+    std::unordered_map<int, int> definitions;
+    for (poBasicBlock* constantBB = cfg.getFirst(); constantBB != nullptr; constantBB = constantBB->getNext())
+    {
+        for (const poInstruction& ins : constantBB->instructions())
+        {
+            definitions[ins.name()]++;
+            if (isVectorType(ins.type()))
+            {
+                _vectors.insert(ins.name());
+            }
+        }
+    }
+
+    for (poBasicBlock* constantBB = cfg.getFirst(); constantBB != nullptr; constantBB = constantBB->getNext())
+    {
+        for (const poInstruction& ins : constantBB->instructions())
+        {
+            if (definitions[ins.name()] != 1)
+            {
+                continue;
+            }
+
+            // The definitions an allocator may repeat instead of restoring
+            if (ins.code() == IR_CONSTANT || ins.code() == IR_PTR || ins.code() == IR_ELEMENT_PTR)
+            {
+                _rematerialized.insert(std::pair<int, const poInstruction*>(ins.name(), &ins));
+            }
+
+            // Negative and cast literals are a unary minus or bitwise cast of the constant
+            int64_t value = 0;
+            const auto& operand = _constants.find(ins.left());
+            if ((ins.code() == IR_CONSTANT && getIntegerConstant(module.constants(), ins, value)) ||
+                (ins.code() == IR_BITWISE_CAST && operand != _constants.end() && wrapIntegerConstant(ins.type(), operand->second, value)) ||
+                (ins.code() == IR_UNARY_MINUS && operand != _constants.end() && wrapIntegerConstant(ins.type(), int64_t(0 - uint64_t(operand->second)), value)))
+            {
+                _constants.insert(std::pair<int, int64_t>(ins.name(), value));
+            }
+        }
+    }
     
     allocator.iterator().reset();
     if (_debugDump)
@@ -2079,8 +3992,17 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
     _x86_64_lower.cfg().addBasicBlock(asmBB);
 
     // Prologue
+    _isLeaf = _omitFramePointer && isLeafFunction(cfg);
+    _numMoves = 0;
+    _numEliminatedMoves = 0;
     generatePrologue(allocator);
 
+    // Frame addresses could be handed to the callee, which would outlive our frame
+    const bool tailCalls = _tailCalls && !hasAlloca(cfg);
+    poTailCall tailCall = poTailCall::None;
+    int tailCallPos = -1;
+    int resultRegister = -1; // where the second eightbyte of the last call returning a struct is
+
     int pos = 0;
     poBasicBlock* bb = cfg.getFirst();
     while (bb)
@@ -2098,11 +4020,21 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
 
             assert(ins.code() != IR_ARG); // args are handled in the call
             
-#ifdef REG_LINEAR
-            spill(allocator, pos);
-#endif
+            if (!allocator.spillsAfterDefinition())
+            {
+                spill(allocator, pos);
+            }
+            move(allocator, pos);
             restore(allocator, pos);
 
+            // A rematerialized definition is repeated at each of its uses instead
+            if (allocator.isRematerialized(ins.name()))
+            {
+                pos++;
+                allocator.iterator().next();
+                continue;
+            }
+
             switch (ins.code())
             {
             case IR_ELEMENT_PTR:
@@ -2152,15 +4084,104 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
                     args.push_back(instructions[i + j + 1]);
                 }
 
-                ir_call(module, allocator, ins, pos, args);
-#ifdef REG_GRAPH
-                spill(allocator, pos); // do the spill for the call
-#endif
+                const int resultPos = i + ins.left() + 1;
+                if (resultPos < int(instructions.size()) && instructions[resultPos].code() == IR_RESULT)
+                {
+                    int first = -1;
+                    getResultRegisters(ins.type(), instructions[resultPos].type(), first, resultRegister);
+                }
+
+                tailCall = tailCalls ? findTailCall(module, function, instructions, i) : poTailCall::None;
+                if (tailCall == poTailCall::None)
+                {
+                    ir_call(module, allocator, ins, pos, args);
+                }
+                else
+                {
+                    ir_call_args(module, allocator, ins, pos, args, tailCall == poTailCall::Loop);
+                    tailCallPos = i;
+                }
+                if (allocator.spillsAfterDefinition())
+                {
+                    spill(allocator, pos); // do the spill for the call
+                }
+                i += ins.left();
+                pos += ins.left();
+                allocator.iterator().advance(ins.left());
+            }
+                break;
+            case IR_COPY_MEMORY:
+            case IR_FILL_MEMORY:
+            {
+                std::vector<poInstruction> args;
+                for (int j = 0; j < ins.left(); j++)
+                {
+                    args.push_back(instructions[i + j + 1]);
+                }
+
+                if (ins.code() == IR_COPY_MEMORY)
+                {
+                    ir_copy_memory(allocator, pos, args);
+                }
+                else
+                {
+                    ir_fill_memory(allocator, pos, args);
+                }
+
+                if (allocator.spillsAfterDefinition())
+                {
+                    spill(allocator, pos);
+                }
+                i += ins.left();
+                pos += ins.left();
+                allocator.iterator().advance(ins.left());
+            }
+                break;
+            case IR_VECTOR_SUM:
+            case IR_VECTOR_MAP:
+            case IR_VECTOR_FIND:
+            {
+                std::vector<poInstruction> args;
+                for (int j = 0; j < ins.left(); j++)
+                {
+                    args.push_back(instructions[i + j + 1]);
+                }
+
+                if (ins.code() == IR_VECTOR_SUM)
+                {
+                    ir_vector_sum(allocator, ins, pos, args);
+                }
+                else if (ins.code() == IR_VECTOR_MAP)
+                {
+                    ir_vector_map(module, allocator, ins, pos, args);
+                }
+                else
+                {
+                    ir_vector_find(allocator, ins, pos, args);
+                }
+
+                if (allocator.spillsAfterDefinition())
+                {
+                    spill(allocator, pos);
+                }
                 i += ins.left();
                 pos += ins.left();
                 allocator.iterator().advance(ins.left());
             }
                 break;
+            case IR_VECTOR_SPLAT:
+                ir_vector_splat(allocator, ins);
+                break;
+            case IR_VECTOR_EQUALS:
+            case IR_VECTOR_GREATER:
+                ir_vector_compare(allocator, ins);
+                break;
+            case IR_VECTOR_SHUFFLE:
+                ir_vector_shuffle(allocator, ins);
+                break;
+            case IR_VECTOR_MOVEMASK:
+                ir_vector_movemask(allocator, ins);
+                break;
             case IR_CMP:
                 ir_cmp(module, allocator, ins);
                 break;
@@ -2180,13 +4201,24 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
                 ir_mul(allocator, ins);
                 break;
             case IR_PARAM:
-                ir_param(module, allocator, ins, numArgs);
+                ir_param(module, allocator, ins, params);
                 break;
             case IR_PHI:
                 // do nothing
                 break;
+            case IR_RESULT:
+                ir_result(allocator, ins, resultRegister);
+                break;
             case IR_RETURN:
-                ir_ret(module, allocator, ins);
+                if (tailCall != poTailCall::None)
+                {
+                    ir_tail_call(allocator, instructions[tailCallPos], tailCall, bb, cfg);
+                    tailCall = poTailCall::None;
+                }
+                else
+                {
+                    ir_ret(module, allocator, ins);
+                }
                 break;
             case IR_RIGHT_SHIFT:
                 ir_shr(allocator, ins);
@@ -2202,9 +4234,10 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
                 break;
             }
 
-#ifdef REG_GRAPH
-            spill(allocator, pos);
-#endif
+            if (allocator.spillsAfterDefinition())
+            {
+                spill(allocator, pos);
+            }
 
             pos++;
             allocator.iterator().next();
@@ -2214,7 +4247,20 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
     }
 
     poAnalyzer an;
-    an.checkCallSites(module, _x86_64_lower.cfg());
+    an.checkCallSites(_x86_64_lower.cfg(), _callLayouts, _isRedZone ? _frameSize : 0);
+
+    // Chain blocks so the hot paths fall through, moving cold blocks out of the way
+    if (_blockLayout)
+    {
+        poBlockLayout layout;
+        layout.layout(module, _x86_64_lower.cfg());
+    }
+
+    // Clean up redundant instructions left behind by lowering
+    if (_peephole)
+    {
+        _peepholeOptimizer.optimize(_x86_64_lower.cfg());
+    }
 
     // Generate the machine code
     //
@@ -2223,12 +4269,19 @@ void poAsm::generate(poModule& module, poFlowGraph& cfg, const int numArgs)
     {
         _x86_64_lower.dump();
     }
+
+    const int programSize = int(_x86_64.programData().size());
     generateMachineCode(module);
+    _allocations.back().setCodeSize(int(_x86_64.programData().size()) - programSize);
+    _allocations.back().setMoves(_numMoves, _numEliminatedMoves);
 }
 
 void poAsm::generateMachineCode(poModule& module)
 {
-    poConstantPool& constants = module.constants();
+    if (_branchRelaxation)
+    {
+        relaxJumps(module);
+    }
 
     po_x86_64_basic_block* asmBB = nullptr;
     for (size_t i = 0; i < _x86_64_lower.cfg().basicBlocks().size(); i++)
@@ -2239,292 +4292,502 @@ void poAsm::generateMachineCode(poModule& module)
 
         for (auto& ins : asmBB->instructions())
         {
-            const int pos = int(_x86_64.programData().size());
-            if (ins.isSSE())
+            generateInstruction(module, asmBB, ins);
+        }
+    }
+}
+
+void poAsm::relaxJumps(poModule& module)
+{
+    std::vector<po_x86_64_basic_block*>& basicBlocks = _x86_64_lower.cfg().basicBlocks();
+    const int numBlocks = int(basicBlocks.size());
+
+    std::unordered_map<po_x86_64_basic_block*, int> blockIndex;
+    for (int i = 0; i < numBlocks; i++)
+    {
+        po_x86_64_basic_block* bb = basicBlocks[i];
+        blockIndex.insert(std::pair<po_x86_64_basic_block*, int>(bb, i));
+
+        // Only jumps which terminate a block can be relaxed
+        const std::vector<po_x86_64_instruction>& ins = bb->instructions();
+        for (int j = 0; j < int(ins.size()) - 1; j++)
+        {
+            if (ins[j].isJump())
+            {
+                return;
+            }
+        }
+    }
+
+    // Remove jumps to the block which follows, skipping over any empty blocks
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        po_x86_64_basic_block* bb = basicBlocks[i];
+        std::vector<po_x86_64_instruction>& ins = bb->instructions();
+        if (ins.size() == 0 || !ins.back().isJump())
+        {
+            continue;
+        }
+
+        po_x86_64_basic_block* targetBB = bb->jumpBlock();
+        int next = i + 1;
+        while (next < numBlocks &&
+            basicBlocks[next] != targetBB &&
+            basicBlocks[next]->instructions().size() == 0)
+        {
+            next++;
+        }
+
+        if (next < numBlocks && basicBlocks[next] == targetBB)
+        {
+            ins.pop_back();
+            bb->setJumpTarget(nullptr);
+
+            std::vector<po_x86_64_basic_block*>& incoming = targetBB->incomingBlocks();
+            incoming.erase(std::remove(incoming.begin(), incoming.end(), bb), incoming.end());
+        }
+    }
+
+    // Measure each block without its jump. The block is encoded as normal, but the
+    // output and anything recorded for patching is thrown away afterwards.
+
+    std::vector<int> blockSize(numBlocks);
+    {
+        poAsmDataBuffer readOnlyData;
+        poAsmDataBuffer initializedData;
+        std::vector<poAsmCall> calls;
+        std::vector<poAsmCall> unknownCalls;
+        std::swap(_readOnlyData, readOnlyData);
+        std::swap(_initializedData, initializedData);
+        std::swap(_calls, calls);
+        std::swap(_unknownCalls, unknownCalls);
+
+        const size_t start = _x86_64.programData().size();
+        for (int i = 0; i < numBlocks; i++)
+        {
+            po_x86_64_basic_block* bb = basicBlocks[i];
+            const size_t pos = _x86_64.programData().size();
+            for (const po_x86_64_instruction& ins : bb->instructions())
             {
-                switch (ins.opcode())
+                if (!ins.isJump())
                 {
-                case VMI_SSE_MOVSD_SRC_MEM_DST_REG:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_movsd_memory_to_reg_x64(ins.dstReg(), 0);
-                        _readOnlyData.addData(ins.id(), constants.getF64(ins.id()), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                    }
-                    else
-                    {
-                        _x86_64.mc_movsd_memory_to_reg_x64(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_SSE_MOVSS_SRC_MEM_DST_REG:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_movss_memory_to_reg_x64(ins.dstReg(), 0);
-                        _readOnlyData.addData(ins.id(), constants.getF32(ins.id()), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                    }
-                    else
-                    {
-                        _x86_64.mc_movss_memory_to_reg_x64(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                default:
-                    _x86_64.emit(ins);
-                    break;
+                    generateInstruction(module, bb, ins);
                 }
             }
+            blockSize[i] = int(_x86_64.programData().size() - pos);
+        }
+        _x86_64.programData().resize(start);
+
+        std::swap(_readOnlyData, readOnlyData);
+        std::swap(_initializedData, initializedData);
+        std::swap(_calls, calls);
+        std::swap(_unknownCalls, unknownCalls);
+    }
+
+    // Start with every jump short and grow any which do not reach, until nothing changes
+
+    std::vector<int> jumpTarget(numBlocks, -1);
+    std::vector<bool> isLong(numBlocks, false);
+    for (int i = 0; i < numBlocks; i++)
+    {
+        po_x86_64_basic_block* bb = basicBlocks[i];
+        const std::vector<po_x86_64_instruction>& ins = bb->instructions();
+        if (ins.size() == 0 || !ins.back().isJump())
+        {
+            continue;
+        }
+
+        const auto& target = blockIndex.find(bb->jumpBlock());
+        if (target == blockIndex.end())
+        {
+            continue;
+        }
+
+        jumpTarget[i] = target->second;
+        isLong[i] = jumpSize(ins.back().opcode()) != 2 && shortJump(ins.back().opcode()) == ins.back().opcode();
+    }
+
+    std::vector<int> blockPos(numBlocks);
+    bool changes = true;
+    while (changes)
+    {
+        changes = false;
+
+        int pos = 0;
+        for (int i = 0; i < numBlocks; i++)
+        {
+            blockPos[i] = pos;
+            pos += blockSize[i];
+            if (jumpTarget[i] != -1)
+            {
+                pos += isLong[i] ? jumpSize(basicBlocks[i]->instructions().back().opcode()) : 2;
+            }
+        }
+
+        for (int i = 0; i < numBlocks; i++)
+        {
+            if (jumpTarget[i] == -1 || isLong[i])
+            {
+                continue;
+            }
+
+            const int imm = blockPos[jumpTarget[i]] - (blockPos[i] + blockSize[i] + 2);
+            if (!fitsShortJump(imm))
+            {
+                isLong[i] = true;
+                changes = true;
+            }
+        }
+    }
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        if (jumpTarget[i] == -1 || isLong[i])
+        {
+            continue;
+        }
+
+        po_x86_64_instruction& jump = basicBlocks[i]->instructions().back();
+        jump = po_x86_64_instruction(false, shortJump(jump.opcode()), -1, -1, int32_t(0));
+    }
+}
+
+void poAsm::generateInstruction(poModule& module, po_x86_64_basic_block* asmBB, const po_x86_64_instruction& ins)
+{
+    poConstantPool& constants = module.constants();
+
+    if (ins.isSSE())
+    {
+        switch (ins.opcode())
+        {
+        case VMI_SSE_MOVSD_SRC_MEM_DST_REG:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_movsd_memory_to_reg_x64(ins.dstReg(), 0);
+                _readOnlyData.addData(ins.id(), constants.getF64(ins.id()), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+            }
             else
             {
-                switch (ins.opcode())
-                {
-                case VMI_CALL:
-                case VMI_CALL_MEM:
-                {
-                    const int symbol = ins.id();
-                    std::string symbolName;
-                    module.getSymbol(symbol, symbolName);
+                _x86_64.mc_movsd_memory_to_reg_x64(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_SSE_MOVSS_SRC_MEM_DST_REG:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_movss_memory_to_reg_x64(ins.dstReg(), 0);
+                _readOnlyData.addData(ins.id(), constants.getF32(ins.id()), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+            }
+            else
+            {
+                _x86_64.mc_movss_memory_to_reg_x64(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        default:
+            _x86_64.emit(ins);
+            break;
+        }
+    }
+    else
+    {
+        switch (ins.opcode())
+        {
+        case VMI_CALL:
+        case VMI_CALL_MEM:
+        {
+            const int symbol = ins.id();
+            std::string symbolName;
+            module.getSymbol(symbol, symbolName);
 
 #ifdef WIN32
-                    // Add patch for this call
+            // Add patch for this call
 
-                    _calls.push_back(poAsmCall(int(_x86_64.programData().size()), 0/*numArgs*/, symbolName));
-                    _x86_64.mc_call(0); // Placeholder for the call
+            _calls.push_back(poAsmCall(int(_x86_64.programData().size()), 0/*numArgs*/, symbolName));
+            _x86_64.mc_call(0); // Placeholder for the call
 #else
-                    // If it is Linux and an external call we need to call into the PLT
+            // If it is Linux and an external call we need to call into the PLT
+
+            _unknownCalls.push_back( poAsmCall(int(_x86_64.programData().size()), 0/*numArgs*/, symbolName) );
+            _x86_64.mc_call(0); // Placeholder for the call                                           
+#endif
+        }
+        break;
+        case VMI_TAIL_CALL:
+        {
+            // Patched the same way as a call, only the opcode differs
+
+            const int symbol = ins.id();
+            std::string symbolName;
+            module.getSymbol(symbol, symbolName);
 
-                    _unknownCalls.push_back( poAsmCall(int(_x86_64.programData().size()), 0/*numArgs*/, symbolName) );
-                    _x86_64.mc_call(0); // Placeholder for the call                                           
+#ifdef WIN32
+            _calls.push_back(poAsmCall(int(_x86_64.programData().size()), 0/*numArgs*/, symbolName));
+#else
+            _unknownCalls.push_back(poAsmCall(int(_x86_64.programData().size()), 0/*numArgs*/, symbolName));
 #endif
+            _x86_64.mc_tail_call(0); // Placeholder for the jump
+        }
+        break;
+        case VMI_SAR8_SRC_IMM_DST_REG:
+            _x86_64.mc_sar_imm_to_reg_8(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_SAR16_SRC_IMM_DST_REG:
+            _x86_64.mc_sar_imm_to_reg_16(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_SAR64_SRC_IMM_DST_REG:
+            _x86_64.mc_sar_imm_to_reg_x64(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_SAL64_SRC_IMM_DST_REG:
+            _x86_64.mc_sal_imm_to_reg_x64(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_SHR64_SRC_IMM_DST_REG:
+            _x86_64.mc_shr_imm_to_reg_x64(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_CDQE:
+            _x86_64.mc_cdqe();
+            break;
+        case VMI_CQO:
+            _x86_64.mc_cqo();
+            break;
+        case VMI_CDQ:
+            _x86_64.mc_cdq();
+            break;
+        case VMI_CWD:
+            _x86_64.mc_cwd();
+            break;
+        case VMI_CBW:
+            _x86_64.mc_cbw();
+            break;
+        case VMI_REP_MOVSB:
+            _x86_64.mc_rep_movsb();
+            break;
+        case VMI_REP_STOSB:
+            _x86_64.mc_rep_stosb();
+            break;
+        case VMI_PUSH_REG:
+            _x86_64.mc_push_reg(ins.dstReg());
+            break;
+        case VMI_POP_REG:
+            _x86_64.mc_pop_reg(ins.dstReg());
+            break;
+        case VMI_NEAR_RETURN:
+            _x86_64.mc_return();
+            break;
+        case VMI_ADD64_SRC_IMM_DST_REG:
+            _x86_64.mc_add_imm_to_reg_x64(ins.dstReg(), int(ins.imm64()));
+            break;
+        case VMI_MOV64_SRC_IMM_DST_REG:
+            _x86_64.mc_mov_imm_to_reg_x64(ins.dstReg(), ins.imm64());
+            break;
+        case VMI_SUB64_SRC_IMM_DST_REG:
+            _x86_64.mc_sub_imm_to_reg_x64(ins.dstReg(), int(ins.imm64()));
+            break;
+        case VMI_MOV32_SRC_IMM_DST_REG:
+            _x86_64.mc_mov_imm_to_reg_32(ins.dstReg(), ins.imm32());
+            break;
+        case VMI_MOV16_SRC_IMM_DST_REG:
+            _x86_64.mc_mov_imm_to_reg_16(ins.dstReg(), ins.imm16());
+            break;
+        case VMI_ADD8_SRC_IMM_DST_REG:
+            _x86_64.mc_add_imm_to_reg_8(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_MOV8_SRC_IMM_DST_REG:
+            _x86_64.mc_mov_imm_to_reg_8(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_SUB8_SRC_IMM_DST_REG:
+            _x86_64.mc_sub_imm_to_reg_8(ins.dstReg(), ins.imm8());
+            break;
+        case VMI_LEA64_SRC_REG_DST_REG:
+            _x86_64.mc_lea_reg_to_reg_x64(ins.dstReg(), 0);
+            _readOnlyData.addData(ins.id(), constants.getString(ins.id()), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+            break;
+        case VMI_MOV64_SRC_MEM_DST_REG:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_memory_to_reg_x64(ins.dstReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I64)
+                {
+                    _initializedData.addData(ins.id(), constants.getI64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
                 }
-                break;
-                case VMI_SAR8_SRC_IMM_DST_REG:
-                    _x86_64.mc_sar_imm_to_reg_8(ins.dstReg(), ins.imm8());
-                    break;
-                case VMI_SAR16_SRC_IMM_DST_REG:
-                    _x86_64.mc_sar_imm_to_reg_16(ins.dstReg(), ins.imm8());
-                    break;
-                case VMI_CDQE:
-                    _x86_64.mc_cdqe();
-                    break;
-                case VMI_PUSH_REG:
-                    _x86_64.mc_push_reg(ins.dstReg());
-                    break;
-                case VMI_POP_REG:
-                    _x86_64.mc_pop_reg(ins.dstReg());
-                    break;
-                case VMI_NEAR_RETURN:
-                    _x86_64.mc_return();
-                    break;
-                case VMI_ADD64_SRC_IMM_DST_REG:
-                    _x86_64.mc_add_imm_to_reg_x64(ins.dstReg(), int(ins.imm64()));
-                    break;
-                case VMI_MOV64_SRC_IMM_DST_REG:
-                    _x86_64.mc_mov_imm_to_reg_x64(ins.dstReg(), ins.imm64());
-                    break;
-                case VMI_SUB64_SRC_IMM_DST_REG:
-                    _x86_64.mc_sub_imm_to_reg_x64(ins.dstReg(), int(ins.imm64()));
-                    break;
-                case VMI_MOV32_SRC_IMM_DST_REG:
-                    _x86_64.mc_mov_imm_to_reg_32(ins.dstReg(), ins.imm32());
-                    break;
-                case VMI_MOV16_SRC_IMM_DST_REG:
-                    _x86_64.mc_mov_imm_to_reg_16(ins.dstReg(), ins.imm16());
-                    break;
-                case VMI_ADD8_SRC_IMM_DST_REG:
-                    _x86_64.mc_add_imm_to_reg_8(ins.dstReg(), ins.imm8());
-                    break;
-                case VMI_MOV8_SRC_IMM_DST_REG:
-                    _x86_64.mc_mov_imm_to_reg_8(ins.dstReg(), ins.imm8());
-                    break;
-                case VMI_SUB8_SRC_IMM_DST_REG:
-                    _x86_64.mc_sub_imm_to_reg_8(ins.dstReg(), ins.imm8());
-                    break;
-                case VMI_LEA64_SRC_REG_DST_REG:
-                    _x86_64.mc_lea_reg_to_reg_x64(ins.dstReg(), 0);
-                    _readOnlyData.addData(ins.id(), constants.getString(ins.id()), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                    break;
-                case VMI_MOV64_SRC_MEM_DST_REG:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_memory_to_reg_x64(ins.dstReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I64)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_memory_to_reg_x64(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_MOV64_SRC_REG_DST_MEM:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_reg_to_memory_x64(0, ins.srcReg());
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I64)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_reg_to_memory_x64(ins.dstReg(), ins.imm32(), ins.srcReg());
-                    }
-                    break;
-                case VMI_MOV32_SRC_MEM_DST_REG:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_mem_to_reg_32(ins.dstReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I32)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_mem_to_reg_32(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_MOV32_SRC_REG_DST_MEM:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_reg_to_mem_32(ins.srcReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I32)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_reg_to_mem_32(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_MOV16_SRC_MEM_DST_REG:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_mem_to_reg_16(ins.dstReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I16)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_mem_to_reg_16(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_MOV16_SRC_REG_DST_MEM:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_reg_to_mem_16(ins.srcReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I16)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_reg_to_mem_16(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_MOV8_SRC_MEM_DST_REG:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_memory_to_reg_8(ins.dstReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I8)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_memory_to_reg_8(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_MOV8_SRC_REG_DST_MEM:
-                    if (ins.id() != -1)
-                    {
-                        _x86_64.mc_mov_reg_to_memory_8(ins.srcReg(), 0);
-                        const poStaticVariable& var = module.staticVariables()[(ins.id())];
-                        const int id = var.constantId();
-                        if (var.type() == TYPE_I8)
-                        {
-                            _initializedData.addData(ins.id(), constants.getI8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                        else
-                        {
-                            _initializedData.addData(ins.id(), constants.getU8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
-                        }
-                    }
-                    else
-                    {
-                        _x86_64.mc_mov_reg_to_memory_8(ins.dstReg(), ins.srcReg(), ins.imm32());
-                    }
-                    break;
-                case VMI_J8:
-                case VMI_JE8:
-                case VMI_JG8:
-                case VMI_JGE8:
-                case VMI_JL8:
-                case VMI_JLE8:
-                case VMI_J32:
-                case VMI_JE32:
-                case VMI_JG32:
-                case VMI_JGE32:
-                case VMI_JL32:
-                case VMI_JLE32:
-                case VMI_JNA32:
-                case VMI_JNB32:
-                case VMI_JNBE32:
-                case VMI_JNE32:
-                case VMI_JNAE32:
-                    emitJump(asmBB);
-                    break;
-                default:
-                    _x86_64.emit(ins);
-                    break;
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_memory_to_reg_x64(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_MOV64_SRC_REG_DST_MEM:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_reg_to_memory_x64(0, ins.srcReg());
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I64)
+                {
+                    _initializedData.addData(ins.id(), constants.getI64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU64(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_reg_to_memory_x64(ins.dstReg(), ins.imm32(), ins.srcReg());
+            }
+            break;
+        case VMI_MOV32_SRC_MEM_DST_REG:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_mem_to_reg_32(ins.dstReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I32)
+                {
+                    _initializedData.addData(ins.id(), constants.getI32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_mem_to_reg_32(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_MOV32_SRC_REG_DST_MEM:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_reg_to_mem_32(ins.srcReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I32)
+                {
+                    _initializedData.addData(ins.id(), constants.getI32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU32(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_reg_to_mem_32(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_MOV16_SRC_MEM_DST_REG:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_mem_to_reg_16(ins.dstReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I16)
+                {
+                    _initializedData.addData(ins.id(), constants.getI16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_mem_to_reg_16(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_MOV16_SRC_REG_DST_MEM:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_reg_to_mem_16(ins.srcReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I16)
+                {
+                    _initializedData.addData(ins.id(), constants.getI16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU16(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_reg_to_mem_16(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_MOV8_SRC_MEM_DST_REG:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_memory_to_reg_8(ins.dstReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I8)
+                {
+                    _initializedData.addData(ins.id(), constants.getI8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+            }
+            else
+            {
+                _x86_64.mc_mov_memory_to_reg_8(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_MOV8_SRC_REG_DST_MEM:
+            if (ins.id() != -1)
+            {
+                _x86_64.mc_mov_reg_to_memory_8(ins.srcReg(), 0);
+                const poStaticVariable& var = module.staticVariables()[(ins.id())];
+                const int id = var.constantId();
+                if (var.type() == TYPE_I8)
+                {
+                    _initializedData.addData(ins.id(), constants.getI8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
+                }
+                else
+                {
+                    _initializedData.addData(ins.id(), constants.getU8(id), _x86_64.programData().size(), -int(sizeof(int32_t))); // insert patch
                 }
             }
+            else
+            {
+                _x86_64.mc_mov_reg_to_memory_8(ins.dstReg(), ins.srcReg(), ins.imm32());
+            }
+            break;
+        case VMI_J8:
+        case VMI_JE8:
+        case VMI_JNE8:
+        case VMI_JG8:
+        case VMI_JGE8:
+        case VMI_JL8:
+        case VMI_JLE8:
+        case VMI_JNA8:
+        case VMI_JNAE8:
+        case VMI_JNB8:
+        case VMI_JNBE8:
+        case VMI_J32:
+        case VMI_JE32:
+        case VMI_JG32:
+        case VMI_JGE32:
+        case VMI_JL32:
+        case VMI_JLE32:
+        case VMI_JNA32:
+        case VMI_JNB32:
+        case VMI_JNBE32:
+        case VMI_JNE32:
+        case VMI_JNAE32:
+            emitJump(asmBB);
+            break;
+        default:
+            _x86_64.emit(ins);
+            break;
         }
     }
 }
@@ -2598,7 +4861,7 @@ void poAsm::generate(poModule& module)
         else
         {
             _mapping.insert(std::pair<std::string, int>(function.fullname(), int(_x86_64.programData().size())));
-            generate(module, function.cfg(), int(function.args().size()));
+            generate(module, function);
         }
     }
 
@@ -2718,10 +4981,11 @@ void poAsm::patchCalls()
 
         if (it != _mapping.end())
         {
+            // Only the displacement is patched, the opcode may be a call or a tail call jump
             const int size = 5;
             const int dataPos = int(_x86_64.programData().size());
             _x86_64.mc_call(it->second - pos);
-            memcpy(_x86_64.programData().data() + pos, _x86_64.programData().data() + dataPos, size);
+            memcpy(_x86_64.programData().data() + pos + 1, _x86_64.programData().data() + dataPos + 1, size - 1);
             _x86_64.programData().resize(_x86_64.programData().size() - size);
         }
         else
@@ -2810,7 +5074,7 @@ void poAsm::link(const int programDataPos, const int initializedDataPos, const i
         const int size = 5;
         const int dataPos = int(_x86_64.programData().size());
         _x86_64.mc_call(disp32);
-        memcpy(_x86_64.programData().data() + externCall.programPos(), _x86_64.programData().data() + dataPos, size);
+        memcpy(_x86_64.programData().data() + externCall.programPos() + 1, _x86_64.programData().data() + dataPos + 1, size - 1);
         _x86_64.programData().resize(_x86_64.programData().size() - size);
 #endif
     }
@@ -1,27 +1,15 @@
 #pragma once
-#include "poPhiWeb.h"
 #include "po_x86_64.h"
+#include "poPeephole.h"
+#include "poRegAlloc.h"
+#include "poCallLayout.h"
+#include "poParallelCopy.h"
 
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 
-// Choose the register allocator to use here
-
-#define REG_GRAPH
-//#define REG_LINEAR
-
-#ifdef REG_LINEAR
-#define PO_ALLOCATOR poRegLinear
-#endif
-#ifdef REG_GRAPH
-#define PO_ALLOCATOR poRegGraph
-#endif
-#ifndef PO_ALLOCATOR
-#error "No register allocator defined"
-#endif
-
 namespace po
 {
     class poFlowGraph;
@@ -31,7 +19,15 @@ namespace po
     class poRegLinearIterator;
     class poConstantPool;
     class poBasicBlock;
-    class PO_ALLOCATOR;
+
+    constexpr int LINEAR_SCAN_THRESHOLD = 5000; // Instructions in a function before graph coloring is too slow
+
+    enum class poTailCall
+    {
+        None,
+        Sibling, // Tear down the frame and jump to the callee
+        Loop // Self recursion, jump back to the start of the function
+    };
 
     enum class poRelocationType
     {
@@ -77,6 +73,41 @@ namespace po
         int _dst;
     };
 
+    class poAsmAllocation
+    {
+    public:
+        poAsmAllocation(const std::string& function,
+            const poRegAllocType type,
+            const int numInstructions,
+            const double milliseconds,
+            const int numSpills,
+            const int numRestores);
+
+        inline void setCodeSize(const int codeSize) { _codeSize = codeSize; }
+        inline void setMoves(const int numMoves, const int numEliminatedMoves) { _numMoves = numMoves; _numEliminatedMoves = numEliminatedMoves; }
+
+        inline const std::string& function() const { return _function; }
+        inline const poRegAllocType type() const { return _type; }
+        inline const int numInstructions() const { return _numInstructions; }
+        inline const double milliseconds() const { return _milliseconds; }
+        inline const int numSpills() const { return _numSpills; }
+        inline const int numRestores() const { return _numRestores; }
+        inline const int codeSize() const { return _codeSize; }
+        inline const int numMoves() const { return _numMoves; }
+        inline const int numEliminatedMoves() const { return _numEliminatedMoves; }
+
+    private:
+        std::string _function;
+        poRegAllocType _type;
+        int _numInstructions;
+        double _milliseconds; /* time taken to allocate the registers */
+        int _numSpills;
+        int _numRestores;
+        int _codeSize; /* bytes of machine code emitted for the function */
+        int _numMoves; /* register to register moves and swaps emitted, for copy instructions or the allocator's own moves */
+        int _numEliminatedMoves; /* copies which needed no move, as both sides share a register */
+    };
+
     class poAsmBasicBlock
     {
     public:
@@ -203,57 +234,100 @@ namespace po
         inline bool isError() const { return _isError; }
         inline const std::string& errorText() const { return _errorText; }
         inline void setDebugDump(const bool debugDump) { _debugDump = debugDump; }
+        inline void setBlockLayout(const bool blockLayout) { _blockLayout = blockLayout; }
+        inline void setBranchRelaxation(const bool branchRelaxation) { _branchRelaxation = branchRelaxation; }
+        inline void setPeephole(const bool peephole) { _peephole = peephole; }
+        inline void setTailCalls(const bool tailCalls) { _tailCalls = tailCalls; }
+        inline void setOmitFramePointer(const bool omitFramePointer) { _omitFramePointer = omitFramePointer; }
+        inline void setAllocator(const poRegAllocType allocator) { _allocator = allocator; }
+        inline void setLinearScanThreshold(const int numInstructions) { _linearScanThreshold = numInstructions; }
+        inline const poPeephole& peepholeOptimizer() const { return _peepholeOptimizer; }
+        inline const std::vector<poAsmAllocation>& allocations() const { return _allocations; }
+        void dumpAllocations(const bool functions) const;
 
     private:
-        void dump(const PO_ALLOCATOR& linear, poRegLinearIterator& iterator, poFlowGraph& cfg);
+        void dump(const poRegAlloc& allocator, poRegLinearIterator& iterator, poFlowGraph& cfg);
 
-        void spill(PO_ALLOCATOR& linear, const int pos);
-        void restore(PO_ALLOCATOR& linear, const int pos);
+        void spill(poRegAlloc& allocator, const int pos);
+        void restore(poRegAlloc& allocator, const int pos);
+        void move(poRegAlloc& allocator, const int pos);
+        void move(const poRegMove& move);
+        void move(poParallelCopy& copy);
+        void rematerialize(poRegAlloc& allocator, const poRegRestore& restore);
 
-        void generate(poModule& module, poFlowGraph& cfg, const int numArgs);
+        void generate(poModule& module, poFunction& function);
         void generateMachineCode(poModule& module);
+        void generateInstruction(poModule& module, po_x86_64_basic_block* asmBB, const po_x86_64_instruction& ins);
+        void relaxJumps(poModule& module);
         void generateExternStub(poModule& module, poFlowGraph& cfg);
         void generateExternStub(const poFunction& function);
         void patchForwardJumps(po_x86_64_basic_block* bb);
         void scanBasicBlocks(poFlowGraph& cfg);
         void patchJump(po_x86_64_basic_block* jump);
         void patchCalls();
-        void generatePrologue(PO_ALLOCATOR& linear);
-        void generateEpilogue(PO_ALLOCATOR& linear);
+        void generatePrologue(poRegAlloc& allocator);
+        void generateEpilogue(poRegAlloc& allocator);
+        inline bool hasStackAdjustment() const { return !_isLeaf || (_frameSize > 0 && !_isRedZone); }
         void setError(const std::string& errorText);
 
         void emitJump(po_x86_64_basic_block* bb);
         bool isEnum(poModule& module, const poInstruction& ins);
+        poTailCall findTailCall(poModule& module, const poFunction& function, const std::vector<poInstruction>& instructions, const int pos);
 
         //=====================================
         // IR to machine code routines
         //=====================================
 
-        void ir_element_ptr(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_ptr(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_store(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_load(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_zero_extend(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_sign_extend(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_bitwise_cast(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_convert(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_add(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_sub(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_mul(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_div(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_mod(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_cmp(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_br(PO_ALLOCATOR& allocator, const poInstruction& ins, poBasicBlock* bb);
-        void ir_constant(poModule& module, poConstantPool& constants, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_copy(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_ret(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_unary_minus(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_call(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args);
-        void ir_param(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins, const int numArgs);
-        void ir_shl(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_shr(PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_load_global(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
-        void ir_store_global(poModule& module, PO_ALLOCATOR& allocator, const poInstruction& ins);
+        void ir_element_ptr(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_ptr(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_store(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_load(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_zero_extend(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_sign_extend(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_bitwise_cast(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_convert(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_add(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_sub(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_mul(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_div(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_mod(poRegAlloc& allocator, const poInstruction& ins);
+        bool ir_mul_constant(poRegAlloc& allocator, const poInstruction& ins);
+        bool ir_div_constant(poRegAlloc& allocator, const poInstruction& ins, const bool remainder);
+        void ir_widen(const int type, const int dst, const int src);
+        void ir_narrow(const int type, const int dst, const int src);
+        void ir_cmp(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_br(poRegAlloc& allocator, const poInstruction& ins, poBasicBlock* bb);
+        void ir_constant(poModule& module, poConstantPool& constants, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_constant(poModule& module, poConstantPool& constants, const int dst, const poInstruction& ins);
+        void ir_copy(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_ret(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_unary_minus(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_call(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args);
+        void ir_result(poRegAlloc& allocator, const poInstruction& ins, const int src);
+        void ir_call_args(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args, const bool loop);
+        void ir_block_args(poRegAlloc& allocator, const int pos, const std::vector<poInstruction>& args, const std::vector<int>& registers);
+        void ir_block_tail(const int dst, const int value, const int offset, const int size);
+        void ir_copy_memory(poRegAlloc& allocator, const int pos, const std::vector<poInstruction>& args);
+        void ir_fill_memory(poRegAlloc& allocator, const int pos, const std::vector<poInstruction>& args);
+        void ir_vector_sum(poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args);
+        void ir_vector_map(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args);
+        void ir_vector_find(poRegAlloc& allocator, const poInstruction& ins, const int pos, const std::vector<poInstruction>& args);
+        void ir_vector_broadcast(const int type, const int dst, const int src);
+        void ir_vector_op(const int type, const int op, const int dst, const int src);
+        void ir_vector_arithmetic(const int type, const int op, const int dst, const int src1, const int src2);
+        void ir_vector_splat(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_vector_compare(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_vector_shuffle(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_vector_movemask(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_vector_scalar_op(const int type, const int op, const bool isArray);
+        po_x86_64_basic_block* ir_vector_block(po_x86_64_basic_block* bb = nullptr);
+        void ir_vector_jump(po_x86_64_basic_block* target, const int jump);
+        void ir_tail_call(poRegAlloc& allocator, const poInstruction& ins, const poTailCall tailCall, poBasicBlock* bb, poFlowGraph& cfg);
+        void ir_param(poModule& module, poRegAlloc& allocator, const poInstruction& ins, const poCallLayout& params);
+        void ir_shl(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_shr(poRegAlloc& allocator, const poInstruction& ins);
+        void ir_load_global(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
+        void ir_store_global(poModule& module, poRegAlloc& allocator, const poInstruction& ins);
         bool ir_jump(const int jump, const int imm, const int type);
 
         std::vector<poRelocation> _pltRelocations;
@@ -269,7 +343,10 @@ namespace po
         poAsmDataBuffer _readOnlyData;
         poAsmDataBuffer _initializedData;
         std::unordered_map<poBasicBlock*, po_x86_64_basic_block*> _basicBlockMap;
-        poPhiWeb _web;
+        std::unordered_map<int, int64_t> _constants; // Integer constants, which may size a block operation or be an operand
+        std::unordered_set<int> _vectors; // Variables holding a whole 16 byte vector
+        std::unordered_map<int, poCallLayout> _callLayouts; // Argument layout of each function called, by symbol
+        std::unordered_map<int, const poInstruction*> _rematerialized; // Definitions which may be repeated at a use rather than restored
         poAsmAddressBuffer _pltgot;
         po_x86_64 _plt;
         po_x86_64 _x86_64;
@@ -278,6 +355,21 @@ namespace po
         bool _isError;
         std::string _errorText;
         int _prologueSize;
+        int _frameSize; /* bytes below the pushed registers */
+        bool _isLeaf; /* the function makes no calls, so has no frame pointer */
+        bool _isRedZone; /* the frame is below the stack pointer rather than allocated */
+        int _numMoves;
+        int _numEliminatedMoves;
         bool _debugDump;
+        bool _blockLayout;
+        bool _branchRelaxation;
+        bool _peephole;
+        bool _tailCalls;
+        bool _omitFramePointer;
+        poRegAllocType _allocator;
+        int _linearScanThreshold; /* functions larger than this use linear scan, or 0 to never switch */
+        poModule* _module; /* the module being generated, for rematerializing constants */
+        std::vector<poAsmAllocation> _allocations;
+        poPeephole _peepholeOptimizer;
     };
 }
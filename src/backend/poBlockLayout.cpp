@@ -0,0 +1,385 @@
+#include "poBlockLayout.h"
+#include "po_x86_64.h"
+#include "poModule.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace po;
+
+//
+// Block placement
+//
+// Blocks are chained together Pettis-Hansen style: each edge is given a static
+// weight and edges are visited heaviest first, joining the chain ending at the
+// source to the chain starting at the target. Edges into or out of cold blocks
+// (paths which end in a call to std::panic or std::abort) have no weight, so those
+// blocks are never chained and are placed at the end of the function.
+//
+
+static const int FALLTHROUGH_WEIGHT = 2;
+static const int JUMP_WEIGHT = 1;
+
+static const char* const coldSymbols[] = { "std::panic", "std::abort" };
+
+static int invertJump(const int opcode)
+{
+    switch (opcode)
+    {
+    case VMI_JE32: return VMI_JNE32;
+    case VMI_JNE32: return VMI_JE32;
+    case VMI_JNAE32: return VMI_JNB32;
+    case VMI_JNB32: return VMI_JNAE32;
+    case VMI_JNBE32: return VMI_JNA32;
+    case VMI_JNA32: return VMI_JNBE32;
+    case VMI_JG32: return VMI_JLE32;
+    case VMI_JLE32: return VMI_JG32;
+    case VMI_JL32: return VMI_JGE32;
+    case VMI_JGE32: return VMI_JL32;
+    }
+
+    return -1;
+}
+
+//
+// poBlockLayoutEdge
+//
+
+poBlockLayoutEdge::poBlockLayoutEdge(const int from, const int to, const int weight)
+    :
+    _from(from),
+    _to(to),
+    _weight(weight)
+{
+}
+
+//
+// poBlockLayout
+//
+
+poBlockLayout::poBlockLayout()
+    :
+    _numColdBlocks(0)
+{
+}
+
+void poBlockLayout::layout(poModule& module, po_x86_64_flow_graph& cfg)
+{
+    _numColdBlocks = 0;
+    if (cfg.basicBlocks().size() < 3)
+    {
+        return;
+    }
+
+    if (!scanSuccessors(cfg))
+    {
+        return;
+    }
+
+    // Chains are built whether or not there are cold blocks, as joining them on their
+    // heaviest edges is what lets the hot side of a branch fall through
+    findColdBlocks(module, cfg);
+    buildChains();
+
+    std::vector<int> order;
+    placeChains(order);
+
+    bool changed = false;
+    for (int i = 0; i < int(order.size()); i++)
+    {
+        if (order[i] != i)
+        {
+            changed = true;
+            break;
+        }
+    }
+
+    if (changed)
+    {
+        fixFallthroughs(cfg, order);
+    }
+}
+
+bool poBlockLayout::scanSuccessors(po_x86_64_flow_graph& cfg)
+{
+    std::vector<po_x86_64_basic_block*>& basicBlocks = cfg.basicBlocks();
+    const int numBlocks = int(basicBlocks.size());
+
+    std::unordered_map<po_x86_64_basic_block*, int> blockIndex;
+    for (int i = 0; i < numBlocks; i++)
+    {
+        blockIndex.insert(std::pair<po_x86_64_basic_block*, int>(basicBlocks[i], i));
+    }
+
+    _fallthrough.assign(numBlocks, -1);
+    _jump.assign(numBlocks, -1);
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        po_x86_64_basic_block* bb = basicBlocks[i];
+        const std::vector<po_x86_64_instruction>& ins = bb->instructions();
+
+        // Only a block terminator may transfer control, otherwise leave the order alone
+        for (int j = 0; j < int(ins.size()) - 1; j++)
+        {
+            if (ins[j].isJump())
+            {
+                return false;
+            }
+        }
+
+        const int next = i + 1 < numBlocks ? i + 1 : -1;
+        if (ins.size() == 0 || ins.back().isSSE())
+        {
+            _fallthrough[i] = next;
+            continue;
+        }
+
+        const int opcode = ins.back().opcode();
+        if (opcode == VMI_NEAR_RETURN || opcode == VMI_TAIL_CALL)
+        {
+            continue;
+        }
+
+        if (!ins.back().isJump())
+        {
+            _fallthrough[i] = next;
+            continue;
+        }
+
+        if (opcode != VMI_J32 && invertJump(opcode) == -1)
+        {
+            return false; // short jumps are not expected this early
+        }
+
+        const auto& target = blockIndex.find(bb->jumpBlock());
+        if (target == blockIndex.end())
+        {
+            return false;
+        }
+
+        _jump[i] = target->second;
+        if (opcode != VMI_J32)
+        {
+            _fallthrough[i] = next;
+        }
+    }
+
+    return true;
+}
+
+bool poBlockLayout::isColdCall(poModule& module, const po_x86_64_instruction& ins) const
+{
+    if (ins.isSSE() || ins.opcode() != VMI_CALL)
+    {
+        return false;
+    }
+
+    std::string symbol;
+    if (!module.getSymbol(ins.id(), symbol))
+    {
+        return false;
+    }
+
+    for (const char* cold : coldSymbols)
+    {
+        if (symbol == cold)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void poBlockLayout::findColdBlocks(poModule& module, po_x86_64_flow_graph& cfg)
+{
+    std::vector<po_x86_64_basic_block*>& basicBlocks = cfg.basicBlocks();
+    const int numBlocks = int(basicBlocks.size());
+
+    _cold.assign(numBlocks, false);
+
+    // The first block holds the prologue and must stay where it is
+    for (int i = 1; i < numBlocks; i++)
+    {
+        for (const po_x86_64_instruction& ins : basicBlocks[i]->instructions())
+        {
+            if (isColdCall(module, ins))
+            {
+                _cold[i] = true;
+                break;
+            }
+        }
+    }
+
+    // Blocks which can only lead into cold blocks are cold as well
+    bool changes = true;
+    while (changes)
+    {
+        changes = false;
+        for (int i = 1; i < numBlocks; i++)
+        {
+            if (_cold[i])
+            {
+                continue;
+            }
+
+            const int fallthrough = _fallthrough[i];
+            const int jump = _jump[i];
+            if (fallthrough == -1 && jump == -1)
+            {
+                continue;
+            }
+
+            if ((fallthrough == -1 || _cold[fallthrough]) &&
+                (jump == -1 || _cold[jump]))
+            {
+                _cold[i] = true;
+                changes = true;
+            }
+        }
+    }
+
+    _numColdBlocks = int(std::count(_cold.begin(), _cold.end(), true));
+}
+
+void poBlockLayout::buildChains()
+{
+    const int numBlocks = int(_cold.size());
+
+    std::vector<poBlockLayoutEdge> edges;
+    for (int i = 0; i < numBlocks; i++)
+    {
+        if (_cold[i])
+        {
+            continue;
+        }
+
+        // Back edges are left alone so loops keep their shape
+        const int fallthrough = _fallthrough[i];
+        if (fallthrough != -1 && !_cold[fallthrough])
+        {
+            edges.push_back(poBlockLayoutEdge(i, fallthrough, FALLTHROUGH_WEIGHT));
+        }
+
+        const int jump = _jump[i];
+        if (jump > i && !_cold[jump])
+        {
+            edges.push_back(poBlockLayoutEdge(i, jump, JUMP_WEIGHT));
+        }
+    }
+
+    std::stable_sort(edges.begin(), edges.end(), [](const poBlockLayoutEdge& a, const poBlockLayoutEdge& b) {
+        return a.weight() > b.weight();
+    });
+
+    _chains.clear();
+    _chainOf.resize(numBlocks);
+    for (int i = 0; i < numBlocks; i++)
+    {
+        _chains.push_back(std::vector<int>{ i });
+        _chainOf[i] = i;
+    }
+
+    for (const poBlockLayoutEdge& edge : edges)
+    {
+        const int fromChain = _chainOf[edge.from()];
+        const int toChain = _chainOf[edge.to()];
+        if (fromChain == toChain ||
+            _chains[fromChain].back() != edge.from() ||
+            _chains[toChain].front() != edge.to() ||
+            edge.to() == 0)
+        {
+            continue;
+        }
+
+        for (const int id : _chains[toChain])
+        {
+            _chains[fromChain].push_back(id);
+            _chainOf[id] = fromChain;
+        }
+        _chains[toChain].clear();
+    }
+}
+
+void poBlockLayout::placeChains(std::vector<int>& order)
+{
+    // The chain holding the entry block goes first, followed by the remaining hot chains
+    // in their original order, and finally the cold blocks.
+
+    order.clear();
+    for (const int id : _chains[_chainOf[0]])
+    {
+        order.push_back(id);
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const bool cold = pass == 1;
+        for (int i = 0; i < int(_chains.size()); i++)
+        {
+            const std::vector<int>& chain = _chains[i];
+            if (chain.size() == 0 || i == _chainOf[0])
+            {
+                continue;
+            }
+
+            if (_cold[chain.front()] != cold)
+            {
+                continue;
+            }
+
+            for (const int id : chain)
+            {
+                order.push_back(id);
+            }
+        }
+    }
+}
+
+void poBlockLayout::fixFallthroughs(po_x86_64_flow_graph& cfg, const std::vector<int>& order)
+{
+    std::vector<po_x86_64_basic_block*>& basicBlocks = cfg.basicBlocks();
+
+    std::vector<po_x86_64_basic_block*> placed;
+    for (int i = 0; i < int(order.size()); i++)
+    {
+        const int id = order[i];
+        const int next = i + 1 < int(order.size()) ? order[i + 1] : -1;
+        po_x86_64_basic_block* bb = basicBlocks[id];
+        placed.push_back(bb);
+
+        const int fallthrough = _fallthrough[id];
+        if (fallthrough == -1 || fallthrough == next)
+        {
+            continue;
+        }
+
+        po_x86_64_basic_block* fallthroughBB = basicBlocks[fallthrough];
+        if (_jump[id] != -1 && _jump[id] == next)
+        {
+            // The jump target is now the next block, so invert the condition
+            // and jump to the old fallthrough instead.
+
+            po_x86_64_basic_block* nextBB = basicBlocks[next];
+            po_x86_64_instruction& ins = bb->instructions().back();
+            ins = po_x86_64_instruction(false, invertJump(ins.opcode()), -1, -1, int32_t(0));
+
+            bb->setJumpTarget(fallthroughBB);
+            std::vector<po_x86_64_basic_block*>& incoming = nextBB->incomingBlocks();
+            incoming.erase(std::remove(incoming.begin(), incoming.end(), bb), incoming.end());
+            fallthroughBB->incomingBlocks().push_back(bb);
+            continue;
+        }
+
+        // Otherwise the fallthrough needs an explicit jump in a block of its own
+
+        po_x86_64_basic_block* jumpBB = new po_x86_64_basic_block();
+        jumpBB->instructions().push_back(po_x86_64_instruction(false, VMI_J32, -1, -1, int32_t(0)));
+        jumpBB->setJumpTarget(fallthroughBB);
+        fallthroughBB->incomingBlocks().push_back(jumpBB);
+        placed.push_back(jumpBB);
+    }
+
+    basicBlocks = placed;
+}
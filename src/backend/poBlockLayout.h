@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace po
+{
+    class po_x86_64_flow_graph;
+    class po_x86_64_basic_block;
+    class po_x86_64_instruction;
+    class poModule;
+
+    class poBlockLayoutEdge
+    {
+    public:
+        poBlockLayoutEdge(const int from, const int to, const int weight);
+
+        inline const int from() const { return _from; }
+        inline const int to() const { return _to; }
+        inline const int weight() const { return _weight; }
+
+    private:
+        int _from;
+        int _to;
+        int _weight;
+    };
+
+    class poBlockLayout
+    {
+    public:
+        poBlockLayout();
+        void layout(poModule& module, po_x86_64_flow_graph& cfg);
+
+        inline const int numColdBlocks() const { return _numColdBlocks; }
+
+    private:
+        bool scanSuccessors(po_x86_64_flow_graph& cfg);
+        void findColdBlocks(poModule& module, po_x86_64_flow_graph& cfg);
+        void buildChains();
+        void placeChains(std::vector<int>& order);
+        void fixFallthroughs(po_x86_64_flow_graph& cfg, const std::vector<int>& order);
+        bool isColdCall(poModule& module, const po_x86_64_instruction& ins) const;
+
+        std::vector<int> _fallthrough; // Block which is reached by falling off the end, or -1
+        std::vector<int> _jump; // Block which is reached by the terminating jump, or -1
+        std::vector<bool> _cold;
+        std::vector<int> _chainOf;
+        std::vector<std::vector<int>> _chains;
+        int _numColdBlocks;
+    };
+}
@@ -0,0 +1,115 @@
+#include "poCallLayout.h"
+#include "po_x86_64.h"
+#include "poModule.h"
+
+#include <algorithm>
+
+using namespace po;
+
+//
+// Argument layout
+//
+// The C ABI on Windows gives each argument a position, so a double in the first
+// argument uses up RCX too. System V instead counts general and SSE arguments
+// separately, which is what calls between Pora functions do on both platforms,
+// with R10 and R11 (and XMM4 and XMM5 on Windows) added as argument registers.
+// Nothing is allocated to these, as they are volatile across calls anyway.
+// Arguments which don't fit are given the next 8 byte stack slot.
+//
+// The eightbytes of a struct are separate arguments, but System V keeps a struct
+// whole: when they don't all fit in the registers left, every one of them goes on the
+// stack, and the registers are still free for the arguments which follow.
+//
+
+static const int generalArgs[] = { VM_ARG1, VM_ARG2, VM_ARG3, VM_ARG4, VM_ARG5, VM_ARG6 };
+static const int sseArgs[] = { VM_SSE_ARG1, VM_SSE_ARG2, VM_SSE_ARG3, VM_SSE_ARG4, VM_SSE_ARG5, VM_SSE_ARG6, VM_SSE_ARG7, VM_SSE_ARG8 };
+
+#ifdef WIN32
+static const int poraGeneralArgs[] = { VM_ARG1, VM_ARG2, VM_ARG3, VM_ARG4, VM_REGISTER_R10, VM_REGISTER_R11 };
+static const int poraSseArgs[] = { VM_SSE_ARG1, VM_SSE_ARG2, VM_SSE_ARG3, VM_SSE_ARG4, VM_SSE_REGISTER_XMM4, VM_SSE_REGISTER_XMM5 };
+#else
+static const int poraGeneralArgs[] = { VM_ARG1, VM_ARG2, VM_ARG3, VM_ARG4, VM_ARG5, VM_ARG6, VM_REGISTER_R10, VM_REGISTER_R11 };
+static const int poraSseArgs[] = { VM_SSE_ARG1, VM_SSE_ARG2, VM_SSE_ARG3, VM_SSE_ARG4, VM_SSE_ARG5, VM_SSE_ARG6, VM_SSE_ARG7, VM_SSE_ARG8 };
+#endif
+
+static bool isSSEArg(const int type)
+{
+    return type == TYPE_F64 || type == TYPE_F32 || isVectorType(type);
+}
+
+poCallArg::poCallArg(const int reg, const int stackSlot)
+    :
+    _reg(reg),
+    _stackSlot(stackSlot)
+{
+}
+
+poCallLayout::poCallLayout(const poCallConvention convention, const std::vector<int>& types, const std::vector<int>& structs)
+    :
+    _numStackSlots(0)
+{
+    if (convention == poCallConvention::Pora)
+    {
+        layoutByClass(types, structs, poraGeneralArgs, VM_PORA_MAX_ARGS, poraSseArgs, VM_PORA_MAX_SSE_ARGS);
+    }
+    else
+    {
+#ifdef WIN32
+        layoutPositional(types);
+#else
+        layoutByClass(types, structs, generalArgs, VM_MAX_ARGS, sseArgs, VM_MAX_SSE_ARGS);
+#endif
+    }
+}
+
+void poCallLayout::layoutPositional(const std::vector<int>& types)
+{
+    for (int i = 0; i < int(types.size()); i++)
+    {
+        if (isSSEArg(types[i]) ? i < VM_MAX_SSE_ARGS : i < VM_MAX_ARGS)
+        {
+            _args.push_back(poCallArg(isSSEArg(types[i]) ? sseArgs[i] : generalArgs[i], -1));
+        }
+        else
+        {
+            _args.push_back(poCallArg(-1, _numStackSlots++));
+        }
+    }
+}
+
+void poCallLayout::layoutByClass(const std::vector<int>& types, const std::vector<int>& structs, const int* general, const int maxArgs, const int* sse, const int maxSSEArgs)
+{
+    int numGeneral = 0;
+    int numSSE = 0;
+    for (int i = 0; i < int(types.size());)
+    {
+        // The number of arguments which are placed together, more than one for the eightbytes of a struct
+        const int count = std::max(1, std::min(structs[i], int(types.size()) - i));
+
+        int needGeneral = 0;
+        int needSSE = 0;
+        for (int j = i; j < i + count; j++)
+        {
+            if (isSSEArg(types[j])) { needSSE++; }
+            else { needGeneral++; }
+        }
+
+        const bool isStack = numGeneral + needGeneral > maxArgs || numSSE + needSSE > maxSSEArgs;
+        for (int j = i; j < i + count; j++)
+        {
+            if (isStack)
+            {
+                _args.push_back(poCallArg(-1, _numStackSlots++));
+            }
+            else if (isSSEArg(types[j]))
+            {
+                _args.push_back(poCallArg(sse[numSSE++], -1));
+            }
+            else
+            {
+                _args.push_back(poCallArg(general[numGeneral++], -1));
+            }
+        }
+        i += count;
+    }
+}
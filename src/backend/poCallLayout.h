@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+
+namespace po
+{
+    enum class poCallConvention;
+
+    class poCallArg
+    {
+    public:
+        poCallArg(const int reg, const int stackSlot);
+
+        inline const int reg() const { return _reg; } /* general or SSE register, or -1 when on the stack */
+        inline const int stackSlot() const { return _stackSlot; }
+        inline const bool isStack() const { return _reg == -1; }
+
+    private:
+        int _reg;
+        int _stackSlot;
+    };
+
+    class poCallLayout
+    {
+    public:
+        poCallLayout(const poCallConvention convention, const std::vector<int>& types, const std::vector<int>& structs);
+
+        inline const std::vector<poCallArg>& args() const { return _args; }
+        inline const poCallArg& arg(const int index) const { return _args[index]; }
+        inline const int numStackSlots() const { return _numStackSlots; }
+
+    private:
+        void layoutPositional(const std::vector<int>& types);
+        void layoutByClass(const std::vector<int>& types, const std::vector<int>& structs, const int* general, const int maxArgs, const int* sse, const int maxSSEArgs);
+
+        std::vector<poCallArg> _args;
+        int _numStackSlots;
+    };
+}
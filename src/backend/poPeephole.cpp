@@ -0,0 +1,1389 @@
+#include "poPeephole.h"
+#include "po_x86_64.h"
+
+#include <iostream>
+#include <iomanip>
+#include <limits>
+
+using namespace po;
+
+//
+// Machine peephole optimizer
+//
+// Runs over the lowered x86_64 flow graph once the call sites and stack offsets have
+// been fixed up. Each pattern is given a window of instructions it may inspect starting
+// at the current position, and patterns are tried in table order until none of them fire.
+// Register liveness is tracked across blocks so patterns can check a temporary is no longer
+// needed. The only instructions which read the flags are the conditional jumps.
+//
+
+static const uint32_t ALL_REGISTERS = (1u << VM_REGISTER_MAX) - 1;
+
+static inline uint32_t bit(const int reg)
+{
+    if (reg < 0 || reg >= VM_REGISTER_MAX)
+    {
+        return 0;
+    }
+
+    return 1u << reg;
+}
+
+static bool isUnconditionalJump(const po_x86_64_instruction& ins)
+{
+    return !ins.isSSE() && (ins.opcode() == VMI_J32 || ins.opcode() == VMI_J8);
+}
+
+// Moves an immediate into a register, zero extending to 64 bits
+static bool isImmediateMove(const po_x86_64_instruction& ins, int64_t& value)
+{
+    if (ins.isSSE())
+    {
+        return false;
+    }
+
+    if (ins.opcode() == VMI_MOV64_SRC_IMM_DST_REG)
+    {
+        value = ins.imm64();
+        return true;
+    }
+
+    if (ins.opcode() == VMI_MOV32_SRC_IMM_DST_REG)
+    {
+        value = int64_t(uint32_t(ins.imm32()));
+        return true;
+    }
+
+    return false;
+}
+
+static bool isZeroDef(const po_x86_64_instruction& ins)
+{
+    int64_t value = 0;
+    if (isImmediateMove(ins, value))
+    {
+        return value == 0;
+    }
+
+    return !ins.isSSE() &&
+        (ins.opcode() == VMI_XOR64_SRC_REG_DST_REG || ins.opcode() == VMI_XOR32_SRC_REG_DST_REG) &&
+        ins.srcReg() == ins.dstReg();
+}
+
+// Writes the whole of the destination register without reading it or touching memory
+static bool isPureDef(const po_x86_64_instruction& ins)
+{
+    if (ins.isSSE())
+    {
+        return false;
+    }
+
+    switch (ins.opcode())
+    {
+    case VMI_MOV64_SRC_REG_DST_REG:
+    case VMI_MOV32_SRC_REG_DST_REG:
+    case VMI_MOV64_SRC_IMM_DST_REG:
+    case VMI_MOV32_SRC_IMM_DST_REG:
+    case VMI_MOV64_SRC_MEM_DST_REG:
+    case VMI_MOV32_SRC_MEM_DST_REG:
+    case VMI_MOV64_SRC_INDEX_DST_REG:
+    case VMI_MOV32_SRC_INDEX_DST_REG:
+    case VMI_LEA64_SRC_REG_DST_REG:
+    case VMI_LEA64_SRC_MEM_DST_REG:
+    case VMI_LEA64_SRC_INDEX_DST_REG:
+        return true;
+    case VMI_XOR64_SRC_REG_DST_REG:
+    case VMI_XOR32_SRC_REG_DST_REG:
+        return ins.srcReg() == ins.dstReg();
+    }
+
+    return false;
+}
+
+static bool isFrameRegister(const int reg)
+{
+    return reg == VM_REGISTER_ESP || reg == VM_REGISTER_EBP;
+}
+
+static int testOpcode(const int cmpOpcode)
+{
+    switch (cmpOpcode)
+    {
+    case VMI_CMP64_SRC_REG_DST_REG: return VMI_TEST64_SRC_REG_DST_REG;
+    case VMI_CMP32_SRC_REG_DST_REG: return VMI_TEST32_SRC_REG_DST_REG;
+    case VMI_CMP16_SRC_REG_DST_REG: return VMI_TEST16_SRC_REG_DST_REG;
+    case VMI_CMP8_SRC_REG_DST_REG: return VMI_TEST8_SRC_REG_DST_REG;
+    }
+
+    return -1;
+}
+
+// The [base + index * scale + offset] form of an instruction which addresses [base + offset]
+static int indexedOpcode(const int memOpcode)
+{
+    switch (memOpcode)
+    {
+    case VMI_MOV64_SRC_MEM_DST_REG: return VMI_MOV64_SRC_INDEX_DST_REG;
+    case VMI_MOV32_SRC_MEM_DST_REG: return VMI_MOV32_SRC_INDEX_DST_REG;
+    case VMI_MOV16_SRC_MEM_DST_REG: return VMI_MOV16_SRC_INDEX_DST_REG;
+    case VMI_MOV8_SRC_MEM_DST_REG: return VMI_MOV8_SRC_INDEX_DST_REG;
+    case VMI_MOV64_SRC_REG_DST_MEM: return VMI_MOV64_SRC_REG_DST_INDEX;
+    case VMI_MOV32_SRC_REG_DST_MEM: return VMI_MOV32_SRC_REG_DST_INDEX;
+    case VMI_MOV16_SRC_REG_DST_MEM: return VMI_MOV16_SRC_REG_DST_INDEX;
+    case VMI_MOV8_SRC_REG_DST_MEM: return VMI_MOV8_SRC_REG_DST_INDEX;
+    case VMI_ADD64_SRC_MEM_DST_REG: return VMI_ADD64_SRC_INDEX_DST_REG;
+    case VMI_ADD32_SRC_MEM_DST_REG: return VMI_ADD32_SRC_INDEX_DST_REG;
+    case VMI_SUB64_SRC_MEM_DST_REG: return VMI_SUB64_SRC_INDEX_DST_REG;
+    case VMI_SUB32_SRC_MEM_DST_REG: return VMI_SUB32_SRC_INDEX_DST_REG;
+    case VMI_CMP64_SRC_MEM_DST_REG: return VMI_CMP64_SRC_INDEX_DST_REG;
+    case VMI_CMP32_SRC_MEM_DST_REG: return VMI_CMP32_SRC_INDEX_DST_REG;
+    }
+
+    return -1;
+}
+
+// The form of a register to register operation which reads its source from memory
+static int memoryOpcode(const int regOpcode)
+{
+    switch (regOpcode)
+    {
+    case VMI_ADD64_SRC_REG_DST_REG: return VMI_ADD64_SRC_MEM_DST_REG;
+    case VMI_ADD32_SRC_REG_DST_REG: return VMI_ADD32_SRC_MEM_DST_REG;
+    case VMI_SUB64_SRC_REG_DST_REG: return VMI_SUB64_SRC_MEM_DST_REG;
+    case VMI_SUB32_SRC_REG_DST_REG: return VMI_SUB32_SRC_MEM_DST_REG;
+    case VMI_CMP64_SRC_REG_DST_REG: return VMI_CMP64_SRC_MEM_DST_REG;
+    case VMI_CMP32_SRC_REG_DST_REG: return VMI_CMP32_SRC_MEM_DST_REG;
+    }
+
+    return -1;
+}
+
+static bool isStoreOpcode(const int opcode)
+{
+    switch (opcode)
+    {
+    case VMI_MOV64_SRC_REG_DST_MEM:
+    case VMI_MOV32_SRC_REG_DST_MEM:
+    case VMI_MOV16_SRC_REG_DST_MEM:
+    case VMI_MOV8_SRC_REG_DST_MEM:
+        return true;
+    }
+
+    return false;
+}
+
+//
+// poPeepholeOperands
+//
+
+poPeepholeOperands::poPeepholeOperands(const po_x86_64_instruction& ins)
+    :
+    _uses(0),
+    _defs(0),
+    _readsFlags(false),
+    _writesFlags(false),
+    _known(true),
+    _storeBase(-1),
+    _storeOffset(0),
+    _storeSize(0),
+    _storeId(-1)
+{
+    if (ins.isSSE())
+    {
+        scanSSE(ins);
+    }
+    else
+    {
+        scan(ins);
+    }
+}
+
+void poPeepholeOperands::setUnknown()
+{
+    _uses = ALL_REGISTERS;
+    _defs = ALL_REGISTERS;
+    _known = false;
+    _storeSize = std::numeric_limits<int>::max();
+}
+
+void poPeepholeOperands::setStore(const po_x86_64_instruction& ins, const int size)
+{
+    _uses |= bit(ins.srcReg());
+    _storeSize = size;
+    if (ins.id() != -1)
+    {
+        _storeId = ins.id();
+    }
+    else
+    {
+        _uses |= bit(ins.dstReg());
+        _storeBase = ins.dstReg();
+        _storeOffset = ins.imm32();
+    }
+}
+
+void poPeepholeOperands::setIndexedStore(const po_x86_64_instruction& ins, const int size)
+{
+    // The address isn't known so any stack slot may be written
+    _uses = bit(ins.srcReg()) | bit(ins.dstReg()) | bit(ins.indexReg());
+    _storeSize = size;
+}
+
+void poPeepholeOperands::scan(const po_x86_64_instruction& ins)
+{
+    const uint32_t src = bit(ins.srcReg());
+    const uint32_t dst = bit(ins.dstReg());
+
+    switch (ins.opcode())
+    {
+    case VMI_MOV64_SRC_REG_DST_REG:
+    case VMI_MOV32_SRC_REG_DST_REG:
+    case VMI_MOV64_SRC_MEM_DST_REG:
+    case VMI_MOV32_SRC_MEM_DST_REG:
+    case VMI_LEA64_SRC_MEM_DST_REG:
+    case VMI_MOVSX_8_TO_32_SRC_REG_DST_REG:
+    case VMI_MOVSX_8_TO_32_SRC_MEM_DST_REG:
+    case VMI_MOVSX_8_TO_64_SRC_REG_DST_REG:
+    case VMI_MOVSX_8_TO_64_SRC_MEM_DST_REG:
+    case VMI_MOVSX_16_TO_32_SRC_REG_DST_REG:
+    case VMI_MOVSX_16_TO_32_SRC_MEM_DST_REG:
+    case VMI_MOVSX_16_TO_64_SRC_REG_DST_REG:
+    case VMI_MOVSX_16_TO_64_SRC_MEM_DST_REG:
+    case VMI_MOVSX_32_TO_64_SRC_REG_DST_REG:
+    case VMI_MOVSX_32_TO_64_SRC_MEM_DST_REG:
+    case VMI_MOVZX_8_TO_32_SRC_REG_DST_REG:
+    case VMI_MOVZX_8_TO_32_SRC_MEM_DST_REG:
+    case VMI_MOVZX_8_TO_64_SRC_REG_DST_REG:
+    case VMI_MOVZX_8_TO_64_SRC_MEM_DST_REG:
+    case VMI_MOVZX_16_TO_32_SRC_REG_DST_REG:
+    case VMI_MOVZX_16_TO_32_SRC_MEM_DST_REG:
+    case VMI_MOVZX_16_TO_64_SRC_REG_DST_REG:
+    case VMI_MOVZX_16_TO_64_SRC_MEM_DST_REG:
+        _uses = src;
+        _defs = dst;
+        break;
+    case VMI_MOV16_SRC_REG_DST_REG:
+    case VMI_MOV8_SRC_REG_DST_REG:
+    case VMI_MOV16_SRC_MEM_DST_REG:
+    case VMI_MOV8_SRC_MEM_DST_REG:
+    case VMI_MOVSX_8_TO_16_SRC_REG_DST_REG:
+    case VMI_MOVSX_8_TO_16_SRC_MEM_DST_REG:
+    case VMI_MOVZX_8_TO_16_SRC_REG_DST_REG:
+    case VMI_MOVZX_8_TO_16_SRC_MEM_DST_REG:
+        // Only part of the destination is written
+        _uses = src | dst;
+        _defs = dst;
+        break;
+    case VMI_MOV64_SRC_IMM_DST_REG:
+    case VMI_MOV32_SRC_IMM_DST_REG:
+    case VMI_LEA64_SRC_REG_DST_REG:
+        _defs = dst;
+        break;
+    case VMI_MOV16_SRC_IMM_DST_REG:
+    case VMI_MOV8_SRC_IMM_DST_REG:
+    case VMI_SAL64_SRC_IMM_DST_REG:
+    case VMI_SAL32_SRC_IMM_DST_REG:
+    case VMI_SAL16_SRC_IMM_DST_REG:
+    case VMI_SAL8_SRC_IMM_DST_REG:
+    case VMI_SAR64_SRC_IMM_DST_REG:
+    case VMI_SAR32_SRC_IMM_DST_REG:
+    case VMI_SAR16_SRC_IMM_DST_REG:
+    case VMI_SAR8_SRC_IMM_DST_REG:
+    case VMI_SHR64_SRC_IMM_DST_REG:
+    case VMI_INC64_DST_REG:
+    case VMI_DEC64_DST_REG:
+    case VMI_NEG64_DST_REG:
+    case VMI_NEG32_DST_REG:
+    case VMI_NEG16_DST_REG:
+    case VMI_NEG8_DST_REG:
+        // Shifts by zero and INC/DEC leave some or all of the flags alone, so they
+        // are not treated as writing them.
+        _uses = dst;
+        _defs = dst;
+        break;
+    case VMI_SAL64_SRC_REG_DST_REG:
+    case VMI_SAL32_SRC_REG_DST_REG:
+    case VMI_SAL16_SRC_REG_DST_REG:
+    case VMI_SAL8_SRC_REG_DST_REG:
+    case VMI_SAR64_SRC_REG_DST_REG:
+    case VMI_SAR32_SRC_REG_DST_REG:
+    case VMI_SAR16_SRC_REG_DST_REG:
+    case VMI_SAR8_SRC_REG_DST_REG:
+        _uses = dst | bit(VM_REGISTER_ECX);
+        _defs = dst;
+        break;
+    case VMI_LEA64_SRC_INDEX_DST_REG:
+    case VMI_MOV64_SRC_INDEX_DST_REG:
+    case VMI_MOV32_SRC_INDEX_DST_REG:
+        _uses = src | bit(ins.indexReg());
+        _defs = dst;
+        break;
+    case VMI_MOV16_SRC_INDEX_DST_REG:
+    case VMI_MOV8_SRC_INDEX_DST_REG:
+        _uses = src | dst | bit(ins.indexReg());
+        _defs = dst;
+        break;
+    case VMI_ADD64_SRC_INDEX_DST_REG:
+    case VMI_ADD32_SRC_INDEX_DST_REG:
+    case VMI_SUB64_SRC_INDEX_DST_REG:
+    case VMI_SUB32_SRC_INDEX_DST_REG:
+        _uses = src | dst | bit(ins.indexReg());
+        _defs = dst;
+        _writesFlags = true;
+        break;
+    case VMI_CMP64_SRC_INDEX_DST_REG:
+    case VMI_CMP32_SRC_INDEX_DST_REG:
+        _uses = src | dst | bit(ins.indexReg());
+        _writesFlags = true;
+        break;
+    case VMI_ADD64_SRC_REG_DST_REG:
+    case VMI_ADD32_SRC_REG_DST_REG:
+    case VMI_ADD16_SRC_REG_DST_REG:
+    case VMI_ADD8_SRC_REG_DST_REG:
+    case VMI_SUB64_SRC_REG_DST_REG:
+    case VMI_SUB32_SRC_REG_DST_REG:
+    case VMI_SUB16_SRC_REG_DST_REG:
+    case VMI_SUB8_SRC_REG_DST_REG:
+    case VMI_ADD64_SRC_MEM_DST_REG:
+    case VMI_ADD32_SRC_MEM_DST_REG:
+    case VMI_ADD16_SRC_MEM_DST_REG:
+    case VMI_ADD8_SRC_MEM_DST_REG:
+    case VMI_SUB64_SRC_MEM_DST_REG:
+    case VMI_SUB32_SRC_MEM_DST_REG:
+    case VMI_SUB16_SRC_MEM_DST_REG:
+    case VMI_SUB8_SRC_MEM_DST_REG:
+    case VMI_IMUL64_SRC_REG_DST_REG:
+    case VMI_IMUL32_SRC_REG_DST_REG:
+    case VMI_IMUL16_SRC_REG_DST_REG:
+    case VMI_AND64_SRC_REG_DST_REG:
+        _uses = src | dst;
+        _defs = dst;
+        _writesFlags = true;
+        break;
+    case VMI_ADD64_SRC_IMM_DST_REG:
+    case VMI_ADD32_SRC_IMM_DST_REG:
+    case VMI_ADD16_SRC_IMM_DST_REG:
+    case VMI_ADD8_SRC_IMM_DST_REG:
+    case VMI_SUB64_SRC_IMM_DST_REG:
+    case VMI_SUB32_SRC_IMM_DST_REG:
+    case VMI_SUB16_SRC_IMM_DST_REG:
+    case VMI_SUB8_SRC_IMM_DST_REG:
+        _uses = dst;
+        _defs = dst;
+        _writesFlags = true;
+        break;
+    case VMI_XOR64_SRC_REG_DST_REG:
+    case VMI_XOR32_SRC_REG_DST_REG:
+        _uses = ins.srcReg() == ins.dstReg() ? 0 : src | dst;
+        _defs = dst;
+        _writesFlags = true;
+        break;
+    case VMI_XCHG64_SRC_REG_DST_REG:
+        _uses = src | dst;
+        _defs = src | dst;
+        break;
+    case VMI_CMP64_SRC_REG_DST_REG:
+    case VMI_CMP32_SRC_REG_DST_REG:
+    case VMI_CMP16_SRC_REG_DST_REG:
+    case VMI_CMP8_SRC_REG_DST_REG:
+    case VMI_CMP64_SRC_MEM_DST_REG:
+    case VMI_CMP32_SRC_MEM_DST_REG:
+    case VMI_CMP16_SRC_MEM_DST_REG:
+    case VMI_CMP8_SRC_MEM_DST_REG:
+    case VMI_CMP64_SRC_REG_DST_MEM:
+    case VMI_CMP32_SRC_REG_DST_MEM:
+    case VMI_CMP16_SRC_REG_DST_MEM:
+    case VMI_CMP8_SRC_REG_DST_MEM:
+    case VMI_TEST64_SRC_REG_DST_REG:
+    case VMI_TEST32_SRC_REG_DST_REG:
+    case VMI_TEST16_SRC_REG_DST_REG:
+    case VMI_TEST8_SRC_REG_DST_REG:
+        _uses = src | dst;
+        _writesFlags = true;
+        break;
+    case VMI_MOV64_SRC_REG_DST_MEM:
+        setStore(ins, 8);
+        break;
+    case VMI_MOV32_SRC_REG_DST_MEM:
+        setStore(ins, 4);
+        break;
+    case VMI_MOV16_SRC_REG_DST_MEM:
+        setStore(ins, 2);
+        break;
+    case VMI_MOV8_SRC_REG_DST_MEM:
+        setStore(ins, 1);
+        break;
+    case VMI_MOV64_SRC_REG_DST_INDEX:
+        setIndexedStore(ins, 8);
+        break;
+    case VMI_MOV32_SRC_REG_DST_INDEX:
+        setIndexedStore(ins, 4);
+        break;
+    case VMI_MOV16_SRC_REG_DST_INDEX:
+        setIndexedStore(ins, 2);
+        break;
+    case VMI_MOV8_SRC_REG_DST_INDEX:
+        setIndexedStore(ins, 1);
+        break;
+    case VMI_CDQE:
+    case VMI_CBW:
+        _uses = bit(VM_REGISTER_EAX);
+        _defs = bit(VM_REGISTER_EAX);
+        break;
+    case VMI_CQO:
+    case VMI_CDQ:
+    case VMI_CWD:
+        _uses = bit(VM_REGISTER_EAX);
+        _defs = bit(VM_REGISTER_EDX);
+        break;
+    case VMI_MUL64_SRC_REG_DST_REG:
+    case VMI_IMUL64_SRC_REG:
+        _uses = dst | bit(VM_REGISTER_EAX);
+        _defs = bit(VM_REGISTER_EAX) | bit(VM_REGISTER_EDX);
+        _writesFlags = true;
+        break;
+    case VMI_J8:
+    case VMI_J32:
+        break;
+    default:
+        if (ins.isJump())
+        {
+            _readsFlags = true;
+            break;
+        }
+
+        setUnknown();
+        break;
+    }
+}
+
+void poPeepholeOperands::scanSSE(const po_x86_64_instruction& ins)
+{
+    // Only the general purpose registers are tracked
+
+    switch (ins.opcode())
+    {
+    case VMI_SSE_MOVSD_SRC_REG_DST_REG:
+    case VMI_SSE_MOVSS_SRC_REG_DST_REG:
+    case VMI_SSE_ADDSD_SRC_REG_DST_REG:
+    case VMI_SSE_ADDSS_SRC_REG_DST_REG:
+    case VMI_SSE_SUBSD_SRC_REG_DST_REG:
+    case VMI_SSE_SUBSS_SRC_REG_DST_REG:
+    case VMI_SSE_MULSD_SRC_REG_DST_REG:
+    case VMI_SSE_MULSS_SRC_REG_DST_REG:
+    case VMI_SSE_DIVSD_SRC_REG_DST_REG:
+    case VMI_SSE_DIVSS_SRC_REG_DST_REG:
+    case VMI_SSE_XORPD_SRC_REG_DST_REG:
+    case VMI_SSE_XORPS_SRC_REG_DST_REG:
+    case VMI_SSE_PSHUFD_SRC_REG_DST_REG:
+    case VMI_SSE_PXOR_SRC_REG_DST_REG:
+    case VMI_SSE_PADDB_SRC_REG_DST_REG:
+    case VMI_SSE_PADDW_SRC_REG_DST_REG:
+    case VMI_SSE_PADDD_SRC_REG_DST_REG:
+    case VMI_SSE_PADDQ_SRC_REG_DST_REG:
+    case VMI_SSE_PSUBB_SRC_REG_DST_REG:
+    case VMI_SSE_PSUBW_SRC_REG_DST_REG:
+    case VMI_SSE_PSUBD_SRC_REG_DST_REG:
+    case VMI_SSE_PSUBQ_SRC_REG_DST_REG:
+    case VMI_SSE_ADDPS_SRC_REG_DST_REG:
+    case VMI_SSE_SUBPS_SRC_REG_DST_REG:
+    case VMI_SSE_MULPS_SRC_REG_DST_REG:
+    case VMI_SSE_DIVPS_SRC_REG_DST_REG:
+    case VMI_SSE_ADDPD_SRC_REG_DST_REG:
+    case VMI_SSE_SUBPD_SRC_REG_DST_REG:
+    case VMI_SSE_MULPD_SRC_REG_DST_REG:
+    case VMI_SSE_DIVPD_SRC_REG_DST_REG:
+    case VMI_SSE_PCMPEQB_SRC_REG_DST_REG:
+    case VMI_SSE_MOVAPS_SRC_REG_DST_REG:
+    case VMI_SSE_PCMPEQD_SRC_REG_DST_REG:
+    case VMI_SSE_PCMPGTD_SRC_REG_DST_REG:
+    case VMI_SSE_CMPPS_SRC_REG_DST_REG:
+    case VMI_SSE_CMPPD_SRC_REG_DST_REG:
+        break;
+    case VMI_SSE_UCOMISD_SRC_REG_DST_REG:
+    case VMI_SSE_UCOMISS_SRC_REG_DST_REG:
+        _writesFlags = true;
+        break;
+    case VMI_SSE_MOVSD_SRC_MEM_DST_REG:
+    case VMI_SSE_MOVSS_SRC_MEM_DST_REG:
+        if (ins.id() == -1)
+        {
+            _uses = bit(ins.srcReg());
+        }
+        break;
+    case VMI_SSE_MOVSD_SRC_REG_DST_MEM:
+        _uses = bit(ins.dstReg());
+        _storeBase = ins.dstReg();
+        _storeOffset = ins.imm32();
+        _storeSize = 8;
+        break;
+    case VMI_SSE_MOVSS_SRC_REG_DST_MEM:
+        _uses = bit(ins.dstReg());
+        _storeBase = ins.dstReg();
+        _storeOffset = ins.imm32();
+        _storeSize = 4;
+        break;
+    case VMI_SSE_CVTSI2SD_SRC_REG_DST_REG:
+    case VMI_SSE_CVTSI2SS_SRC_REG_DST_REG:
+        _uses = bit(ins.srcReg());
+        break;
+    case VMI_SSE_CVTSD2SI_SRC_REG_DST_REG:
+    case VMI_SSE_CVTSS2SI_SRC_REG_DST_REG:
+    case VMI_SSE_PMOVMSKB_SRC_REG_DST_REG:
+    case VMI_SSE_MOVMSKPS_SRC_REG_DST_REG:
+    case VMI_SSE_MOVMSKPD_SRC_REG_DST_REG:
+        _defs = bit(ins.dstReg());
+        break;
+    default:
+        setUnknown();
+        break;
+    }
+}
+
+//
+// poPeepholePattern
+//
+
+poPeepholePattern::poPeepholePattern(const std::string& name, const int window, poPeepholeMatch match)
+    :
+    _name(name),
+    _window(window),
+    _match(match),
+    _hits(0)
+{
+}
+
+//
+// poPeephole
+//
+
+poPeephole::poPeephole()
+{
+    _patterns.push_back(poPeepholePattern("mov-self", 1, &poPeephole::matchMovSelf));
+    _patterns.push_back(poPeepholePattern("load-after-store", 2, &poPeephole::matchLoadAfterStore));
+    _patterns.push_back(poPeepholePattern("spill-restore", 16, &poPeephole::matchSpillRestore));
+    _patterns.push_back(poPeepholePattern("store-copy", 2, &poPeephole::matchStoreCopy));
+    _patterns.push_back(poPeepholePattern("copy-forward", 2, &poPeephole::matchCopyForward));
+    _patterns.push_back(poPeepholePattern("lea-scaled-add", 4, &poPeephole::matchLeaScaledAdd));
+    _patterns.push_back(poPeepholePattern("lea-add", 2, &poPeephole::matchLeaAdd));
+    _patterns.push_back(poPeepholePattern("address-fold", 8, &poPeephole::matchAddressFold));
+    _patterns.push_back(poPeepholePattern("load-fold", 4, &poPeephole::matchLoadFold));
+    _patterns.push_back(poPeepholePattern("test-zero", 8, &poPeephole::matchTestZero));
+    _patterns.push_back(poPeepholePattern("dead-def", 1, &poPeephole::matchDeadDef));
+    _patterns.push_back(poPeepholePattern("zero-idiom", 1, &poPeephole::matchZeroIdiom));
+    _patterns.push_back(poPeepholePattern("short-immediate", 1, &poPeephole::matchShortImmediate));
+}
+
+void poPeephole::optimize(po_x86_64_flow_graph& cfg)
+{
+    analyze(cfg);
+
+    // Rewrites never make a register live on entry to a block which wasn't before,
+    // so the block liveness computed up front remains safe while rewriting.
+
+    bool changes = true;
+    while (changes)
+    {
+        changes = false;
+        for (po_x86_64_basic_block* bb : cfg.basicBlocks())
+        {
+            if (optimizeBlock(bb))
+            {
+                changes = true;
+            }
+        }
+    }
+}
+
+void poPeephole::dump() const
+{
+    std::cout << "Peephole patterns:" << std::endl;
+    for (const poPeepholePattern& pattern : _patterns)
+    {
+        std::cout << "    " << std::left << std::setw(20) << pattern.name() << pattern.hits() << std::endl;
+    }
+}
+
+void poPeephole::analyze(po_x86_64_flow_graph& cfg)
+{
+    std::vector<po_x86_64_basic_block*>& basicBlocks = cfg.basicBlocks();
+    const int numBlocks = int(basicBlocks.size());
+
+    std::vector<std::vector<int>> successors(numBlocks);
+    std::vector<bool> exits(numBlocks, false);
+    std::unordered_map<po_x86_64_basic_block*, int> blockIndex;
+    for (int i = 0; i < numBlocks; i++)
+    {
+        blockIndex.insert(std::pair<po_x86_64_basic_block*, int>(basicBlocks[i], i));
+    }
+
+    for (int i = 0; i < numBlocks; i++)
+    {
+        po_x86_64_basic_block* bb = basicBlocks[i];
+        const std::vector<po_x86_64_instruction>& ins = bb->instructions();
+
+        if (bb->jumpBlock())
+        {
+            const auto& target = blockIndex.find(bb->jumpBlock());
+            if (target != blockIndex.end())
+            {
+                successors[i].push_back(target->second);
+            }
+            else
+            {
+                exits[i] = true;
+            }
+        }
+
+        if (ins.size() > 0 && !ins.back().isSSE() &&
+            (ins.back().opcode() == VMI_NEAR_RETURN || ins.back().opcode() == VMI_TAIL_CALL || isUnconditionalJump(ins.back())))
+        {
+            continue;
+        }
+
+        if (i + 1 < numBlocks)
+        {
+            successors[i].push_back(i + 1);
+        }
+        else
+        {
+            exits[i] = true;
+        }
+    }
+
+    // Registers read before they are written (gen) and registers written (kill) in each block
+
+    std::vector<uint32_t> gen(numBlocks, 0);
+    std::vector<uint32_t> kill(numBlocks, 0);
+    std::vector<int> flags(numBlocks, 0); // 1 = flags read on entry, -1 = flags written first
+    for (int i = 0; i < numBlocks; i++)
+    {
+        for (const po_x86_64_instruction& ins : basicBlocks[i]->instructions())
+        {
+            const poPeepholeOperands ops(ins);
+            gen[i] |= ops.uses() & ~kill[i];
+            kill[i] |= ops.defs();
+
+            if (flags[i] == 0 && ops.readsFlags())
+            {
+                flags[i] = 1;
+            }
+            else if (flags[i] == 0 && ops.writesFlags())
+            {
+                flags[i] = -1;
+            }
+        }
+    }
+
+    std::vector<uint32_t> liveIn(numBlocks, 0);
+    std::vector<uint32_t> liveOut(numBlocks, 0);
+    std::vector<bool> flagsIn(numBlocks, false);
+    std::vector<bool> flagsOut(numBlocks, false);
+
+    bool changes = true;
+    while (changes)
+    {
+        changes = false;
+        for (int i = numBlocks - 1; i >= 0; i--)
+        {
+            uint32_t out = exits[i] ? ALL_REGISTERS : 0;
+            bool outFlags = false;
+            for (const int succ : successors[i])
+            {
+                out |= liveIn[succ];
+                outFlags = outFlags || flagsIn[succ];
+            }
+
+            const uint32_t in = gen[i] | (out & ~kill[i]);
+            const bool inFlags = flags[i] == 1 || (flags[i] == 0 && outFlags);
+            if (in != liveIn[i] || out != liveOut[i] || inFlags != flagsIn[i] || outFlags != flagsOut[i])
+            {
+                liveIn[i] = in;
+                liveOut[i] = out;
+                flagsIn[i] = inFlags;
+                flagsOut[i] = outFlags;
+                changes = true;
+            }
+        }
+    }
+
+    _liveOut.clear();
+    _flagsOut.clear();
+    for (int i = 0; i < numBlocks; i++)
+    {
+        _liveOut[basicBlocks[i]] = liveOut[i];
+        _flagsOut[basicBlocks[i]] = flagsOut[i];
+    }
+}
+
+bool poPeephole::optimizeBlock(po_x86_64_basic_block* bb)
+{
+    bool changes = false;
+    int pos = 0;
+    while (pos < int(bb->instructions().size()))
+    {
+        bool matched = false;
+        for (poPeepholePattern& pattern : _patterns)
+        {
+            if ((this->*pattern.match())(bb, pos, pattern.window()))
+            {
+                pattern.addHit();
+                matched = true;
+                changes = true;
+                break;
+            }
+        }
+
+        if (!matched)
+        {
+            pos++;
+        }
+    }
+
+    return changes;
+}
+
+uint32_t poPeephole::liveAfter(po_x86_64_basic_block* bb, const int pos)
+{
+    const std::vector<po_x86_64_instruction>& ins = bb->instructions();
+
+    uint32_t live = _liveOut[bb];
+    for (int i = int(ins.size()) - 1; i > pos; i--)
+    {
+        const poPeepholeOperands ops(ins[i]);
+        live = (live & ~ops.defs()) | ops.uses();
+    }
+
+    return live;
+}
+
+bool poPeephole::isDeadAfter(po_x86_64_basic_block* bb, const int pos, const int reg)
+{
+    return (liveAfter(bb, pos) & bit(reg)) == 0;
+}
+
+bool poPeephole::flagsLiveAfter(po_x86_64_basic_block* bb, const int pos)
+{
+    const std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    for (int i = pos + 1; i < int(ins.size()); i++)
+    {
+        const poPeepholeOperands ops(ins[i]);
+        if (ops.readsFlags())
+        {
+            return true;
+        }
+        if (ops.writesFlags())
+        {
+            return false;
+        }
+    }
+
+    return _flagsOut[bb];
+}
+
+// mov r, r
+bool poPeephole::matchMovSelf(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    const po_x86_64_instruction& mov = ins[pos];
+    if (mov.isSSE() ||
+        mov.opcode() != VMI_MOV64_SRC_REG_DST_REG ||
+        mov.srcReg() != mov.dstReg())
+    {
+        return false;
+    }
+
+    ins.erase(ins.begin() + pos);
+    return true;
+}
+
+// mov [m], r; mov r2, [m] => mov [m], r; mov r2, r
+bool poPeephole::matchLoadAfterStore(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    if (pos + 1 >= int(ins.size()))
+    {
+        return false;
+    }
+
+    const po_x86_64_instruction& store = ins[pos];
+    const po_x86_64_instruction& load = ins[pos + 1];
+    if (store.isSSE() || load.isSSE() ||
+        store.opcode() != VMI_MOV64_SRC_REG_DST_MEM ||
+        load.opcode() != VMI_MOV64_SRC_MEM_DST_REG ||
+        store.id() != load.id())
+    {
+        return false;
+    }
+
+    if (store.id() == -1 &&
+        (store.dstReg() != load.srcReg() || store.imm32() != load.imm32()))
+    {
+        return false;
+    }
+
+    if (load.dstReg() == store.srcReg())
+    {
+        ins.erase(ins.begin() + pos + 1);
+    }
+    else
+    {
+        ins[pos + 1] = po_x86_64_instruction(false, VMI_MOV64_SRC_REG_DST_REG, store.srcReg(), load.dstReg());
+    }
+
+    return true;
+}
+
+// Folds the restore of a stack slot which still holds the spilled register:
+// mov [rsp+n], r; ... ; mov r2, [rsp+n] => mov [rsp+n], r; ... ; mov r2, r
+bool poPeephole::matchSpillRestore(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    const po_x86_64_instruction& spill = ins[pos];
+    if (spill.isSSE() ||
+        spill.opcode() != VMI_MOV64_SRC_REG_DST_MEM ||
+        spill.id() != -1 ||
+        spill.dstReg() != VM_REGISTER_ESP ||
+        isFrameRegister(spill.srcReg()))
+    {
+        return false;
+    }
+
+    const int reg = spill.srcReg();
+    const int offset = spill.imm32();
+    const int end = std::min(pos + window, int(ins.size()));
+    for (int i = pos + 1; i < end; i++)
+    {
+        const po_x86_64_instruction& restore = ins[i];
+        if (!restore.isSSE() &&
+            restore.opcode() == VMI_MOV64_SRC_MEM_DST_REG &&
+            restore.id() == -1 &&
+            restore.srcReg() == VM_REGISTER_ESP &&
+            restore.imm32() == offset)
+        {
+            if (restore.dstReg() == reg)
+            {
+                ins.erase(ins.begin() + i);
+            }
+            else
+            {
+                ins[i] = po_x86_64_instruction(false, VMI_MOV64_SRC_REG_DST_REG, reg, restore.dstReg());
+            }
+            return true;
+        }
+
+        const poPeepholeOperands ops(restore);
+        if (!ops.isKnown() ||
+            (ops.defs() & (bit(reg) | bit(VM_REGISTER_ESP))) != 0)
+        {
+            return false;
+        }
+
+        if (ops.storesMemory() && ops.storeId() == -1)
+        {
+            if (ops.storeBase() != VM_REGISTER_ESP)
+            {
+                return false; // may point into the stack frame
+            }
+
+            if (ops.storeOffset() < offset + 8 && offset < ops.storeOffset() + ops.storeSize())
+            {
+                return false;
+            }
+        }
+    }
+
+    return false;
+}
+
+// mov t, s; mov [m], t => mov [m], s
+bool poPeephole::matchStoreCopy(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    if (pos + 1 >= int(ins.size()))
+    {
+        return false;
+    }
+
+    const po_x86_64_instruction& mov = ins[pos];
+    po_x86_64_instruction& store = ins[pos + 1];
+    if (mov.isSSE() || store.isSSE() ||
+        mov.opcode() != VMI_MOV64_SRC_REG_DST_REG ||
+        mov.srcReg() == mov.dstReg() ||
+        isFrameRegister(mov.dstReg()))
+    {
+        return false;
+    }
+
+    switch (store.opcode())
+    {
+    case VMI_MOV64_SRC_REG_DST_MEM:
+    case VMI_MOV32_SRC_REG_DST_MEM:
+    case VMI_MOV16_SRC_REG_DST_MEM:
+    case VMI_MOV8_SRC_REG_DST_MEM:
+        break;
+    default:
+        return false;
+    }
+
+    const int temp = mov.dstReg();
+    if (store.srcReg() != temp ||
+        (store.id() == -1 && store.dstReg() == temp) ||
+        !isDeadAfter(bb, pos + 1, temp))
+    {
+        return false;
+    }
+
+    store.setSrcReg(mov.srcReg());
+    ins.erase(ins.begin() + pos);
+    return true;
+}
+
+// def t; mov d, t => def d
+bool poPeephole::matchCopyForward(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    if (pos + 1 >= int(ins.size()))
+    {
+        return false;
+    }
+
+    po_x86_64_instruction& def = ins[pos];
+    const po_x86_64_instruction& mov = ins[pos + 1];
+    if (!isPureDef(def) ||
+        mov.isSSE() ||
+        mov.opcode() != VMI_MOV64_SRC_REG_DST_REG)
+    {
+        return false;
+    }
+
+    const int temp = def.dstReg();
+    const int dst = mov.dstReg();
+    if (mov.srcReg() != temp ||
+        dst == temp ||
+        isFrameRegister(temp) ||
+        isFrameRegister(dst) ||
+        !isDeadAfter(bb, pos + 1, temp))
+    {
+        return false;
+    }
+
+    if (def.opcode() == VMI_XOR64_SRC_REG_DST_REG || def.opcode() == VMI_XOR32_SRC_REG_DST_REG)
+    {
+        def.setSrcReg(dst);
+    }
+    def.setDstReg(dst);
+    ins.erase(ins.begin() + pos + 1);
+    return true;
+}
+
+// Array indexing: mov d, scale; imul d, i; add d, b; (add d, n) => lea d, [b + i * scale + n]
+bool poPeephole::matchLeaScaledAdd(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    if (pos + 2 >= int(ins.size()))
+    {
+        return false;
+    }
+
+    int64_t scale = 0;
+    const po_x86_64_instruction& mov = ins[pos];
+    const po_x86_64_instruction& mul = ins[pos + 1];
+    const po_x86_64_instruction& add = ins[pos + 2];
+    if (!isImmediateMove(mov, scale) ||
+        (scale != 1 && scale != 2 && scale != 4 && scale != 8) ||
+        mul.isSSE() || add.isSSE() ||
+        mul.opcode() != VMI_IMUL64_SRC_REG_DST_REG ||
+        add.opcode() != VMI_ADD64_SRC_REG_DST_REG)
+    {
+        return false;
+    }
+
+    const int dst = mov.dstReg();
+    const int index = mul.srcReg();
+    const int base = add.srcReg();
+    if (isFrameRegister(dst) ||
+        mul.dstReg() != dst || add.dstReg() != dst ||
+        index == dst || index == VM_REGISTER_ESP ||
+        base == dst)
+    {
+        return false;
+    }
+
+    int last = pos + 2;
+    int offset = 0;
+    if (pos + 3 < int(ins.size()) && pos + 3 < pos + window)
+    {
+        const po_x86_64_instruction& next = ins[pos + 3];
+        if (!next.isSSE() && next.opcode() == VMI_ADD64_SRC_IMM_DST_REG && next.dstReg() == dst)
+        {
+            offset = next.imm32();
+            last = pos + 3;
+        }
+    }
+
+    if (flagsLiveAfter(bb, last))
+    {
+        return false;
+    }
+
+    po_x86_64_instruction lea(false, VMI_LEA64_SRC_INDEX_DST_REG, base, dst, int32_t(offset));
+    lea.setIndex(index, int(scale));
+    ins[pos] = lea;
+    ins.erase(ins.begin() + pos + 1, ins.begin() + last + 1);
+    return true;
+}
+
+// mov d, a; add d, n => lea d, [a + n]
+// mov d, a; add d, b => lea d, [a + b]
+// mov d, n; add d, b => lea d, [b + n]
+// lea d, [a + n]; add d, b => lea d, [a + b + n]
+bool poPeephole::matchLeaAdd(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    if (pos + 1 >= int(ins.size()))
+    {
+        return false;
+    }
+
+    const po_x86_64_instruction& mov = ins[pos];
+    const po_x86_64_instruction& add = ins[pos + 1];
+    const int dst = mov.dstReg();
+    if (mov.isSSE() || add.isSSE() ||
+        add.dstReg() != dst ||
+        isFrameRegister(dst))
+    {
+        return false;
+    }
+
+    int64_t value = 0;
+    if (mov.opcode() == VMI_LEA64_SRC_MEM_DST_REG && mov.srcReg() != dst)
+    {
+        // Field of an element whose size isn't a valid scale
+        if (add.opcode() != VMI_ADD64_SRC_REG_DST_REG ||
+            add.srcReg() == dst ||
+            add.srcReg() == VM_REGISTER_ESP ||
+            flagsLiveAfter(bb, pos + 1))
+        {
+            return false;
+        }
+
+        po_x86_64_instruction lea(false, VMI_LEA64_SRC_INDEX_DST_REG, mov.srcReg(), dst, int32_t(mov.imm32()));
+        lea.setIndex(add.srcReg(), 1);
+        ins[pos] = lea;
+        ins.erase(ins.begin() + pos + 1);
+        return true;
+    }
+    else if (mov.opcode() == VMI_MOV64_SRC_REG_DST_REG && mov.srcReg() != dst)
+    {
+        const int src = mov.srcReg();
+        if (add.opcode() == VMI_ADD64_SRC_IMM_DST_REG ||
+            add.opcode() == VMI_SUB64_SRC_IMM_DST_REG)
+        {
+            const int imm = add.imm32();
+            if (add.opcode() == VMI_SUB64_SRC_IMM_DST_REG && imm == std::numeric_limits<int>::min())
+            {
+                return false;
+            }
+
+            if (flagsLiveAfter(bb, pos + 1))
+            {
+                return false;
+            }
+
+            ins[pos] = po_x86_64_instruction(false, VMI_LEA64_SRC_MEM_DST_REG, src, dst,
+                int32_t(add.opcode() == VMI_ADD64_SRC_IMM_DST_REG ? imm : -imm));
+            ins.erase(ins.begin() + pos + 1);
+            return true;
+        }
+
+        if (add.opcode() == VMI_ADD64_SRC_REG_DST_REG && add.srcReg() != dst)
+        {
+            int base = src;
+            int index = add.srcReg();
+            if (index == VM_REGISTER_ESP)
+            {
+                std::swap(base, index);
+            }
+
+            if (index == VM_REGISTER_ESP || flagsLiveAfter(bb, pos + 1))
+            {
+                return false;
+            }
+
+            po_x86_64_instruction lea(false, VMI_LEA64_SRC_INDEX_DST_REG, base, dst, int32_t(0));
+            lea.setIndex(index, 1);
+            ins[pos] = lea;
+            ins.erase(ins.begin() + pos + 1);
+            return true;
+        }
+    }
+    else if (isImmediateMove(mov, value) &&
+        value <= std::numeric_limits<int32_t>::max() &&
+        value >= std::numeric_limits<int32_t>::min() &&
+        add.opcode() == VMI_ADD64_SRC_REG_DST_REG &&
+        add.srcReg() != dst)
+    {
+        if (flagsLiveAfter(bb, pos + 1))
+        {
+            return false;
+        }
+
+        ins[pos] = po_x86_64_instruction(false, VMI_LEA64_SRC_MEM_DST_REG, add.srcReg(), dst, int32_t(value));
+        ins.erase(ins.begin() + pos + 1);
+        return true;
+    }
+
+    return false;
+}
+
+// Element and field access: folds the address into the instruction dereferencing it
+// lea t, [b + i * scale + n]; ... ; mov r, [t + m] => mov r, [b + i * scale + n + m]
+// lea t, [b + n]; ... ; add r, [t + m] => add r, [b + n + m]
+bool poPeephole::matchAddressFold(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    const po_x86_64_instruction& lea = ins[pos];
+    if (lea.isSSE() ||
+        (lea.opcode() != VMI_LEA64_SRC_INDEX_DST_REG && lea.opcode() != VMI_LEA64_SRC_MEM_DST_REG))
+    {
+        return false;
+    }
+
+    const bool indexed = lea.opcode() == VMI_LEA64_SRC_INDEX_DST_REG;
+    const int temp = lea.dstReg();
+    const int base = lea.srcReg();
+    const int index = indexed ? lea.indexReg() : -1;
+    if (isFrameRegister(temp) || temp == base || temp == index)
+    {
+        return false;
+    }
+
+    const int end = std::min(pos + window, int(ins.size()));
+    for (int i = pos + 1; i < end; i++)
+    {
+        const po_x86_64_instruction& access = ins[i];
+        const poPeepholeOperands ops(access);
+        if (!ops.isKnown())
+        {
+            return false;
+        }
+
+        if ((ops.uses() & bit(temp)) != 0)
+        {
+            if (access.isSSE() || access.id() != -1)
+            {
+                return false;
+            }
+
+            const int opcode = indexedOpcode(access.opcode());
+            if (opcode == -1)
+            {
+                return false;
+            }
+
+            // The address must be the only use of the temporary
+            const bool store = isStoreOpcode(access.opcode());
+            const int address = store ? access.dstReg() : access.srcReg();
+            const int other = store ? access.srcReg() : access.dstReg();
+            if (address != temp)
+            {
+                return false;
+            }
+
+            if (other == temp ? !isPureDef(access) : !isDeadAfter(bb, i, temp))
+            {
+                return false;
+            }
+
+            const int64_t offset = int64_t(lea.imm32()) + int64_t(access.imm32());
+            if (offset < std::numeric_limits<int32_t>::min() ||
+                offset > std::numeric_limits<int32_t>::max())
+            {
+                return false;
+            }
+
+            po_x86_64_instruction folded(false, indexed ? opcode : access.opcode(),
+                store ? access.srcReg() : base,
+                store ? base : access.dstReg(),
+                int32_t(offset));
+            if (indexed)
+            {
+                folded.setIndex(index, lea.scale());
+            }
+
+            ins[i] = folded;
+            ins.erase(ins.begin() + pos);
+            return true;
+        }
+
+        if ((ops.defs() & (bit(temp) | bit(base) | bit(index))) != 0)
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Moves a load into the arithmetic or compare which consumes it
+// mov t, [m]; ... ; add r, t => ... ; add r, [m]
+bool poPeephole::matchLoadFold(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    const po_x86_64_instruction& load = ins[pos];
+    if (load.isSSE() || load.id() != -1)
+    {
+        return false;
+    }
+
+    bool indexed = false;
+    int size = 0;
+    switch (load.opcode())
+    {
+    case VMI_MOV64_SRC_MEM_DST_REG: size = 8; break;
+    case VMI_MOV32_SRC_MEM_DST_REG: size = 4; break;
+    case VMI_MOV64_SRC_INDEX_DST_REG: size = 8; indexed = true; break;
+    case VMI_MOV32_SRC_INDEX_DST_REG: size = 4; indexed = true; break;
+    default:
+        return false;
+    }
+
+    const int temp = load.dstReg();
+    const uint32_t address = bit(load.srcReg()) | (indexed ? bit(load.indexReg()) : 0);
+    if (isFrameRegister(temp) || (address & bit(temp)) != 0)
+    {
+        return false;
+    }
+
+    // The memory read is delayed to the consumer, so nothing in between may write memory
+    const int end = std::min(pos + window, int(ins.size()));
+    for (int i = pos + 1; i < end; i++)
+    {
+        const po_x86_64_instruction& op = ins[i];
+        const poPeepholeOperands ops(op);
+        if (!ops.isKnown() || ops.storesMemory())
+        {
+            return false;
+        }
+
+        if ((ops.uses() & bit(temp)) != 0)
+        {
+            const int opcode = op.isSSE() ? -1 : memoryOpcode(op.opcode());
+            if (opcode == -1 ||
+                op.srcReg() != temp ||
+                op.dstReg() == temp ||
+                (size == 4 && opcode != VMI_ADD32_SRC_MEM_DST_REG && opcode != VMI_SUB32_SRC_MEM_DST_REG && opcode != VMI_CMP32_SRC_MEM_DST_REG) ||
+                !isDeadAfter(bb, i, temp))
+            {
+                return false;
+            }
+
+            po_x86_64_instruction folded(false, indexed ? indexedOpcode(opcode) : opcode, load.srcReg(), op.dstReg(), int32_t(load.imm32()));
+            if (indexed)
+            {
+                folded.setIndex(load.indexReg(), load.scale());
+            }
+
+            ins[i] = folded;
+            ins.erase(ins.begin() + pos);
+            return true;
+        }
+
+        if ((ops.defs() & (bit(temp) | address)) != 0)
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Comparing against a register known to be zero: cmp r, z => test r, r
+bool poPeephole::matchTestZero(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    if (!isZeroDef(ins[pos]))
+    {
+        return false;
+    }
+
+    const int zero = ins[pos].dstReg();
+    const int end = std::min(pos + window, int(ins.size()));
+    for (int i = pos + 1; i < end; i++)
+    {
+        const po_x86_64_instruction& cmp = ins[i];
+        const int opcode = cmp.isSSE() ? -1 : testOpcode(cmp.opcode());
+        if (opcode != -1 && cmp.srcReg() == zero && cmp.dstReg() != zero)
+        {
+            ins[i] = po_x86_64_instruction(false, opcode, cmp.dstReg(), cmp.dstReg());
+            return true;
+        }
+
+        const poPeepholeOperands ops(cmp);
+        if (!ops.isKnown() || (ops.defs() & bit(zero)) != 0)
+        {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+// Removes a register write which is never read
+bool poPeephole::matchDeadDef(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    const po_x86_64_instruction& def = ins[pos];
+    if (!isPureDef(def) ||
+        isFrameRegister(def.dstReg()) ||
+        !isDeadAfter(bb, pos, def.dstReg()))
+    {
+        return false;
+    }
+
+    const poPeepholeOperands ops(def);
+    if (ops.writesFlags() && flagsLiveAfter(bb, pos))
+    {
+        return false;
+    }
+
+    ins.erase(ins.begin() + pos);
+    return true;
+}
+
+// mov r, 0 => xor r32, r32
+bool poPeephole::matchZeroIdiom(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    int64_t value = 0;
+    const int dst = ins[pos].dstReg();
+    if (!isImmediateMove(ins[pos], value) ||
+        value != 0 ||
+        dst < 0 ||
+        isFrameRegister(dst) ||
+        flagsLiveAfter(bb, pos))
+    {
+        return false;
+    }
+
+    ins[pos] = po_x86_64_instruction(false, VMI_XOR32_SRC_REG_DST_REG, dst, dst);
+    return true;
+}
+
+// movabs r, n => mov r32, n when n fits in 31 bits, the upper half is zero extended
+bool poPeephole::matchShortImmediate(po_x86_64_basic_block* bb, const int pos, const int window)
+{
+    std::vector<po_x86_64_instruction>& ins = bb->instructions();
+    const po_x86_64_instruction& mov = ins[pos];
+    if (mov.isSSE() ||
+        mov.opcode() != VMI_MOV64_SRC_IMM_DST_REG ||
+        mov.imm64() <= 0 ||
+        mov.imm64() > std::numeric_limits<int32_t>::max())
+    {
+        return false;
+    }
+
+    ins[pos] = po_x86_64_instruction(false, VMI_MOV32_SRC_IMM_DST_REG, -1, mov.dstReg(), int32_t(mov.imm64()));
+    return true;
+}
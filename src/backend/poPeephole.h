@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace po
+{
+    class po_x86_64_flow_graph;
+    class po_x86_64_basic_block;
+    class po_x86_64_instruction;
+    class poPeephole;
+
+    typedef bool (poPeephole::*poPeepholeMatch)(po_x86_64_basic_block* bb, const int pos, const int window);
+
+    //
+    // Registers, flags and memory touched by a single machine instruction.
+    // Instructions which aren't understood read and write everything.
+    //
+    class poPeepholeOperands
+    {
+    public:
+        poPeepholeOperands(const po_x86_64_instruction& ins);
+
+        inline const uint32_t uses() const { return _uses; }
+        inline const uint32_t defs() const { return _defs; }
+        inline const bool readsFlags() const { return _readsFlags; }
+        inline const bool writesFlags() const { return _writesFlags; }
+        inline const bool isKnown() const { return _known; }
+        inline const bool storesMemory() const { return _storeSize > 0; }
+        inline const int storeBase() const { return _storeBase; }
+        inline const int storeOffset() const { return _storeOffset; }
+        inline const int storeSize() const { return _storeSize; }
+        inline const int storeId() const { return _storeId; }
+
+    private:
+        void scan(const po_x86_64_instruction& ins);
+        void scanSSE(const po_x86_64_instruction& ins);
+        void setStore(const po_x86_64_instruction& ins, const int size);
+        void setIndexedStore(const po_x86_64_instruction& ins, const int size);
+        void setUnknown();
+
+        uint32_t _uses;
+        uint32_t _defs;
+        bool _readsFlags;
+        bool _writesFlags;
+        bool _known;
+        int _storeBase;
+        int _storeOffset;
+        int _storeSize;
+        int _storeId;
+    };
+
+    class poPeepholePattern
+    {
+    public:
+        poPeepholePattern(const std::string& name, const int window, poPeepholeMatch match);
+
+        inline const std::string& name() const { return _name; }
+        inline const int window() const { return _window; }
+        inline const poPeepholeMatch match() const { return _match; }
+        inline const int hits() const { return _hits; }
+        inline void addHit() { _hits++; }
+
+    private:
+        std::string _name;
+        int _window; // Number of instructions the pattern may look at
+        poPeepholeMatch _match;
+        int _hits;
+    };
+
+    class poPeephole
+    {
+    public:
+        poPeephole();
+        void optimize(po_x86_64_flow_graph& cfg);
+        void dump() const;
+
+        inline const std::vector<poPeepholePattern>& patterns() const { return _patterns; }
+
+    private:
+        void analyze(po_x86_64_flow_graph& cfg);
+        bool optimizeBlock(po_x86_64_basic_block* bb);
+        uint32_t liveAfter(po_x86_64_basic_block* bb, const int pos);
+        bool isDeadAfter(po_x86_64_basic_block* bb, const int pos, const int reg);
+        bool flagsLiveAfter(po_x86_64_basic_block* bb, const int pos);
+
+        bool matchMovSelf(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchLoadAfterStore(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchSpillRestore(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchCopyForward(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchStoreCopy(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchLeaScaledAdd(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchLeaAdd(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchAddressFold(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchLoadFold(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchTestZero(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchDeadDef(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchZeroIdiom(po_x86_64_basic_block* bb, const int pos, const int window);
+        bool matchShortImmediate(po_x86_64_basic_block* bb, const int pos, const int window);
+
+        std::vector<poPeepholePattern> _patterns;
+        std::unordered_map<po_x86_64_basic_block*, uint32_t> _liveOut; // Registers live at the end of each block
+        std::unordered_map<po_x86_64_basic_block*, bool> _flagsOut; // Flags are read after the end of each block
+    };
+}
@@ -59,7 +59,8 @@ enum vm_instruction_code
     VM_INSTRUCTION_CODE_IMMEDIATE = 0x4,
     VM_INSTRUCTION_CODE_SRC_REGISTER = 0x8,
     VM_INSTRUCTION_CODE_SRC_MEMORY = 0x10,
-    VM_INSTRUCTION_CODE_OFFSET = 0x20
+    VM_INSTRUCTION_CODE_OFFSET = 0x20,
+    VM_INSTRUCTION_CODE_INDEX = 0x40
 };
 
 #define CODE_NONE (VM_INSTRUCTION_CODE_NONE)
@@ -73,6 +74,9 @@ enum vm_instruction_code
 #define CODE_BMRO (VM_INSTRUCTION_CODE_DST_MEMORY | VM_INSTRUCTION_CODE_SRC_REGISTER | VM_INSTRUCTION_CODE_OFFSET)
 #define CODE_BRMO (VM_INSTRUCTION_CODE_SRC_MEMORY | VM_INSTRUCTION_CODE_DST_REGISTER | VM_INSTRUCTION_CODE_OFFSET)
 #define CODE_BRI (VM_INSTRUCTION_CODE_DST_REGISTER | VM_INSTRUCTION_CODE_IMMEDIATE)
+#define CODE_BRRI (VM_INSTRUCTION_CODE_DST_REGISTER | VM_INSTRUCTION_CODE_SRC_REGISTER | VM_INSTRUCTION_CODE_IMMEDIATE)
+#define CODE_BRMIO (VM_INSTRUCTION_CODE_SRC_MEMORY | VM_INSTRUCTION_CODE_DST_REGISTER | VM_INSTRUCTION_CODE_INDEX | VM_INSTRUCTION_CODE_OFFSET)
+#define CODE_BMRIO (VM_INSTRUCTION_CODE_DST_MEMORY | VM_INSTRUCTION_CODE_SRC_REGISTER | VM_INSTRUCTION_CODE_INDEX | VM_INSTRUCTION_CODE_OFFSET)
 
 enum vm_instruction_encoding
 {
@@ -124,11 +128,13 @@ static constexpr vm_instruction gInstructions[VMI_MAX_INSTRUCTIONS] = {
     INS(0x0, 0x48, 0x81, 0x0, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),    // VMI_ADD64_SRC_IMM_DST_REG
     INS(0x0, 0x48, 0x3, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),    // VMI_ADD64_SRC_MEM_DST_REG
     INS(0x0, 0x48, 0x1, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR),    // VMI_ADD64_SRC_REG_DST_MEM
+    INS(0x0, 0x48, 0x3, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),   // VMI_ADD64_SRC_INDEX_DST_REG
 
     INS(0x0, 0x0, 0x1, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_ADD32_SRC_REG_DST_REG
     INS(0x0, 0x0, 0x81, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI), // VMI_ADD32_SRC_IMM_DST_REG
     INS(0x0, 0x0, 0x3, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), // VMI_ADD32_SRC_MEM_DST_REG
     INS(0x0, 0x0, 0x1, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_RM), // VMI_ADD32_SRC_REG_DST_MEM
+    INS(0x0, 0x0, 0x3, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM), // VMI_ADD32_SRC_INDEX_DST_REG
 
     INS(0x66, 0x0, 0x1, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_ADD16_SRC_REG_DST_REG
     INS(0x66, 0x0, 0x81, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI), // VMI_ADD16_SRC_IMM_DST_REG
@@ -144,11 +150,13 @@ static constexpr vm_instruction gInstructions[VMI_MAX_INSTRUCTIONS] = {
     INS(0x0, 0x48, 0x81, 5, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),    // VMI_SUB64_SRC_IMM_DST_REG
     INS(0x0, 0x48, 0x2B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),   // VMI_SUB64_SRC_MEM_DST_REG
     INS(0x0, 0x48, 0x29, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR),   // VMI_SUB64_SRC_REG_DST_MEM
+    INS(0x0, 0x48, 0x2B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),  // VMI_SUB64_SRC_INDEX_DST_REG
 
     INS(0x0, 0x0, 0x2B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM),   //VMI_SUB32_SRC_REG_DST_REG,
     INS(0x0, 0x0, 0x81, 0x5, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),          //VMI_SUB32_SRC_IMM_DST_REG,
     INS(0x0, 0x0, 0x2B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),   //VMI_SUB32_SRC_MEM_DST_REG,
     INS(0x0, 0x0, 0x29, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR),   //VMI_SUB32_SRC_REG_DST_MEM,
+    INS(0x0, 0x0, 0x2B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),  //VMI_SUB32_SRC_INDEX_DST_REG,
 
     INS(0x66, 0x0, 0x2B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM),   // VMI_SUB16_SRC_REG_DST_REG,
     INS(0x66, 0x0, 0x81, 0x5, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),          // VMI_SUB16_SRC_IMM_DST_REG,
@@ -164,21 +172,29 @@ static constexpr vm_instruction gInstructions[VMI_MAX_INSTRUCTIONS] = {
     INS(0x0, 0x48, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR),   // VMI_MOV64_SRC_REG_DST_MEM
     INS(0x0, 0x48, 0x8B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),   // VMI_MOV64_SRC_MEM_DST_REG
     INS(0x0, 0x48, 0xC7, 0x0, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),    // VMI_MOV64_SRC_IMM_DST_REG
+    INS(0x0, 0x48, 0x8B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),  // VMI_MOV64_SRC_INDEX_DST_REG
+    INS(0x0, 0x48, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRIO, VMI_ENC_MR),  // VMI_MOV64_SRC_REG_DST_INDEX
 
     INS(0x0, 0x0, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR),      //VMI_MOV_SRC_REG_DST_REG,
     INS(0x0, 0x0, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR),     //VMI_MOV32_SRC_REG_DST_MEM,
     INS(0x0, 0x0, 0x8B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),     //VMI_MOV32_SRC_MEM_DST_REG,
     INS(0x0, 0x0, 0xB8, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_OI),       // VMI_MOV32_SRC_IMM_DST_REG
+    INS(0x0, 0x0, 0x8B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),    //VMI_MOV32_SRC_INDEX_DST_REG,
+    INS(0x0, 0x0, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRIO, VMI_ENC_MR),    //VMI_MOV32_SRC_REG_DST_INDEX,
 
     INS(0x66, 0x0, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR),// VMI_MOV16_SRC_REG_DST_REG,
     INS(0x66, 0x0, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR),// VMI_MOV16_SRC_REG_DST_MEM,
     INS(0x66, 0x0, 0x8B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),// VMI_MOV16_SRC_MEM_DST_REG,
     INS(0x66, 0x0, 0xB8, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_OI),// VMI_MOV16_SRC_IMM_DST_REG,
+    INS(0x66, 0x0, 0x8B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),// VMI_MOV16_SRC_INDEX_DST_REG,
+    INS(0x66, 0x0, 0x89, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRIO, VMI_ENC_MR),// VMI_MOV16_SRC_REG_DST_INDEX,
 
     INS(0x0, 0x48, 0xB0, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_OI), //VMI_MOV8_SRC_IMM_DST_REG
     INS(0x0, 0x48, 0x88, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), //VMI_MOV8_SRC_REG_DST_REG,
-    INS(0x0, 0x48, 0x8A, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRM, VMI_ENC_RM), //VMI_MOV8_SRC_MEM_DST_REG,
+    INS(0x0, 0x48, 0x8A, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), //VMI_MOV8_SRC_MEM_DST_REG,
     INS(0x0, 0x48, 0x88, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR), //VMI_MOV8_SRC_REG_DST_MEM,
+    INS(0x0, 0x40, 0x8A, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM), //VMI_MOV8_SRC_INDEX_DST_REG,
+    INS(0x0, 0x40, 0x88, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRIO, VMI_ENC_MR), //VMI_MOV8_SRC_REG_DST_INDEX,
 
     INS(0x0, 0x48, 0x0F, 0xAF, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM), // VMI_IMUL64_SRC_REG_DST_REG /* signed */
     INS(0x0, 0x48, 0x0F, 0xAF, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), // VMI_IMUL64_SRC_MEM_DST_REG /* signed */
@@ -214,26 +230,42 @@ static constexpr vm_instruction gInstructions[VMI_MAX_INSTRUCTIONS] = {
     INS(0x0, 0x48, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM), // VMI_CMP64_SRC_REG_DST_REG
     INS(0x0, 0x48, 0x39, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR), // VMI_CMP64_SRC_REG_DST_MEM
     INS(0x0, 0x48, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), // VMI_CMP64_SRC_MEM_DST_REG
+    INS(0x0, 0x48, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM), // VMI_CMP64_SRC_INDEX_DST_REG
 
     INS(0x0, 0x0, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM), //VMI_CMP32_SRC_REG_DST_REG,
     INS(0x0, 0x0, 0x39, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR), //VMI_CMP32_SRC_REG_DST_MEM,
     INS(0x0, 0x0, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), //VMI_CMP32_SRC_MEM_DST_REG,
+    INS(0x0, 0x0, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM), //VMI_CMP32_SRC_INDEX_DST_REG,
 
     INS(0x66, 0x0, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM), //VMI_CMP16_SRC_REG_DST_REG,
     INS(0x66, 0x0, 0x39, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_MR), //VMI_CMP16_SRC_REG_DST_MEM,
     INS(0x66, 0x0, 0x3B, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), //VMI_CMP16_SRC_MEM_DST_REG,
 
     INS(0x0, 0x40, 0x38, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_CMP8_SRC_REG_DST_REG
-    INS(0x0, 0x40, 0x3A, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRM, VMI_ENC_RM), // VMI_CMP8_SRC_MEM_DST_REG
+    INS(0x0, 0x40, 0x3A, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM), // VMI_CMP8_SRC_MEM_DST_REG
     INS(0x0, 0x40, 0x38, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMR, VMI_ENC_MR), // VMI_CMP8_SRC_REG_DST_MEM
 
+    INS(0x0, 0x48, 0x85, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_TEST64_SRC_REG_DST_REG
+    INS(0x0, 0x0, 0x85, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_TEST32_SRC_REG_DST_REG
+    INS(0x66, 0x0, 0x85, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_TEST16_SRC_REG_DST_REG
+    INS(0x0, 0x40, 0x84, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_TEST8_SRC_REG_DST_REG
+
+    INS(0x0, 0x48, 0x31, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_XOR64_SRC_REG_DST_REG
+    INS(0x0, 0x0, 0x31, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_XOR32_SRC_REG_DST_REG
+
+    INS(0x0, 0x48, 0x87, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_XCHG64_SRC_REG_DST_REG
+
     INS(0x0, 0x0, 0xEB, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_J8
     INS(0x0, 0x0, 0x74, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JE8
     INS(0x0, 0x0, 0x75, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JNE8
-    INS(0x0, 0x0, 0x72, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JL8,
-    INS(0x0, 0x0, 0x77, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JG8,
-    INS(0x0, 0x0, 0x76, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JLE8,
-    INS(0x0, 0x0, 0x73, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JGE8,
+    INS(0x0, 0x0, 0x7C, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JL8, /*signed*/
+    INS(0x0, 0x0, 0x7F, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JG8, /*signed*/
+    INS(0x0, 0x0, 0x7E, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JLE8, /*signed*/
+    INS(0x0, 0x0, 0x7D, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JGE8, /*signed*/
+    INS(0x0, 0x0, 0x72, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JNAE8, /*unsigned*/
+    INS(0x0, 0x0, 0x77, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JNBE8, /*unsigned*/
+    INS(0x0, 0x0, 0x76, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JNA8, /*unsigned*/
+    INS(0x0, 0x0, 0x73, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_JNB8, /*unsigned*/
     INS(0x0, 0x0, 0xFF, 0x4, VM_INSTRUCTION_CODE_OFFSET, CODE_UR, VMI_ENC_M), // VMI_JA64
 
     INS(0x0, 0x0, 0xE9, VMI_UNUSED, VM_INSTRUCTION_CODE_OFFSET, CODE_UI, VMI_ENC_D), // VMI_J32
@@ -311,7 +343,8 @@ static constexpr vm_instruction gInstructions[VMI_MAX_INSTRUCTIONS] = {
     INS(0x0, 0x48, 0xF, 0xB7, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),//VMI_MOVZX_16_TO_64_SRC_MEM_DST_REG,
 
     INS(0x0, 0x48, 0x8D, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM),    // VMI_LEA64_SRC_REG_DST_REG,
-    INS(0x0, 0x48, 0x8D, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BMR, VMI_ENC_RM),    // VMI_LEA64_SRC_MEM_DST_REG,
+    INS(0x0, 0x48, 0x8D, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_RM),    // VMI_LEA64_SRC_MEM_DST_REG,
+    INS(0x0, 0x48, 0x8D, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRMIO, VMI_ENC_RM),    // VMI_LEA64_SRC_INDEX_DST_REG,
 
     INS(0x0, 0x48, 0xC1, 0x4, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),// VMI_SAL64_SRC_IMM_DST_REG, // left shift
     INS(0x0, 0x0, 0xC1, 0x4, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI),// VMI_SAL32_SRC_IMM_DST_REG,
@@ -334,12 +367,24 @@ static constexpr vm_instruction gInstructions[VMI_MAX_INSTRUCTIONS] = {
     INS(0x0, 0x40, 0xD2, 0x7, VM_INSTRUCTION_UNARY, CODE_UR, VMI_ENC_MC),// VMI_SAR8_SRC_REG_DST_REG,
 
     INS(0x0, 0x48, 0x98, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_CDQE
+    INS(0x0, 0x48, 0x99, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_CQO
+    INS(0x0, 0x0, 0x99, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_CDQ
+    INS(0x66, 0x0, 0x99, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_CWD
+    INS(0x66, 0x0, 0x98, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_CBW
+
+    INS(0xF3, 0x0, 0xA4, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_REP_MOVSB
+    INS(0xF3, 0x0, 0xAA, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_Z0),// VMI_REP_STOSB
+    INS(0x0, 0x48, 0x0F, 0xBC, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_RM), // VMI_BSF64_SRC_REG_DST_REG
+    INS(0x0, 0x48, 0xC1, 0x5, VM_INSTRUCTION_BINARY, CODE_BRI, VMI_ENC_MI), // VMI_SHR64_SRC_IMM_DST_REG
+    INS(0x0, 0x48, 0x21, VMI_UNUSED, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_MR), // VMI_AND64_SRC_REG_DST_REG
+    INS(0x0, 0x48, 0xF7, 0x5, VM_INSTRUCTION_UNARY, CODE_UR, VMI_ENC_M), // VMI_IMUL64_SRC_REG /*signed*/
 
     INS(0x0, 0x0, 0x50, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_C), // VMI_PUSH_REG, (not implemented)
     INS(0x0, 0x0, 0x48, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_C), // VMI_POP_REG, (not implemented)
     INS(0x0, 0x0, 0x0, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_C), // VMI_JUMP_MEM, (not implemented)
     INS(0x0, 0x0, 0x0, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_C), // JMI_CALL_MEM, (not implemented)
     INS(0x0, 0x0, 0x0, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_C), // VMI_CALL (not implemented)
+    INS(0x0, 0x0, 0x0, 0x0, VM_INSTRUCTION_NONE, CODE_NONE, VMI_ENC_C), // VMI_TAIL_CALL (not implemented)
 };
 
 static constexpr vm_sse_instruction gInstructions_SSE[VMI_SSE_MAX_INSTRUCTIONS] = {
@@ -398,6 +443,39 @@ static constexpr vm_sse_instruction gInstructions_SSE[VMI_SSE_MAX_INSTRUCTIONS]
 
     SSE_INS(0x0, VMI_UNUSED, 0xF, 0x57, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_XORPS_SRC_REG_DST_REG
 
+    SSE_INS(0x0, 0xF3, 0xF, 0x6F, VM_INSTRUCTION_BINARY, CODE_BRMO, VMI_ENC_A), // VMI_SSE_MOVDQU_SRC_MEM_DST_REG
+    SSE_INS(0x0, 0xF3, 0xF, 0x7F, VM_INSTRUCTION_BINARY, CODE_BMRO, VMI_ENC_C), // VMI_SSE_MOVDQU_SRC_REG_DST_MEM
+    SSE_INS(0x48, 0x66, 0xF, 0x6E, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MOVQ_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x6C, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PUNPCKLQDQ_SRC_REG_DST_REG
+    SSE_INS(0x48, 0x66, 0xF, 0x7E, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MOVQ_SRC_SSE_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x70, VM_INSTRUCTION_BINARY, CODE_BRRI, VMI_ENC_A), // VMI_SSE_PSHUFD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xEF, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PXOR_SRC_REG_DST_REG
+
+    SSE_INS(0x0, 0x66, 0xF, 0xFC, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PADDB_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xFD, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PADDW_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xFE, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PADDD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xD4, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PADDQ_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xF8, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PSUBB_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xF9, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PSUBW_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xFA, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PSUBD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xFB, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PSUBQ_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0x58, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_ADDPS_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0x5C, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_SUBPS_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0x59, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MULPS_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0x5E, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_DIVPS_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x5C, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_SUBPD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x59, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MULPD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x5E, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_DIVPD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x74, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PCMPEQB_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xD7, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PMOVMSKB_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0x28, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MOVAPS_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x76, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PCMPEQD_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x66, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_PCMPGTD_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0xC2, VM_INSTRUCTION_BINARY, CODE_BRRI, VMI_ENC_A), // VMI_SSE_CMPPS_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0xC2, VM_INSTRUCTION_BINARY, CODE_BRRI, VMI_ENC_A), // VMI_SSE_CMPPD_SRC_REG_DST_REG
+    SSE_INS(0x0, VMI_UNUSED, 0xF, 0x50, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MOVMSKPS_SRC_REG_DST_REG
+    SSE_INS(0x0, 0x66, 0xF, 0x50, VM_INSTRUCTION_BINARY, CODE_BRR, VMI_ENC_A), // VMI_SSE_MOVMSKPD_SRC_REG_DST_REG
+
 };
 
 //=====================
@@ -409,6 +487,7 @@ static constexpr vm_sse_instruction gInstructions_SSE[VMI_SSE_MAX_INSTRUCTIONS]
 void po_x86_64::emit(const vm_instruction& ins)
 {
     assert(ins.code == CODE_NONE);
+    if (ins.legacy > 0) { _programData.push_back(ins.legacy); }
     if (ins.rex > 0) { _programData.push_back(ins.rex); }
     _programData.push_back(ins.ins);
 }
@@ -660,6 +739,62 @@ void po_x86_64::emit_brmo(const vm_instruction& ins, char dst, char src, int off
     }
 }
 
+void po_x86_64::emit_brmio(const vm_instruction& ins, char dst, char base, char index, int scale, int offset)
+{
+    assert(ins.code == CODE_BRMIO);
+    emit_sib(ins, dst, base, index, scale, offset);
+}
+
+void po_x86_64::emit_bmrio(const vm_instruction& ins, char base, char index, int scale, char src, int offset)
+{
+    assert(ins.code == CODE_BMRIO);
+    emit_sib(ins, src, base, index, scale, offset);
+}
+
+void po_x86_64::emit_sib(const vm_instruction& ins, char reg, char base, char index, int scale, int offset)
+{
+    assert(index != VM_REGISTER_ESP); // RSP can't be used as an index
+    if (ins.legacy) { _programData.push_back(ins.legacy); }
+
+    unsigned char rex = ins.rex;
+    if (reg >= VM_REGISTER_R8) { rex |= 0x4 | (1 << 6); }
+    if (index >= VM_REGISTER_R8) { rex |= 0x2 | (1 << 6); }
+    if (base >= VM_REGISTER_R8) { rex |= 0x1 | (1 << 6); }
+    if (rex > 0) { _programData.push_back(rex); }
+    _programData.push_back(ins.ins);
+    if (ins.subins != VMI_UNUSED) { _programData.push_back(ins.subins); }
+
+    int ss = 0;
+    switch (scale)
+    {
+    case 1: ss = 0; break;
+    case 2: ss = 1; break;
+    case 4: ss = 2; break;
+    case 8: ss = 3; break;
+    default: assert(false); break;
+    }
+
+    // RBP/R13 as a base always needs a displacement
+    int mod = 0x2;
+    if (offset == 0 && (base % 8) != VM_REGISTER_EBP) { mod = 0x0; }
+    else if (offset >= -128 && offset <= 127) { mod = 0x1; }
+
+    _programData.push_back((((reg % 8) & 0x7) << 3) | 0x4 | (mod << 6));
+    _programData.push_back((ss << 6) | (((index % 8) & 0x7) << 3) | ((base % 8) & 0x7)); // SIB byte
+
+    if (mod == 0x1)
+    {
+        _programData.push_back((unsigned char)(offset & 0xff));
+    }
+    else if (mod == 0x2)
+    {
+        _programData.push_back((unsigned char)(offset & 0xff));
+        _programData.push_back((unsigned char)((offset >> 8) & 0xff));
+        _programData.push_back((unsigned char)((offset >> 16) & 0xff));
+        _programData.push_back((unsigned char)((offset >> 24) & 0xff));
+    }
+}
+
 void po_x86_64::emit_bmro(const vm_instruction& ins, char dst, char src, int offset)
 {
     assert(ins.code == CODE_BMRO);
@@ -744,6 +879,43 @@ void po_x86_64::emit_ui(const vm_instruction& ins, int imm)
 //================
 
 
+const bool po_x86_64_instruction::isJump() const
+{
+    if (_isSSE)
+    {
+        return false;
+    }
+
+    switch (_opcode)
+    {
+    case VMI_J8:
+    case VMI_JE8:
+    case VMI_JNE8:
+    case VMI_JL8:
+    case VMI_JG8:
+    case VMI_JLE8:
+    case VMI_JGE8:
+    case VMI_JNAE8:
+    case VMI_JNBE8:
+    case VMI_JNA8:
+    case VMI_JNB8:
+    case VMI_J32:
+    case VMI_JE32:
+    case VMI_JNE32:
+    case VMI_JNAE32:
+    case VMI_JNBE32:
+    case VMI_JNA32:
+    case VMI_JNB32:
+    case VMI_JG32:
+    case VMI_JGE32:
+    case VMI_JL32:
+    case VMI_JLE32:
+        return true;
+    }
+
+    return false;
+}
+
 void po_x86_64_Lower::op_imm(const int opcode, const int imm)
 {
     _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, opcode, -1, -1, imm));
@@ -796,6 +968,11 @@ void po_x86_64_Lower::sse_binop(const int src, const int dst, const int opcode,
     _cfg.getLast()->instructions().push_back(po_x86_64_instruction(true, opcode, src, dst, offset));
 }
 
+void po_x86_64_Lower::sse_binop_imm(const int src, const int dst, const int opcode, const char imm)
+{
+    _cfg.getLast()->instructions().push_back(po_x86_64_instruction(true, opcode, src, dst, int8_t(imm)));
+}
+
 void po_x86_64_Lower::sse_unaryop(const int dst, const int opcode, const int offset)
 {
     _cfg.getLast()->instructions().push_back(po_x86_64_instruction(true, opcode, -1, dst, offset));
@@ -804,7 +981,7 @@ void po_x86_64_Lower::sse_unaryop(const int dst, const int opcode, const int off
 void po_x86_64_Lower::mc_reserve() {}
 void po_x86_64_Lower::mc_reserve2() {}
 void po_x86_64_Lower::mc_reserve3() {}
-void po_x86_64_Lower::mc_cdq() {}
+void po_x86_64_Lower::mc_cdq() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_CDQ, -1, -1)); }
 void po_x86_64_Lower::mc_return() { op_imm(VMI_NEAR_RETURN, 0); }
 void po_x86_64_Lower::mc_push_32(const int imm) {}
 void po_x86_64_Lower::mc_push_reg(char reg) { unaryop(reg, VMI_PUSH_REG); }
@@ -911,6 +1088,7 @@ void po_x86_64_Lower::mc_mov_memory_to_reg_x64(char dst, char src, int src_offse
 void po_x86_64_Lower::mc_mov_memory_to_reg_x64(char dst, int addr) { binop(-1, dst, VMI_MOV64_SRC_MEM_DST_REG, addr); }
 void po_x86_64_Lower::mc_mov_reg_to_memory_x64(char src, int addr) { binop(src, -1, VMI_MOV64_SRC_REG_DST_MEM, addr); };
 void po_x86_64_Lower::mc_mov_reg_to_reg_x64(char dst, char src) { binop(src, dst, VMI_MOV64_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_xchg_reg_to_reg_x64(char dst, char src) { binop(src, dst, VMI_XCHG64_SRC_REG_DST_REG); }
 void po_x86_64_Lower::mc_add_reg_to_reg_x64(char dst, char src) { binop(src, dst, VMI_ADD64_SRC_REG_DST_REG); }
 void po_x86_64_Lower::mc_add_memory_to_reg_x64(char dst, char src, int src_offset) { binop(src, dst, VMI_ADD64_SRC_MEM_DST_REG, src_offset); }
 void po_x86_64_Lower::mc_add_reg_to_memory_x64(char dst, char src, int dst_offset) { binop(src, dst, VMI_ADD64_SRC_REG_DST_MEM, dst_offset); }
@@ -938,6 +1116,15 @@ void po_x86_64_Lower::mc_neg_memory_x64(int reg, int offset) { unaryop(reg, VMI_
 void po_x86_64_Lower::mc_neg_reg_x64(int reg) { unaryop(reg, VMI_NEG64_DST_REG); }
 void po_x86_64_Lower::mc_lea_reg_to_reg_x64(char dst, int addr) { binop(-1, dst, VMI_LEA64_SRC_REG_DST_REG, addr); }
 void po_x86_64_Lower::mc_sar_imm_to_reg_x64(char reg, char imm) { unaryop_imm(reg, VMI_SAR64_SRC_IMM_DST_REG, imm); }
+void po_x86_64_Lower::mc_shr_imm_to_reg_x64(char reg, char imm) { unaryop_imm(reg, VMI_SHR64_SRC_IMM_DST_REG, imm); }
+void po_x86_64_Lower::mc_and_reg_to_reg_x64(char dst, char src) { binop(src, dst, VMI_AND64_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_imul_reg_x64(char reg) { unaryop(reg, VMI_IMUL64_SRC_REG); }
+void po_x86_64_Lower::mc_lea_index_to_reg_x64(char dst, char base, char index, int scale, int offset)
+{
+    po_x86_64_instruction ins(false, VMI_LEA64_SRC_INDEX_DST_REG, base, dst, int32_t(offset));
+    ins.setIndex(index, scale);
+    _cfg.getLast()->instructions().push_back(ins);
+}
 void po_x86_64_Lower::mc_sal_imm_to_reg_x64(char reg, char imm) { unaryop_imm(reg, VMI_SAL64_SRC_IMM_DST_REG, imm); }
 void po_x86_64_Lower::mc_sar_reg_x64(char reg) { unaryop(reg, VMI_SAR64_SRC_REG_DST_REG); }
 void po_x86_64_Lower::mc_sal_reg_x64(char reg) { unaryop(reg, VMI_SAL64_SRC_REG_DST_REG); }
@@ -951,6 +1138,10 @@ void po_x86_64_Lower::mc_jump_less_8(int imm) { op_imm(VMI_JL8, imm); }
 void po_x86_64_Lower::mc_jump_less_equal_8(int imm) { op_imm(VMI_JLE8, imm); }
 void po_x86_64_Lower::mc_jump_greater_8(int imm) { op_imm(VMI_JG8, imm); }
 void po_x86_64_Lower::mc_jump_greater_equal_8(int imm) { op_imm(VMI_JGE8, imm); }
+void po_x86_64_Lower::mc_jump_not_above_8(int imm) { op_imm(VMI_JNA8, imm); }
+void po_x86_64_Lower::mc_jump_not_above_equal_8(int imm) { op_imm(VMI_JNAE8, imm); }
+void po_x86_64_Lower::mc_jump_not_below_8(int imm) { op_imm(VMI_JNB8, imm); }
+void po_x86_64_Lower::mc_jump_not_below_equal_8(int imm) { op_imm(VMI_JNBE8, imm); }
 void po_x86_64_Lower::mc_jump_unconditional(int imm) { op_imm(VMI_J32, imm); }
 void po_x86_64_Lower::mc_jump_equals(int imm) { op_imm(VMI_JE32, imm); }
 void po_x86_64_Lower::mc_jump_not_equals(int imm) { op_imm(VMI_JNE32, imm); }
@@ -966,6 +1157,7 @@ void po_x86_64_Lower::mc_jump_absolute(int reg) {  }
 void po_x86_64_Lower::mc_jump_memory(int offset) { op_imm(VMI_JUMP_MEM, offset); }
 void po_x86_64_Lower::mc_call_memory(int offset) { op_imm(VMI_CALL_MEM, offset); }
 void po_x86_64_Lower::mc_call(int offset) { op_imm(VMI_CALL, offset); }
+void po_x86_64_Lower::mc_tail_call(int offset) { op_imm(VMI_TAIL_CALL, offset); }
 void po_x86_64_Lower::mc_call_absolute(int reg) { }
 
 /* Sign extend operations */
@@ -996,6 +1188,15 @@ void po_x86_64_Lower::mc_movzx_16_to_32_mem_to_reg(char dst, char src, int src_o
 void po_x86_64_Lower::mc_movzx_16_to_64_reg_to_reg(char dst, char src) { binop(src, dst, VMI_MOVZX_16_TO_64_SRC_REG_DST_REG); }
 void po_x86_64_Lower::mc_movzx_16_to_64_mem_to_reg(char dst, char src, int src_offset) { binop(src, dst, VMI_MOVZX_16_TO_64_SRC_MEM_DST_REG, src_offset); }
 void po_x86_64_Lower::mc_cdqe() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_CDQE, -1, -1)); }
+void po_x86_64_Lower::mc_cqo() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_CQO, -1, -1)); }
+void po_x86_64_Lower::mc_cwd() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_CWD, -1, -1)); }
+void po_x86_64_Lower::mc_cbw() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_CBW, -1, -1)); }
+
+/* Block memory operations */
+
+void po_x86_64_Lower::mc_rep_movsb() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_REP_MOVSB, -1, -1)); }
+void po_x86_64_Lower::mc_rep_stosb() { _cfg.getLast()->instructions().push_back(po_x86_64_instruction(false, VMI_REP_STOSB, -1, -1)); }
+void po_x86_64_Lower::mc_bsf_reg_to_reg_x64(char dst, char src) { binop(src, dst, VMI_BSF64_SRC_REG_DST_REG); }
 
 /* Floating point operations */
 
@@ -1035,6 +1236,38 @@ void po_x86_64_Lower::mc_cvtsssi_reg_to_reg_x64(int dst, int src) { sse_binop(sr
 void po_x86_64_Lower::mc_ucmps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_UCOMISS_SRC_REG_DST_REG); }
 void po_x86_64_Lower::mc_ucmps_memory_to_reg_x64(int dst, int src, int src_offset) { sse_binop(src, dst, VMI_SSE_UCOMISS_SRC_MEM_DST_REG); }
 void po_x86_64_Lower::mc_xorps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_XORPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_movdqu_reg_to_memory_x64(int dst, int src, int dst_offset) { sse_binop(src, dst, VMI_SSE_MOVDQU_SRC_REG_DST_MEM, dst_offset); }
+void po_x86_64_Lower::mc_movdqu_memory_to_reg_x64(int dst, int src, int src_offset) { sse_binop(src, dst, VMI_SSE_MOVDQU_SRC_MEM_DST_REG, src_offset); }
+void po_x86_64_Lower::mc_movq_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_MOVQ_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_punpcklqdq_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PUNPCKLQDQ_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_movq_sse_to_reg_x64(int dst, int src) { sse_binop(dst, src, VMI_SSE_MOVQ_SRC_SSE_DST_REG); }
+void po_x86_64_Lower::mc_pshufd_reg_to_reg_x64(int dst, int src, char imm) { sse_binop_imm(src, dst, VMI_SSE_PSHUFD_SRC_REG_DST_REG, imm); }
+void po_x86_64_Lower::mc_pxor_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PXOR_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_paddb_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PADDB_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_paddw_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PADDW_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_paddd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PADDD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_paddq_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PADDQ_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_psubb_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PSUBB_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_psubw_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PSUBW_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_psubd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PSUBD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_psubq_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PSUBQ_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_addps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_ADDPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_subps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_SUBPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_mulps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_MULPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_divps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_DIVPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_addpd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_ADDPD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_subpd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_SUBPD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_mulpd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_MULPD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_divpd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_DIVPD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_pcmpeqb_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PCMPEQB_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_pmovmskb_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PMOVMSKB_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_movaps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_MOVAPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_pcmpeqd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PCMPEQD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_pcmpgtd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_PCMPGTD_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_cmpps_reg_to_reg_x64(int dst, int src, char imm) { sse_binop_imm(src, dst, VMI_SSE_CMPPS_SRC_REG_DST_REG, imm); }
+void po_x86_64_Lower::mc_cmppd_reg_to_reg_x64(int dst, int src, char imm) { sse_binop_imm(src, dst, VMI_SSE_CMPPD_SRC_REG_DST_REG, imm); }
+void po_x86_64_Lower::mc_movmskps_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_MOVMSKPS_SRC_REG_DST_REG); }
+void po_x86_64_Lower::mc_movmskpd_reg_to_reg_x64(int dst, int src) { sse_binop(src, dst, VMI_SSE_MOVMSKPD_SRC_REG_DST_REG); }
 
 void po_x86_64_Lower::dump() const
 {
@@ -1099,6 +1332,24 @@ void po_x86_64::emit_sse_brr(const vm_sse_instruction& ins, int src, int dst)
     _programData.push_back((((dst % 8) & 0x7) << 3) | (0x3 << 6) | ((src % 8) & 0x7));
 }
 
+void po_x86_64::emit_sse_brri(const vm_sse_instruction& ins, int src, int dst, char imm)
+{
+    assert(ins.code == CODE_BRRI);
+    if (ins.ins1 != VMI_UNUSED) {
+        _programData.push_back(ins.ins1);
+    }
+    unsigned char rex = ins.rex;
+    if (src >= VM_SSE_REGISTER_XMM8) { rex |= 0x1 | (1 << 6); }
+    if (dst >= VM_SSE_REGISTER_XMM8) { rex |= 0x4 | (1 << 6); }
+
+    if (rex > 0) { _programData.push_back(rex); }
+    _programData.push_back(ins.ins2);
+    _programData.push_back(ins.ins3);
+
+    _programData.push_back((((dst % 8) & 0x7) << 3) | (0x3 << 6) | ((src % 8) & 0x7));
+    _programData.push_back((unsigned char)imm);
+}
+
 void po_x86_64::emit_sse_brmo(const vm_sse_instruction& ins, int src, int dst, int src_offset)
 {
     assert(ins.code == CODE_BRMO);
@@ -1206,6 +1457,9 @@ void po_x86_64::emit(const po_x86_64_instruction& instruction)
             case CODE_BRR:
                 emit_sse_brr(sse_ins, instruction.srcReg(), instruction.dstReg());
                 break;
+            case CODE_BRRI:
+                emit_sse_brri(sse_ins, instruction.srcReg(), instruction.dstReg(), instruction.imm8());
+                break;
             case CODE_BRMO:
                 emit_sse_brmo(sse_ins, instruction.srcReg(), instruction.dstReg(), instruction.imm32());
                 break;
@@ -1230,9 +1484,15 @@ void po_x86_64::emit(const po_x86_64_instruction& instruction)
             case CODE_BRMO:
                 emit_brmo(ins, instruction.dstReg(), instruction.srcReg(), instruction.imm32());
                 break;
+            case CODE_BRMIO:
+                emit_brmio(ins, instruction.dstReg(), instruction.srcReg(), instruction.indexReg(), instruction.scale(), instruction.imm32());
+                break;
             case CODE_BMRO:
                 emit_bmro(ins, instruction.dstReg(), instruction.srcReg(), instruction.imm32());
                 break;
+            case CODE_BMRIO:
+                emit_bmrio(ins, instruction.dstReg(), instruction.indexReg(), instruction.scale(), instruction.srcReg(), instruction.imm32());
+                break;
             case CODE_BRM:
                 emit_brm(ins, instruction.dstReg(), instruction.imm32());
                 break;
@@ -1263,6 +1523,9 @@ void po_x86_64::emit_jump(const int opcode, const int imm)
     case VMI_J32:
         mc_jump_unconditional(imm);
         break;
+    case VMI_J8:
+        mc_jump_unconditional_8(imm);
+        break;
     case VMI_JE8:
         mc_jump_equals_8(imm);
         break;
@@ -1281,6 +1544,18 @@ void po_x86_64::emit_jump(const int opcode, const int imm)
     case VMI_JGE8:
         mc_jump_greater_equal_8(imm);
         break;
+    case VMI_JNA8:
+        mc_jump_not_above_8(imm);
+        break;
+    case VMI_JNAE8:
+        mc_jump_not_above_equal_8(imm);
+        break;
+    case VMI_JNB8:
+        mc_jump_not_below_8(imm);
+        break;
+    case VMI_JNBE8:
+        mc_jump_not_below_equal_8(imm);
+        break;
     case VMI_JL32:
         mc_jump_less(imm);
         break;
@@ -1334,7 +1609,7 @@ void po_x86_64::mc_reserve3()
 }
 void po_x86_64::mc_cdq()
 {
-    _programData.push_back(0x99);
+    emit(gInstructions[VMI_CDQ]);
 }
 void po_x86_64::mc_return()
 {
@@ -1815,31 +2090,47 @@ void po_x86_64::mc_cmp_memory_to_reg_x64(char dst, char src, int src_offset)
 }
 void po_x86_64::mc_jump_unconditional_8(int imm)
 {
-    emit_ui(gInstructions[VMI_J8], imm);
+    emit_ui(gInstructions[VMI_J8], char(imm));
 }
 void po_x86_64::mc_jump_equals_8(int imm)
 {
-    emit_ui(gInstructions[VMI_JE8], imm);
+    emit_ui(gInstructions[VMI_JE8], char(imm));
 }
 void po_x86_64::mc_jump_not_equals_8(int imm)
 {
-    emit_ui(gInstructions[VMI_JNE8], imm);
+    emit_ui(gInstructions[VMI_JNE8], char(imm));
 }
 void po_x86_64::mc_jump_less_8(int imm)
 {
-    emit_ui(gInstructions[VMI_JL8], imm);
+    emit_ui(gInstructions[VMI_JL8], char(imm));
 }
 void po_x86_64::mc_jump_less_equal_8(int imm)
 {
-    emit_ui(gInstructions[VMI_JLE8], imm);
+    emit_ui(gInstructions[VMI_JLE8], char(imm));
 }
 void po_x86_64::mc_jump_greater_8(int imm)
 {
-    emit_ui(gInstructions[VMI_JG8], imm);
+    emit_ui(gInstructions[VMI_JG8], char(imm));
 }
 void po_x86_64::mc_jump_greater_equal_8(int imm)
 {
-    emit_ui(gInstructions[VMI_JGE8], imm);
+    emit_ui(gInstructions[VMI_JGE8], char(imm));
+}
+void po_x86_64::mc_jump_not_above_8(int imm)
+{
+    emit_ui(gInstructions[VMI_JNA8], char(imm));
+}
+void po_x86_64::mc_jump_not_above_equal_8(int imm)
+{
+    emit_ui(gInstructions[VMI_JNAE8], char(imm));
+}
+void po_x86_64::mc_jump_not_below_8(int imm)
+{
+    emit_ui(gInstructions[VMI_JNB8], char(imm));
+}
+void po_x86_64::mc_jump_not_below_equal_8(int imm)
+{
+    emit_ui(gInstructions[VMI_JNBE8], char(imm));
 }
 void po_x86_64::mc_jump_unconditional(int imm)
 {
@@ -1921,6 +2212,16 @@ void po_x86_64::mc_call(int offset)
     _programData.push_back((unsigned char)((offset >> 16) & 0xff));
     _programData.push_back((unsigned char)((offset >> 24) & 0xff));
 }
+void po_x86_64::mc_tail_call(int offset)
+{
+    offset -= 5;
+
+    _programData.push_back(0xE9);
+    _programData.push_back((unsigned char)(offset & 0xff));
+    _programData.push_back((unsigned char)((offset >> 8) & 0xff));
+    _programData.push_back((unsigned char)((offset >> 16) & 0xff));
+    _programData.push_back((unsigned char)((offset >> 24) & 0xff));
+}
 void po_x86_64::mc_call_absolute(int reg)
 {
     if (reg >= VM_REGISTER_R8)
@@ -2089,6 +2390,42 @@ void po_x86_64::mc_cdqe()
 {
     emit(gInstructions[VMI_CDQE]);
 }
+void po_x86_64::mc_cqo()
+{
+    emit(gInstructions[VMI_CQO]);
+}
+void po_x86_64::mc_cwd()
+{
+    emit(gInstructions[VMI_CWD]);
+}
+void po_x86_64::mc_cbw()
+{
+    emit(gInstructions[VMI_CBW]);
+}
+void po_x86_64::mc_rep_movsb()
+{
+    emit(gInstructions[VMI_REP_MOVSB]);
+}
+void po_x86_64::mc_rep_stosb()
+{
+    emit(gInstructions[VMI_REP_STOSB]);
+}
+void po_x86_64::mc_bsf_reg_to_reg_x64(char dst, char src)
+{
+    emit_brr(gInstructions[VMI_BSF64_SRC_REG_DST_REG], dst, src);
+}
+void po_x86_64::mc_shr_imm_to_reg_x64(char reg, char imm)
+{
+    emit_bri(gInstructions[VMI_SHR64_SRC_IMM_DST_REG], reg, imm);
+}
+void po_x86_64::mc_and_reg_to_reg_x64(char dst, char src)
+{
+    emit_brr(gInstructions[VMI_AND64_SRC_REG_DST_REG], dst, src);
+}
+void po_x86_64::mc_imul_reg_x64(char reg)
+{
+    emit_ur(gInstructions[VMI_IMUL64_SRC_REG], reg);
+}
 
 
 void po_x86_64::mc_movsd_reg_to_reg_x64(int dst, int src)
@@ -2235,4 +2572,139 @@ void po_x86_64::mc_xorps_reg_to_reg_x64(int dst, int src)
 {
     emit_sse_brr(gInstructions_SSE[VMI_SSE_XORPS_SRC_REG_DST_REG], src, dst);
 }
+void po_x86_64::mc_movdqu_reg_to_memory_x64(int dst, int src, int dst_offset)
+{
+    emit_sse_bmro(gInstructions_SSE[VMI_SSE_MOVDQU_SRC_REG_DST_MEM], src, dst, dst_offset);
+}
+void po_x86_64::mc_movdqu_memory_to_reg_x64(int dst, int src, int src_offset)
+{
+    emit_sse_brmo(gInstructions_SSE[VMI_SSE_MOVDQU_SRC_MEM_DST_REG], src, dst, src_offset);
+}
+void po_x86_64::mc_movq_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MOVQ_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_punpcklqdq_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PUNPCKLQDQ_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_movq_sse_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MOVQ_SRC_SSE_DST_REG], dst, src);
+}
+void po_x86_64::mc_pshufd_reg_to_reg_x64(int dst, int src, char imm)
+{
+    emit_sse_brri(gInstructions_SSE[VMI_SSE_PSHUFD_SRC_REG_DST_REG], src, dst, imm);
+}
+void po_x86_64::mc_pxor_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PXOR_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_paddb_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PADDB_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_paddw_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PADDW_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_paddd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PADDD_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_paddq_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PADDQ_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_psubb_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PSUBB_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_psubw_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PSUBW_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_psubd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PSUBD_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_psubq_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PSUBQ_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_addps_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_ADDPS_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_subps_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_SUBPS_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_mulps_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MULPS_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_divps_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_DIVPS_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_addpd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_ADDPD_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_subpd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_SUBPD_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_mulpd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MULPD_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_divpd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_DIVPD_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_pcmpeqb_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PCMPEQB_SRC_REG_DST_REG], src, dst);
+}
+void po_x86_64::mc_pmovmskb_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PMOVMSKB_SRC_REG_DST_REG], src, dst);
+}
+
+void po_x86_64::mc_movaps_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MOVAPS_SRC_REG_DST_REG], src, dst);
+}
+
+void po_x86_64::mc_pcmpeqd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PCMPEQD_SRC_REG_DST_REG], src, dst);
+}
+
+void po_x86_64::mc_pcmpgtd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_PCMPGTD_SRC_REG_DST_REG], src, dst);
+}
+
+void po_x86_64::mc_cmpps_reg_to_reg_x64(int dst, int src, char imm)
+{
+    emit_sse_brri(gInstructions_SSE[VMI_SSE_CMPPS_SRC_REG_DST_REG], src, dst, imm);
+}
+
+void po_x86_64::mc_cmppd_reg_to_reg_x64(int dst, int src, char imm)
+{
+    emit_sse_brri(gInstructions_SSE[VMI_SSE_CMPPD_SRC_REG_DST_REG], src, dst, imm);
+}
+
+void po_x86_64::mc_movmskps_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MOVMSKPS_SRC_REG_DST_REG], src, dst);
+}
+
+void po_x86_64::mc_movmskpd_reg_to_reg_x64(int dst, int src)
+{
+    emit_sse_brr(gInstructions_SSE[VMI_SSE_MOVMSKPD_SRC_REG_DST_REG], src, dst);
+}
 
@@ -59,11 +59,13 @@ namespace po
         VMI_ADD64_SRC_IMM_DST_REG,
         VMI_ADD64_SRC_MEM_DST_REG,
         VMI_ADD64_SRC_REG_DST_MEM,
+        VMI_ADD64_SRC_INDEX_DST_REG,
 
         VMI_ADD32_SRC_REG_DST_REG,
         VMI_ADD32_SRC_IMM_DST_REG,
         VMI_ADD32_SRC_MEM_DST_REG,
         VMI_ADD32_SRC_REG_DST_MEM,
+        VMI_ADD32_SRC_INDEX_DST_REG,
 
         VMI_ADD16_SRC_REG_DST_REG,
         VMI_ADD16_SRC_IMM_DST_REG,
@@ -79,11 +81,13 @@ namespace po
         VMI_SUB64_SRC_IMM_DST_REG,
         VMI_SUB64_SRC_MEM_DST_REG,
         VMI_SUB64_SRC_REG_DST_MEM,
+        VMI_SUB64_SRC_INDEX_DST_REG,
 
         VMI_SUB32_SRC_REG_DST_REG,
         VMI_SUB32_SRC_IMM_DST_REG,
         VMI_SUB32_SRC_MEM_DST_REG,
         VMI_SUB32_SRC_REG_DST_MEM,
+        VMI_SUB32_SRC_INDEX_DST_REG,
 
         VMI_SUB16_SRC_REG_DST_REG,
         VMI_SUB16_SRC_IMM_DST_REG,
@@ -99,21 +103,29 @@ namespace po
         VMI_MOV64_SRC_REG_DST_MEM,
         VMI_MOV64_SRC_MEM_DST_REG,
         VMI_MOV64_SRC_IMM_DST_REG,
+        VMI_MOV64_SRC_INDEX_DST_REG,
+        VMI_MOV64_SRC_REG_DST_INDEX,
 
         VMI_MOV32_SRC_REG_DST_REG,
         VMI_MOV32_SRC_REG_DST_MEM,
         VMI_MOV32_SRC_MEM_DST_REG,
         VMI_MOV32_SRC_IMM_DST_REG,
+        VMI_MOV32_SRC_INDEX_DST_REG,
+        VMI_MOV32_SRC_REG_DST_INDEX,
 
         VMI_MOV16_SRC_REG_DST_REG,
         VMI_MOV16_SRC_REG_DST_MEM,
         VMI_MOV16_SRC_MEM_DST_REG,
         VMI_MOV16_SRC_IMM_DST_REG,
+        VMI_MOV16_SRC_INDEX_DST_REG,
+        VMI_MOV16_SRC_REG_DST_INDEX,
 
         VMI_MOV8_SRC_IMM_DST_REG,
         VMI_MOV8_SRC_REG_DST_REG,
         VMI_MOV8_SRC_MEM_DST_REG,
         VMI_MOV8_SRC_REG_DST_MEM,
+        VMI_MOV8_SRC_INDEX_DST_REG,
+        VMI_MOV8_SRC_REG_DST_INDEX,
 
         VMI_IMUL64_SRC_REG_DST_REG,
         VMI_IMUL64_SRC_MEM_DST_REG,
@@ -148,10 +160,12 @@ namespace po
         VMI_CMP64_SRC_REG_DST_REG,
         VMI_CMP64_SRC_REG_DST_MEM,
         VMI_CMP64_SRC_MEM_DST_REG,
+        VMI_CMP64_SRC_INDEX_DST_REG,
 
         VMI_CMP32_SRC_REG_DST_REG,
         VMI_CMP32_SRC_REG_DST_MEM,
         VMI_CMP32_SRC_MEM_DST_REG,
+        VMI_CMP32_SRC_INDEX_DST_REG,
 
         VMI_CMP16_SRC_REG_DST_REG,
         VMI_CMP16_SRC_REG_DST_MEM,
@@ -161,6 +175,16 @@ namespace po
         VMI_CMP8_SRC_MEM_DST_REG,
         VMI_CMP8_SRC_REG_DST_MEM,
 
+        VMI_TEST64_SRC_REG_DST_REG,
+        VMI_TEST32_SRC_REG_DST_REG,
+        VMI_TEST16_SRC_REG_DST_REG,
+        VMI_TEST8_SRC_REG_DST_REG,
+
+        VMI_XOR64_SRC_REG_DST_REG,
+        VMI_XOR32_SRC_REG_DST_REG,
+
+        VMI_XCHG64_SRC_REG_DST_REG,
+
         VMI_J8,
         VMI_JE8,
         VMI_JNE8,
@@ -168,6 +192,10 @@ namespace po
         VMI_JG8,
         VMI_JLE8,
         VMI_JGE8,
+        VMI_JNAE8, /*unsigned*/
+        VMI_JNBE8, /*unsigned*/
+        VMI_JNA8, /*unsigned*/
+        VMI_JNB8, /*unsigned*/
         VMI_JA64,
 
         VMI_J32,
@@ -246,6 +274,7 @@ namespace po
 
         VMI_LEA64_SRC_REG_DST_REG,
         VMI_LEA64_SRC_MEM_DST_REG,
+        VMI_LEA64_SRC_INDEX_DST_REG, // base + index * scale + offset
 
         VMI_SAL64_SRC_IMM_DST_REG, // left shift
         VMI_SAL32_SRC_IMM_DST_REG,
@@ -268,12 +297,24 @@ namespace po
         VMI_SAR8_SRC_REG_DST_REG,
 
         VMI_CDQE,
+        VMI_CQO, // sign extend the dividend into rdx:rax, edx:eax, dx:ax or ax
+        VMI_CDQ,
+        VMI_CWD,
+        VMI_CBW,
+
+        VMI_REP_MOVSB, // block copy and fill
+        VMI_REP_STOSB,
+        VMI_BSF64_SRC_REG_DST_REG, // index of the lowest set bit
+        VMI_SHR64_SRC_IMM_DST_REG, // logical right shift
+        VMI_AND64_SRC_REG_DST_REG,
+        VMI_IMUL64_SRC_REG, // signed RDX:RAX = RAX * reg
 
         VMI_PUSH_REG,
         VMI_POP_REG,
         VMI_JUMP_MEM,
         VMI_CALL_MEM,
         VMI_CALL,
+        VMI_TAIL_CALL,
 
         // End of instructions
         VMI_MAX_INSTRUCTIONS
@@ -335,6 +376,40 @@ namespace po
 
         VMI_SSE_XORPS_SRC_REG_DST_REG,
 
+        VMI_SSE_MOVDQU_SRC_MEM_DST_REG,
+        VMI_SSE_MOVDQU_SRC_REG_DST_MEM,
+        VMI_SSE_MOVQ_SRC_REG_DST_REG, // general purpose register into sse register
+        VMI_SSE_PUNPCKLQDQ_SRC_REG_DST_REG,
+        VMI_SSE_MOVQ_SRC_SSE_DST_REG, // sse register into general purpose register
+        VMI_SSE_PSHUFD_SRC_REG_DST_REG,
+        VMI_SSE_PXOR_SRC_REG_DST_REG,
+
+        // Packed operations over all lanes of the register
+        VMI_SSE_PADDB_SRC_REG_DST_REG,
+        VMI_SSE_PADDW_SRC_REG_DST_REG,
+        VMI_SSE_PADDD_SRC_REG_DST_REG,
+        VMI_SSE_PADDQ_SRC_REG_DST_REG,
+        VMI_SSE_PSUBB_SRC_REG_DST_REG,
+        VMI_SSE_PSUBW_SRC_REG_DST_REG,
+        VMI_SSE_PSUBD_SRC_REG_DST_REG,
+        VMI_SSE_PSUBQ_SRC_REG_DST_REG,
+        VMI_SSE_ADDPS_SRC_REG_DST_REG,
+        VMI_SSE_SUBPS_SRC_REG_DST_REG,
+        VMI_SSE_MULPS_SRC_REG_DST_REG,
+        VMI_SSE_DIVPS_SRC_REG_DST_REG,
+        VMI_SSE_SUBPD_SRC_REG_DST_REG,
+        VMI_SSE_MULPD_SRC_REG_DST_REG,
+        VMI_SSE_DIVPD_SRC_REG_DST_REG,
+        VMI_SSE_PCMPEQB_SRC_REG_DST_REG,
+        VMI_SSE_PMOVMSKB_SRC_REG_DST_REG, // byte mask of an sse register into a general purpose register
+        VMI_SSE_MOVAPS_SRC_REG_DST_REG,
+        VMI_SSE_PCMPEQD_SRC_REG_DST_REG,
+        VMI_SSE_PCMPGTD_SRC_REG_DST_REG,
+        VMI_SSE_CMPPS_SRC_REG_DST_REG,
+        VMI_SSE_CMPPD_SRC_REG_DST_REG,
+        VMI_SSE_MOVMSKPS_SRC_REG_DST_REG, // sign bits of the floats of an sse register into a general purpose register
+        VMI_SSE_MOVMSKPD_SRC_REG_DST_REG,
+
         // End of instructions
         VMI_SSE_MAX_INSTRUCTIONS
     };
@@ -356,6 +431,10 @@ namespace po
 #define VM_SSE_ARG8 (-1)
 #define VM_MAX_ARGS 4
 #define VM_MAX_SSE_ARGS 4
+#define VM_REGISTER_HOMES 32 /* shadow space the caller reserves for the register arguments */
+#define VM_RED_ZONE 0
+#define VM_PORA_MAX_ARGS 6 /* calls between Pora functions also pass arguments in R10 and R11 */
+#define VM_PORA_MAX_SSE_ARGS 6 /* and in XMM4 and XMM5 */
 #else
 #define VM_ARG1 VM_REGISTER_EDI
 #define VM_ARG2 VM_REGISTER_ESI
@@ -373,32 +452,41 @@ namespace po
 #define VM_SSE_ARG8 VM_SSE_REGISTER_XMM7
 #define VM_MAX_ARGS 6
 #define VM_MAX_SSE_ARGS 8
+#define VM_REGISTER_HOMES 0
+#define VM_RED_ZONE 128 /* bytes below the stack pointer which signal handlers leave alone */
+#define VM_PORA_MAX_ARGS 8 /* calls between Pora functions also pass arguments in R10 and R11 */
+#define VM_PORA_MAX_SSE_ARGS 8
 #endif
 
     class po_x86_64_instruction
     {
     public:
         po_x86_64_instruction(bool isSSE, int opcode, int srcReg, int dstReg)
-            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _imm8(0), _id(-1) {
+            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _id(-1), _indexReg(-1), _scale(0), _imm8(0) {
         }
         po_x86_64_instruction(bool isSSE, int opcode, int srcReg, int dstReg, int8_t imm)
-            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _imm8(imm), _id(-1) {
+            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _id(-1), _indexReg(-1), _scale(0), _imm8(imm) {
         }
         po_x86_64_instruction(bool isSSE, int opcode, int srcReg, int dstReg, int16_t imm)
-            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _imm16(imm), _id(-1) {
+            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _id(-1), _indexReg(-1), _scale(0), _imm16(imm) {
         }
         po_x86_64_instruction(bool isSSE, int opcode, int srcReg, int dstReg, int32_t imm)
-            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _imm32(imm), _id(-1) {}
+            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _id(-1), _indexReg(-1), _scale(0), _imm32(imm) {}
         po_x86_64_instruction(bool isSSE, int opcode, int srcReg, int dstReg, int64_t imm)
-            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _imm64(imm), _id(-1) {
+            : _isSSE(isSSE), _opcode(opcode), _srcReg(srcReg), _dstReg(dstReg), _id(-1), _indexReg(-1), _scale(0), _imm64(imm) {
         }
 
         inline void setId(int id) { _id = id; }
+        inline void setSrcReg(const int srcReg) { _srcReg = srcReg; }
+        inline void setDstReg(const int dstReg) { _dstReg = dstReg; }
+        inline void setIndex(const int indexReg, const int scale) { _indexReg = indexReg; _scale = scale; }
 
         inline const int id() const { return _id; }
         inline const int opcode() const { return _opcode; }
         inline const int srcReg() const { return _srcReg; }
         inline const int dstReg() const { return _dstReg; }
+        inline const int indexReg() const { return _indexReg; }
+        inline const int scale() const { return _scale; }
         
         inline const int8_t imm8() const { return _imm8; }
         inline const int16_t imm16() const { return _imm16; }
@@ -411,6 +499,7 @@ namespace po
         inline void setImm64(const int64_t imm64) { _imm64 = imm64; }
 
         inline const bool isSSE() const { return _isSSE; }
+        const bool isJump() const;
 
     private:
         bool _isSSE; // Indicates if the instruction is an SSE instruction
@@ -418,6 +507,8 @@ namespace po
         int _srcReg; // Source register
         int _dstReg; // Destination register
         int _id;    // id for an assoicated constant or function
+        int _indexReg; // Index register for base + index * scale addressing
+        int _scale; // Scale applied to the index register (1, 2, 4 or 8)
 
         union
         {
@@ -631,6 +722,7 @@ namespace po
         void mc_mov_memory_to_reg_x64(char dst, int addr);
         void mc_mov_reg_to_memory_x64(char src, int addr);
         void mc_mov_reg_to_reg_x64(char dst, char src);
+        void mc_xchg_reg_to_reg_x64(char dst, char src);
         void mc_add_reg_to_reg_x64(char dst, char src);
         void mc_add_memory_to_reg_x64(char dst, char src, int src_offset);
         void mc_add_reg_to_memory_x64(char dst, char src, int dst_offset);
@@ -661,6 +753,10 @@ namespace po
         void mc_sal_imm_to_reg_x64(char reg, char imm);
         void mc_sar_reg_x64(char reg);
         void mc_sal_reg_x64(char reg);
+        void mc_shr_imm_to_reg_x64(char reg, char imm);
+        void mc_and_reg_to_reg_x64(char dst, char src);
+        void mc_imul_reg_x64(char reg);
+        void mc_lea_index_to_reg_x64(char dst, char base, char index, int scale, int offset);
 
         /* Jump operations */
 
@@ -671,6 +767,10 @@ namespace po
         void mc_jump_less_equal_8(int imm);
         void mc_jump_greater_8(int imm);
         void mc_jump_greater_equal_8(int imm);
+        void mc_jump_not_above_8(int imm);
+        void mc_jump_not_above_equal_8(int imm);
+        void mc_jump_not_below_8(int imm);
+        void mc_jump_not_below_equal_8(int imm);
         void mc_jump_unconditional(int imm);
         void mc_jump_equals(int imm);
         void mc_jump_not_equals(int imm);
@@ -686,6 +786,7 @@ namespace po
         void mc_jump_memory(int offset);
         void mc_call_memory(int offset);
         void mc_call(int offset);
+        void mc_tail_call(int offset);
         void mc_call_absolute(int reg);
 
         /* Sign extend operations */
@@ -716,6 +817,15 @@ namespace po
         void mc_movzx_16_to_64_reg_to_reg(char dst, char src);
         void mc_movzx_16_to_64_mem_to_reg(char dst, char src, int src_offset);
         void mc_cdqe();
+        void mc_cqo();
+        void mc_cwd();
+        void mc_cbw();
+
+        /* Block memory operations */
+
+        void mc_rep_movsb();
+        void mc_rep_stosb();
+        void mc_bsf_reg_to_reg_x64(char dst, char src);
 
         /* Floating point operations */
 
@@ -755,6 +865,38 @@ namespace po
         void mc_ucmps_reg_to_reg_x64(int dst, int src);
         void mc_ucmps_memory_to_reg_x64(int dst, int src, int src_offset);
         void mc_xorps_reg_to_reg_x64(int dst, int src);
+        void mc_movdqu_reg_to_memory_x64(int dst, int src, int dst_offset);
+        void mc_movdqu_memory_to_reg_x64(int dst, int src, int src_offset);
+        void mc_movq_reg_to_reg_x64(int dst, int src);
+        void mc_punpcklqdq_reg_to_reg_x64(int dst, int src);
+        void mc_movq_sse_to_reg_x64(int dst, int src);
+        void mc_pshufd_reg_to_reg_x64(int dst, int src, char imm);
+        void mc_pxor_reg_to_reg_x64(int dst, int src);
+        void mc_paddb_reg_to_reg_x64(int dst, int src);
+        void mc_paddw_reg_to_reg_x64(int dst, int src);
+        void mc_paddd_reg_to_reg_x64(int dst, int src);
+        void mc_paddq_reg_to_reg_x64(int dst, int src);
+        void mc_psubb_reg_to_reg_x64(int dst, int src);
+        void mc_psubw_reg_to_reg_x64(int dst, int src);
+        void mc_psubd_reg_to_reg_x64(int dst, int src);
+        void mc_psubq_reg_to_reg_x64(int dst, int src);
+        void mc_addps_reg_to_reg_x64(int dst, int src);
+        void mc_subps_reg_to_reg_x64(int dst, int src);
+        void mc_mulps_reg_to_reg_x64(int dst, int src);
+        void mc_divps_reg_to_reg_x64(int dst, int src);
+        void mc_addpd_reg_to_reg_x64(int dst, int src);
+        void mc_subpd_reg_to_reg_x64(int dst, int src);
+        void mc_mulpd_reg_to_reg_x64(int dst, int src);
+        void mc_divpd_reg_to_reg_x64(int dst, int src);
+        void mc_pcmpeqb_reg_to_reg_x64(int dst, int src);
+        void mc_pmovmskb_reg_to_reg_x64(int dst, int src);
+        void mc_movaps_reg_to_reg_x64(int dst, int src);
+        void mc_pcmpeqd_reg_to_reg_x64(int dst, int src);
+        void mc_pcmpgtd_reg_to_reg_x64(int dst, int src);
+        void mc_cmpps_reg_to_reg_x64(int dst, int src, char imm);
+        void mc_cmppd_reg_to_reg_x64(int dst, int src, char imm);
+        void mc_movmskps_reg_to_reg_x64(int dst, int src);
+        void mc_movmskpd_reg_to_reg_x64(int dst, int src);
 
         inline po_x86_64_flow_graph& cfg() { return _cfg; }
         void dump() const;
@@ -776,6 +918,7 @@ namespace po
 
         void sse_binop(const int src, const int dst, const int opcode);
         void sse_binop(const int src, const int dst, const int opcode, const int offset);
+        void sse_binop_imm(const int src, const int dst, const int opcode, const char imm);
         void sse_unaryop(const int dst, const int opcode, const int offset);
     };
 
@@ -932,6 +1075,9 @@ namespace po
         void mc_sal_imm_to_reg_x64(char reg, char imm);
         void mc_sar_reg_x64(char reg);
         void mc_sal_reg_x64(char reg);
+        void mc_shr_imm_to_reg_x64(char reg, char imm);
+        void mc_and_reg_to_reg_x64(char dst, char src);
+        void mc_imul_reg_x64(char reg);
 
         /* Jump operations */
 
@@ -942,6 +1088,10 @@ namespace po
         void mc_jump_less_equal_8(int imm);
         void mc_jump_greater_8(int imm);
         void mc_jump_greater_equal_8(int imm);
+        void mc_jump_not_above_8(int imm);
+        void mc_jump_not_above_equal_8(int imm);
+        void mc_jump_not_below_8(int imm);
+        void mc_jump_not_below_equal_8(int imm);
         void mc_jump_unconditional(int imm);
         void mc_jump_equals(int imm);
         void mc_jump_not_equals(int imm);
@@ -957,6 +1107,7 @@ namespace po
         void mc_jump_memory(int offset);
         void mc_call_memory(int offset);
         void mc_call(int offset);
+        void mc_tail_call(int offset);
         void mc_call_absolute(int reg);
         
         /* Sign extend operations */
@@ -987,6 +1138,15 @@ namespace po
         void mc_movzx_16_to_64_reg_to_reg(char dst, char src);
         void mc_movzx_16_to_64_mem_to_reg(char dst, char src, int src_offset);
         void mc_cdqe();
+        void mc_cqo();
+        void mc_cwd();
+        void mc_cbw();
+
+        /* Block memory operations */
+
+        void mc_rep_movsb();
+        void mc_rep_stosb();
+        void mc_bsf_reg_to_reg_x64(char dst, char src);
 
         /* Floating point operations */
 
@@ -1026,6 +1186,38 @@ namespace po
         void mc_ucmps_reg_to_reg_x64(int dst, int src);
         void mc_ucmps_memory_to_reg_x64(int dst, int src, int src_offset);
         void mc_xorps_reg_to_reg_x64(int dst, int src);
+        void mc_movdqu_reg_to_memory_x64(int dst, int src, int dst_offset);
+        void mc_movdqu_memory_to_reg_x64(int dst, int src, int src_offset);
+        void mc_movq_reg_to_reg_x64(int dst, int src);
+        void mc_punpcklqdq_reg_to_reg_x64(int dst, int src);
+        void mc_movq_sse_to_reg_x64(int dst, int src);
+        void mc_pshufd_reg_to_reg_x64(int dst, int src, char imm);
+        void mc_pxor_reg_to_reg_x64(int dst, int src);
+        void mc_paddb_reg_to_reg_x64(int dst, int src);
+        void mc_paddw_reg_to_reg_x64(int dst, int src);
+        void mc_paddd_reg_to_reg_x64(int dst, int src);
+        void mc_paddq_reg_to_reg_x64(int dst, int src);
+        void mc_psubb_reg_to_reg_x64(int dst, int src);
+        void mc_psubw_reg_to_reg_x64(int dst, int src);
+        void mc_psubd_reg_to_reg_x64(int dst, int src);
+        void mc_psubq_reg_to_reg_x64(int dst, int src);
+        void mc_addps_reg_to_reg_x64(int dst, int src);
+        void mc_subps_reg_to_reg_x64(int dst, int src);
+        void mc_mulps_reg_to_reg_x64(int dst, int src);
+        void mc_divps_reg_to_reg_x64(int dst, int src);
+        void mc_addpd_reg_to_reg_x64(int dst, int src);
+        void mc_subpd_reg_to_reg_x64(int dst, int src);
+        void mc_mulpd_reg_to_reg_x64(int dst, int src);
+        void mc_divpd_reg_to_reg_x64(int dst, int src);
+        void mc_pcmpeqb_reg_to_reg_x64(int dst, int src);
+        void mc_pmovmskb_reg_to_reg_x64(int dst, int src);
+        void mc_movaps_reg_to_reg_x64(int dst, int src);
+        void mc_pcmpeqd_reg_to_reg_x64(int dst, int src);
+        void mc_pcmpgtd_reg_to_reg_x64(int dst, int src);
+        void mc_cmpps_reg_to_reg_x64(int dst, int src, char imm);
+        void mc_cmppd_reg_to_reg_x64(int dst, int src, char imm);
+        void mc_movmskps_reg_to_reg_x64(int dst, int src);
+        void mc_movmskpd_reg_to_reg_x64(int dst, int src);
 
     private:
         //============================================
@@ -1042,12 +1234,16 @@ namespace po
         void emit_brm(const vm_instruction& ins, char dst, char src);
         void emit_bmr(const vm_instruction& ins, char dst, char src);
         void emit_brmo(const vm_instruction& ins, char dst, char src, int offset);
+        void emit_brmio(const vm_instruction& ins, char dst, char base, char index, int scale, int offset);
+        void emit_bmrio(const vm_instruction& ins, char base, char index, int scale, char src, int offset);
+        void emit_sib(const vm_instruction& ins, char reg, char base, char index, int scale, int offset);
         void emit_bmro(const vm_instruction& ins, char dst, char src, int offset);
         void emit_brr_disp(const vm_instruction& ins, int reg, int disp32);
         void emit_ui(const vm_instruction& ins, char imm);
         void emit_ui(const vm_instruction& ins, int imm);
 
         void emit_sse_brr(const vm_sse_instruction& ins, int src, int dst);
+        void emit_sse_brri(const vm_sse_instruction& ins, int src, int dst, char imm);
         void emit_sse_brmo(const vm_sse_instruction& ins, int src, int dst, int src_offset);
         void emit_sse_bmro(const vm_sse_instruction& ins, int src, int dst, int dst_offset);
         void emit_sse_brm(const vm_sse_instruction& ins, int dst, int disp32);
@@ -0,0 +1,156 @@
+#include "poAggregate.h"
+#include "poModule.h"
+
+#include <algorithm>
+
+using namespace po;
+
+static int getIntegerType(const int size)
+{
+    switch (size)
+    {
+    case 4:
+        return TYPE_I32;
+    case 2:
+        return TYPE_I16;
+    case 1:
+        return TYPE_I8;
+    }
+
+    return TYPE_I64; /* odd sizes are padded out to a whole eightbyte */
+}
+
+poAggregate::poAggregate(poModule& module, const int type, const poCallConvention convention)
+    :
+    _module(module),
+    _isMemory(false)
+{
+    const int size = module.types()[type].size();
+
+#ifdef WIN32
+    if (convention == poCallConvention::X86_64)
+    {
+        _isMemory = size > 8;
+        if (!_isMemory)
+        {
+            _types.push_back(TYPE_I64);
+        }
+        return;
+    }
+#else
+    (void)convention; /* System V is followed whatever the convention */
+#endif
+
+    if (size <= 0 || size > 16)
+    {
+        _isMemory = true;
+        return;
+    }
+
+    const int numEightbytes = (size + 7) / 8;
+    _types.resize(numEightbytes, -1);
+    _fields.resize(numEightbytes, 0);
+    _isSSE.resize(numEightbytes, true);
+
+    classify(type, 0);
+    if (_isMemory)
+    {
+        _types.clear();
+        return;
+    }
+
+    for (int i = 0; i < numEightbytes; i++)
+    {
+        const int bytes = std::min(8, size - i * 8);
+
+        // A single field covering the eightbyte is moved as its own type
+        if (_fields[i] == 1 &&
+            _types[i] != -1 &&
+            module.types()[_types[i]].size() == bytes)
+        {
+            continue;
+        }
+
+        if (_fields[i] > 0 && _isSSE[i])
+        {
+            _types[i] = bytes == 4 ? TYPE_F32 : TYPE_F64;
+        }
+        else
+        {
+            _types[i] = getIntegerType(bytes);
+        }
+    }
+}
+
+void poAggregate::classify(const int type, const int offset)
+{
+    const poType& typeData = _module.types()[type];
+    if (typeData.isPointer())
+    {
+        classifyScalar(type, 8, false, offset);
+        return;
+    }
+
+    if (type == TYPE_ENUM || typeData.kind() == poTypeKind::ENUM)
+    {
+        classifyScalar(TYPE_I32, 4, false, offset);
+        return;
+    }
+
+    if (typeData.isPrimitive())
+    {
+        if (isVectorType(type))
+        {
+            _isMemory = true;
+            return;
+        }
+
+        classifyScalar(type, typeData.size(), type == TYPE_F64 || type == TYPE_F32, offset);
+        return;
+    }
+
+    for (const poField& field : typeData.fields())
+    {
+        if (field.hasAttribute(poAttributes::STATIC))
+        {
+            continue;
+        }
+
+        const poType& fieldType = _module.types()[field.type()];
+        if (fieldType.isArray())
+        {
+            const int elementSize = _module.types()[fieldType.baseType()].size();
+            for (int i = 0; i < field.numElements() && !_isMemory; i++)
+            {
+                classify(fieldType.baseType(), offset + field.offset() + i * elementSize);
+            }
+        }
+        else
+        {
+            classify(field.type(), offset + field.offset());
+        }
+
+        if (_isMemory)
+        {
+            return;
+        }
+    }
+}
+
+void poAggregate::classifyScalar(const int type, const int size, const bool isSSE, const int offset)
+{
+    // Fields which are unaligned or straddle two eightbytes have to stay in memory
+    if (size <= 0 ||
+        offset % size != 0 ||
+        offset % 8 + size > 8 ||
+        offset / 8 >= int(_fields.size()))
+    {
+        _isMemory = true;
+        return;
+    }
+
+    const int index = offset / 8;
+    _fields[index]++;
+    _isSSE[index] = _isSSE[index] && isSSE;
+    _types[index] = offset % 8 == 0 ? type : -1;
+}
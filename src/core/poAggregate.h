@@ -0,0 +1,36 @@
+#pragma once
+#include <vector>
+
+namespace po
+{
+    class poModule;
+    enum class poCallConvention;
+
+    //
+    // Classifies a struct passed or returned by value, following System V. The struct is split
+    // into eightbytes, each of which is INTEGER unless all of its fields are floating point, in
+    // which case it is SSE. Structs of up to two eightbytes travel in registers, one per
+    // eightbyte, while anything larger, with unaligned fields or vectors is kept in memory.
+    //
+    // The C ABI on Windows only puts structs of up to 8 bytes in a register, packed into an i64.
+    //
+
+    class poAggregate
+    {
+    public:
+        poAggregate(poModule& module, const int type, const poCallConvention convention);
+
+        inline const bool isMemory() const { return _isMemory; }
+        inline const std::vector<int>& types() const { return _types; } /* the scalar type each eightbyte is moved as */
+
+    private:
+        void classify(const int type, const int offset);
+        void classifyScalar(const int type, const int size, const bool isSSE, const int offset);
+
+        poModule& _module;
+        bool _isMemory;
+        std::vector<int> _types;
+        std::vector<int> _fields; /* the number of fields in each eightbyte */
+        std::vector<bool> _isSSE;
+    };
+}
@@ -55,10 +55,16 @@ bool poInstruction::isSpecialInstruction() const
     {
     case (IR_CONSTANT): /* technically not, but keep it in for now */
     case (IR_CALL):
+    case (IR_RESULT):
     case (IR_BR):
     case (IR_PARAM):
     case (IR_ALLOCA):
     case (IR_MALLOC):
+    case (IR_COPY_MEMORY):
+    case (IR_FILL_MEMORY):
+    case (IR_VECTOR_SUM):
+    case (IR_VECTOR_MAP):
+    case (IR_VECTOR_FIND):
         return true;
     }
     return false;
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 
 /* 
 * Flow graph of basic blocks for a single function.
@@ -34,12 +35,23 @@ namespace po
     constexpr int IR_ZERO_EXTEND = 0x35;
     constexpr int IR_BITWISE_CAST = 0x36;
     constexpr int IR_CONVERT = 0x37;
+    constexpr int IR_RESULT = 0x38;
     constexpr int IR_ALLOCA = 0x40;
     constexpr int IR_MALLOC = 0x41;
     constexpr int IR_LOAD = 0x42;
     constexpr int IR_STORE = 0x43;
     constexpr int IR_PTR = 0x44;
     constexpr int IR_ELEMENT_PTR = 0x45;
+    constexpr int IR_COPY_MEMORY = 0x46;
+    constexpr int IR_FILL_MEMORY = 0x47;
+    constexpr int IR_VECTOR_SUM = 0x48;
+    constexpr int IR_VECTOR_MAP = 0x49;
+    constexpr int IR_VECTOR_FIND = 0x4A;
+    constexpr int IR_VECTOR_SPLAT = 0x4B;
+    constexpr int IR_VECTOR_EQUALS = 0x4C;
+    constexpr int IR_VECTOR_GREATER = 0x4D;
+    constexpr int IR_VECTOR_SHUFFLE = 0x4E;
+    constexpr int IR_VECTOR_MOVEMASK = 0x4F;
 
     constexpr int IR_LOAD_GLOBAL = 0x50;
     constexpr int IR_STORE_GLOBAL = 0x51;
@@ -0,0 +1,853 @@
+#include "poInterpreter.h"
+#include "poModule.h"
+#include "poCFG.h"
+#include "poDom.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+
+using namespace po;
+
+static constexpr int MAX_STEPS = 100000;
+static constexpr int MAX_DEPTH = 64;
+static constexpr size_t MAX_MEMORY = 1024 * 1024;
+static constexpr uint64_t MEMORY_BASE = 0x10000; /* keeps null and small integers from being valid addresses */
+static constexpr int ORDER_NONE = 2;
+
+static int getSize(const int type)
+{
+    switch (type)
+    {
+    case TYPE_I32:
+    case TYPE_U32:
+    case TYPE_F32:
+        return 4;
+    case TYPE_I16:
+    case TYPE_U16:
+        return 2;
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+        return 1;
+    }
+    return 8;
+}
+
+static bool isSigned(const int type)
+{
+    return type == TYPE_I64 || type == TYPE_I32 || type == TYPE_I16 || type == TYPE_I8;
+}
+
+static bool isUnsigned(const int type)
+{
+    return type == TYPE_U64 || type == TYPE_U32 || type == TYPE_U16 || type == TYPE_U8 || type == TYPE_BOOLEAN;
+}
+
+static bool isFloat(const int type)
+{
+    return type == TYPE_F32 || type == TYPE_F64;
+}
+
+static uint64_t signExtend(const uint64_t value, const int size)
+{
+    switch (size)
+    {
+    case 4: return uint64_t(int64_t(int32_t(value)));
+    case 2: return uint64_t(int64_t(int16_t(value)));
+    case 1: return uint64_t(int64_t(int8_t(value)));
+    }
+    return value;
+}
+
+static uint64_t zeroExtend(const uint64_t value, const int size)
+{
+    switch (size)
+    {
+    case 4: return value & 0xFFFFFFFF;
+    case 2: return value & 0xFFFF;
+    case 1: return value & 0xFF;
+    }
+    return value;
+}
+
+static uint64_t extend(const int type, const uint64_t value)
+{
+    // Only the bits of the type are meaningful, the rest are filled in to keep a single
+    // representation of each value
+
+    return isSigned(type) ? signExtend(value, getSize(type)) : zeroExtend(value, getSize(type));
+}
+
+static float toF32(const uint64_t value)
+{
+    const uint32_t bits = uint32_t(value);
+    float f32 = 0;
+    std::memcpy(&f32, &bits, sizeof(f32));
+    return f32;
+}
+
+static uint64_t fromF32(const float f32)
+{
+    uint32_t bits = 0;
+    std::memcpy(&bits, &f32, sizeof(bits));
+    return bits;
+}
+
+static double toF64(const uint64_t value)
+{
+    double f64 = 0;
+    std::memcpy(&f64, &value, sizeof(f64));
+    return f64;
+}
+
+static uint64_t fromF64(const double f64)
+{
+    uint64_t bits = 0;
+    std::memcpy(&bits, &f64, sizeof(bits));
+    return bits;
+}
+
+//================
+
+void poInterpreterFrame::set(const int name, const int type, const uint64_t value)
+{
+    _values[name] = value;
+    _types[name] = type;
+}
+
+bool poInterpreterFrame::get(const int name, uint64_t& value) const
+{
+    const auto& it = _values.find(name);
+    if (it == _values.end())
+    {
+        return false;
+    }
+
+    value = it->second;
+    return true;
+}
+
+int poInterpreterFrame::getType(const int name) const
+{
+    const auto& it = _types.find(name);
+    return it == _types.end() ? -1 : it->second;
+}
+
+//================
+
+poInterpreter::poInterpreter(poModule& module)
+    :
+    _module(module),
+    _steps(0),
+    _compareType(-1),
+    _signedOrder(ORDER_NONE),
+    _unsignedOrder(ORDER_NONE)
+{
+}
+
+bool poInterpreter::call(const int function, const std::vector<uint64_t>& args, uint64_t& result)
+{
+    _steps = 0;
+    _memory.clear();
+    _compareType = -1;
+    return run(function, args, result, 0);
+}
+
+bool poInterpreter::isScalar(const int type)
+{
+    if (isSigned(type) || isUnsigned(type) || isFloat(type))
+    {
+        return true;
+    }
+
+    return type > TYPE_OBJECT &&
+        type < int(_module.types().size()) &&
+        _module.types()[type].isPointer();
+}
+
+bool poInterpreter::getConstant(const poInstruction& ins, uint64_t& value)
+{
+    const poConstantPool& constants = _module.constants();
+    const int id = ins.constant();
+    if (id == -1)
+    {
+        return false;
+    }
+
+    switch (ins.type())
+    {
+    case TYPE_I64: value = uint64_t(constants.getI64(id)); break;
+    case TYPE_U64: value = constants.getU64(id); break;
+    case TYPE_I32: value = uint64_t(int64_t(constants.getI32(id))); break;
+    case TYPE_U32: value = constants.getU32(id); break;
+    case TYPE_I16: value = uint64_t(int64_t(constants.getI16(id))); break;
+    case TYPE_U16:
+        // The backend only moves the low byte of these, sign extended
+        value = zeroExtend(uint64_t(int64_t(char(constants.getU16(id)))), 2);
+        break;
+    case TYPE_I8: value = uint64_t(int64_t(constants.getI8(id))); break;
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+        value = constants.getU8(id);
+        break;
+    case TYPE_F32: value = fromF32(constants.getF32(id)); break;
+    case TYPE_F64: value = fromF64(constants.getF64(id)); break;
+    default:
+        // Pointer constants are strings in read only data
+        return false;
+    }
+
+    return true;
+}
+
+int poInterpreter::addConstant(const int type, const uint64_t value)
+{
+    poConstantPool& constants = _module.constants();
+    int id = -1;
+    switch (type)
+    {
+    case TYPE_I64:
+        id = constants.getConstant(int64_t(value));
+        if (id == -1) { id = constants.addConstant(int64_t(value)); }
+        break;
+    case TYPE_U64:
+        id = constants.getConstant(uint64_t(value));
+        if (id == -1) { id = constants.addConstant(uint64_t(value)); }
+        break;
+    case TYPE_I32:
+        id = constants.getConstant(int32_t(value));
+        if (id == -1) { id = constants.addConstant(int32_t(value)); }
+        break;
+    case TYPE_U32:
+        id = constants.getConstant(uint32_t(value));
+        if (id == -1) { id = constants.addConstant(uint32_t(value)); }
+        break;
+    case TYPE_I16:
+        id = constants.getConstant(int16_t(value));
+        if (id == -1) { id = constants.addConstant(int16_t(value)); }
+        break;
+    case TYPE_U16:
+        id = constants.getConstant(uint16_t(value));
+        if (id == -1) { id = constants.addConstant(uint16_t(value)); }
+        break;
+    case TYPE_I8:
+        id = constants.getConstant(int8_t(value));
+        if (id == -1) { id = constants.addConstant(int8_t(value)); }
+        break;
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+        id = constants.getConstant(uint8_t(value));
+        if (id == -1) { id = constants.addConstant(uint8_t(value)); }
+        break;
+    case TYPE_F32:
+        id = constants.getConstant(toF32(value));
+        if (id == -1) { id = constants.addConstant(toF32(value)); }
+        break;
+    case TYPE_F64:
+        id = constants.getConstant(toF64(value));
+        if (id == -1) { id = constants.addConstant(toF64(value)); }
+        break;
+    }
+    return id;
+}
+
+bool poInterpreter::run(const int function, const std::vector<uint64_t>& args, uint64_t& result, const int depth)
+{
+    if (depth > MAX_DEPTH)
+    {
+        return false;
+    }
+
+    // Extern functions, and those which were never generated, have no blocks
+    poFunction& func = _module.functions()[function];
+    poFlowGraph& cfg = func.cfg();
+    if (func.hasAttribute(poAttributes::EXTERN) ||
+        func.hasAttribute(poAttributes::GENERIC) ||
+        cfg.numBlocks() == 0)
+    {
+        return false;
+    }
+
+    const size_t stack = _memory.size();
+    poInterpreterFrame frame;
+    poBasicBlock* pred = nullptr;
+    poBasicBlock* bb = cfg.getFirst();
+    bool ok = true;
+    bool done = false;
+    while (ok && !done)
+    {
+        if (pred && !enter(function, bb, pred, frame))
+        {
+            ok = false;
+            break;
+        }
+
+        poBasicBlock* next = bb->getNext();
+        const std::vector<poInstruction>& instructions = bb->instructions();
+        for (int i = 0; i < int(instructions.size()) && ok && !done; i++)
+        {
+            const poInstruction& ins = instructions[i];
+            if (++_steps > MAX_STEPS)
+            {
+                ok = false;
+                break;
+            }
+
+            switch (ins.code())
+            {
+            case IR_PARAM:
+                ok = ins.left() >= 0 && ins.left() < int(args.size()) && isScalar(ins.type());
+                if (ok)
+                {
+                    frame.set(ins.name(), ins.type(), extend(ins.type(), args[ins.left()]));
+                }
+                break;
+            case IR_CALL:
+            {
+                const int numArgs = ins.left();
+                std::vector<uint64_t> callArgs;
+                for (int j = i + 1; j <= i + numArgs && ok; j++)
+                {
+                    uint64_t value = 0;
+                    ok = j < int(instructions.size()) &&
+                        instructions[j].code() == IR_ARG &&
+                        isScalar(instructions[j].type()) &&
+                        frame.get(instructions[j].left(), value);
+                    callArgs.push_back(value);
+                }
+
+                int callee = -1;
+                uint64_t value = 0;
+                ok = ok &&
+                    (ins.type() == TYPE_VOID || isScalar(ins.type())) &&
+                    getFunction(ins.right(), callee) &&
+                    run(callee, callArgs, value, depth + 1);
+                if (ok && ins.type() != TYPE_VOID)
+                {
+                    frame.set(ins.name(), ins.type(), extend(ins.type(), value));
+                }
+                i += numArgs;
+                break;
+            }
+            case IR_BR:
+            {
+                bool taken = false;
+                ok = branch(ins, taken);
+                if (taken)
+                {
+                    next = bb->getBranch();
+                }
+                i = int(instructions.size());
+                break;
+            }
+            case IR_RETURN:
+                result = 0;
+                ok = ins.right() == -1 && (ins.left() == -1 || frame.get(ins.left(), result)); /* only a single value is returned */
+                done = true;
+                break;
+            default:
+                ok = execute(ins, frame);
+                break;
+            }
+        }
+
+        if (!ok || done)
+        {
+            break;
+        }
+
+        if (next == nullptr)
+        {
+            ok = false;
+            break;
+        }
+
+        pred = bb;
+        bb = next;
+    }
+
+    _memory.resize(stack);
+    return ok;
+}
+
+bool poInterpreter::enter(const int function, poBasicBlock* bb, poBasicBlock* pred, poInterpreterFrame& frame)
+{
+    // Each phi takes the value which reaches it from the edge we came in on. The block recorded
+    // against a value is the predecessor, or after promoting memory to registers, the closest
+    // block which dominates the predecessor and defines it.
+
+    std::vector<int> names;
+    std::vector<int> types;
+    std::vector<uint64_t> values;
+    for (poPhi& phi : bb->phis())
+    {
+        const std::vector<poBasicBlock*>& incoming = phi.getBasicBlock();
+        int index = -1;
+        for (poBasicBlock* dom = pred; dom && index == -1; dom = getDominator(function, dom))
+        {
+            for (int i = 0; i < int(incoming.size()); i++)
+            {
+                if (incoming[i] == dom)
+                {
+                    index = i;
+                    break;
+                }
+            }
+        }
+
+        uint64_t value = 0;
+        if (index == -1 ||
+            index >= int(phi.values().size()) ||
+            !frame.get(phi.values()[index], value))
+        {
+            return false;
+        }
+
+        names.push_back(phi.name());
+        types.push_back(phi.getType());
+        values.push_back(value);
+    }
+
+    // All of the phis read their values before any of them are written
+    for (int i = 0; i < int(names.size()); i++)
+    {
+        frame.set(names[i], types[i], values[i]);
+    }
+    return true;
+}
+
+poBasicBlock* poInterpreter::getDominator(const int function, poBasicBlock* bb)
+{
+    auto it = _dominators.find(function);
+    if (it == _dominators.end())
+    {
+        poDom dom;
+        dom.compute(_module.functions()[function].cfg());
+
+        std::unordered_map<poBasicBlock*, poBasicBlock*> dominators;
+        for (int i = 0; i < dom.num(); i++)
+        {
+            const poDomNode& node = dom.get(i);
+            const int immediate = node.immediateDominator();
+            if (immediate >= 0 && immediate < dom.num() && immediate != i)
+            {
+                dominators[node.getBasicBlock()] = dom.get(immediate).getBasicBlock();
+            }
+        }
+        it = _dominators.insert(std::pair<int, std::unordered_map<poBasicBlock*, poBasicBlock*>>(function, dominators)).first;
+    }
+
+    const auto& dominator = it->second.find(bb);
+    return dominator == it->second.end() ? nullptr : dominator->second;
+}
+
+bool poInterpreter::execute(const poInstruction& ins, poInterpreterFrame& frame)
+{
+    uint64_t left = 0;
+    uint64_t right = 0;
+    uint64_t result = 0;
+    switch (ins.code())
+    {
+    case IR_PHI:
+        // Resolved on entry to the block
+        return true;
+    case IR_CONSTANT:
+        if (!getConstant(ins, result))
+        {
+            return false;
+        }
+        break;
+    case IR_COPY:
+        if (!isScalar(ins.type()) || !frame.get(ins.left(), result))
+        {
+            return false;
+        }
+        break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+    case IR_MODULO:
+    case IR_LEFT_SHIFT:
+    case IR_RIGHT_SHIFT:
+        if (!frame.get(ins.left(), left) ||
+            !frame.get(ins.right(), right) ||
+            !arithmetic(ins, left, right, result))
+        {
+            return false;
+        }
+        break;
+    case IR_UNARY_MINUS:
+        if (!frame.get(ins.left(), left))
+        {
+            return false;
+        }
+
+        // Floats are subtracted from zero, so zero stays positive
+        if (ins.type() == TYPE_F32) { result = fromF32(0.0f - toF32(left)); }
+        else if (ins.type() == TYPE_F64) { result = fromF64(0.0 - toF64(left)); }
+        else if (isSigned(ins.type()) || isUnsigned(ins.type())) { result = 0 - left; }
+        else { return false; }
+        break;
+    case IR_CMP:
+        return frame.get(ins.left(), left) &&
+            frame.get(ins.right(), right) &&
+            compare(ins, left, right);
+    case IR_SIGN_EXTEND:
+    case IR_ZERO_EXTEND:
+    case IR_CONVERT:
+    case IR_BITWISE_CAST:
+        if (!frame.get(ins.left(), left) ||
+            !convert(ins, left, result))
+        {
+            return false;
+        }
+        break;
+    case IR_ALLOCA:
+    {
+        const poType& type = _module.types()[ins.type()];
+        if (!type.isPointer() && !type.isArray())
+        {
+            return false;
+        }
+
+        // Slots are kept to multiples of 8 bytes, the same as on the stack
+        const size_t size = size_t(_module.types()[type.baseType()].size()) * size_t(ins.left());
+        const size_t offset = _memory.size();
+        if (offset + size + 8 > MAX_MEMORY)
+        {
+            return false;
+        }
+        _memory.resize(offset + (size + 7) / 8 * 8, 0);
+        result = MEMORY_BASE + offset;
+        break;
+    }
+    case IR_PTR:
+        if (ins.memOffset() < 0 || !frame.get(ins.left(), result))
+        {
+            return false;
+        }
+
+        result += uint64_t(ins.memOffset());
+        if (ins.right() != -1)
+        {
+            if (getSize(frame.getType(ins.right())) != 8 ||
+                !frame.get(ins.right(), right))
+            {
+                return false;
+            }
+            result += right;
+        }
+        break;
+    case IR_ELEMENT_PTR:
+    {
+        // Without an index the backend adds the size of an element or nothing depending on
+        // where the pointer is held, so only indexed pointers are followed
+        const poType& type = _module.types()[ins.type()];
+        if (!type.isPointer() ||
+            ins.right() == -1 ||
+            getSize(frame.getType(ins.right())) != 8 ||
+            !frame.get(ins.left(), left) ||
+            !frame.get(ins.right(), right))
+        {
+            return false;
+        }
+
+        result = left + right * uint64_t(_module.types()[type.baseType()].size());
+        break;
+    }
+    case IR_LOAD:
+        if (!isScalar(ins.type()) ||
+            !frame.get(ins.left(), left) ||
+            !load(ins.type(), left, result))
+        {
+            return false;
+        }
+        break;
+    case IR_STORE:
+        return isScalar(ins.type()) &&
+            frame.get(ins.left(), left) &&
+            frame.get(ins.right(), right) &&
+            store(ins.type(), left, right);
+    default:
+        // Globals, the heap, block memory and vector operations are not evaluated
+        return false;
+    }
+
+    frame.set(ins.name(), ins.type(), extend(ins.type(), result));
+    return true;
+}
+
+bool poInterpreter::compare(const poInstruction& ins, const uint64_t left, const uint64_t right)
+{
+    _compareType = ins.type();
+    _signedOrder = ORDER_NONE;
+    _unsignedOrder = ORDER_NONE;
+
+    if (isFloat(ins.type()))
+    {
+        // Only the unsigned jumps read the flags of a float compare, which can't be
+        // ordered at all with a NaN
+        const double lhs = ins.type() == TYPE_F32 ? toF32(left) : toF64(left);
+        const double rhs = ins.type() == TYPE_F32 ? toF32(right) : toF64(right);
+        if (std::isnan(lhs) || std::isnan(rhs))
+        {
+            return false;
+        }
+        _unsignedOrder = lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+        return true;
+    }
+
+    if (!isScalar(ins.type()))
+    {
+        return false;
+    }
+
+    const int size = getSize(ins.type());
+    const int64_t lhs = int64_t(signExtend(left, size));
+    const int64_t rhs = int64_t(signExtend(right, size));
+    const uint64_t ulhs = zeroExtend(left, size);
+    const uint64_t urhs = zeroExtend(right, size);
+    _signedOrder = lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+    _unsignedOrder = ulhs < urhs ? -1 : (ulhs > urhs ? 1 : 0);
+    return true;
+}
+
+bool poInterpreter::branch(const poInstruction& ins, bool& taken)
+{
+    if (ins.left() == IR_JUMP_UNCONDITIONAL)
+    {
+        taken = true;
+        return true;
+    }
+
+    // The type of the branch picks between the signed and unsigned jumps
+    const int order = isFloat(ins.type()) || isUnsigned(ins.type()) ? _unsignedOrder : _signedOrder;
+    if (_compareType == -1 || order == ORDER_NONE)
+    {
+        return false;
+    }
+
+    switch (ins.left())
+    {
+    case IR_JUMP_EQUALS: taken = order == 0; break;
+    case IR_JUMP_NOT_EQUALS: taken = order != 0; break;
+    case IR_JUMP_LESS: taken = order < 0; break;
+    case IR_JUMP_GREATER: taken = order > 0; break;
+    case IR_JUMP_GREATER_EQUALS: taken = order >= 0; break;
+    case IR_JUMP_LESS_EQUALS: taken = order <= 0; break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+bool poInterpreter::arithmetic(const poInstruction& ins, const uint64_t left, const uint64_t right, uint64_t& result)
+{
+    const int type = ins.type();
+    if (type == TYPE_F32 || type == TYPE_F64)
+    {
+        const bool f32 = type == TYPE_F32;
+        switch (ins.code())
+        {
+        case IR_ADD: result = f32 ? fromF32(toF32(left) + toF32(right)) : fromF64(toF64(left) + toF64(right)); break;
+        case IR_SUB: result = f32 ? fromF32(toF32(left) - toF32(right)) : fromF64(toF64(left) - toF64(right)); break;
+        case IR_MUL: result = f32 ? fromF32(toF32(left) * toF32(right)) : fromF64(toF64(left) * toF64(right)); break;
+        case IR_DIV: result = f32 ? fromF32(toF32(left) / toF32(right)) : fromF64(toF64(left) / toF64(right)); break;
+        default:
+            return false;
+        }
+        return true;
+    }
+
+    if (!isSigned(type) && !isUnsigned(type))
+    {
+        return false;
+    }
+
+    const int size = getSize(type);
+    const int bits = size == 8 ? 63 : 31; /* the count is masked by the shift instructions */
+    switch (ins.code())
+    {
+    case IR_ADD: result = left + right; break;
+    case IR_SUB: result = left - right; break;
+    case IR_MUL: result = left * right; break;
+    case IR_LEFT_SHIFT: result = left << (right & bits); break;
+    case IR_RIGHT_SHIFT:
+        // Always an arithmetic shift, whatever the type
+        result = uint64_t(int64_t(signExtend(left, size)) >> (right & bits));
+        break;
+    case IR_DIV:
+    case IR_MODULO:
+        if (zeroExtend(right, size) == 0)
+        {
+            return false;
+        }
+
+        if (isSigned(type))
+        {
+            // The dividend isn't sign extended into the upper half before dividing,
+            // so a negative one gives a different answer
+            const int64_t lhs = int64_t(signExtend(left, size));
+            const int64_t rhs = int64_t(signExtend(right, size));
+            if (lhs < 0)
+            {
+                return false;
+            }
+            result = uint64_t(ins.code() == IR_DIV ? lhs / rhs : lhs % rhs);
+        }
+        else
+        {
+            const uint64_t lhs = zeroExtend(left, size);
+            const uint64_t rhs = zeroExtend(right, size);
+            result = ins.code() == IR_DIV ? lhs / rhs : lhs % rhs;
+        }
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+bool poInterpreter::convert(const poInstruction& ins, const uint64_t value, uint64_t& result)
+{
+    const int dstType = ins.type();
+    const int srcType = ins.memOffset();
+    switch (ins.code())
+    {
+    case IR_SIGN_EXTEND:
+        switch (srcType)
+        {
+        case TYPE_I32:
+        case TYPE_U32:
+            result = signExtend(value, 4);
+            return true;
+        case TYPE_I16:
+        case TYPE_U16:
+            result = signExtend(value, 2);
+            return dstType == TYPE_I64 || dstType == TYPE_I32;
+        case TYPE_I8:
+        case TYPE_U8:
+            result = signExtend(value, 1);
+            return dstType == TYPE_I64 || dstType == TYPE_I32 || dstType == TYPE_I16;
+        }
+        return false;
+    case IR_ZERO_EXTEND:
+        switch (srcType)
+        {
+        case TYPE_U32:
+            // Lowered as cdqe
+            result = signExtend(value, 4);
+            return true;
+        case TYPE_U16:
+            // Lowered as movsx
+            result = signExtend(value, 2);
+            return dstType == TYPE_U64 || dstType == TYPE_U32;
+        case TYPE_U8:
+            result = zeroExtend(value, 1);
+            return dstType == TYPE_U64 || dstType == TYPE_U32 || dstType == TYPE_U16;
+        }
+        return false;
+    case IR_CONVERT:
+        if (isFloat(srcType))
+        {
+            if (!isSigned(dstType))
+            {
+                return false;
+            }
+
+            // cvtsd2si rounds to nearest, while cvttss2si truncates
+            const double f64 = srcType == TYPE_F64 ? std::nearbyint(toF64(value)) : std::trunc(double(toF32(value)));
+            if (std::isnan(f64) || f64 < -9223372036854775808.0 || f64 >= 9223372036854775808.0)
+            {
+                return false;
+            }
+            result = uint64_t(int64_t(f64));
+            return true;
+        }
+
+        if (!isSigned(srcType))
+        {
+            return false;
+        }
+
+        switch (dstType)
+        {
+        case TYPE_F64:
+            result = fromF64(double(int64_t(signExtend(value, getSize(srcType)))));
+            return true;
+        case TYPE_F32:
+            result = fromF32(float(int64_t(signExtend(value, getSize(srcType)))));
+            return true;
+        }
+        return false;
+    case IR_BITWISE_CAST:
+        // The register is moved as it is, so it can't widen or cross to a float register
+        if (isFloat(srcType) ||
+            isFloat(dstType) ||
+            !isScalar(srcType) ||
+            !isScalar(dstType) ||
+            getSize(dstType) > getSize(srcType))
+        {
+            return false;
+        }
+        result = value;
+        return true;
+    }
+    return false;
+}
+
+bool poInterpreter::load(const int type, const uint64_t address, uint64_t& value)
+{
+    const int size = getSize(type);
+    if (address < MEMORY_BASE ||
+        address - MEMORY_BASE + size > _memory.size())
+    {
+        return false;
+    }
+
+    value = 0;
+    std::memcpy(&value, &_memory[address - MEMORY_BASE], size);
+    return true;
+}
+
+bool poInterpreter::store(const int type, const uint64_t address, const uint64_t value)
+{
+    const int size = getSize(type);
+    if (address < MEMORY_BASE ||
+        address - MEMORY_BASE + size > _memory.size())
+    {
+        return false;
+    }
+
+    std::memcpy(&_memory[address - MEMORY_BASE], &value, size);
+    return true;
+}
+
+bool poInterpreter::getFunction(const int symbol, int& function)
+{
+    const auto& it = _functions.find(symbol);
+    if (it != _functions.end())
+    {
+        function = it->second;
+        return function != -1;
+    }
+
+    std::string name;
+    function = -1;
+    if (_module.getSymbol(symbol, name))
+    {
+        for (int i = 0; i < int(_module.functions().size()); i++)
+        {
+            if (_module.functions()[i].fullname() == name)
+            {
+                function = i;
+                break;
+            }
+        }
+    }
+
+    _functions.insert(std::pair<int, int>(symbol, function));
+    return function != -1;
+}
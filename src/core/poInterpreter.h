@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//
+// Interpreter for the IR, used to run functions at compile time.
+//
+// Values are held as raw 64-bit patterns, integers extended from the width of their type
+// and floats as their bits. Memory from IR_ALLOCA comes from an arena of its own, so a
+// function which only touches its own stack and calls others which do the same can be
+// run without side effects. Anything else, such as globals, the heap, extern calls or
+// vector instructions, stops the evaluation, as does running out of steps.
+//
+// The results have to match what the generated code would compute, so operations the
+// backend lowers with different results to the language (signed division of negative
+// values, unsigned or float to float conversions) are refused rather than evaluated.
+// Both the code generator's form and SSA form can be run.
+//
+
+namespace po
+{
+    class poModule;
+    class poBasicBlock;
+    class poInstruction;
+
+    class poInterpreterFrame
+    {
+    public:
+        void set(const int name, const int type, const uint64_t value);
+        bool get(const int name, uint64_t& value) const;
+        int getType(const int name) const;
+
+    private:
+        std::unordered_map<int, uint64_t> _values;
+        std::unordered_map<int, int> _types;
+    };
+
+    class poInterpreter
+    {
+    public:
+        poInterpreter(poModule& module);
+        bool call(const int function, const std::vector<uint64_t>& args, uint64_t& result);
+
+        bool getConstant(const poInstruction& ins, uint64_t& value);
+        int addConstant(const int type, const uint64_t value);
+        bool isScalar(const int type);
+        bool getFunction(const int symbol, int& function);
+
+    private:
+        bool run(const int function, const std::vector<uint64_t>& args, uint64_t& result, const int depth);
+        bool enter(const int function, poBasicBlock* bb, poBasicBlock* pred, poInterpreterFrame& frame);
+        bool execute(const poInstruction& ins, poInterpreterFrame& frame);
+        bool compare(const poInstruction& ins, const uint64_t left, const uint64_t right);
+        bool branch(const poInstruction& ins, bool& taken);
+        bool arithmetic(const poInstruction& ins, const uint64_t left, const uint64_t right, uint64_t& result);
+        bool convert(const poInstruction& ins, const uint64_t value, uint64_t& result);
+        bool load(const int type, const uint64_t address, uint64_t& value);
+        bool store(const int type, const uint64_t address, const uint64_t value);
+        poBasicBlock* getDominator(const int function, poBasicBlock* bb);
+
+        poModule& _module;
+        std::vector<uint8_t> _memory;
+        std::unordered_map<int, int> _functions; // symbol -> function
+        std::unordered_map<int, std::unordered_map<poBasicBlock*, poBasicBlock*>> _dominators;
+        int _steps;
+
+        // State of the last compare, for the branch which follows it
+        int _compareType;
+        int _signedOrder;
+        int _unsignedOrder;
+    };
+}
@@ -81,6 +81,10 @@ poLexer::poLexer()
     addKeyword("u32", poTokenType::U32_TYPE);
     addKeyword("u16", poTokenType::U16_TYPE);
     addKeyword("u8", poTokenType::U8_TYPE);
+    addKeyword("f32x4", poTokenType::F32X4_TYPE);
+    addKeyword("f64x2", poTokenType::F64X2_TYPE);
+    addKeyword("i32x4", poTokenType::I32X4_TYPE);
+    addKeyword("u8x16", poTokenType::U8X16_TYPE);
     addKeyword("true", poTokenType::TRUE);
     addKeyword("false", poTokenType::FALSE);
     addKeyword("boolean", poTokenType::BOOLEAN);
@@ -97,6 +97,10 @@ namespace po
         U32_TYPE,
         U16_TYPE,
         U8_TYPE,
+        F32X4_TYPE,
+        F64X2_TYPE,
+        I32X4_TYPE,
+        U8X16_TYPE,
         BOOLEAN,
         VOID,
         OBJECT,
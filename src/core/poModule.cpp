@@ -455,6 +455,10 @@ void poModule::addPrimitives()
     addType(poType(TYPE_PARAMETRIC_3, -1, "PARAMETRIC_3"));
     addType(poType(TYPE_PARAMETRIC_4, -1, "PARAMETRIC_4"));
     addType(poType(TYPE_TRAIT_NEW, -1, "TRAIT_NEW"));
+    addType(poType(TYPE_F32X4, -1, "F32X4"));
+    addType(poType(TYPE_F64X2, -1, "F64X2"));
+    addType(poType(TYPE_I32X4, -1, "I32X4"));
+    addType(poType(TYPE_U8X16, -1, "U8X16"));
     addType(poType(TYPE_OBJECT, -1, "OBJECT"));
     assert(_types.size() == TYPE_OBJECT + 1);
 
@@ -472,6 +476,10 @@ void poModule::addPrimitives()
     types[TYPE_BOOLEAN].setSize(1);
     types[TYPE_STRING].setSize(8);
     types[TYPE_ENUM].setSize(4);
+    types[TYPE_F32X4].setSize(16);
+    types[TYPE_F64X2].setSize(16);
+    types[TYPE_I32X4].setSize(16);
+    types[TYPE_U8X16].setSize(16);
 
     // Set kind
     types[TYPE_TRAIT_NEW].setKind(poTypeKind::TRAIT);
@@ -699,6 +707,21 @@ bool poModule::getSymbol(const int id, std::string& symbol)
     return false;
 }
 
+void poModule::setSummary(const std::string& function, const poSummary& summary)
+{
+    _summaries[function] = summary;
+}
+
+const poSummary* poModule::getSummary(const std::string& function) const
+{
+    const auto& it = _summaries.find(function);
+    if (it != _summaries.end())
+    {
+        return &it->second;
+    }
+    return nullptr;
+}
+
 void poModule::dumpTypes()
 {
     for (auto& type : _types)
@@ -781,6 +804,10 @@ void poModule::dump(const std::string& name)
                     break;
                 case IR_RETURN:
                     std::cout << " IR_RETURN " << int(ins.type()) << " " << ins.left();
+                    if (ins.right() != -1)
+                    {
+                        std::cout << " " << int(ins.memOffset()) << " " << ins.right();
+                    }
                     break;
                 case IR_COPY:
                     std::cout << " IR_COPY " << int(ins.type()) << " " << ins.left();
@@ -791,6 +818,39 @@ void poModule::dump(const std::string& name)
                 case IR_ARG:
                     std::cout << " IR_ARG " << int(ins.type()) << " " << int(ins.left());
                     break;
+                case IR_RESULT:
+                    std::cout << " IR_RESULT " << int(ins.type()) << " " << int(ins.left());
+                    break;
+                case IR_COPY_MEMORY:
+                    std::cout << " IR_COPY_MEMORY " << int(ins.left());
+                    break;
+                case IR_FILL_MEMORY:
+                    std::cout << " IR_FILL_MEMORY " << int(ins.left());
+                    break;
+                case IR_VECTOR_SUM:
+                    std::cout << " IR_VECTOR_SUM " << int(ins.type()) << " " << int(ins.left());
+                    break;
+                case IR_VECTOR_MAP:
+                    std::cout << " IR_VECTOR_MAP " << int(ins.left()) << " " << int(ins.right());
+                    break;
+                case IR_VECTOR_FIND:
+                    std::cout << " IR_VECTOR_FIND " << int(ins.type()) << " " << int(ins.left());
+                    break;
+                case IR_VECTOR_SPLAT:
+                    std::cout << " IR_VECTOR_SPLAT " << int(ins.type()) << " " << ins.left();
+                    break;
+                case IR_VECTOR_EQUALS:
+                    std::cout << " IR_VECTOR_EQUALS " << int(ins.type()) << " " << ins.left() << " " << ins.right();
+                    break;
+                case IR_VECTOR_GREATER:
+                    std::cout << " IR_VECTOR_GREATER " << int(ins.type()) << " " << ins.left() << " " << ins.right();
+                    break;
+                case IR_VECTOR_SHUFFLE:
+                    std::cout << " IR_VECTOR_SHUFFLE " << int(ins.type()) << " " << ins.left() << " " << ins.memOffset();
+                    break;
+                case IR_VECTOR_MOVEMASK:
+                    std::cout << " IR_VECTOR_MOVEMASK " << int(ins.memOffset()) << " " << ins.left();
+                    break;
                 case IR_PARAM:
                     std::cout << " IR_PARAM " << int(ins.type());
                     break;
@@ -1,6 +1,7 @@
 #pragma once
 #include "poCFG.h"
 #include "poType.h"
+#include "poSummary.h"
 
 #include <vector>
 #include <string>
@@ -10,7 +11,8 @@ namespace po
 {
     enum class poCallConvention
     {
-        X86_64
+        X86_64, // The platform C ABI, for extern functions
+        Pora // Calls between Pora functions, which assigns more argument registers
     };
 
     class poConstant
@@ -93,6 +95,7 @@ namespace po
         inline void addFunction(const int id) { _functions.push_back(id); }
         inline void addType(const int id) { _types.push_back(id); }
         inline void addStaticVariable(const int id) { _staticVariables.push_back(id); }
+        inline std::vector<int>& functions() { return _functions; }
         inline const std::vector<int>& functions() const { return _functions; }
         inline const std::vector<int>& types() const { return _types; }
         inline const std::vector<int>& staticVariables() const { return _staticVariables; }
@@ -173,6 +176,7 @@ namespace po
         inline const int type() const { return _type; }
         inline const std::string& name() const { return _name; }
         inline const int constantId() const { return _constantId; }
+        inline void setConstantId(const int constantId) { _constantId = constantId; }
 
     private:
         int _type;
@@ -195,6 +199,8 @@ namespace po
         inline std::vector<poStaticVariable>& staticVariables() { return _staticVariables; }
         int addSymbol(const std::string& symbol);
         bool getSymbol(const int id, std::string& symbol);
+        void setSummary(const std::string& function, const poSummary& summary);
+        const poSummary* getSummary(const std::string& function) const;
         void addFunction(const poFunction& function);
         void addType(const poType& type);
         void addStaticVariable(const poStaticVariable& variable);
@@ -215,6 +221,7 @@ namespace po
         std::unordered_map<int, int> _arrayTypes; /* mapping from base type -> array type */
         std::unordered_map<int, int> _pointerTypes; /* mapping from base type -> pointer type */
         std::unordered_map<int, std::string> _symbols;
+        std::unordered_map<std::string, poSummary> _summaries; /* side effects of each function by name */
         std::vector<poNamespace> _namespaces;
         poConstantPool _constants;
     };
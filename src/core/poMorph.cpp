@@ -378,7 +378,7 @@ void poMorph:: substituteConstructor(const std::string& namespaceName, std::vect
             fullName,
             int(argList.size()),
             poAttributes::PUBLIC,
-            poCallConvention::X86_64
+            poCallConvention::Pora
         ));
 
         for (poNamespace& ns : _module.namespaces()) {
@@ -507,7 +507,7 @@ void poMorph:: substituteFunctions(const std::string& namespaceName, std::vector
             fullName,
             int(argList.size()),
             poAttributes::PUBLIC,
-            poCallConvention::X86_64
+            poCallConvention::Pora
         ));
 
         for (poNamespace& ns : _module.namespaces()) {
@@ -82,6 +82,24 @@ const bool poNLF::isIrreducible() const
     return ok;
 }
 
+const int poNLF::getDepth(const int node) const
+{
+    // The number of loops the node is nested in, found by walking up the loop headers
+
+    int depth = 0;
+    int header = node;
+    for (size_t i = 0; i < _header.size() && header >= 0; i++)
+    {
+        if (_type[header] != poNLFType::NonHeader)
+        {
+            depth++;
+        }
+        header = _header[header];
+    }
+
+    return depth;
+}
+
 void poNLF::compute(const poDom& dom)
 {
     const size_t numNodes = dom.num();
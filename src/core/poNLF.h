@@ -54,6 +54,7 @@ namespace po
         void compute(const poDom& dom);
         inline const int getHeader(const int node) const { return _header[node]; }
         inline const poNLFType getType(const int node) const { return _type[node]; }
+        const int getDepth(const int node) const;
         const bool isIrreducible() const;
 
     private:
@@ -13,12 +13,12 @@ void poOptDCE::optimize(poModule& module)
             continue; // Skip extern functions
         }
 
-        optimize(function);
+        optimize(module, function);
         function.cfg().optimize(); /* remove any unreachable blocks after DCE */
     }
 }
 
-void poOptDCE::optimize(poDom& dom, const int id)
+void poOptDCE::optimize(poModule& module, poDom& dom, const int id)
 {
     _visitedNodes.insert(id);
 
@@ -44,7 +44,7 @@ void poOptDCE::optimize(poDom& dom, const int id)
     {
         if (_visitedNodes.find(successors[i]) == _visitedNodes.end())
         {
-            optimize(dom, successors[i]);
+            optimize(module, dom, successors[i]);
         }
     }
 
@@ -54,6 +54,46 @@ void poOptDCE::optimize(poDom& dom, const int id)
     while (pos >= 0)
     {
         auto& ins = bb->getInstruction(pos);
+        if (ins.code() == IR_ARG)
+        {
+            /* arguments of a call are kept or removed along with it */
+            int callPos = pos - 1;
+            while (callPos >= 0 && bb->getInstruction(callPos).code() == IR_ARG)
+            {
+                callPos--;
+            }
+            if (callPos >= 0 && bb->getInstruction(callPos).code() == IR_CALL)
+            {
+                pos--;
+                continue;
+            }
+        }
+        else if (ins.code() == IR_CALL)
+        {
+            /* the second half of a struct returned in registers is read after the arguments */
+            const int resultPos = pos + ins.left() + 1;
+            const bool hasResult = resultPos < int(bb->numInstructions()) &&
+                bb->getInstruction(resultPos).code() == IR_RESULT;
+
+            if (_usedNames.find(ins.name()) == _usedNames.end() &&
+                !hasResult &&
+                isRemovableCall(module, ins))
+            {
+                while (pos + 1 < int(bb->numInstructions()) && bb->getInstruction(pos + 1).code() == IR_ARG)
+                {
+                    bb->removeInstruction(pos + 1);
+                }
+                bb->removeInstruction(pos);
+                pos--;
+                continue;
+            }
+
+            for (int i = pos + 1; i < int(bb->numInstructions()) && bb->getInstruction(i).code() == IR_ARG; i++)
+            {
+                _usedNames.insert(bb->getInstruction(i).left());
+            }
+        }
+
         switch (ins.code())
         {
         case IR_CMP: /* skip on these as they won't have uses */
@@ -65,6 +105,12 @@ void poOptDCE::optimize(poDom& dom, const int id)
         case IR_LOAD_GLOBAL:
         case IR_STORE_GLOBAL:
         case IR_CALL: /* call may have uses or not, but certainly can have side-effects */
+        case IR_PARAM: /* parameters give the registers of the ones after them */
+        case IR_COPY_MEMORY:
+        case IR_FILL_MEMORY:
+        case IR_VECTOR_SUM:
+        case IR_VECTOR_MAP:
+        case IR_VECTOR_FIND:
             goto done;
         default:
             break;
@@ -93,7 +139,19 @@ void poOptDCE::optimize(poDom& dom, const int id)
     }
 }
 
-void poOptDCE::optimize(poFunction& function)
+bool poOptDCE::isRemovableCall(poModule& module, const poInstruction& call)
+{
+    std::string symbol;
+    if (!module.getSymbol(call.right(), symbol))
+    {
+        return false;
+    }
+
+    const poSummary* summary = module.getSummary(symbol);
+    return summary != nullptr && !summary->hasSideEffects();
+}
+
+void poOptDCE::optimize(poModule& module, poFunction& function)
 {
     _usedNames.clear();
     _visitedNodes.clear();
@@ -103,5 +161,5 @@ void poOptDCE::optimize(poFunction& function)
     poDom dom;
     dom.compute(cfg);
 
-    optimize(dom, dom.start());
+    optimize(module, dom, dom.start());
 }
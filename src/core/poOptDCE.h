@@ -3,7 +3,8 @@
 #include <unordered_set>
 
 /* File for performing dead code elimination (DCE) on 
-* the program in SSA form. */
+* the program in SSA form. Calls whose result is unused are
+* removed when the callee's summary shows no side effects. */
 
 namespace po
 {
@@ -11,6 +12,7 @@ namespace po
     class poFunction;
     class poDom;
     class poDomNode;
+    class poInstruction;
 
     class poOptDCE
     {
@@ -18,8 +20,9 @@ namespace po
         void optimize(poModule& module);
 
     private:
-        void optimize(poFunction& function);
-        void optimize(poDom& dom, const int id);
+        void optimize(poModule& module, poFunction& function);
+        void optimize(poModule& module, poDom& dom, const int id);
+        bool isRemovableCall(poModule& module, const poInstruction& call);
 
         std::unordered_set<int> _usedNames;
         std::unordered_set<int> _visitedNodes;
@@ -0,0 +1,356 @@
+#include "poOptEscape.h"
+#include "poModule.h"
+#include "poCFG.h"
+
+#include <assert.h>
+#include <algorithm>
+#include <unordered_set>
+
+using namespace po;
+
+static const int MAX_OBJECT_SIZE = 256; // Largest single allocation moved onto the stack
+static const int MAX_FRAME_SIZE = 1024; // Limit on the stack used by moved allocations in one function
+
+static const char* const MALLOC_SYMBOL = "std::malloc2";
+static const char* const MALLOC_ARRAY_SYMBOL = "std::malloc3";
+
+//
+// poOptEscape_Allocation
+//
+
+poOptEscape_Allocation::poOptEscape_Allocation(poBasicBlock* bb, const int pos, const int numElements)
+    :
+    _bb(bb),
+    _pos(pos),
+    _numElements(numElements)
+{
+}
+
+//
+// poOptEscape
+//
+
+poOptEscape::poOptEscape()
+    :
+    _numPromoted(0)
+{
+}
+
+void poOptEscape::optimize(poModule& module)
+{
+    _graph.analyze(module);
+    _functions.clear();
+    _numPromoted = 0;
+
+    summarize(module);
+
+    for (int i = 0; i < int(module.functions().size()); i++)
+    {
+        poFunction& func = module.functions()[i];
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC))
+        {
+            continue;
+        }
+
+        optimize(module, i);
+    }
+}
+
+void poOptEscape::summarize(poModule& module)
+{
+    // Start by assuming no parameter escapes, only marking those which are seen to.
+    // Functions without a body are left with no summary so every argument escapes.
+
+    const int numFunctions = int(module.functions().size());
+    _captures.assign(numFunctions, std::vector<bool>());
+    for (int i = 0; i < numFunctions; i++)
+    {
+        poFunction& func = module.functions()[i];
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC) ||
+            func.cfg().getFirst() == nullptr)
+        {
+            continue;
+        }
+
+        int numParams = 0;
+        for (const poInstruction& ins : func.cfg().getFirst()->instructions())
+        {
+            if (ins.code() == IR_PARAM)
+            {
+                numParams = std::max(numParams, ins.left() + 1);
+            }
+        }
+        _captures[i].assign(numParams, false);
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < numFunctions; i++)
+        {
+            if (_captures[i].size() > 0 && summarize(module, i))
+            {
+                changed = true;
+            }
+        }
+    }
+}
+
+bool poOptEscape::summarize(poModule& module, const int id)
+{
+    poFlowGraph& cfg = module.functions()[id].cfg();
+    _uses.analyze(cfg);
+
+    bool changed = false;
+    for (const poInstruction& ins : cfg.getFirst()->instructions())
+    {
+        if (ins.code() != IR_PARAM || _captures[id][ins.left()])
+        {
+            continue;
+        }
+
+        if (escapes(module, ins.name(), false))
+        {
+            _captures[id][ins.left()] = true;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+void poOptEscape::optimize(poModule& module, const int id)
+{
+    poFlowGraph& cfg = module.functions()[id].cfg();
+    _uses.analyze(cfg);
+    _constants.clear();
+
+    for (poBasicBlock* bb = cfg.getFirst(); bb != nullptr; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            if (ins.code() != IR_CONSTANT)
+            {
+                continue;
+            }
+
+            const poConstantPool& pool = module.constants();
+            switch (ins.type())
+            {
+            case TYPE_I64:
+                _constants.insert(std::pair<int, int64_t>(ins.name(), pool.getI64(ins.constant())));
+                break;
+            case TYPE_U64:
+                _constants.insert(std::pair<int, int64_t>(ins.name(), int64_t(pool.getU64(ins.constant()))));
+                break;
+            }
+        }
+    }
+
+    // 1. Find the allocations which can be moved
+
+    std::vector<poOptEscape_Allocation> allocations;
+    int frameSize = 0;
+    for (poBasicBlock* bb = cfg.getFirst(); bb != nullptr; bb = bb->getNext())
+    {
+        for (int i = 0; i < int(bb->numInstructions()); i++)
+        {
+            int numElements = 0;
+            if (!findAllocation(module, bb, i, numElements))
+            {
+                continue;
+            }
+
+            const poInstruction& ins = bb->getInstruction(i);
+            const poType& type = module.types()[ins.type()];
+            const int size = module.types()[type.baseType()].size() * numElements;
+            if (size <= 0 ||
+                size > MAX_OBJECT_SIZE ||
+                frameSize + size > MAX_FRAME_SIZE)
+            {
+                continue;
+            }
+
+            if (escapes(module, ins.name(), true))
+            {
+                continue;
+            }
+
+            frameSize += size;
+            allocations.push_back(poOptEscape_Allocation(bb, i, numElements));
+        }
+    }
+
+    if (allocations.size() == 0)
+    {
+        return;
+    }
+
+    // 2. Replace the calls with IR_ALLOCA and remove their arguments, last first so positions stay valid
+
+    for (int i = int(allocations.size()) - 1; i >= 0; i--)
+    {
+        const poOptEscape_Allocation& allocation = allocations[i];
+        poBasicBlock* bb = allocation.getBasicBlock();
+        poInstruction& call = bb->getInstruction(allocation.pos());
+        const int numArgs = call.left();
+
+        call = poInstruction(call.name(), call.type(), int16_t(allocation.numElements()), -1, IR_ALLOCA);
+        for (int j = 0; j < numArgs; j++)
+        {
+            bb->removeInstruction(allocation.pos() + 1);
+        }
+    }
+
+    _numPromoted += int(allocations.size());
+    _functions.push_back(id);
+}
+
+bool poOptEscape::findAllocation(poModule& module, poBasicBlock* bb, const int pos, int& numElements)
+{
+    const poInstruction& ins = bb->getInstruction(pos);
+    if (ins.code() != IR_CALL ||
+        !module.types()[ins.type()].isPointer())
+    {
+        return false;
+    }
+
+    std::string symbol;
+    if (!module.getSymbol(ins.right(), symbol))
+    {
+        return false;
+    }
+
+    if (symbol == MALLOC_SYMBOL && ins.left() == 3)
+    {
+        numElements = 1;
+        return true;
+    }
+
+    if (symbol == MALLOC_ARRAY_SYMBOL && ins.left() == 4)
+    {
+        // The number of elements is the second argument, which must be a constant
+
+        const poInstruction& arg = bb->getInstruction(pos + 2);
+        assert(arg.code() == IR_ARG);
+        const auto& constant = _constants.find(arg.left());
+        if (constant == _constants.end() ||
+            constant->second <= 0 ||
+            constant->second > INT16_MAX)
+        {
+            return false;
+        }
+
+        numElements = int(constant->second);
+        return true;
+    }
+
+    return false;
+}
+
+bool poOptEscape::escapes(poModule& module, const int variable, const bool onStack)
+{
+    // Follow the pointer and any pointers derived from it. An allocation moved onto the stack
+    // has no register, so it may only be used to form other pointers or be passed to a call.
+
+    std::vector<int> worklist{ variable };
+    std::unordered_set<int> visited;
+    while (worklist.size() > 0)
+    {
+        const int name = worklist.back();
+        worklist.pop_back();
+        if (!visited.insert(name).second || !_uses.hasUses(name))
+        {
+            continue;
+        }
+
+        const bool isStack = onStack && name == variable;
+        for (const poInstructionRef& use : _uses.getUses(name))
+        {
+            const poInstruction& ins = use.getInstruction();
+            switch (ins.code())
+            {
+            case IR_PTR:
+            case IR_ELEMENT_PTR:
+                if (ins.left() != name)
+                {
+                    return true; // used as an offset
+                }
+                worklist.push_back(ins.name());
+                break;
+            case IR_ARG:
+                if (isCaptured(module, use.getBasicBlock(), use.getAdjustedRef()))
+                {
+                    return true;
+                }
+                break;
+            case IR_LOAD:
+            case IR_CMP:
+                if (isStack)
+                {
+                    return true;
+                }
+                break;
+            case IR_STORE:
+                if (isStack || ins.right() == name)
+                {
+                    return true; // the pointer itself is written to memory
+                }
+                break;
+            case IR_COPY:
+            case IR_BITWISE_CAST:
+                if (isStack)
+                {
+                    return true;
+                }
+                worklist.push_back(ins.name());
+                break;
+            default:
+                // Returned, merged in a phi or used in some other way
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool poOptEscape::isCaptured(poModule& module, poBasicBlock* bb, const int pos)
+{
+    int callPos = pos - 1;
+    while (callPos >= 0 && bb->getInstruction(callPos).code() == IR_ARG)
+    {
+        callPos--;
+    }
+
+    if (callPos >= 0 &&
+        (bb->getInstruction(callPos).code() == IR_COPY_MEMORY ||
+         bb->getInstruction(callPos).code() == IR_FILL_MEMORY))
+    {
+        return false; // block operations only access the memory
+    }
+
+    if (callPos < 0 || bb->getInstruction(callPos).code() != IR_CALL)
+    {
+        return true;
+    }
+
+    std::string symbol;
+    if (!module.getSymbol(bb->getInstruction(callPos).right(), symbol))
+    {
+        return true;
+    }
+
+    poCallGraphNode* node = _graph.findNodeByName(symbol);
+    if (node == nullptr)
+    {
+        return true;
+    }
+
+    const std::vector<bool>& captures = _captures[node->id()];
+    const int index = pos - callPos - 1;
+    return index >= int(captures.size()) || captures[index];
+}
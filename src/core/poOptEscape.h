@@ -0,0 +1,64 @@
+#pragma once
+#include "poCallGraph.h"
+#include "poUses.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+//
+// Escape analysis which moves objects created with new onto the stack.
+//
+// Each function is first summarized by which of its parameters may escape,
+// iterating over the call graph until nothing changes. An allocation of a constant
+// size whose pointer is never stored, returned, merged in a phi or passed to a
+// parameter which escapes is then rewritten into an IR_ALLOCA. Constructor calls
+// are left in place. This is performed in SSA form.
+//
+
+namespace po
+{
+    class poModule;
+    class poFlowGraph;
+    class poBasicBlock;
+
+    class poOptEscape_Allocation
+    {
+    public:
+        poOptEscape_Allocation(poBasicBlock* bb, const int pos, const int numElements);
+
+        inline poBasicBlock* getBasicBlock() const { return _bb; }
+        inline const int pos() const { return _pos; }
+        inline const int numElements() const { return _numElements; }
+
+    private:
+        poBasicBlock* _bb;
+        int _pos;
+        int _numElements;
+    };
+
+    class poOptEscape
+    {
+    public:
+        poOptEscape();
+        void optimize(poModule& module);
+
+        inline const int numPromoted() const { return _numPromoted; }
+        inline const std::vector<int>& functions() const { return _functions; }
+
+    private:
+        void summarize(poModule& module);
+        bool summarize(poModule& module, const int id);
+        void optimize(poModule& module, const int id);
+        bool findAllocation(poModule& module, poBasicBlock* bb, const int pos, int& numElements);
+        bool escapes(poModule& module, const int variable, const bool onStack);
+        bool isCaptured(poModule& module, poBasicBlock* bb, const int pos);
+
+        poCallGraph _graph;
+        poUses _uses;
+        std::vector<std::vector<bool>> _captures; // Parameters of each function which may escape
+        std::unordered_map<int, int64_t> _constants;
+        std::vector<int> _functions; // Functions which had allocations moved onto the stack
+        int _numPromoted;
+    };
+}
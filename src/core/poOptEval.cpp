@@ -0,0 +1,156 @@
+#include "poOptEval.h"
+#include "poInterpreter.h"
+#include "poModule.h"
+#include "poCFG.h"
+
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <unordered_map>
+
+using namespace po;
+
+poOptEval::poOptEval()
+    :
+    _numCalls(0),
+    _numFolded(0)
+{
+}
+
+void poOptEval::optimize(poModule& module)
+{
+    _numCalls = 0;
+    _numFolded = 0;
+    _results.clear();
+
+    poInterpreter interpreter(module);
+    for (poFunction& func : module.functions())
+    {
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC) ||
+            func.cfg().getFirst() == nullptr)
+        {
+            continue;
+        }
+
+        optimize(module, interpreter, func.cfg());
+    }
+}
+
+void poOptEval::optimize(poModule& module, poInterpreter& interpreter, poFlowGraph& cfg)
+{
+    // Find the value of each constant, the calls we fold are added as we go so that
+    // calls taking their results can be folded in turn
+
+    std::unordered_map<int, uint64_t> constants;
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            uint64_t value = 0;
+            if (ins.code() == IR_CONSTANT &&
+                interpreter.getConstant(ins, value))
+            {
+                constants[ins.name()] = value;
+            }
+        }
+    }
+
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        for (int i = 0; i < int(bb->numInstructions()); i++)
+        {
+            const poInstruction& call = bb->getInstruction(i);
+            if (call.code() != IR_CALL ||
+                !interpreter.isScalar(call.type()) ||
+                module.types()[call.type()].isPointer())
+            {
+                continue;
+            }
+
+            // Functions which use memory or call externs can't be run, so don't try
+            std::string symbol;
+            const poSummary* summary = module.getSymbol(call.right(), symbol) ? module.getSummary(symbol) : nullptr;
+            if (summary != nullptr &&
+                (summary->accessesMemory() || summary->callsExtern()))
+            {
+                continue;
+            }
+
+            const int numArgs = call.left();
+            std::vector<uint64_t> args;
+            for (int j = i + 1; j <= i + numArgs && j < int(bb->numInstructions()); j++)
+            {
+                const poInstruction& arg = bb->getInstruction(j);
+                const auto& it = constants.find(arg.left());
+                if (arg.code() != IR_ARG || it == constants.end())
+                {
+                    break;
+                }
+                args.push_back(it->second);
+            }
+
+            if (int(args.size()) != numArgs)
+            {
+                continue;
+            }
+
+            _numCalls++;
+            uint64_t result = 0;
+            if (!evaluate(interpreter, call.right(), args, result))
+            {
+                continue;
+            }
+
+            // The constant has to load back as the same value, which not all of them do
+            const int id = interpreter.addConstant(call.type(), result);
+            if (id == -1 || id > std::numeric_limits<int16_t>::max())
+            {
+                continue;
+            }
+
+            const poInstruction constant(call.name(), call.type(), int16_t(id), IR_CONSTANT);
+            uint64_t value = 0;
+            if (!interpreter.getConstant(constant, value) || value != result)
+            {
+                continue;
+            }
+
+            bb->getInstruction(i) = constant;
+            for (int j = 0; j < numArgs; j++)
+            {
+                bb->removeInstruction(i + 1);
+            }
+
+            constants[constant.name()] = result;
+            _numFolded++;
+        }
+    }
+}
+
+bool poOptEval::evaluate(poInterpreter& interpreter, const int symbol, const std::vector<uint64_t>& args, uint64_t& result)
+{
+    std::vector<uint64_t> key;
+    key.push_back(uint64_t(symbol));
+    key.insert(key.end(), args.begin(), args.end());
+
+    const auto& it = _results.find(key);
+    if (it != _results.end())
+    {
+        result = it->second.second;
+        return it->second.first;
+    }
+
+    int function = -1;
+    const bool ok = interpreter.getFunction(symbol, function) &&
+        interpreter.call(function, args, result);
+    _results.insert(std::pair<std::vector<uint64_t>, std::pair<bool, uint64_t>>(key, std::pair<bool, uint64_t>(ok, result)));
+    return ok;
+}
+
+void poOptEval::dump() const
+{
+    std::cout << "Compile time evaluation:" << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "constant calls" << _numCalls << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "folded" << _numFolded << std::endl;
+}
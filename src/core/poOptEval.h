@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+//
+// Compile time evaluation of calls to side effect free functions.
+//
+// A call whose arguments are all constants is run through the IR interpreter and,
+// if the callee finishes within the interpreter's step budget without touching
+// anything outside its own stack, is replaced with the constant it returned. Loops,
+// recursion and calls to other such functions are followed. The results are kept
+// per callee and arguments so repeated calls are only run once. This is performed
+// in SSA form, before inlining takes the calls apart.
+//
+
+namespace po
+{
+    class poModule;
+    class poFlowGraph;
+    class poInterpreter;
+
+    class poOptEval
+    {
+    public:
+        poOptEval();
+        void optimize(poModule& module);
+        void dump() const;
+
+        inline const int numCalls() const { return _numCalls; }
+        inline const int numFolded() const { return _numFolded; }
+
+    private:
+        void optimize(poModule& module, poInterpreter& interpreter, poFlowGraph& cfg);
+        bool evaluate(poInterpreter& interpreter, const int symbol, const std::vector<uint64_t>& args, uint64_t& result);
+
+        std::map<std::vector<uint64_t>, std::pair<bool, uint64_t>> _results; /* symbol and args -> result */
+        int _numCalls;
+        int _numFolded;
+    };
+}
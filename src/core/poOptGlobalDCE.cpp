@@ -0,0 +1,214 @@
+#include "poOptGlobalDCE.h"
+#include "poCallGraph.h"
+#include "poModule.h"
+#include "poCFG.h"
+
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace po;
+
+poOptGlobalDCE::poOptGlobalDCE()
+    :
+    _numFunctions(0),
+    _numInstructions(0),
+    _numBytes(0)
+{
+}
+
+void poOptGlobalDCE::optimize(poModule& module)
+{
+    _numFunctions = 0;
+    _numInstructions = 0;
+    _numBytes = 0;
+
+    std::vector<bool> reachable;
+    if (!findReachable(module, reachable))
+    {
+        return;
+    }
+
+    countReadOnlyData(module, reachable);
+
+    // Remove the unreachable functions, keeping the order of the others
+
+    std::vector<poFunction>& functions = module.functions();
+    std::vector<poFunction> live;
+    std::vector<int> remap(functions.size(), -1);
+    for (int i = 0; i < int(functions.size()); i++)
+    {
+        poFunction& func = functions[i];
+        if (reachable[i])
+        {
+            remap[i] = int(live.size());
+            live.push_back(std::move(func));
+            continue;
+        }
+
+        _numFunctions++;
+        poFlowGraph& cfg = func.cfg();
+        for (int j = 0; j < int(cfg.numBlocks()); j++)
+        {
+            _numInstructions += int(cfg.getBasicBlock(j)->numInstructions());
+        }
+        cfg.destroy();
+    }
+
+    functions.swap(live);
+    remapIds(module, remap);
+}
+
+bool poOptGlobalDCE::findReachable(poModule& module, std::vector<bool>& reachable)
+{
+    poCallGraph graph;
+    graph.analyze(module);
+
+    // The roots are the functions called by the entry stub
+
+    std::vector<poCallGraphNode*> stack;
+    reachable.resize(module.functions().size(), false);
+    for (poCallGraphNode* node : graph.nodes())
+    {
+        const std::string& name = module.functions()[node->id()].name();
+        if (name == "main" || name == "pora_open" || name == "pora_close")
+        {
+            reachable[node->id()] = true;
+            stack.push_back(node);
+        }
+    }
+
+    // Without an entry point nothing can be said about what is used
+
+    if (stack.size() == 0)
+    {
+        return false;
+    }
+
+    while (stack.size() > 0)
+    {
+        poCallGraphNode* node = stack.back();
+        stack.pop_back();
+        for (poCallGraphNode* child : node->children())
+        {
+            if (!reachable[child->id()])
+            {
+                reachable[child->id()] = true;
+                stack.push_back(child);
+            }
+        }
+    }
+
+    return true;
+}
+
+void poOptGlobalDCE::countReadOnlyData(poModule& module, const std::vector<bool>& reachable)
+{
+    // Find the floating point and string constants used by the live and the dead functions,
+    // the ones only the dead functions use will no longer be emitted.
+
+    std::unordered_set<int> live;
+    std::unordered_map<int, int> dead; /* constant id -> type */
+    for (int i = 0; i < int(module.functions().size()); i++)
+    {
+        poFlowGraph& cfg = module.functions()[i].cfg();
+        for (int j = 0; j < int(cfg.numBlocks()); j++)
+        {
+            for (const poInstruction& ins : cfg.getBasicBlock(j)->instructions())
+            {
+                if (ins.code() != IR_CONSTANT)
+                {
+                    continue;
+                }
+
+                // Strings are pointer constants, the same as the assembler treats them
+
+                int type = ins.type();
+                if (module.types()[type].isPointer())
+                {
+                    type = TYPE_STRING;
+                }
+                else if (type != TYPE_F32 && type != TYPE_F64)
+                {
+                    continue;
+                }
+
+                if (reachable[i])
+                {
+                    live.insert(ins.constant());
+                }
+                else
+                {
+                    dead[ins.constant()] = type;
+                }
+            }
+        }
+    }
+
+    poConstantPool& constants = module.constants();
+    for (const auto& it : dead)
+    {
+        if (live.find(it.first) != live.end())
+        {
+            continue;
+        }
+
+        switch (it.second)
+        {
+        case TYPE_F32:
+            _numBytes += int(sizeof(float));
+            break;
+        case TYPE_F64:
+            _numBytes += int(sizeof(double));
+            break;
+        case TYPE_STRING:
+            _numBytes += int(constants.getString(it.first).size()) + 1;
+            break;
+        }
+    }
+}
+
+void poOptGlobalDCE::remapIds(poModule& module, const std::vector<int>& remap)
+{
+    // Namespaces and types refer to their functions by index into the module
+
+    for (poNamespace& ns : module.namespaces())
+    {
+        std::vector<int> functions;
+        for (const int id : ns.functions())
+        {
+            if (remap[id] != -1)
+            {
+                functions.push_back(remap[id]);
+            }
+        }
+        ns.functions().swap(functions);
+    }
+
+    for (poType& type : module.types())
+    {
+        for (poMemberFunction& method : type.functions())
+        {
+            if (method.id() >= 0 && method.id() < int(remap.size()))
+            {
+                method.setId(remap[method.id()]);
+            }
+        }
+        for (poConstructor& constructor : type.constructors())
+        {
+            if (constructor.id() >= 0 && constructor.id() < int(remap.size()))
+            {
+                constructor.setId(remap[constructor.id()]);
+            }
+        }
+    }
+}
+
+void poOptGlobalDCE::dump() const
+{
+    std::cout << "Dead functions:" << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "functions" << _numFunctions << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "instructions" << _numInstructions << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "rodata bytes" << _numBytes << std::endl;
+}
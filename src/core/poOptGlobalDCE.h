@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+//
+// Whole program dead function elimination.
+//
+// Walks the call graph from the functions the entry stub calls (main, pora_open
+// and pora_close) and removes every function that can not be reached. This covers
+// unused library code, generic instances that were never called and extern imports
+// which only dead code referred to. It runs straight after code generation so that
+// the remaining passes, register allocation and the assembler do not see the dead
+// functions at all.
+//
+// Read only data is emitted lazily for the constants the generated code uses, so the
+// constants of the removed functions are dropped along with them. Types are kept, their
+// ids are referenced throughout the IR and they produce no code or data on their own.
+//
+
+namespace po
+{
+    class poModule;
+
+    class poOptGlobalDCE
+    {
+    public:
+        poOptGlobalDCE();
+        void optimize(poModule& module);
+        void dump() const;
+
+        inline const int numFunctions() const { return _numFunctions; }
+        inline const int numInstructions() const { return _numInstructions; }
+        inline const int numBytes() const { return _numBytes; }
+
+    private:
+        bool findReachable(poModule& module, std::vector<bool>& reachable);
+        void countReadOnlyData(poModule& module, const std::vector<bool>& reachable);
+        void remapIds(poModule& module, const std::vector<int>& remap);
+
+        int _numFunctions;
+        int _numInstructions;
+        int _numBytes;
+    };
+}
@@ -0,0 +1,701 @@
+#include "poOptIdiom.h"
+#include "poModule.h"
+#include "poCFG.h"
+
+#include <assert.h>
+#include <cstring>
+
+using namespace po;
+
+static const char* const MALLOC_SYMBOL = "std::malloc2";
+static const char* const MALLOC_ARRAY_SYMBOL = "std::malloc3";
+
+poOptIdiom::poOptIdiom()
+    :
+    _maxName(0),
+    _numCopies(0),
+    _numFills(0)
+{
+}
+
+void poOptIdiom::optimize(poModule& module)
+{
+    _numCopies = 0;
+    _numFills = 0;
+
+    for (poFunction& func : module.functions())
+    {
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC) ||
+            func.cfg().getFirst() == nullptr)
+        {
+            continue;
+        }
+
+        optimize(module, func.cfg());
+    }
+}
+
+void poOptIdiom::optimize(poModule& module, poFlowGraph& cfg)
+{
+    bool analyze = true;
+    poBasicBlock* bb = cfg.getFirst();
+    while (bb)
+    {
+        if (analyze)
+        {
+            // Find the uses, definitions and the largest name in use
+
+            _uses.analyze(cfg);
+            _defs.clear();
+            _maxName = 0;
+            _numPredecessors.clear();
+            for (poBasicBlock* defBB = cfg.getFirst(); defBB != nullptr; defBB = defBB->getNext())
+            {
+                if (defBB->getBranch() != nullptr)
+                {
+                    _numPredecessors[defBB->getBranch()]++;
+                }
+                if (defBB->getNext() != nullptr && !defBB->unconditionalBranch() &&
+                    (defBB->numInstructions() == 0 || defBB->instructions().back().code() != IR_RETURN))
+                {
+                    _numPredecessors[defBB->getNext()]++;
+                }
+
+                for (int i = 0; i < int(defBB->numInstructions()); i++)
+                {
+                    const int name = defBB->getInstruction(i).name();
+                    _defs.insert(std::pair<int, poInstructionRef>(name, poInstructionRef(defBB, i, 0)));
+                    _maxName = std::max(_maxName, name);
+                }
+            }
+            analyze = false;
+        }
+
+        if (recognize(module, bb))
+        {
+            analyze = true;
+        }
+
+        bb = bb->getNext();
+    }
+}
+
+bool poOptIdiom::recognize(poModule& module, poBasicBlock* header)
+{
+    // 1. Match the loop header: the induction variable, any constants, the compare and the exit branch
+
+    const int numHeader = int(header->numInstructions());
+    if (numHeader < 3 ||
+        header->getBranch() == nullptr ||
+        header->unconditionalBranch() ||
+        _numPredecessors[header] != 2)
+    {
+        return false;
+    }
+
+    const poInstruction& phi = header->getInstruction(0);
+    const poInstruction& cmp = header->getInstruction(numHeader - 2);
+    const poInstruction& br = header->getInstruction(numHeader - 1);
+    if (phi.code() != IR_PHI ||
+        phi.type() != TYPE_I64 ||
+        cmp.code() != IR_CMP ||
+        cmp.type() != TYPE_I64 ||
+        cmp.left() != phi.name() ||
+        br.code() != IR_BR ||
+        br.left() != IR_JUMP_GREATER_EQUALS)
+    {
+        return false;
+    }
+
+    for (int i = 1; i < numHeader - 2; i++)
+    {
+        if (header->getInstruction(i).code() != IR_CONSTANT)
+        {
+            return false;
+        }
+    }
+
+    // 2. The body is a run of straight line blocks ending with the jump back to the header
+
+    std::vector<poBasicBlock*> body;
+    poBasicBlock* bb = header->getNext();
+    while (bb != nullptr && bb != header->getBranch())
+    {
+        if (_numPredecessors[bb] != 1 ||
+            bb->numInstructions() == 0)
+        {
+            return false;
+        }
+
+        body.push_back(bb);
+        if (bb->getBranch() != nullptr)
+        {
+            break;
+        }
+
+        bb = bb->getNext();
+    }
+
+    if (body.size() == 0 ||
+        body.back()->getBranch() != header ||
+        !body.back()->unconditionalBranch())
+    {
+        return false;
+    }
+
+    poBasicBlock* latch = body.back();
+    const poInstruction jump = latch->instructions().back();
+    if (jump.code() != IR_BR)
+    {
+        return false;
+    }
+
+    _loopNames.clear();
+    _matched.clear();
+    for (const poInstruction& ins : header->instructions())
+    {
+        _loopNames.insert(ins.name());
+    }
+
+    const poInstruction* store = nullptr;
+    const poInstruction* load = nullptr;
+    for (poBasicBlock* bodyBB : body)
+    {
+        const int numInstructions = int(bodyBB->numInstructions()) - (bodyBB == latch ? 1 : 0);
+        for (int i = 0; i < numInstructions; i++)
+        {
+            const poInstruction& ins = bodyBB->getInstruction(i);
+            _loopNames.insert(ins.name());
+            switch (ins.code())
+            {
+            case IR_STORE:
+                if (store != nullptr)
+                {
+                    return false;
+                }
+                store = &ins;
+                break;
+            case IR_LOAD:
+                if (load != nullptr)
+                {
+                    return false;
+                }
+                load = &ins;
+                break;
+            case IR_CONSTANT:
+            case IR_ADD:
+            case IR_COPY:
+            case IR_BITWISE_CAST:
+            case IR_ELEMENT_PTR:
+                break;
+            default:
+                return false;
+            }
+        }
+    }
+
+    if (store == nullptr)
+    {
+        return false;
+    }
+
+    // 3. The induction variable starts outside the loop and is stepped by one
+
+    const int iv = phi.name();
+    const int bound = cmp.right();
+    if (!isInvariant(bound))
+    {
+        return false;
+    }
+
+    int next = -1;
+    if (_loopNames.find(phi.left()) != _loopNames.end() &&
+        _loopNames.find(phi.right()) == _loopNames.end())
+    {
+        next = phi.left();
+    }
+    else if (_loopNames.find(phi.right()) != _loopNames.end() &&
+        _loopNames.find(phi.left()) == _loopNames.end())
+    {
+        next = phi.right();
+    }
+    else
+    {
+        return false;
+    }
+
+    int step = next;
+    const poInstruction* stepIns = findDef(step);
+    if (stepIns != nullptr && stepIns->code() == IR_COPY)
+    {
+        _matched.insert(step);
+        step = stepIns->left();
+    }
+
+    int64_t increment = 0;
+    if (_loopNames.find(step) == _loopNames.end() ||
+        !isIndex(module, step, iv, increment) ||
+        increment != 1)
+    {
+        return false;
+    }
+
+    // 4. A single element store to the destination indexed by the induction variable
+
+    const poInstruction* dstPtr = findDef(store->left());
+    if (dstPtr == nullptr ||
+        dstPtr->code() != IR_ELEMENT_PTR ||
+        dstPtr->memOffset() != 0 ||
+        dstPtr->right() != iv ||
+        !isInvariant(dstPtr->left()) ||
+        _uses.getUses(dstPtr->name()).size() != 1)
+    {
+        return false;
+    }
+
+    const int elementType = store->type();
+    const int size = module.types()[elementType].size();
+    if ((size != 1 && size != 2 && size != 4 && size != 8) ||
+        module.types()[module.types()[dstPtr->type()].baseType()].size() != size)
+    {
+        return false;
+    }
+
+    _matched.insert(store->name());
+    _matched.insert(dstPtr->name());
+
+    const int dst = dstPtr->left();
+    const int dstType = dstPtr->type();
+    int src = -1;
+    int srcType = -1;
+    int64_t srcOffset = 0;
+    int fill = store->right();
+    int fillValue = -1;
+    if (load != nullptr)
+    {
+        // A copy, the stored value is loaded from the source at the same or a later element
+
+        const poInstruction* srcPtr = findDef(load->left());
+        if (store->right() != load->name() ||
+            load->type() != elementType ||
+            _uses.getUses(load->name()).size() != 1 ||
+            srcPtr == nullptr ||
+            srcPtr->code() != IR_ELEMENT_PTR ||
+            srcPtr->memOffset() != 0 ||
+            !isInvariant(srcPtr->left()) ||
+            _uses.getUses(srcPtr->name()).size() != 1 ||
+            !isIndex(module, srcPtr->right(), iv, srcOffset) ||
+            module.types()[module.types()[srcPtr->type()].baseType()].size() != size)
+        {
+            return false;
+        }
+
+        _matched.insert(load->name());
+        _matched.insert(srcPtr->name());
+        src = srcPtr->left();
+        srcType = srcPtr->type();
+
+        const int dstRoot = findRoot(dst);
+        const int srcRoot = findRoot(src);
+        if (dstRoot == srcRoot ? srcOffset < 0 : !isDisjoint(module, dstRoot, srcRoot, header))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // A fill, the stored value must be the same byte repeated. Constants are
+        // usually cast to the element type within the loop.
+
+        const poInstruction* cast = findDef(fill);
+        if (cast != nullptr &&
+            cast->code() == IR_BITWISE_CAST &&
+            _loopNames.find(fill) != _loopNames.end())
+        {
+            _matched.insert(fill);
+            fill = cast->left();
+        }
+
+        if (!isInvariant(fill) ||
+            !isFillValue(module, fill, size, fillValue))
+        {
+            return false;
+        }
+    }
+
+    // Anything left over other than constants has some other purpose
+
+    for (poBasicBlock* bodyBB : body)
+    {
+        const int numInstructions = int(bodyBB->numInstructions()) - (bodyBB == latch ? 1 : 0);
+        for (int i = 0; i < numInstructions; i++)
+        {
+            const poInstruction& ins = bodyBB->getInstruction(i);
+            if (ins.code() != IR_CONSTANT &&
+                _matched.find(ins.name()) == _matched.end())
+            {
+                return false;
+            }
+        }
+    }
+
+    // 5. Replace the body with the block operation over the remaining elements
+
+    std::vector<poInstruction> instructions;
+
+    const int count = ++_maxName;
+    instructions.push_back(poInstruction(count, TYPE_I64, bound, iv, IR_SUB));
+
+    int numBytes = count;
+    if (size > 1)
+    {
+        const int elementSize = addConstant(module, instructions, TYPE_I64, size);
+        numBytes = ++_maxName;
+        instructions.push_back(poInstruction(numBytes, TYPE_I64, count, elementSize, IR_MUL));
+    }
+
+    const int dstElement = ++_maxName;
+    instructions.push_back(poInstruction(dstElement, dstType, dst, iv, 0, IR_ELEMENT_PTR));
+
+    if (load != nullptr)
+    {
+        int index = iv;
+        if (srcOffset != 0)
+        {
+            const int offset = addConstant(module, instructions, TYPE_I64, srcOffset);
+            index = ++_maxName;
+            instructions.push_back(poInstruction(index, TYPE_I64, iv, offset, IR_ADD));
+        }
+
+        const int srcElement = ++_maxName;
+        instructions.push_back(poInstruction(srcElement, srcType, src, index, 0, IR_ELEMENT_PTR));
+
+        instructions.push_back(poInstruction(++_maxName, TYPE_VOID, 3, -1, IR_COPY_MEMORY));
+        instructions.push_back(poInstruction(++_maxName, dstType, dstElement, -1, IR_ARG));
+        instructions.push_back(poInstruction(++_maxName, srcType, srcElement, -1, IR_ARG));
+        instructions.push_back(poInstruction(++_maxName, TYPE_I64, numBytes, -1, IR_ARG));
+        _numCopies++;
+    }
+    else
+    {
+        int value = fill;
+        int valueType = elementType;
+        if (fillValue != -1)
+        {
+            value = addConstant(module, instructions, TYPE_U8, fillValue);
+            valueType = TYPE_U8;
+        }
+
+        instructions.push_back(poInstruction(++_maxName, TYPE_VOID, 3, -1, IR_FILL_MEMORY));
+        instructions.push_back(poInstruction(++_maxName, dstType, dstElement, -1, IR_ARG));
+        instructions.push_back(poInstruction(++_maxName, int16_t(valueType), value, -1, IR_ARG));
+        instructions.push_back(poInstruction(++_maxName, TYPE_I64, numBytes, -1, IR_ARG));
+        _numFills++;
+    }
+
+    // Step straight to the bound so the header exits with the value the loop would have left
+    instructions.push_back(poInstruction(next, TYPE_I64, bound, -1, IR_COPY));
+
+    for (poBasicBlock* bodyBB : body)
+    {
+        while (bodyBB->numInstructions() > 0)
+        {
+            bodyBB->removeInstruction(int(bodyBB->numInstructions()) - 1);
+        }
+    }
+
+    poBasicBlock* first = body.front();
+    for (const poInstruction& ins : instructions)
+    {
+        first->addInstruction(ins);
+    }
+    latch->addInstruction(jump);
+
+    return true;
+}
+
+bool poOptIdiom::isInvariant(const int name) const
+{
+    if (_loopNames.find(name) == _loopNames.end())
+    {
+        return true;
+    }
+
+    // Constants are free to be used anywhere the header dominates
+    const auto& def = _defs.find(name);
+    return def != _defs.end() && def->second.getInstruction().code() == IR_CONSTANT;
+}
+
+bool poOptIdiom::isConstant(poModule& module, const int name, int64_t& value)
+{
+    const poInstruction* ins = findDef(name);
+    if (ins == nullptr ||
+        ins->code() != IR_CONSTANT ||
+        ins->type() != TYPE_I64)
+    {
+        return false;
+    }
+
+    value = module.constants().getI64(ins->constant());
+    return true;
+}
+
+bool poOptIdiom::isIndex(poModule& module, const int name, const int iv, int64_t& offset)
+{
+    // Either the induction variable itself or the induction variable plus a constant
+
+    if (name == iv)
+    {
+        offset = 0;
+        return true;
+    }
+
+    const poInstruction* ins = findDef(name);
+    if (ins == nullptr ||
+        ins->code() != IR_ADD ||
+        ins->type() != TYPE_I64 ||
+        _loopNames.find(name) == _loopNames.end())
+    {
+        return false;
+    }
+
+    if ((ins->left() == iv && isConstant(module, ins->right(), offset)) ||
+        (ins->right() == iv && isConstant(module, ins->left(), offset)))
+    {
+        _matched.insert(name);
+        return true;
+    }
+
+    return false;
+}
+
+bool poOptIdiom::isFillValue(poModule& module, const int name, const int size, int& value)
+{
+    // Any single byte value can be stored as it is, wider values need to be a constant
+    // made of the same byte repeated.
+
+    const poInstruction* ins = findDef(name);
+    if (ins == nullptr)
+    {
+        return false;
+    }
+
+    if (ins->code() != IR_CONSTANT)
+    {
+        value = -1;
+        return size == 1 && ins->type() != TYPE_F64 && ins->type() != TYPE_F32;
+    }
+
+    const poConstantPool& pool = module.constants();
+    uint64_t bits = 0;
+    switch (ins->type())
+    {
+    case TYPE_I64: bits = uint64_t(pool.getI64(ins->constant())); break;
+    case TYPE_U64: bits = pool.getU64(ins->constant()); break;
+    case TYPE_I32: bits = uint32_t(pool.getI32(ins->constant())); break;
+    case TYPE_U32: bits = pool.getU32(ins->constant()); break;
+    case TYPE_I16: bits = uint16_t(pool.getI16(ins->constant())); break;
+    case TYPE_U16: bits = pool.getU16(ins->constant()); break;
+    case TYPE_I8: bits = uint8_t(pool.getI8(ins->constant())); break;
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+        bits = pool.getU8(ins->constant());
+        break;
+    case TYPE_F64:
+    {
+        const double f64 = pool.getF64(ins->constant());
+        std::memcpy(&bits, &f64, sizeof(f64));
+    }
+        break;
+    case TYPE_F32:
+    {
+        const float f32 = pool.getF32(ins->constant());
+        uint32_t bits32 = 0;
+        std::memcpy(&bits32, &f32, sizeof(f32));
+        bits = bits32;
+    }
+        break;
+    default:
+        return false;
+    }
+
+    const uint64_t byte = bits & 0xFF;
+    for (int i = 1; i < size; i++)
+    {
+        if (((bits >> (i * 8)) & 0xFF) != byte)
+        {
+            return false;
+        }
+    }
+
+    value = int(byte);
+    return true;
+}
+
+bool poOptIdiom::isDisjoint(poModule& module, const int dst, const int src, poBasicBlock* header)
+{
+    return isFresh(module, dst, header) || isFresh(module, src, header);
+}
+
+bool poOptIdiom::isFresh(poModule& module, const int name, poBasicBlock* header)
+{
+    // The pointer must come straight from the allocator. It may only have been used to form
+    // addresses to load or store through before the loop, as otherwise it could have been
+    // stored away and loaded back as the other array.
+
+    const poInstruction* def = findDef(name);
+    if (def == nullptr || def->code() != IR_CALL)
+    {
+        return false;
+    }
+
+    std::string symbol;
+    if (!module.getSymbol(def->right(), symbol) ||
+        (symbol != MALLOC_SYMBOL && symbol != MALLOC_ARRAY_SYMBOL))
+    {
+        return false;
+    }
+
+    std::vector<int> worklist{ name };
+    std::unordered_set<int> visited;
+    while (worklist.size() > 0)
+    {
+        const int variable = worklist.back();
+        worklist.pop_back();
+        if (!visited.insert(variable).second || !_uses.hasUses(variable))
+        {
+            continue;
+        }
+
+        for (const poInstructionRef& use : _uses.getUses(variable))
+        {
+            const poInstruction& ins = use.getInstruction();
+            bool escapes = false;
+            switch (ins.code())
+            {
+            case IR_COPY:
+            case IR_BITWISE_CAST:
+                worklist.push_back(ins.name());
+                break;
+            case IR_CMP:
+                break;
+            case IR_PTR:
+            case IR_ELEMENT_PTR:
+                if (ins.left() != variable || !_uses.hasUses(ins.name()))
+                {
+                    escapes = ins.left() != variable;
+                    break;
+                }
+
+                for (const poInstructionRef& address : _uses.getUses(ins.name()))
+                {
+                    const poInstruction& access = address.getInstruction();
+                    if (!(access.code() == IR_LOAD && access.left() == ins.name()) &&
+                        !(access.code() == IR_STORE && access.left() == ins.name() && access.right() != ins.name()))
+                    {
+                        escapes = true;
+                    }
+                }
+                break;
+            default:
+                escapes = true;
+                break;
+            }
+
+            if (escapes && reaches(use.getBasicBlock(), header))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool poOptIdiom::reaches(poBasicBlock* from, poBasicBlock* to) const
+{
+    std::vector<poBasicBlock*> worklist{ from };
+    std::unordered_set<poBasicBlock*> visited;
+    while (worklist.size() > 0)
+    {
+        poBasicBlock* bb = worklist.back();
+        worklist.pop_back();
+        if (bb == to)
+        {
+            return true;
+        }
+
+        if (!visited.insert(bb).second)
+        {
+            continue;
+        }
+
+        if (bb->getBranch() != nullptr)
+        {
+            worklist.push_back(bb->getBranch());
+        }
+        if (bb->getNext() != nullptr && !bb->unconditionalBranch())
+        {
+            worklist.push_back(bb->getNext());
+        }
+    }
+
+    return false;
+}
+
+int poOptIdiom::findRoot(const int name)
+{
+    int root = name;
+    for (int i = 0; i < int(_defs.size()); i++)
+    {
+        const poInstruction* def = findDef(root);
+        if (def == nullptr ||
+            (def->code() != IR_COPY && def->code() != IR_BITWISE_CAST))
+        {
+            break;
+        }
+
+        root = def->left();
+    }
+
+    return root;
+}
+
+int poOptIdiom::addConstant(poModule& module, std::vector<poInstruction>& instructions, const int type, const int64_t value)
+{
+    poConstantPool& pool = module.constants();
+    int constant = -1;
+    if (type == TYPE_U8)
+    {
+        constant = pool.getConstant(uint8_t(value));
+        if (constant == -1)
+        {
+            constant = pool.addConstant(uint8_t(value));
+        }
+    }
+    else
+    {
+        assert(type == TYPE_I64);
+        constant = pool.getConstant(value);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(value);
+        }
+    }
+
+    const int name = ++_maxName;
+    instructions.push_back(poInstruction(name, int16_t(type), int16_t(constant), IR_CONSTANT));
+    return name;
+}
+
+poInstruction* poOptIdiom::findDef(const int name)
+{
+    const auto& def = _defs.find(name);
+    if (def == _defs.end())
+    {
+        return nullptr;
+    }
+
+    return &def->second.getInstruction();
+}
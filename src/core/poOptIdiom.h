@@ -0,0 +1,65 @@
+#pragma once
+#include "poUses.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//
+// Loop idiom recognition which replaces loops that copy or fill an array one
+// element at a time with a single block memory operation.
+//
+// Only the simplest counted loop is matched: a header holding the induction
+// variable, a signed compare against a loop invariant bound and a branch out,
+// followed by straight line blocks which perform a single element store and
+// step the induction variable by one. The body is replaced by IR_COPY_MEMORY
+// or IR_FILL_MEMORY covering the remaining iterations and the induction variable
+// is stepped straight to the bound, so the loop exits on the next test with
+// the same final value. This is performed in SSA form.
+//
+// A copy is made from the lowest address upwards, so it is only formed when
+// the destination can not overlap the source from above. Either the two arrays
+// share a base and the destination is not ahead of the source, or one of them
+// is a fresh allocation whose pointer has not yet been stored anywhere.
+//
+
+namespace po
+{
+    class poModule;
+    class poFlowGraph;
+    class poBasicBlock;
+
+    class poOptIdiom
+    {
+    public:
+        poOptIdiom();
+        void optimize(poModule& module);
+
+        inline const int numCopies() const { return _numCopies; }
+        inline const int numFills() const { return _numFills; }
+
+    private:
+        void optimize(poModule& module, poFlowGraph& cfg);
+        bool recognize(poModule& module, poBasicBlock* header);
+        bool isInvariant(const int name) const;
+        bool isConstant(poModule& module, const int name, int64_t& value);
+        bool isIndex(poModule& module, const int name, const int iv, int64_t& offset);
+        bool isFillValue(poModule& module, const int name, const int size, int& value);
+        bool isDisjoint(poModule& module, const int dst, const int src, poBasicBlock* header);
+        bool isFresh(poModule& module, const int name, poBasicBlock* header);
+        bool reaches(poBasicBlock* from, poBasicBlock* to) const;
+        int findRoot(const int name);
+        int addConstant(poModule& module, std::vector<poInstruction>& instructions, const int type, const int64_t value);
+        poInstruction* findDef(const int name);
+
+        poUses _uses;
+        std::unordered_map<int, poInstructionRef> _defs;
+        std::unordered_map<poBasicBlock*, int> _numPredecessors;
+        std::unordered_set<int> _loopNames; // Names defined in the loop being matched
+        std::unordered_set<int> _matched; // Instructions of the loop accounted for by the idiom
+        int _maxName;
+        int _numCopies;
+        int _numFills;
+    };
+}
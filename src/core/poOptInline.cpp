@@ -1,8 +1,10 @@
 #include "poOptInline.h"
 #include "poModule.h"
 #include "poSSA.h"
+#include "poUses.h"
 
 #include <assert.h>
+#include <unordered_set>
 #include <iostream>
 
 using namespace po;
@@ -90,7 +92,7 @@ void poOptInline:: optimize(poModule& module, poFlowGraph& cfg)
             {
                 poInstruction& ins = bb->getInstruction(i);
 
-                if (ins.code() == IR_CALL && canInline(module, ins))
+                if (ins.code() == IR_CALL && canInline(module, ins) && !isDeadCall(module, cfg, bb, i))
                 {
                     const int numArguments = ins.left();
                     splitBasicBlock(bb, i + numArguments + 1, cfg);
@@ -139,6 +141,39 @@ poBasicBlock* poOptInline::splitBasicBlock(poBasicBlock* bb, const int instructi
     return newBB;
 }
 
+int poOptInline::addReturnValue(const int name, const int type, const std::vector<int>& values, const std::vector<poBasicBlock*>& blocks, poBasicBlock* resultBB, const int pos, int& maxName)
+{
+    // Joins the values returned by the inlined function into the name of the result, returning the number of phis added
+
+    if (values.size() >= 2)
+    {
+        poPhi phi(name, type);
+        for (int i = 0; i < int(values.size()); i++)
+        {
+            phi.addValue(values[i], blocks[i]);
+        }
+        resultBB->addPhi(phi);
+
+        int phiName = name;
+        poInstruction phiIns(phiName, type, values[0], values[1], IR_PHI);
+        resultBB->insertInstruction(phiIns, pos);
+
+        for (int i = 2; i < int(values.size()); i++)
+        {
+            const int newName = ++maxName;
+            poInstruction phiIns(newName, type, values[i], phiName, IR_PHI);
+            resultBB->insertInstruction(phiIns, pos + i - 1);
+            phiName = newName;
+        }
+        return int(values.size()) - 1;
+    }
+    else if (values.size() == 1)
+    {
+        resultBB->getPrev()->addInstruction(poInstruction(name, type, values[0], -1, IR_COPY));
+    }
+    return 0;
+}
+
 bool poOptInline::shouldInline(poModule& module, poFunction& function)
 {
     // Heuristics are determined here (e.g., function size, etc.)
@@ -204,6 +239,36 @@ bool poOptInline::canInline(poModule& module, const poInstruction& ins)
     return func.canInline();
 }
 
+bool poOptInline::isDeadCall(poModule& module, poFlowGraph& cfg, poBasicBlock* bb, const int pos)
+{
+    // A call with an unused result and no side effects is left for DCE to remove, rather
+    // than inlining a body which would have to be removed piece by piece
+
+    const poInstruction& ins = bb->getInstruction(pos);
+    const int resultPos = pos + ins.left() + 1;
+    if (resultPos < int(bb->numInstructions()) &&
+        bb->getInstruction(resultPos).code() == IR_RESULT)
+    {
+        return false;
+    }
+
+    std::string functionName;
+    if (!module.getSymbol(ins.right(), functionName))
+    {
+        return false;
+    }
+
+    const poSummary* summary = module.getSummary(functionName);
+    if (summary == nullptr || summary->hasSideEffects())
+    {
+        return false;
+    }
+
+    poUses uses;
+    uses.analyze(cfg);
+    return !uses.hasUses(ins.name());
+}
+
 void poOptInline::inlineFunctionCall(poInstruction& ins, poBasicBlock* bb, poModule& module, poFlowGraph& cfg)
 {
     const int symbolId = ins.right();
@@ -233,19 +298,41 @@ void poOptInline::inlineFunctionCall(poInstruction& ins, poBasicBlock* bb, poMod
         }
     }
 
+    // Stack allocations passed as arguments have no register, so their address is taken instead
+    std::unordered_set<int> stackNames;
+    for (poBasicBlock* callerBB = cfg.getFirst(); callerBB != nullptr; callerBB = callerBB->getNext())
+    {
+        for (const poInstruction& callerIns : callerBB->instructions())
+        {
+            if (callerIns.code() == IR_ALLOCA)
+            {
+                stackNames.insert(callerIns.name());
+            }
+        }
+    }
+
     std::unordered_map<int, int> paramToArg;
+    std::unordered_map<int, int> paramToStack;
     const int numArguments = ins.left();
     for (int i = 0; i < numArguments; i++)
     {
         const poInstruction& argIns = bb->instructions()[int(bb->numInstructions()) - numArguments + i];
         assert(argIns.code() == IR_ARG);
-        paramToArg.insert(std::pair<int, int>(paramValues[i], argIns.left()));
+        if (stackNames.find(argIns.left()) != stackNames.end())
+        {
+            paramToStack.insert(std::pair<int, int>(paramValues[i], argIns.left()));
+        }
+        else
+        {
+            paramToArg.insert(std::pair<int, int>(paramValues[i], argIns.left()));
+        }
     }
 
     const int REBASE_OFFSET = 10000;
 
     // Copy the basic blocks and instructions from the function into the caller
     std::vector<int> returnValues;
+    std::vector<int> secondValues;
     std::vector<poBasicBlock*> returnBlocks;
     poBasicBlock* lastInsertedBB = bb->getNext();
     int maxName = 0;
@@ -258,6 +345,12 @@ void poOptInline::inlineFunctionCall(poInstruction& ins, poBasicBlock* bb, poMod
             // Replace parameter references with argument values
             if (funcIns.code() == IR_PARAM)
             {
+                const auto& stack = paramToStack.find(funcIns.name());
+                if (stack != paramToStack.end())
+                {
+                    newBB->addInstruction(poInstruction(funcIns.name() + REBASE_OFFSET, funcIns.type(), stack->second, -1, 0, IR_PTR));
+                    maxName = std::max(maxName, funcIns.name() + REBASE_OFFSET);
+                }
                 continue; // Skip parameter instructions
             }
 
@@ -303,6 +396,20 @@ void poOptInline::inlineFunctionCall(poInstruction& ins, poBasicBlock* bb, poMod
 
                     returnValues.push_back(copyName);
                     returnBlocks.push_back(newBB);
+
+                    if (funcIns.right() != -1)
+                    {
+                        maxName++;
+                        newBB->addInstruction(poInstruction(
+                            maxName,
+                            funcIns.memOffset(),
+                            funcIns.right(),
+                            -1,
+                            IR_COPY
+                        ));
+
+                        secondValues.push_back(maxName);
+                    }
                 }
 
                 // We need to branch to the block after the call.
@@ -368,31 +475,22 @@ void poOptInline::inlineFunctionCall(poInstruction& ins, poBasicBlock* bb, poMod
         }
     }
 
-    // After inlining, we need to handle the return values
-    if (returnValues.size() >= 2)
+    // A struct returned in two registers has its second half read straight after the call
+    int resultName = -1;
+    int resultType = TYPE_VOID;
+    if (lastInsertedBB->numInstructions() > 0 &&
+        lastInsertedBB->getInstruction(0).code() == IR_RESULT)
     {
-        poPhi phi(ins.name(), ins.type());
-        for (int i = 0; i < int(returnValues.size()); i++)
-        {
-            phi.addValue(returnValues[i], returnBlocks[i]);
-        }
-        lastInsertedBB->addPhi(phi);
-
-        int name = ins.name();
-        poInstruction phiIns(name, ins.type(), returnValues[0], returnValues[1], IR_PHI);
-        lastInsertedBB->insertInstruction(phiIns, 0);
-
-        for (int i = 2; i < int(returnValues.size()); i++)
-        {
-            const int newName = maxName + 1;
-            poInstruction phiIns(newName, ins.type(), returnValues[i], name, IR_PHI);
-            lastInsertedBB->insertInstruction(phiIns, i - 1);
-            name = newName;
-        }
+        resultName = lastInsertedBB->getInstruction(0).name();
+        resultType = lastInsertedBB->getInstruction(0).type();
+        lastInsertedBB->removeInstruction(0);
     }
-    else if (returnValues.size() == 1)
+
+    // After inlining, we need to handle the return values
+    int numPhis = addReturnValue(ins.name(), ins.type(), returnValues, returnBlocks, lastInsertedBB, 0, maxName);
+    if (resultName != -1 && secondValues.size() == returnValues.size())
     {
-        lastInsertedBB->getPrev()->addInstruction(poInstruction(ins.name(), ins.type(), returnValues[0], -1, IR_COPY));
+        addReturnValue(resultName, resultType, secondValues, returnBlocks, lastInsertedBB, numPhis, maxName);
     }
 
     // Finally, remove the call instruction and argument instructions
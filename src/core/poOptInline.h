@@ -3,6 +3,7 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 namespace po
 {
@@ -19,8 +20,10 @@ namespace po
         void optimize(poModule& module, poFlowGraph& cfg);
     private:
         bool canInline(poModule& module, const poInstruction& ins);
+        bool isDeadCall(poModule& module, poFlowGraph& cfg, poBasicBlock* bb, const int pos);
         bool shouldInline(poModule& module, poFunction& function);
         void inlineFunctionCall(poInstruction& ins, poBasicBlock* bb, poModule& module, poFlowGraph& cfg);
+        int addReturnValue(const int name, const int type, const std::vector<int>& values, const std::vector<poBasicBlock*>& blocks, poBasicBlock* resultBB, const int pos, int& maxName);
         poBasicBlock* splitBasicBlock(poBasicBlock* bb, const int instructionIndex, poFlowGraph& cfg);
 
         poCallGraph _graph;
@@ -5,6 +5,8 @@
 #include "poSSA.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <cstdint>
 
 using namespace po;
 
@@ -31,10 +33,155 @@ void poOptMemToReg_Alloca::addUse(const poInstructionRef& ref)
     }
 }
 
+//
+// poOptMemToReg_Field
+//
+
+poOptMemToReg_Field::poOptMemToReg_Field(const int offset, const int type, const int size, const bool promote)
+    :
+    _offset(offset),
+    _type(type),
+    _size(size),
+    _promote(promote)
+{
+}
+
+//
+// poOptMemToReg_Aggregate
+//
+
+static const int MAX_FIELDS = 16; // Limit the number of variables created for a single aggregate
+
+poOptMemToReg_Aggregate::poOptMemToReg_Aggregate(const poInstructionRef& source, const int size)
+    :
+    _source(source),
+    _size(size),
+    _partial(false)
+{
+}
+
+void poOptMemToReg_Aggregate::addAccess(const poInstructionRef& ptr, const int offset, const int type, const int size, const bool promote)
+{
+    for (poOptMemToReg_Field& field : _fields)
+    {
+        if (field.offset() == offset)
+        {
+            if (field.type() != type)
+            {
+                // The field spans the widest access, so it overlaps all the fields this reaches
+                field.setPromote(false);
+                field.setSize(std::max(field.size(), size));
+            }
+
+            field.ptrs().push_back(ptr);
+            return;
+        }
+    }
+
+    poOptMemToReg_Field field(offset, type, size, promote);
+    field.ptrs().push_back(ptr);
+    _fields.push_back(field);
+}
+
+void poOptMemToReg_Aggregate::addEscape(const int offset, const int size)
+{
+    _escapes.push_back(std::pair<int, int>(offset, size));
+}
+
+void poOptMemToReg_Aggregate::resolve()
+{
+    // A field can't be promoted if any other access or escaping address overlaps it
+
+    for (int i = 0; i < int(_fields.size()); i++)
+    {
+        poOptMemToReg_Field& field = _fields[i];
+        for (int j = 0; j < int(_fields.size()); j++)
+        {
+            if (i != j && _fields[j].overlaps(field.offset(), field.size()))
+            {
+                field.setPromote(false);
+            }
+        }
+
+        for (const std::pair<int, int>& escape : _escapes)
+        {
+            if (field.overlaps(escape.first, escape.second))
+            {
+                field.setPromote(false);
+            }
+        }
+    }
+
+    int numPromoted = 0;
+    for (poOptMemToReg_Field& field : _fields)
+    {
+        if (field.promote())
+        {
+            if (numPromoted == MAX_FIELDS)
+            {
+                field.setPromote(false);
+            }
+            else
+            {
+                numPromoted++;
+            }
+        }
+    }
+
+    _partial = _escapes.size() > 0 || numPromoted != int(_fields.size());
+}
+
 //
 // poOptMemToReg
 //
 
+static bool getIntegerConstant(poModule& module, const poInstruction& ins, int64_t& value)
+{
+    const poConstantPool& pool = module.constants();
+    switch (ins.type())
+    {
+    case TYPE_I64:
+        value = pool.getI64(ins.constant());
+        return true;
+    case TYPE_U64:
+        value = int64_t(pool.getU64(ins.constant()));
+        return true;
+    case TYPE_I32:
+        value = pool.getI32(ins.constant());
+        return true;
+    case TYPE_U32:
+        value = pool.getU32(ins.constant());
+        return true;
+    }
+
+    return false;
+}
+
+static bool isScalarType(poModule& module, const int type)
+{
+    switch (type)
+    {
+    case TYPE_I64:
+    case TYPE_I32:
+    case TYPE_I16:
+    case TYPE_I8:
+    case TYPE_U64:
+    case TYPE_U32:
+    case TYPE_U16:
+    case TYPE_U8:
+    case TYPE_BOOLEAN:
+    case TYPE_F64:
+    case TYPE_F32:
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        return true;
+    }
+
+    return module.types()[type].baseType() == TYPE_ENUM;
+}
+
 void poOptMemToReg::optimize(poModule& module)
 {
     for (poFunction& func : module.functions())
@@ -55,7 +202,11 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
 
     _uses.analyze(cfg);
     _alloca.clear();
+    _aggregates.clear();
+    _constants.clear();
 
+    std::unordered_set<int> stackNames;
+    int maxName = 0;
     int pos = 0;
     int baseRef = 0;
     poBasicBlock* bb = cfg.getFirst();
@@ -64,9 +215,36 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
         for (const poInstruction& ins : bb->instructions())
         {
             const int name = ins.name();
-            if (ins.code() == IR_ALLOCA)
+            maxName = std::max(maxName, name);
+            int64_t value = 0;
+            if (ins.code() == IR_CONSTANT && getIntegerConstant(module, ins, value))
             {
+                _constants.insert(std::pair<int, int64_t>(name, value));
+            }
+            else if (ins.code() == IR_ALLOCA)
+            {
+                stackNames.insert(name);
+
                 const poType& type = module.types()[ins.type()];
+                if (type.isArray())
+                {
+                    // Fixed size array, the number of elements is held in left
+                    const int size = module.types()[type.baseType()].size() * ins.left();
+                    _aggregates.push_back(poOptMemToReg_Aggregate(poInstructionRef(bb, pos, baseRef), size));
+                    pos++;
+                    continue;
+                }
+
+                if (type.isPointer() &&
+                    module.types()[type.baseType()].baseType() == TYPE_OBJECT)
+                {
+                    // Struct held on the stack
+                    const int size = module.types()[type.baseType()].size();
+                    _aggregates.push_back(poOptMemToReg_Aggregate(poInstructionRef(bb, pos, baseRef), size));
+                    pos++;
+                    continue;
+                }
+
                 if (!type.isPointer())
                 {
                     // If the type is not a pointer, we cannot promote it
@@ -75,9 +253,9 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
                 }
 
                 const poType& baseType = module.types()[type.baseType()];
-                if (baseType.baseType() == TYPE_OBJECT || baseType.isPointer() || baseType.isArray())
+                if (baseType.baseType() == TYPE_OBJECT || baseType.isArray())
                 {
-                    // If the base type is an object or pointer, we cannot promote it
+                    // If the base type is an object or array, we cannot promote it
                     pos++;
                     continue;
                 }
@@ -103,6 +281,16 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
         baseRef = pos;
     }
 
+    for (poOptMemToReg_Alloca& al : _alloca)
+    {
+        const poInstruction& allocaIns = al.source().getInstruction();
+        const int baseType = module.types()[allocaIns.type()].baseType();
+        if (al.promote() && module.types()[baseType].isPointer())
+        {
+            al.setPromote(canPromotePointer(al, stackNames));
+        }
+    }
+
     // 2. Replace the instructions of IR_ALLOCA, IR_LOAD, IR_STORE, IR_PTR with register based instructions
 
     for (poOptMemToReg_Alloca& al : _alloca)
@@ -114,98 +302,12 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
             auto& allocaIns = al.source().getInstruction();
             auto& type = module.types()[allocaIns.type()];
             assert(type.isPointer());
-            const int baseType = type.baseType();
+            const int baseType = module.types()[type.baseType()].isPointer() ? TYPE_I64 /* null */ : type.baseType();
             allocaIns.setLeft(-1);
             allocaIns.setRight(-1);
             allocaIns.setCode(IR_CONSTANT);
             allocaIns.setType(baseType);
-            poConstantPool& pool = module.constants();
-            int constant = -1;
-            switch (baseType)
-            {
-            case TYPE_I64:
-                constant = pool.getConstant(int(0));
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(int(0));
-                }
-                break;
-            case TYPE_BOOLEAN:
-            case TYPE_U8:
-                constant = pool.getConstant((uint8_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(uint8_t(0));
-                }
-                break;
-            case TYPE_U16:
-                constant = pool.getConstant((uint16_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(uint16_t(0));
-                }
-                break;
-            case TYPE_U32:
-                constant = pool.getConstant((uint32_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(uint32_t(0));
-                }
-                break;
-            case TYPE_U64:
-                constant = pool.getConstant((uint64_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(uint64_t(0));
-                }
-                break;
-            case TYPE_I32:
-                constant = pool.getConstant((int32_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(int32_t(0));
-                }
-                break;
-            case TYPE_I16:
-                constant = pool.getConstant((int16_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(int16_t(0));
-                }
-                break;
-            case TYPE_I8:
-                constant = pool.getConstant((int8_t)0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(int8_t(0));
-                }
-                break;
-            case TYPE_F32:
-                constant = pool.getConstant(0.0f);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(float(0));
-                }
-                break;
-            case TYPE_F64:
-                constant = pool.getConstant(0.0);
-                if (constant == -1)
-                {
-                    constant = pool.addConstant(double(0));
-                }
-                break;
-            default:
-                if (module.types()[baseType].baseType() == TYPE_ENUM)
-                {
-                    constant = pool.getConstant((int32_t)0);
-                    if (constant == -1)
-                    {
-                        constant = pool.addConstant(int32_t(0));
-                    }
-                }
-                break;
-            }
-
+            const int constant = getZeroConstant(module, baseType);
             if (constant != -1)
             {
                 allocaIns.setConstant(constant);
@@ -216,7 +318,7 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
 
                     if (ins.code() == IR_PTR)
                     {
-                        rewritePtr(ins);
+                        rewritePtr(ins, allocaIns.name());
                     }
                 }
             }
@@ -231,7 +333,11 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
         variables.push_back(al.source().getInstruction().name());
     }
 
-    // 4. Remove instructions no longer needed (name == -1)
+    // 4. Split structs and arrays into a variable per field
+
+    splitAggregates(module, variables, maxName);
+
+    // 5. Remove instructions no longer needed (name == -1)
     bb = cfg.getFirst();
     while (bb)
     {
@@ -252,12 +358,229 @@ void poOptMemToReg::optimize(poModule& module, poFlowGraph& cfg)
         bb = bb->getNext();
     }
 
-    // 5: Phi node insertion, SSA rename
+    // 6: Phi node insertion, SSA rename
     poSSA_Reconstruct ssa;
     ssa.reconstruct(cfg, variables);
 }
 
-void poOptMemToReg::rewritePtr(poInstruction& ins)
+bool poOptMemToReg::getAccessType(const int ptr, int& type)
+{
+    // The pointer must only be loaded from and stored to, always with the same type
+
+    if (!_uses.hasUses(ptr))
+    {
+        return false;
+    }
+
+    type = -1;
+    for (const poInstructionRef& use : _uses.getUses(ptr))
+    {
+        const poInstruction& ins = use.getInstruction();
+        const bool isLoad = ins.code() == IR_LOAD && ins.left() == ptr;
+        const bool isStore = ins.code() == IR_STORE && ins.left() == ptr && ins.right() != ptr;
+        if (!isLoad && !isStore)
+        {
+            return false;
+        }
+
+        if (type != -1 && type != ins.type())
+        {
+            return false;
+        }
+
+        type = ins.type();
+    }
+
+    return true;
+}
+
+bool poOptMemToReg::canPromotePointer(poOptMemToReg_Alloca& al, const std::unordered_set<int>& stackNames)
+{
+    // A pointer variable is only promoted when it is plainly loaded and stored, and never
+    // holds the address of a stack allocation, as those only have a stack slot.
+
+    for (const poInstructionRef& use : al.uses())
+    {
+        const poInstruction& ptr = use.getInstruction();
+        if (ptr.right() != -1 || ptr.memOffset() != 0)
+        {
+            return false;
+        }
+
+        if (!_uses.hasUses(ptr.name()))
+        {
+            continue;
+        }
+
+        int type = -1;
+        if (!getAccessType(ptr.name(), type))
+        {
+            return false;
+        }
+
+        for (const poInstructionRef& access : _uses.getUses(ptr.name()))
+        {
+            const poInstruction& ins = access.getInstruction();
+            if (ins.code() == IR_STORE && stackNames.find(ins.right()) != stackNames.end())
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool poOptMemToReg::analyzeAggregate(poModule& module, poOptMemToReg_Aggregate& aggregate)
+{
+    const poInstruction& allocaIns = aggregate.source().getInstruction();
+    const int name = allocaIns.name();
+    if (!_uses.hasUses(name) || aggregate.size() <= 0)
+    {
+        return false;
+    }
+
+    for (const poInstructionRef& use : _uses.getUses(name))
+    {
+        // Every use must address the aggregate at a constant offset, anything else could reach any field
+
+        const poInstruction& ins = use.getInstruction();
+        const poType& ptrType = module.types()[ins.type()];
+        const int pointeeSize = module.types()[ptrType.baseType()].size();
+
+        int offset = -1;
+        if (ins.code() == IR_PTR && ins.left() == name && ins.right() == -1)
+        {
+            offset = ins.memOffset();
+        }
+        else if (ins.code() == IR_ELEMENT_PTR && ins.left() == name && ins.right() != -1)
+        {
+            const auto& index = _constants.find(ins.right());
+            if (index == _constants.end())
+            {
+                return false;
+            }
+
+            offset = int(index->second) * pointeeSize;
+        }
+
+        if (offset < 0 || offset >= aggregate.size())
+        {
+            return false;
+        }
+
+        int type = -1;
+        if (getAccessType(ins.name(), type))
+        {
+            const int size = module.types()[type].size();
+            if (size <= 0 || offset + size > aggregate.size())
+            {
+                return false;
+            }
+
+            aggregate.addAccess(use, offset, type, size, isScalarType(module, type));
+        }
+        else
+        {
+            // The address is used for something other than a load or store, such as a nested struct or
+            // being passed to a call. Only the struct field holding it can be reached through it, while
+            // an array element pointer can reach the whole array.
+
+            const poType& allocaType = module.types()[allocaIns.type()];
+            if (allocaType.isArray())
+            {
+                return false;
+            }
+
+            bool found = false;
+            for (const poField& field : module.types()[allocaType.baseType()].fields())
+            {
+                if (field.hasAttribute(poAttributes::STATIC))
+                {
+                    continue;
+                }
+
+                const int size = module.types()[field.type()].size() * field.numElements();
+                if (offset >= field.offset() && offset < field.offset() + size)
+                {
+                    aggregate.addEscape(field.offset(), size);
+                    found = true;
+                    break;
+                }
+            }
+
+            if (!found)
+            {
+                return false;
+            }
+        }
+    }
+
+    aggregate.resolve();
+    return true;
+}
+
+void poOptMemToReg::splitAggregates(poModule& module, std::vector<int>& variables, int maxName)
+{
+    // New variables are named from the top of the name space, clear of the names given
+    // out by the SSA reconstruction. They are renamed by the reconstruction anyway.
+
+    int nextName = INT16_MAX;
+
+    // Each promoted field starts out as zero where the aggregate was allocated
+    std::vector<std::vector<poInstruction>> zeros(_aggregates.size());
+
+    for (int i = 0; i < int(_aggregates.size()); i++)
+    {
+        poOptMemToReg_Aggregate& aggregate = _aggregates[i];
+        if (!analyzeAggregate(module, aggregate))
+        {
+            continue;
+        }
+
+        for (poOptMemToReg_Field& field : aggregate.fields())
+        {
+            if (!field.promote())
+            {
+                continue;
+            }
+
+            const int constant = getZeroConstant(module, field.type());
+            if (constant == -1 || nextName <= maxName)
+            {
+                continue;
+            }
+
+            const int variable = nextName--;
+            for (poInstructionRef& ptr : field.ptrs())
+            {
+                rewritePtr(ptr.getInstruction(), variable);
+            }
+
+            zeros[i].push_back(poInstruction(variable, field.type(), constant, IR_CONSTANT));
+            variables.push_back(variable);
+        }
+
+        if (!aggregate.isPartial() && int(zeros[i].size()) == int(aggregate.fields().size()))
+        {
+            aggregate.source().getInstruction().setName(-1);
+        }
+    }
+
+    // Insert last to first, so the positions of the aggregates still to come don't move
+
+    for (int i = int(_aggregates.size()) - 1; i >= 0; i--)
+    {
+        poInstructionRef& source = _aggregates[i].source();
+        poBasicBlock* bb = source.getBasicBlock();
+        for (int j = int(zeros[i].size()) - 1; j >= 0; j--)
+        {
+            bb->insertInstruction(zeros[i][j], source.getAdjustedRef());
+        }
+    }
+}
+
+void poOptMemToReg::rewritePtr(poInstruction& ins, const int variable)
 {
     /* Find any load/store instructions which reference this */
 
@@ -276,17 +599,17 @@ void poOptMemToReg::rewritePtr(poInstruction& ins)
         {
             // Replace the load with a copy
             useIns.setCode(IR_COPY);
-            useIns.setLeft(ins.left());
+            useIns.setLeft(variable);
             useIns.setConstant(0);
             useIns.setRight(-1);
         }
         else if (useIns.code() == IR_STORE)
         {
-            // Replace the store with a copy to ins.left()
+            // Replace the store with a copy to the variable
             useIns.setCode(IR_COPY);
             useIns.setLeft(useIns.right());
             useIns.setRight(-1);
-            useIns.setName(ins.left());
+            useIns.setName(variable);
             useIns.setConstant(0);
         }
     }
@@ -298,3 +621,105 @@ void poOptMemToReg::rewritePtr(poInstruction& ins)
     ins.setRight(-1);
 }
 
+
+int poOptMemToReg::getZeroConstant(poModule& module, const int type)
+{
+    poConstantPool& pool = module.constants();
+    int constant = -1;
+    switch (type)
+    {
+    case TYPE_I64:
+        constant = pool.getConstant(int(0));
+        if (constant == -1)
+        {
+            constant = pool.addConstant(int(0));
+        }
+        break;
+    case TYPE_BOOLEAN:
+    case TYPE_U8:
+        constant = pool.getConstant((uint8_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(uint8_t(0));
+        }
+        break;
+    case TYPE_U16:
+        constant = pool.getConstant((uint16_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(uint16_t(0));
+        }
+        break;
+    case TYPE_U32:
+        constant = pool.getConstant((uint32_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(uint32_t(0));
+        }
+        break;
+    case TYPE_U64:
+        constant = pool.getConstant((uint64_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(uint64_t(0));
+        }
+        break;
+    case TYPE_I32:
+        constant = pool.getConstant((int32_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(int32_t(0));
+        }
+        break;
+    case TYPE_I16:
+        constant = pool.getConstant((int16_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(int16_t(0));
+        }
+        break;
+    case TYPE_I8:
+        constant = pool.getConstant((int8_t)0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(int8_t(0));
+        }
+        break;
+    case TYPE_F32:
+        constant = pool.getConstant(0.0f);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(float(0));
+        }
+        break;
+    case TYPE_F64:
+        constant = pool.getConstant(0.0);
+        if (constant == -1)
+        {
+            constant = pool.addConstant(double(0));
+        }
+        break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        constant = pool.getConstant(int64_t(0));
+        if (constant == -1)
+        {
+            constant = pool.addConstant(int64_t(0));
+        }
+        break;
+    default:
+        if (module.types()[type].baseType() == TYPE_ENUM)
+        {
+            constant = pool.getConstant((int32_t)0);
+            if (constant == -1)
+            {
+                constant = pool.addConstant(int32_t(0));
+            }
+        }
+        break;
+    }
+
+    return constant;
+}
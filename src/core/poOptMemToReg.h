@@ -1,13 +1,20 @@
 #pragma once
 #include "poUses.h"
 
+#include <cstdint>
 #include <unordered_map>
+#include <unordered_set>
 
 //
 // Optimization pass which seeks to eliminate uses
 // of the IR_ALLOCA which allocates onto the stack
 // with operation which use registers.
 // This is performed in SSA form.
+//
+// Structs and fixed size arrays are split into a variable per
+// field (scalar replacement of aggregates), provided each field
+// is only loaded and stored at a constant offset. Fields whose
+// address escapes, or which overlap another access, stay in memory.
 // 
 
 
@@ -25,6 +32,7 @@ namespace po
         poOptMemToReg_Alloca(const poInstructionRef&  source);
         void addUse(const poInstructionRef& ref);
         inline const bool promote() const { return _promote; }
+        inline void setPromote(const bool promote) { _promote = promote; }
         inline std::vector<poInstructionRef>& uses() { return _uses; }
         inline poInstructionRef& source() { return _source; }
 
@@ -34,6 +42,47 @@ namespace po
         bool _promote;
     };
 
+    class poOptMemToReg_Field
+    {
+    public:
+        poOptMemToReg_Field(const int offset, const int type, const int size, const bool promote);
+        inline const int offset() const { return _offset; }
+        inline const int type() const { return _type; }
+        inline const int size() const { return _size; }
+        inline const bool promote() const { return _promote; }
+        inline void setPromote(const bool promote) { _promote = promote; }
+        inline void setSize(const int size) { _size = size; }
+        inline std::vector<poInstructionRef>& ptrs() { return _ptrs; }
+        inline const bool overlaps(const int offset, const int size) const { return offset < _offset + _size && _offset < offset + size; }
+
+    private:
+        std::vector<poInstructionRef> _ptrs; // IR_PTR or IR_ELEMENT_PTR instructions which address the field
+        int _offset;
+        int _type;
+        int _size;
+        bool _promote;
+    };
+
+    class poOptMemToReg_Aggregate
+    {
+    public:
+        poOptMemToReg_Aggregate(const poInstructionRef& source, const int size);
+        void addAccess(const poInstructionRef& ptr, const int offset, const int type, const int size, const bool promote);
+        void addEscape(const int offset, const int size);
+        void resolve();
+        inline poInstructionRef& source() { return _source; }
+        inline std::vector<poOptMemToReg_Field>& fields() { return _fields; }
+        inline const int size() const { return _size; }
+        inline const bool isPartial() const { return _partial; }
+
+    private:
+        std::vector<poOptMemToReg_Field> _fields;
+        std::vector<std::pair<int, int>> _escapes; // offset and size of the ranges which are addressed elsewhere
+        poInstructionRef _source;
+        int _size;
+        bool _partial;
+    };
+
     class poOptMemToReg
     {
     public:
@@ -41,9 +90,16 @@ namespace po
         void optimize(poModule& module, poFlowGraph& cfg);
 
     private:
-        void rewritePtr(poInstruction& ins);
+        void rewritePtr(poInstruction& ins, const int variable);
+        bool analyzeAggregate(poModule& module, poOptMemToReg_Aggregate& aggregate);
+        bool getAccessType(const int ptr, int& type);
+        bool canPromotePointer(poOptMemToReg_Alloca& al, const std::unordered_set<int>& stackNames);
+        void splitAggregates(poModule& module, std::vector<int>& variables, int maxName);
+        int getZeroConstant(poModule& module, const int type);
 
         poUses _uses;
         std::vector<poOptMemToReg_Alloca> _alloca;
+        std::vector<poOptMemToReg_Aggregate> _aggregates;
+        std::unordered_map<int, int64_t> _constants; // integer constants which may be used as array indices
     };
 }
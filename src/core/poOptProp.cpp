@@ -156,7 +156,7 @@ void poOptProp::eliminateBranch(poModule& module, poInstruction& ins, int nodeId
             }
             break;
         case IR_JUMP_LESS:
-            if (result > 0)
+            if (result >= 0)
             {
                 blockToRemove = bb->getBranch();
             }
@@ -166,7 +166,7 @@ void poOptProp::eliminateBranch(poModule& module, poInstruction& ins, int nodeId
             }
             break;
         case IR_JUMP_LESS_EQUALS:
-            if (result >= 0)
+            if (result > 0)
             {
                 blockToRemove = bb->getBranch();
             }
@@ -0,0 +1,855 @@
+#include "poOptVectorize.h"
+#include "poModule.h"
+#include "poCFG.h"
+
+#include <assert.h>
+
+using namespace po;
+
+poOptVectorize::poOptVectorize()
+    :
+    _header(nullptr),
+    _latch(nullptr),
+    _maxName(0),
+    _numSums(0),
+    _numMaps(0),
+    _numFinds(0)
+{
+}
+
+void poOptVectorize::optimize(poModule& module)
+{
+    _numSums = 0;
+    _numMaps = 0;
+    _numFinds = 0;
+
+    for (poFunction& func : module.functions())
+    {
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC) ||
+            func.cfg().getFirst() == nullptr)
+        {
+            continue;
+        }
+
+        optimize(module, func.cfg());
+    }
+}
+
+void poOptVectorize::optimize(poModule& module, poFlowGraph& cfg)
+{
+    bool analyze = true;
+    poBasicBlock* bb = cfg.getFirst();
+    while (bb)
+    {
+        if (analyze)
+        {
+            // Find the uses, definitions and the largest name in use
+
+            _uses.analyze(cfg);
+            _defs.clear();
+            _maxName = 0;
+            _numPredecessors.clear();
+            for (poBasicBlock* defBB = cfg.getFirst(); defBB != nullptr; defBB = defBB->getNext())
+            {
+                if (defBB->getBranch() != nullptr)
+                {
+                    _numPredecessors[defBB->getBranch()]++;
+                }
+                if (defBB->getNext() != nullptr && !defBB->unconditionalBranch() &&
+                    (defBB->numInstructions() == 0 || defBB->instructions().back().code() != IR_RETURN))
+                {
+                    _numPredecessors[defBB->getNext()]++;
+                }
+
+                for (int i = 0; i < int(defBB->numInstructions()); i++)
+                {
+                    const int name = defBB->getInstruction(i).name();
+                    _defs.insert(std::pair<int, poInstructionRef>(name, poInstructionRef(defBB, i, 0)));
+                    _maxName = std::max(_maxName, name);
+                }
+            }
+            analyze = false;
+        }
+
+        if (recognize(module, bb))
+        {
+            analyze = true;
+        }
+
+        bb = bb->getNext();
+    }
+}
+
+bool poOptVectorize::recognize(poModule& module, poBasicBlock* header)
+{
+    // The header branches out of the loop and is entered from before the loop and the latch
+
+    if (header->numInstructions() < 3 ||
+        header->getBranch() == nullptr ||
+        header->unconditionalBranch() ||
+        _numPredecessors[header] != 2)
+    {
+        return false;
+    }
+
+    // The rest of the loop is a run of straight line blocks ending with the jump back to the header.
+    // Any of them other than the latch may also branch out to the same exit.
+
+    poBasicBlock* exit = header->getBranch();
+    _header = header;
+    _latch = nullptr;
+    _body.clear();
+    _tests.clear();
+    poBasicBlock* bb = header->getNext();
+    while (bb != nullptr)
+    {
+        if (_numPredecessors[bb] != 1 ||
+            bb->numInstructions() == 0)
+        {
+            return false;
+        }
+
+        _body.push_back(bb);
+        if (bb->getBranch() == header && bb->unconditionalBranch())
+        {
+            _latch = bb;
+            break;
+        }
+
+        if (bb->getBranch() != nullptr)
+        {
+            if (bb->getBranch() != exit || bb->unconditionalBranch())
+            {
+                return false;
+            }
+            _tests.push_back(bb);
+        }
+
+        bb = bb->getNext();
+    }
+
+    if (_latch == nullptr ||
+        _latch->instructions().back().code() != IR_BR)
+    {
+        return false;
+    }
+
+    _loopNames.clear();
+    _phis.clear();
+    for (const poInstruction& ins : header->instructions())
+    {
+        _loopNames.insert(ins.name());
+    }
+    for (int i = 0; i < int(header->numInstructions()) && header->getInstruction(i).code() == IR_PHI; i++)
+    {
+        _phis.push_back(&header->getInstruction(i));
+    }
+    for (poBasicBlock* bodyBB : _body)
+    {
+        for (const poInstruction& ins : bodyBB->instructions())
+        {
+            _loopNames.insert(ins.name());
+        }
+    }
+
+    return recognizeSum(module) ||
+        recognizeMap(module) ||
+        recognizeFind(module);
+}
+
+bool poOptVectorize::recognizeSum(poModule& module)
+{
+    // acc += array[iv + offset] with an integer accumulator
+
+    _matched.clear();
+
+    int iv = -1;
+    int bound = -1;
+    if (_tests.size() != 0 ||
+        _phis.size() != 2 ||
+        !findCountedHeader(iv, bound))
+    {
+        return false;
+    }
+
+    const poInstruction* ivPhi = _phis[0]->name() == iv ? _phis[0] : _phis[1];
+    const poInstruction* accPhi = _phis[0]->name() == iv ? _phis[1] : _phis[0];
+    const int type = accPhi->type();
+    if (type != TYPE_I64 &&
+        type != TYPE_U64 &&
+        type != TYPE_I32 &&
+        type != TYPE_U32)
+    {
+        return false;
+    }
+
+    int next = -1;
+    if (!findStep(module, *ivPhi, next))
+    {
+        return false;
+    }
+
+    const int acc = accPhi->name();
+    int accNext = -1;
+    if (isLoopInstruction(accPhi->left()) && !isLoopInstruction(accPhi->right()))
+    {
+        accNext = accPhi->left();
+    }
+    else if (isLoopInstruction(accPhi->right()) && !isLoopInstruction(accPhi->left()))
+    {
+        accNext = accPhi->right();
+    }
+    else
+    {
+        return false;
+    }
+
+    int sum = accNext;
+    const poInstruction* copy = findDef(sum);
+    if (copy != nullptr && copy->code() == IR_COPY)
+    {
+        _matched.insert(sum);
+        sum = copy->left();
+    }
+
+    const poInstruction* add = findDef(sum);
+    if (add == nullptr ||
+        add->code() != IR_ADD ||
+        add->type() != type ||
+        !isLoopInstruction(sum) ||
+        numUses(sum) != 1)
+    {
+        return false;
+    }
+
+    const int load = add->left() == acc ? add->right() : add->left();
+    int array = -1;
+    int arrayType = -1;
+    int64_t offset = 0;
+    if ((add->left() != acc && add->right() != acc) ||
+        !findElement(module, load, type, iv, array, arrayType, offset))
+    {
+        return false;
+    }
+
+    // The running total may not be looked at part way through
+
+    for (const poInstructionRef& use : _uses.getUses(acc))
+    {
+        if (isLoopInstruction(use.getInstruction().name()) &&
+            use.getInstruction().name() != sum)
+        {
+            return false;
+        }
+    }
+
+    _matched.insert(sum);
+    _matched.insert(ivPhi->name());
+    _matched.insert(acc);
+    if (!allMatched())
+    {
+        return false;
+    }
+
+    std::vector<poInstruction> instructions;
+
+    const int count = ++_maxName;
+    instructions.push_back(poInstruction(count, TYPE_I64, bound, iv, IR_SUB));
+
+    const int index = addIndex(module, instructions, iv, offset);
+    const int element = ++_maxName;
+    instructions.push_back(poInstruction(element, int16_t(arrayType), array, index, 0, IR_ELEMENT_PTR));
+
+    const int result = ++_maxName;
+    instructions.push_back(poInstruction(result, int16_t(type), 2, -1, IR_VECTOR_SUM));
+    instructions.push_back(poInstruction(++_maxName, int16_t(arrayType), element, -1, IR_ARG));
+    instructions.push_back(poInstruction(++_maxName, TYPE_I64, count, -1, IR_ARG));
+
+    // The total is copied into the phi operand, as the accumulator may share its register
+    const int total = ++_maxName;
+    instructions.push_back(poInstruction(total, int16_t(type), acc, result, IR_ADD));
+    instructions.push_back(poInstruction(accNext, int16_t(type), total, -1, IR_COPY));
+    instructions.push_back(poInstruction(next, TYPE_I64, bound, -1, IR_COPY));
+
+    replaceBody(instructions);
+    _numSums++;
+    return true;
+}
+
+bool poOptVectorize::recognizeMap(poModule& module)
+{
+    // dst[iv] = x op y where each of x and y is either an array element or a loop invariant
+
+    _matched.clear();
+
+    int iv = -1;
+    int bound = -1;
+    if (_tests.size() != 0 ||
+        _phis.size() != 1 ||
+        !findCountedHeader(iv, bound))
+    {
+        return false;
+    }
+
+    int next = -1;
+    if (!findStep(module, *_phis[0], next))
+    {
+        return false;
+    }
+
+    const poInstruction* store = nullptr;
+    for (poBasicBlock* bodyBB : _body)
+    {
+        for (const poInstruction& ins : bodyBB->instructions())
+        {
+            if (ins.code() == IR_STORE)
+            {
+                if (store != nullptr)
+                {
+                    return false;
+                }
+                store = &ins;
+            }
+        }
+    }
+
+    if (store == nullptr)
+    {
+        return false;
+    }
+
+    const poInstruction* dstPtr = findDef(store->left());
+    if (dstPtr == nullptr ||
+        dstPtr->code() != IR_ELEMENT_PTR ||
+        dstPtr->memOffset() != 0 ||
+        dstPtr->right() != iv ||
+        !isInvariant(dstPtr->left()) ||
+        numUses(dstPtr->name()) != 1)
+    {
+        return false;
+    }
+
+    const int type = store->type();
+    const int size = module.types()[type].size();
+    const bool isFloat = type == TYPE_F64 || type == TYPE_F32;
+    switch (type)
+    {
+    case TYPE_I64:
+    case TYPE_U64:
+    case TYPE_I32:
+    case TYPE_U32:
+    case TYPE_I16:
+    case TYPE_U16:
+    case TYPE_I8:
+    case TYPE_U8:
+    case TYPE_F64:
+    case TYPE_F32:
+        break;
+    default:
+        return false;
+    }
+
+    if (module.types()[module.types()[dstPtr->type()].baseType()].size() != size)
+    {
+        return false;
+    }
+
+    // SSE2 has no packed multiply or divide for the integer types
+
+    const poInstruction* op = findDef(store->right());
+    if (op == nullptr ||
+        op->type() != type ||
+        !isLoopInstruction(op->name()) ||
+        numUses(op->name()) != 1 ||
+        !(op->code() == IR_ADD ||
+          op->code() == IR_SUB ||
+          (isFloat && (op->code() == IR_MUL || op->code() == IR_DIV))))
+    {
+        return false;
+    }
+
+    int operands[2] = { op->left(), op->right() };
+    int arrays[2] = { -1, -1 };
+    int arrayTypes[2] = { -1, -1 };
+    int64_t offsets[2] = { 0, 0 };
+    for (int i = 0; i < 2; i++)
+    {
+        if (!findElement(module, operands[i], type, iv, arrays[i], arrayTypes[i], offsets[i]) &&
+            !isInvariant(operands[i]))
+        {
+            return false;
+        }
+    }
+
+    if (arrays[0] == -1)
+    {
+        // The backend expects the first operand to be an array
+        if (arrays[1] == -1 ||
+            (op->code() != IR_ADD && op->code() != IR_MUL))
+        {
+            return false;
+        }
+        std::swap(operands[0], operands[1]);
+        std::swap(arrays[0], arrays[1]);
+        std::swap(arrayTypes[0], arrayTypes[1]);
+        std::swap(offsets[0], offsets[1]);
+    }
+
+    _matched.insert(store->name());
+    _matched.insert(dstPtr->name());
+    _matched.insert(op->name());
+    _matched.insert(iv);
+    if (!allMatched())
+    {
+        return false;
+    }
+
+    std::vector<poInstruction> instructions;
+
+    const int count = ++_maxName;
+    instructions.push_back(poInstruction(count, TYPE_I64, bound, iv, IR_SUB));
+
+    const int dst = ++_maxName;
+    instructions.push_back(poInstruction(dst, dstPtr->type(), dstPtr->left(), iv, 0, IR_ELEMENT_PTR));
+
+    int args[2] = { -1, -1 };
+    int argTypes[2] = { -1, -1 };
+    for (int i = 0; i < 2; i++)
+    {
+        if (arrays[i] != -1)
+        {
+            const int index = addIndex(module, instructions, iv, offsets[i]);
+            args[i] = ++_maxName;
+            argTypes[i] = arrayTypes[i];
+            instructions.push_back(poInstruction(args[i], int16_t(arrayTypes[i]), arrays[i], index, 0, IR_ELEMENT_PTR));
+        }
+        else
+        {
+            // Constants within the loop are removed with the body
+            args[i] = operands[i];
+            argTypes[i] = type;
+            const poInstruction* constant = findDef(operands[i]);
+            if (isLoopInstruction(operands[i]) && constant != nullptr)
+            {
+                args[i] = ++_maxName;
+                instructions.push_back(poInstruction(args[i], constant->type(), constant->constant(), IR_CONSTANT));
+            }
+        }
+    }
+
+    instructions.push_back(poInstruction(++_maxName, TYPE_VOID, 4, op->code(), IR_VECTOR_MAP));
+    instructions.push_back(poInstruction(++_maxName, dstPtr->type(), dst, -1, IR_ARG));
+    instructions.push_back(poInstruction(++_maxName, int16_t(argTypes[0]), args[0], -1, IR_ARG));
+    instructions.push_back(poInstruction(++_maxName, int16_t(argTypes[1]), args[1], -1, IR_ARG));
+    instructions.push_back(poInstruction(++_maxName, TYPE_I64, count, -1, IR_ARG));
+
+    instructions.push_back(poInstruction(next, TYPE_I64, bound, -1, IR_COPY));
+
+    replaceBody(instructions);
+    _numMaps++;
+    return true;
+}
+
+bool poOptVectorize::recognizeFind(poModule& module)
+{
+    // while (array[iv] != value && iv < bound) iv += 1, with the tests in either order
+
+    _matched.clear();
+
+    if (_tests.size() != 1 ||
+        _body.size() != 2 ||
+        _phis.size() != 1 ||
+        _phis[0]->type() != TYPE_I64)
+    {
+        return false;
+    }
+
+    const int iv = _phis[0]->name();
+    int next = -1;
+    if (!findStep(module, *_phis[0], next))
+    {
+        return false;
+    }
+
+    int bound = -1;
+    int value = -1;
+    int valueType = -1;
+    int array = -1;
+    int arrayType = -1;
+    poBasicBlock* tests[2] = { _header, _tests[0] };
+    for (poBasicBlock* test : tests)
+    {
+        const int numInstructions = int(test->numInstructions());
+        if (numInstructions < 2)
+        {
+            return false;
+        }
+
+        const poInstruction& cmp = test->getInstruction(numInstructions - 2);
+        const poInstruction& br = test->getInstruction(numInstructions - 1);
+        if (cmp.code() != IR_CMP ||
+            br.code() != IR_BR)
+        {
+            return false;
+        }
+
+        if (br.left() == IR_JUMP_GREATER_EQUALS &&
+            cmp.type() == TYPE_I64 &&
+            cmp.left() == iv &&
+            bound == -1)
+        {
+            // The bound may be widened from a smaller invariant each time around
+            bound = cmp.right();
+            const poInstruction* extend = findDef(bound);
+            if (!isInvariant(bound))
+            {
+                if (extend == nullptr ||
+                    (extend->code() != IR_SIGN_EXTEND && extend->code() != IR_ZERO_EXTEND && extend->code() != IR_BITWISE_CAST) ||
+                    !isInvariant(extend->left()))
+                {
+                    return false;
+                }
+                _matched.insert(bound);
+            }
+        }
+        else if (br.left() == IR_JUMP_EQUALS &&
+            (cmp.type() == TYPE_U8 || cmp.type() == TYPE_I8) &&
+            value == -1)
+        {
+            const poInstruction* load = findDef(cmp.left());
+            int element = cmp.left();
+            value = cmp.right();
+            if (load == nullptr || load->code() != IR_LOAD)
+            {
+                element = cmp.right();
+                value = cmp.left();
+            }
+
+            int64_t offset = 0;
+            if (!isInvariant(value) ||
+                !findElement(module, element, cmp.type(), iv, array, arrayType, offset) ||
+                offset != 0)
+            {
+                return false;
+            }
+            valueType = cmp.type();
+        }
+        else
+        {
+            return false;
+        }
+
+        _matched.insert(cmp.name());
+        _matched.insert(br.name());
+    }
+
+    _matched.insert(iv);
+    if (bound == -1 ||
+        value == -1 ||
+        !allMatched())
+    {
+        return false;
+    }
+
+    // Only the latch is replaced, the search leaves the induction variable on the element which ends the loop
+
+    std::vector<poInstruction> instructions;
+
+    const int start = addIndex(module, instructions, iv, 1);
+    const int count = ++_maxName;
+    instructions.push_back(poInstruction(count, TYPE_I64, bound, start, IR_SUB));
+
+    const int element = ++_maxName;
+    instructions.push_back(poInstruction(element, int16_t(arrayType), array, start, 0, IR_ELEMENT_PTR));
+
+    const int result = ++_maxName;
+    instructions.push_back(poInstruction(result, TYPE_I64, 3, -1, IR_VECTOR_FIND));
+    instructions.push_back(poInstruction(++_maxName, int16_t(arrayType), element, -1, IR_ARG));
+    instructions.push_back(poInstruction(++_maxName, int16_t(valueType), value, -1, IR_ARG));
+    instructions.push_back(poInstruction(++_maxName, TYPE_I64, count, -1, IR_ARG));
+
+    const int end = ++_maxName;
+    instructions.push_back(poInstruction(end, TYPE_I64, start, result, IR_ADD));
+    instructions.push_back(poInstruction(next, TYPE_I64, end, -1, IR_COPY));
+
+    const poInstruction jump = _latch->instructions().back();
+    while (_latch->numInstructions() > 0)
+    {
+        _latch->removeInstruction(int(_latch->numInstructions()) - 1);
+    }
+    for (const poInstruction& ins : instructions)
+    {
+        _latch->addInstruction(ins);
+    }
+    _latch->addInstruction(jump);
+
+    _numFinds++;
+    return true;
+}
+
+bool poOptVectorize::findStep(poModule& module, const poInstruction& phi, int& next)
+{
+    // The induction variable starts outside the loop and is stepped by one
+
+    if (_loopNames.find(phi.left()) != _loopNames.end() &&
+        _loopNames.find(phi.right()) == _loopNames.end())
+    {
+        next = phi.left();
+    }
+    else if (_loopNames.find(phi.right()) != _loopNames.end() &&
+        _loopNames.find(phi.left()) == _loopNames.end())
+    {
+        next = phi.right();
+    }
+    else
+    {
+        return false;
+    }
+
+    int step = next;
+    const poInstruction* stepIns = findDef(step);
+    if (stepIns != nullptr && stepIns->code() == IR_COPY)
+    {
+        _matched.insert(step);
+        step = stepIns->left();
+    }
+
+    int64_t increment = 0;
+    return isLoopInstruction(step) &&
+        isIndex(module, step, phi.name(), increment) &&
+        increment == 1;
+}
+
+bool poOptVectorize::findCountedHeader(int& iv, int& bound)
+{
+    // The phis, any constants and a signed compare of an induction variable against an invariant bound
+
+    const int numHeader = int(_header->numInstructions());
+    const poInstruction& cmp = _header->getInstruction(numHeader - 2);
+    const poInstruction& br = _header->getInstruction(numHeader - 1);
+    if (cmp.code() != IR_CMP ||
+        cmp.type() != TYPE_I64 ||
+        br.code() != IR_BR ||
+        br.left() != IR_JUMP_GREATER_EQUALS)
+    {
+        return false;
+    }
+
+    for (int i = int(_phis.size()); i < numHeader - 2; i++)
+    {
+        if (_header->getInstruction(i).code() != IR_CONSTANT)
+        {
+            return false;
+        }
+    }
+
+    iv = -1;
+    for (const poInstruction* phi : _phis)
+    {
+        if (phi->name() == cmp.left() && phi->type() == TYPE_I64)
+        {
+            iv = phi->name();
+        }
+    }
+
+    bound = cmp.right();
+    if (iv == -1 || !isInvariant(bound))
+    {
+        return false;
+    }
+
+    _matched.insert(cmp.name());
+    _matched.insert(br.name());
+    return true;
+}
+
+bool poOptVectorize::findElement(poModule& module, const int name, const int type, const int iv, int& array, int& arrayType, int64_t& offset)
+{
+    // A load of the given type used only once, from an array element indexed by the induction variable
+
+    const poInstruction* load = findDef(name);
+    if (load == nullptr ||
+        load->code() != IR_LOAD ||
+        load->type() != type ||
+        !isLoopInstruction(name) ||
+        numUses(name) != 1)
+    {
+        return false;
+    }
+
+    const poInstruction* ptr = findDef(load->left());
+    if (ptr == nullptr ||
+        ptr->code() != IR_ELEMENT_PTR ||
+        ptr->memOffset() != 0 ||
+        !isInvariant(ptr->left()) ||
+        numUses(ptr->name()) != 1 ||
+        !isIndex(module, ptr->right(), iv, offset) ||
+        module.types()[module.types()[ptr->type()].baseType()].size() != module.types()[type].size())
+    {
+        return false;
+    }
+
+    _matched.insert(name);
+    _matched.insert(ptr->name());
+    array = ptr->left();
+    arrayType = ptr->type();
+    return true;
+}
+
+bool poOptVectorize::isInvariant(const int name) const
+{
+    if (_loopNames.find(name) == _loopNames.end())
+    {
+        return true;
+    }
+
+    // Constants are free to be used anywhere the header dominates
+    const auto& def = _defs.find(name);
+    return def != _defs.end() && def->second.getInstruction().code() == IR_CONSTANT;
+}
+
+bool poOptVectorize::isConstant(poModule& module, const int name, int64_t& value)
+{
+    // A constant, or a negated one as in a[i + -1]
+
+    const poInstruction* ins = findDef(name);
+    if (ins != nullptr &&
+        ins->code() == IR_UNARY_MINUS &&
+        ins->type() == TYPE_I64 &&
+        isConstant(module, ins->left(), value))
+    {
+        value = -value;
+        _matched.insert(name);
+        return true;
+    }
+
+    if (ins == nullptr ||
+        ins->code() != IR_CONSTANT ||
+        ins->type() != TYPE_I64)
+    {
+        return false;
+    }
+
+    value = module.constants().getI64(ins->constant());
+    return true;
+}
+
+bool poOptVectorize::isIndex(poModule& module, const int name, const int iv, int64_t& offset)
+{
+    // Either the induction variable itself or the induction variable plus a constant
+
+    if (name == iv)
+    {
+        offset = 0;
+        return true;
+    }
+
+    const poInstruction* ins = findDef(name);
+    if (ins == nullptr ||
+        ins->code() != IR_ADD ||
+        ins->type() != TYPE_I64 ||
+        !isLoopInstruction(name))
+    {
+        return false;
+    }
+
+    if ((ins->left() == iv && isConstant(module, ins->right(), offset)) ||
+        (ins->right() == iv && isConstant(module, ins->left(), offset)))
+    {
+        _matched.insert(name);
+        return true;
+    }
+
+    return false;
+}
+
+bool poOptVectorize::isLoopInstruction(const int name) const
+{
+    return _loopNames.find(name) != _loopNames.end();
+}
+
+bool poOptVectorize::allMatched() const
+{
+    // Anything left over other than constants has some other purpose
+
+    std::vector<poBasicBlock*> blocks{ _header };
+    blocks.insert(blocks.end(), _body.begin(), _body.end());
+    for (poBasicBlock* bb : blocks)
+    {
+        const int numInstructions = int(bb->numInstructions()) - (bb == _latch ? 1 : 0);
+        for (int i = 0; i < numInstructions; i++)
+        {
+            const poInstruction& ins = bb->getInstruction(i);
+            if (ins.code() != IR_CONSTANT &&
+                _matched.find(ins.name()) == _matched.end())
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int poOptVectorize::numUses(const int name) const
+{
+    return _uses.hasUses(name) ? int(_uses.getUses(name).size()) : 0;
+}
+
+int poOptVectorize::addConstant(poModule& module, std::vector<poInstruction>& instructions, const int64_t value)
+{
+    poConstantPool& pool = module.constants();
+    int constant = pool.getConstant(value);
+    if (constant == -1)
+    {
+        constant = pool.addConstant(value);
+    }
+
+    const int name = ++_maxName;
+    instructions.push_back(poInstruction(name, TYPE_I64, int16_t(constant), IR_CONSTANT));
+    return name;
+}
+
+int poOptVectorize::addIndex(poModule& module, std::vector<poInstruction>& instructions, const int iv, const int64_t offset)
+{
+    if (offset == 0)
+    {
+        return iv;
+    }
+
+    const int constant = addConstant(module, instructions, offset);
+    const int index = ++_maxName;
+    instructions.push_back(poInstruction(index, TYPE_I64, iv, constant, IR_ADD));
+    return index;
+}
+
+void poOptVectorize::replaceBody(const std::vector<poInstruction>& instructions)
+{
+    const poInstruction jump = _latch->instructions().back();
+    for (poBasicBlock* bodyBB : _body)
+    {
+        while (bodyBB->numInstructions() > 0)
+        {
+            bodyBB->removeInstruction(int(bodyBB->numInstructions()) - 1);
+        }
+    }
+
+    poBasicBlock* first = _body.front();
+    for (const poInstruction& ins : instructions)
+    {
+        first->addInstruction(ins);
+    }
+    _latch->addInstruction(jump);
+}
+
+poInstruction* poOptVectorize::findDef(const int name)
+{
+    const auto& def = _defs.find(name);
+    if (def == _defs.end())
+    {
+        return nullptr;
+    }
+
+    return &def->second.getInstruction();
+}
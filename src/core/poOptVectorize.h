@@ -0,0 +1,83 @@
+#pragma once
+#include "poUses.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+//
+// Loop vectorization which replaces simple counted loops over arrays with
+// operations the backend lowers to 16 byte SSE2 loops and a scalar epilogue.
+//
+// Three shapes are recognized, each stepping an induction variable by one:
+//
+//  - A sum reduction of a 32 or 64 bit integer array (IR_VECTOR_SUM).
+//    Floating point sums are left alone as reordering the additions changes
+//    the result.
+//  - An element wise add or subtract of integer arrays, or an add, subtract,
+//    multiply or divide of floating point arrays, where either operand may
+//    also be a loop invariant scalar (IR_VECTOR_MAP). The backend checks at
+//    run time whether the destination overlaps a source just ahead of it and
+//    falls back to the scalar loop when it does.
+//  - A search for the first byte equal to a value within a bound, such as the
+//    loop in strlen (IR_VECTOR_FIND).
+//
+// For sums and maps the body is replaced and the induction variable is stepped
+// straight to the bound, as with the idiom recognizer. For searches only the
+// latch is replaced, stepping the induction variable to the element which ends
+// the loop so the tests run once more and exit just as the original would.
+//
+
+namespace po
+{
+    class poModule;
+    class poFlowGraph;
+    class poBasicBlock;
+
+    class poOptVectorize
+    {
+    public:
+        poOptVectorize();
+        void optimize(poModule& module);
+
+        inline const int numSums() const { return _numSums; }
+        inline const int numMaps() const { return _numMaps; }
+        inline const int numFinds() const { return _numFinds; }
+
+    private:
+        void optimize(poModule& module, poFlowGraph& cfg);
+        bool recognize(poModule& module, poBasicBlock* header);
+        bool recognizeSum(poModule& module);
+        bool recognizeMap(poModule& module);
+        bool recognizeFind(poModule& module);
+        bool findStep(poModule& module, const poInstruction& phi, int& next);
+        bool findCountedHeader(int& iv, int& bound);
+        bool findElement(poModule& module, const int name, const int type, const int iv, int& array, int& arrayType, int64_t& offset);
+        bool isInvariant(const int name) const;
+        bool isConstant(poModule& module, const int name, int64_t& value);
+        bool isIndex(poModule& module, const int name, const int iv, int64_t& offset);
+        bool isLoopInstruction(const int name) const;
+        bool allMatched() const;
+        int numUses(const int name) const;
+        int addConstant(poModule& module, std::vector<poInstruction>& instructions, const int64_t value);
+        int addIndex(poModule& module, std::vector<poInstruction>& instructions, const int iv, const int64_t offset);
+        void replaceBody(const std::vector<poInstruction>& instructions);
+        poInstruction* findDef(const int name);
+
+        poUses _uses;
+        std::unordered_map<int, poInstructionRef> _defs;
+        std::unordered_map<poBasicBlock*, int> _numPredecessors;
+        std::unordered_set<int> _loopNames; // Names defined in the loop being matched
+        std::unordered_set<int> _matched; // Instructions of the loop accounted for by the pattern
+        std::vector<poBasicBlock*> _body; // Blocks after the header, ending with the latch
+        std::vector<poBasicBlock*> _tests; // Body blocks which also branch out of the loop
+        std::vector<const poInstruction*> _phis;
+        poBasicBlock* _header;
+        poBasicBlock* _latch;
+        int _maxName;
+        int _numSums;
+        int _numMaps;
+        int _numFinds;
+    };
+}
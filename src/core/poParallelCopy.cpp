@@ -0,0 +1,89 @@
+#include "poParallelCopy.h"
+
+using namespace po;
+
+//====================
+// poRegMove
+//====================
+
+poRegMove::poRegMove()
+    :
+    _dst(-1),
+    _src(-1),
+    _isSwap(false)
+{
+}
+
+poRegMove::poRegMove(const int dst, const int src, const bool isSwap)
+    :
+    _dst(dst),
+    _src(src),
+    _isSwap(isSwap)
+{
+}
+
+//====================
+// poParallelCopy
+//====================
+
+void poParallelCopy::add(const int dst, const int src)
+{
+    if (dst != src)
+    {
+        _copies.push_back(std::pair<int, int>(dst, src));
+    }
+}
+
+bool poParallelCopy::isRead(const int reg, const int ignore) const
+{
+    for (int i = 0; i < int(_copies.size()); i++)
+    {
+        if (i != ignore && _copies[i].second == reg)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void poParallelCopy::sequentialize(std::vector<poRegMove>& moves)
+{
+    while (_copies.size() > 0)
+    {
+        bool progress = false;
+        for (int i = 0; i < int(_copies.size());)
+        {
+            if (isRead(_copies[i].first, i))
+            {
+                i++;
+                continue;
+            }
+
+            moves.push_back(poRegMove(_copies[i].first, _copies[i].second, false));
+            _copies.erase(_copies.begin() + i);
+            progress = true;
+        }
+
+        if (progress || _copies.size() == 0)
+        {
+            continue;
+        }
+
+        // Only cycles are left; after the swap the destination is done and its old value
+        // is in the source, so the move which read it reads the source instead
+        const int dst = _copies[0].first;
+        const int src = _copies[0].second;
+        moves.push_back(poRegMove(dst, src, true));
+        _copies.erase(_copies.begin());
+
+        for (std::pair<int, int>& copy : _copies)
+        {
+            if (copy.second == dst)
+            {
+                copy.second = src;
+            }
+        }
+
+        std::erase_if(_copies, [](const std::pair<int, int>& copy) { return copy.first == copy.second; });
+    }
+}
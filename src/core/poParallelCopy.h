@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+
+namespace po
+{
+    //
+    // Sequentializes a parallel copy between registers, such as the moves on a control flow
+    // edge once each side has been allocated. Every destination is written once and all the
+    // sources are read before any of them are overwritten.
+    //
+    // A move whose destination isn't read by any other move is performed first, which may in turn
+    // free up other destinations. Whatever is left is made up of cycles, each of which is broken
+    // by swapping a destination with its source, so a cycle of k registers takes k - 1 swaps and
+    // no scratch register.
+    //
+
+    class poRegMove
+    {
+    public:
+        poRegMove();
+        poRegMove(const int dst, const int src, const bool isSwap);
+
+        inline const int dst() const { return _dst; }
+        inline const int src() const { return _src; }
+        inline const bool isSwap() const { return _isSwap; }
+
+    private:
+        int _dst;
+        int _src;
+        bool _isSwap; /* exchange the registers rather than copy */
+    };
+
+    class poParallelCopy
+    {
+    public:
+        void add(const int dst, const int src);
+        void sequentialize(std::vector<poRegMove>& moves);
+        inline const bool isEmpty() const { return _copies.size() == 0; }
+
+    private:
+        bool isRead(const int reg, const int ignore) const;
+
+        std::vector<std::pair<int, int>> _copies; /* destination, source */
+    };
+}
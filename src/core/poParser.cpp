@@ -34,7 +34,9 @@ bool poParser::matchPrimitiveType() const
         type == poTokenType::I64_TYPE || type == poTokenType::I8_TYPE ||
         type == poTokenType::U32_TYPE || type == poTokenType::U64_TYPE ||
         type == poTokenType::U8_TYPE || type == poTokenType::F32_TYPE ||
-        type == poTokenType::F64_TYPE;
+        type == poTokenType::F64_TYPE || type == poTokenType::F32X4_TYPE ||
+        type == poTokenType::F64X2_TYPE || type == poTokenType::I32X4_TYPE ||
+        type == poTokenType::U8X16_TYPE;
 }
 
 bool poParser::lookahead(const poTokenType type, const int amount)
@@ -1685,6 +1687,10 @@ poNode* poFunctionParser::parseBody(const bool isLoop)
             _parser.match(poTokenType::U8_TYPE) ||
             _parser.match(poTokenType::F32_TYPE) ||
             _parser.match(poTokenType::F64_TYPE) ||
+            _parser.match(poTokenType::F32X4_TYPE) ||
+            _parser.match(poTokenType::F64X2_TYPE) ||
+            _parser.match(poTokenType::I32X4_TYPE) ||
+            _parser.match(poTokenType::U8X16_TYPE) ||
             _parser.match(poTokenType::OBJECT) ||
             _parser.match(poTokenType::IDENTIFIER) ||
             _parser.match(poTokenType::STAR))
@@ -1803,6 +1809,10 @@ poNode* poFunctionParser::parseArg()
         _parser.match(poTokenType::U8_TYPE) ||
         _parser.match(poTokenType::F64_TYPE) ||
         _parser.match(poTokenType::F32_TYPE) ||
+        _parser.match(poTokenType::F32X4_TYPE) ||
+        _parser.match(poTokenType::F64X2_TYPE) ||
+        _parser.match(poTokenType::I32X4_TYPE) ||
+        _parser.match(poTokenType::U8X16_TYPE) ||
         _parser.match(poTokenType::OBJECT) ||
         _parser.match(poTokenType::IDENTIFIER))
     {
@@ -2818,35 +2828,20 @@ poNode* poNamespaceParser::parseStaticVariable(const poToken& type, const int po
     if (_parser.match(poTokenType::EQUALS))
     {
         _parser.advance();
-        if (_parser.match(poTokenType::TRUE) ||
-            _parser.match(poTokenType::FALSE) ||
-            _parser.match(poTokenType::F32) ||
-            _parser.match(poTokenType::F64) ||
-            _parser.match(poTokenType::I32) ||
-            _parser.match(poTokenType::I64) ||
-            _parser.match(poTokenType::I8) ||
-            _parser.match(poTokenType::I16) ||
-            _parser.match(poTokenType::U32) ||
-            _parser.match(poTokenType::U64) ||
-            _parser.match(poTokenType::U8) ||
-            _parser.match(poTokenType::U16) ||
-            _parser.match(poTokenType::STRING) ||
-            _parser.match(poTokenType::CHAR))
-        {
-            poToken value = _parser.peek();
-            _parser.advance();
 
-            poNode* assign = new poBinaryNode(poNodeType::ASSIGNMENT,
-                variable,
-                new poNode(poNodeType::CONSTANT, value),
-                name);
-            variable = assign;
-        }
-        else
+        // Anything other than a literal is evaluated at compile time
+        poFunctionParser funcParser(_parser);
+        poNode* value = funcParser.parseExpression();
+        if (value == nullptr || _parser.isError())
         {
             _parser.setError("Expected value.");
             return nullptr;
         }
+
+        variable = new poBinaryNode(poNodeType::ASSIGNMENT,
+            variable,
+            value,
+            name);
     }
     if (_parser.match(poTokenType::SEMICOLON))
     {
@@ -0,0 +1,57 @@
+#pragma once
+
+namespace po
+{
+    //
+    // Common interface of the register allocators.
+    //
+    // The code generator only talks to an allocator through this interface, so
+    // the allocator can be chosen for each function when the compiler is run.
+    // The spill and restore counts are used to compare the allocators.
+    //
+    // A restore may rematerialize its variable rather than load it from a stack slot,
+    // in which case the code generator repeats the constant or address computation.
+    //
+    // At each position the code generator performs the spills, then the register moves and
+    // then the restores. The moves are already in an order which is safe to perform one after
+    // the other (see poParallelCopy). Only an allocator which resolves its copies after
+    // allocation has moves; one which coalesces them beforehand leaves them as copy instructions.
+    //
+
+    class poFlowGraph;
+    class poRegSpill;
+    class poRegRestore;
+    class poRegMove;
+    class poRegLinearIterator;
+    enum class poRegType;
+
+    enum class poRegAllocType
+    {
+        Graph, /* graph coloring, see poRegGraph */
+        Linear /* linear scan, see poRegLinear */
+    };
+
+    class poRegAlloc
+    {
+    public:
+        virtual ~poRegAlloc() {}
+        virtual void setNumRegisters(const int numRegisters) = 0;
+        virtual void setVolatile(const int reg, const bool isVolatile) = 0;
+        virtual void setType(const int reg, const poRegType type) = 0;
+        virtual void allocateRegisters(poFlowGraph& cfg) = 0;
+        virtual int getRegisterByVariable(const int variable, const int pos) const = 0;
+        virtual int getRegisterByVariable(const int variable) const = 0;
+        virtual int getStackSlotByVariable(const int variable) const = 0;
+        virtual int stackSize() const = 0;
+        virtual bool isRegisterSet(const int index) const = 0;
+        virtual bool isVolatile(const int index) const = 0;
+        virtual bool spillAt(const int index, const int element, poRegSpill* spill) const = 0;
+        virtual bool restoreAt(const int index, const int element, poRegRestore* restore) const = 0;
+        virtual bool moveAt(const int /*index*/, const int /*element*/, poRegMove* /*move*/) const { return false; }
+        virtual bool spillsAfterDefinition() const = 0; /* otherwise the spills are performed before the instruction */
+        virtual bool isRematerialized(const int variable) const = 0; /* the definition is dropped, as the value is regenerated at every use */
+        virtual int numSpills() const = 0;
+        virtual int numRestores() const = 0;
+        virtual poRegLinearIterator& iterator() = 0;
+    };
+}
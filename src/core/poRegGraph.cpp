@@ -5,51 +5,120 @@
 #include "poSSA.h"
 #include "poUses.h"
 #include "poPhiWeb.h"
+#include "poDom.h"
+#include "poNLF.h"
 
 #include <assert.h>
+#include <cmath>
+#include <bit>
 
 using namespace po;
 
+constexpr int MAX_LOOP_DEPTH = 8; // deeper loops are weighted the same
+
+//
+// poInterferenceMatrix
+//
+
+void poInterferenceMatrix::resize(const int size)
+{
+    _size = size;
+    const int64_t numBits = int64_t(size) * (size - 1) / 2;
+    _bits.resize(size_t((numBits + 63) / 64), 0);
+}
+
+void poInterferenceMatrix::clear()
+{
+    _size = 0;
+    _bits.clear();
+}
+
 //
 // poInterferenceGraph
 //
 
 void poInterferenceGraph::insert(const poInterferenceGraph_Node& node) {
+    const int id = int(_nodes.size());
+    _variables.insert(std::pair<int, int>(node.name(), id));
     _nodes.push_back(node);
+    _neighbours.push_back(std::vector<int>());
+    _numNeighbours.push_back(0);
+    _interference.resize(id + 1);
+    if (int(_live.size()) * 64 <= id)
+    {
+        _live.push_back(0);
+    }
 
-    // Remove any nodes which are no longer live
-    std::vector<int> toRemove;
-    for (const int id : _liveNodes)
+    // Nodes are inserted in order of their start, so any node which ended before this one is no longer live
+    while (_liveEnds.size() > 0 && _liveEnds.top().first < node.liveStart())
     {
-        const poInterferenceGraph_Node& liveNode = _nodes[id];
-        if (liveNode.liveEnd() < node.liveStart())
-        {
-            toRemove.push_back(id);
-        }
+        const int dead = _liveEnds.top().second;
+        _live[dead / 64] &= ~(uint64_t(1) << (dead % 64));
+        _liveEnds.pop();
     }
 
-    for (const int id : toRemove)
+    // Check for interference with other live variables
+    for (int word = 0; word < int(_live.size()); word++)
     {
-        const auto& it = std::lower_bound(_liveNodes.begin(), _liveNodes.end(), id); // Nodes always in order
-        if (it != _liveNodes.end())
+        uint64_t bits = _live[word];
+        while (bits != 0)
         {
-            _liveNodes.erase(it);
+            addInterference(id, word * 64 + std::countr_zero(bits));
+            bits &= bits - 1;
         }
     }
 
-    // Check for interference with other live variables
-    std::vector<int>& neighbours = _nodes.back().getNeighbours();
-    const int curId = int(_nodes.size()) - 1;
-    for (const int id : _liveNodes)
+    _live[id / 64] |= uint64_t(1) << (id % 64);
+    _liveEnds.push(std::pair<int, int>(node.liveEnd(), id));
+}
+
+void poInterferenceGraph::addInterference(const int u, const int v)
+{
+    if (u == v || _interference.test(u, v))
     {
-        neighbours.push_back(id);
-        poInterferenceGraph_Node& node = _nodes[id];
-        node.getNeighbours().push_back(curId);
+        return;
     }
 
-    // Add current node to live nodes
-    const auto& curIt = std::lower_bound(_liveNodes.begin(), _liveNodes.end(), curId);
-    _liveNodes.insert(curIt, curId); // Invariant: nodes always in order
+    _interference.set(u, v);
+    _neighbours[u].push_back(v);
+    _neighbours[v].push_back(u);
+    _numNeighbours[u]++;
+    _numNeighbours[v]++;
+}
+
+void poInterferenceGraph::removeInterference(const int u, const int v)
+{
+    // The neighbour arrays are only cleaned up by compactNeighbours
+
+    if (u == v || !_interference.test(u, v))
+    {
+        return;
+    }
+
+    _interference.reset(u, v);
+    _numNeighbours[u]--;
+    _numNeighbours[v]--;
+}
+
+void poInterferenceGraph::compactNeighbours()
+{
+    // Drop the removed edges, and the duplicates left by removing and adding an edge again
+
+    std::vector<int> seen(_nodes.size(), -1);
+    for (int u = 0; u < int(_neighbours.size()); u++)
+    {
+        std::vector<int>& neighbours = _neighbours[u];
+        int count = 0;
+        for (const int v : neighbours)
+        {
+            if (_interference.test(u, v) && seen[v] != u)
+            {
+                seen[v] = u;
+                neighbours[count++] = v;
+            }
+        }
+        neighbours.resize(count);
+    }
 }
 
 void poInterferenceGraph::calculateAffinity(const poPhiWeb& web)
@@ -96,9 +165,36 @@ void poInterferenceGraph::calculateAffinity(const poPhiWeb& web)
     }
 }
 
-void poInterferenceGraph::colorGraph(const int numColors, const int numSpills)
+void poInterferenceGraph::addMove(const int dst, const int src)
 {
-    // Aggressive coalescing based on affinities
+    // The copy is the last use of the source, so they can share a register without
+    // interfering. Any longer overlap is a real interference and the copy has to stay.
+
+    if (dst == src)
+    {
+        return;
+    }
+
+    poInterferenceGraph_Node& dstNode = _nodes[dst];
+    poInterferenceGraph_Node& srcNode = _nodes[src];
+    if (srcNode.liveEnd() != dstNode.liveStart())
+    {
+        return;
+    }
+
+    removeInterference(dst, src);
+    _moves.push_back(std::pair<int, int>(dst, src));
+}
+
+void poInterferenceGraph::addCost(const int id, const float cost)
+{
+    _nodes[id].addCost(cost);
+}
+
+void poInterferenceGraph::mergeAffinities()
+{
+    // Aggressive coalescing based on affinities, the phi web is renamed to a single variable
+    // by SSA destruction so these have to be in the same register.
 
     for (int i = 0; i < int(_nodes.size()); i++)
     {
@@ -112,33 +208,21 @@ void poInterferenceGraph::colorGraph(const int numColors, const int numSpills)
                 continue;
             }
 
-            // Merge affinity nodes
-            std::vector<int>& neighbours = node.getNeighbours();
-            for (const int neighbourId : affinityNode.getNeighbours())
+            // Merge affinity nodes, each takes the neighbours of the other
+            for (size_t j = 0; j < _neighbours[affinityId].size(); j++)
             {
-                if (neighbourId == i)
-                {
-                    continue;
-                }
-                
-                // Add neighbour to current node
-                if (std::find(neighbours.begin(), neighbours.end(), neighbourId) == neighbours.end())
+                const int neighbourId = _neighbours[affinityId][j];
+                if (_interference.test(affinityId, neighbourId))
                 {
-                    neighbours.push_back(neighbourId);
+                    addInterference(i, neighbourId);
                 }
             }
-            for (const int neighbourId : neighbours)
+            for (size_t j = 0; j < _neighbours[i].size(); j++)
             {
-                if (neighbourId == affinityId)
-                {
-                    continue;
-                }
-
-                // Add neighbour to current node
-                auto& affinityNeighbours = affinityNode.getNeighbours();
-                if (std::find(affinityNeighbours.begin(), affinityNeighbours.end(), neighbourId) == affinityNeighbours.end())
+                const int neighbourId = _neighbours[i][j];
+                if (_interference.test(i, neighbourId))
                 {
-                    affinityNeighbours.push_back(neighbourId);
+                    addInterference(affinityId, neighbourId);
                 }
             }
 
@@ -147,94 +231,462 @@ void poInterferenceGraph::colorGraph(const int numColors, const int numSpills)
             affinityNode.getMerged().push_back(i);
         }
     }
+}
 
+void poInterferenceGraph::colorGraph(const int numColors, const int numSpills)
+{
+    mergeAffinities();
+    compactNeighbours();
 
-    // Spill if there are not enough colors (this is often called simplification)
+    // Spilled nodes are restored into the last registers, so if anything
+    // spills those can't be handed out and the graph has to be colored again.
 
-    int numSpilled = 0;
-    int colorsToUse = numColors;
-    bool changes = true;
-    while (changes)
+    if (!color(numColors) && numSpills > 0)
     {
-        changes = false;
-        for (int i = 0; i < int(_nodes.size()); i++)
-        {
-            auto& node = _nodes[i];
-            if (node.getNeighbours().size() >= colorsToUse)
-            {
-                removeFromNeighbours(node, i);
+        color(std::max(numColors - numSpills, 0));
+    }
+}
 
-                node.setSpilled(true);
-                node.clearNeightbours();
-                changes = true;
+bool poInterferenceGraph::color(const int numColors)
+{
+    _numColors = numColors;
 
-                for (auto& merge : node.getMerged()) {
-                    auto& mergeNode = _nodes[merge];
+    build();
+    makeWorklist();
 
-                    removeFromNeighbours(mergeNode, merge);
-                    mergeNode.setSpilled(true);
-                    mergeNode.clearNeightbours();
-                }
+    while (_simplifyWorklist.size() > 0 ||
+        _moveWorklist.size() > 0 ||
+        _freezeWorklist.size() > 0 ||
+        _spillWorklist.size() > 0)
+    {
+        if (_simplifyWorklist.size() > 0) { simplify(); }
+        else if (_moveWorklist.size() > 0) { coalesce(); }
+        else if (_freezeWorklist.size() > 0) { freeze(); }
+        else { selectSpill(); }
+    }
+
+    assignColors();
+
+    bool colored = true;
+    for (int i = 0; i < int(_nodes.size()); i++)
+    {
+        const int color = _colors[getAlias(i)];
+        _nodes[i].setColor(color);
+        _nodes[i].setSpilled(color == -1);
+        colored &= color != -1;
+    }
+
+    return colored;
+}
+
+void poInterferenceGraph::build()
+{
+    const int numNodes = int(_nodes.size());
+    _adjacentMatrix.clear();
+    _adjacentMatrix.resize(numNodes);
+    _adjacent.assign(numNodes, std::vector<int>());
+    _degree.assign(numNodes, 0);
+    _alias.assign(numNodes, -1);
+    _colors.assign(numNodes, -1);
+    _costs.assign(numNodes, 0.0f);
+    _spans.assign(numNodes, 0);
+    _states.assign(numNodes, poColorState::Initial);
+    _nodeMoves.assign(numNodes, std::vector<int>());
+    _moveStates.assign(_moves.size(), poMoveState::Worklist);
+    _simplifyWorklist.clear();
+    _freezeWorklist.clear();
+    _spillWorklist.clear();
+    _moveWorklist.clear();
+    _stack.clear();
+
+    // Phi webs start out coalesced into their lowest node
+
+    for (int i = 0; i < numNodes; i++)
+    {
+        if (_alias[i] != -1)
+        {
+            continue;
+        }
 
-                if (numSpilled == 0)
+        std::vector<int> web = { i };
+        for (size_t j = 0; j < web.size(); j++)
+        {
+            for (const int merged : _nodes[web[j]].getMerged())
+            {
+                if (merged != i && _alias[merged] == -1)
                 {
-                    colorsToUse -= numSpills;
+                    _alias[merged] = i;
+                    _states[merged] = poColorState::Coalesced;
+                    web.push_back(merged);
                 }
-                numSpilled++;
             }
         }
     }
 
-    // Greedy coloring algorithm
+    for (int i = 0; i < numNodes; i++)
+    {
+        const poInterferenceGraph_Node& node = _nodes[i];
+        const int u = getAlias(i);
+        _costs[u] += node.cost();
+        _spans[u] += node.liveEnd() - node.liveStart() + 1;
+        for (const int neighbour : _neighbours[i])
+        {
+            addEdge(u, getAlias(neighbour));
+        }
+    }
 
-    for (poInterferenceGraph_Node& node : _nodes)
+    for (int i = 0; i < int(_moves.size()); i++)
     {
-        if (node.spilled())
+        const int u = getAlias(_moves[i].first);
+        const int v = getAlias(_moves[i].second);
+        if (u == v)
         {
+            _moveStates[i] = poMoveState::Coalesced;
             continue;
         }
 
-        if (node.color() != -1)
+        _nodeMoves[u].push_back(i);
+        _nodeMoves[v].push_back(i);
+        _moveWorklist.insert(i);
+    }
+}
+
+void poInterferenceGraph::makeWorklist()
+{
+    for (int i = 0; i < int(_nodes.size()); i++)
+    {
+        if (_states[i] != poColorState::Initial)
         {
             continue;
         }
 
-        std::vector<bool> usedColors(colorsToUse, false);
-        for (const int neighbourId : node.getNeighbours())
+        if (_degree[i] >= _numColors)
+        {
+            setState(i, poColorState::Spill);
+        }
+        else if (moveRelated(i))
+        {
+            setState(i, poColorState::Freeze);
+        }
+        else
         {
-            const int color = _nodes[neighbourId].color();
-            if (color >= 0 && color < colorsToUse)
+            setState(i, poColorState::Simplify);
+        }
+    }
+}
+
+void poInterferenceGraph::simplify()
+{
+    // Take the last node so that select colors the nodes in program order
+
+    const int id = *_simplifyWorklist.rbegin();
+    setState(id, poColorState::Stack);
+    _stack.push_back(id);
+
+    for (const int neighbour : _adjacent[id])
+    {
+        if (_states[neighbour] != poColorState::Stack &&
+            _states[neighbour] != poColorState::Coalesced)
+        {
+            decrementDegree(neighbour);
+        }
+    }
+}
+
+void poInterferenceGraph::coalesce()
+{
+    const int move = *_moveWorklist.begin();
+    _moveWorklist.erase(move);
+
+    const int u = getAlias(_moves[move].first);
+    const int v = getAlias(_moves[move].second);
+    if (u == v)
+    {
+        _moveStates[move] = poMoveState::Coalesced;
+        addWorklist(u);
+    }
+    else if (_adjacentMatrix.test(u, v))
+    {
+        _moveStates[move] = poMoveState::Constrained;
+        addWorklist(u);
+        addWorklist(v);
+    }
+    else if (george(u, v) || briggs(u, v))
+    {
+        _moveStates[move] = poMoveState::Coalesced;
+        combine(u, v);
+        addWorklist(u);
+    }
+    else
+    {
+        _moveStates[move] = poMoveState::Active;
+    }
+}
+
+void poInterferenceGraph::freeze()
+{
+    const int id = *_freezeWorklist.begin();
+    setState(id, poColorState::Simplify);
+    freezeMoves(id);
+}
+
+void poInterferenceGraph::selectSpill()
+{
+    // Prefer nodes which are cheap to spill for the number of neighbours they relieve
+
+    int best = -1;
+    float bestCost = 0.0f;
+    for (const int id : _spillWorklist)
+    {
+        const float cost = _costs[id] / (float(std::max(_spans[id], 1)) * float(std::max(_degree[id], 1)));
+        if (best == -1 || cost < bestCost)
+        {
+            best = id;
+            bestCost = cost;
+        }
+    }
+
+    setState(best, poColorState::Simplify);
+    freezeMoves(best);
+}
+
+void poInterferenceGraph::assignColors()
+{
+    while (_stack.size() > 0)
+    {
+        const int id = _stack.back();
+        _stack.pop_back();
+
+        std::vector<bool> usedColors(_numColors, false);
+        for (const int neighbour : _adjacent[id])
+        {
+            const int color = _colors[getAlias(neighbour)];
+            if (color != -1)
             {
                 usedColors[color] = true;
             }
         }
-        for (int c = 0; c < colorsToUse; c++)
+
+        int color = -1;
+        for (const int move : _nodeMoves[id])
+        {
+            const int partner = getAlias(_moves[move].first) == id ? getAlias(_moves[move].second) : getAlias(_moves[move].first);
+            const int partnerColor = _colors[partner];
+            if (partnerColor != -1 && !usedColors[partnerColor])
+            {
+                color = partnerColor;
+                break;
+            }
+        }
+
+        for (int c = 0; c < _numColors && color == -1; c++)
         {
             if (!usedColors[c])
             {
-                node.setColor(c);
+                color = c;
+            }
+        }
 
-                // Color merged nodes the same
-                for (const int mergedId : node.getMerged())
-                {
-                    _nodes[mergedId].setColor(c);
-                }
+        _colors[id] = color;
+        setState(id, color == -1 ? poColorState::Spilled : poColorState::Colored);
+    }
+}
 
-                break;
+void poInterferenceGraph::addEdge(const int u, const int v)
+{
+    if (u == v || _adjacentMatrix.test(u, v))
+    {
+        return;
+    }
+
+    _adjacentMatrix.set(u, v);
+    _adjacent[u].push_back(v);
+    _adjacent[v].push_back(u);
+    _degree[u]++;
+    _degree[v]++;
+}
+
+void poInterferenceGraph::decrementDegree(const int id)
+{
+    const int degree = _degree[id]--;
+    if (degree != _numColors)
+    {
+        return;
+    }
+
+    enableMoves(id);
+    for (const int neighbour : _adjacent[id])
+    {
+        if (_states[neighbour] != poColorState::Stack &&
+            _states[neighbour] != poColorState::Coalesced)
+        {
+            enableMoves(neighbour);
+        }
+    }
+
+    if (_states[id] == poColorState::Spill)
+    {
+        setState(id, moveRelated(id) ? poColorState::Freeze : poColorState::Simplify);
+    }
+}
+
+void poInterferenceGraph::enableMoves(const int id)
+{
+    for (const int move : _nodeMoves[id])
+    {
+        if (_moveStates[move] == poMoveState::Active)
+        {
+            _moveStates[move] = poMoveState::Worklist;
+            _moveWorklist.insert(move);
+        }
+    }
+}
+
+void poInterferenceGraph::freezeMoves(const int id)
+{
+    for (const int move : _nodeMoves[id])
+    {
+        if (_moveStates[move] != poMoveState::Active &&
+            _moveStates[move] != poMoveState::Worklist)
+        {
+            continue;
+        }
+
+        _moveWorklist.erase(move);
+        _moveStates[move] = poMoveState::Frozen;
+
+        const int u = getAlias(_moves[move].first);
+        const int v = u == getAlias(id) ? getAlias(_moves[move].second) : u;
+        if (_states[v] == poColorState::Freeze &&
+            !moveRelated(v) &&
+            _degree[v] < _numColors)
+        {
+            setState(v, poColorState::Simplify);
+        }
+    }
+}
+
+void poInterferenceGraph::combine(const int u, const int v)
+{
+    setState(v, poColorState::Coalesced);
+    _alias[v] = u;
+    _costs[u] += _costs[v];
+    _spans[u] += _spans[v];
+    _nodeMoves[u].insert(_nodeMoves[u].end(), _nodeMoves[v].begin(), _nodeMoves[v].end());
+    enableMoves(v);
+
+    for (const int neighbour : _adjacent[v])
+    {
+        if (_states[neighbour] == poColorState::Stack ||
+            _states[neighbour] == poColorState::Coalesced)
+        {
+            continue;
+        }
+
+        addEdge(neighbour, u);
+        decrementDegree(neighbour);
+    }
+
+    if (_degree[u] >= _numColors && _states[u] == poColorState::Freeze)
+    {
+        setState(u, poColorState::Spill);
+    }
+}
+
+void poInterferenceGraph::addWorklist(const int id)
+{
+    if (_states[id] == poColorState::Freeze &&
+        !moveRelated(id) &&
+        _degree[id] < _numColors)
+    {
+        setState(id, poColorState::Simplify);
+    }
+}
+
+void poInterferenceGraph::setState(const int id, const poColorState state)
+{
+    switch (_states[id])
+    {
+    case poColorState::Simplify: _simplifyWorklist.erase(id); break;
+    case poColorState::Freeze: _freezeWorklist.erase(id); break;
+    case poColorState::Spill: _spillWorklist.erase(id); break;
+    default: break;
+    }
+
+    _states[id] = state;
+    switch (state)
+    {
+    case poColorState::Simplify: _simplifyWorklist.insert(id); break;
+    case poColorState::Freeze: _freezeWorklist.insert(id); break;
+    case poColorState::Spill: _spillWorklist.insert(id); break;
+    default: break;
+    }
+}
+
+bool poInterferenceGraph::moveRelated(const int id) const
+{
+    for (const int move : _nodeMoves[id])
+    {
+        if (_moveStates[move] == poMoveState::Active ||
+            _moveStates[move] == poMoveState::Worklist)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool poInterferenceGraph::briggs(const int u, const int v) const
+{
+    // The merged node has fewer than K neighbours of significant degree, where the
+    // neighbours shared by both are counted once
+
+    int significant = 0;
+    for (const int id : { u, v })
+    {
+        for (const int neighbour : _adjacent[id])
+        {
+            if (_states[neighbour] != poColorState::Stack &&
+                _states[neighbour] != poColorState::Coalesced &&
+                _degree[neighbour] >= _numColors &&
+                (id == u || !_adjacentMatrix.test(neighbour, u)))
+            {
+                significant++;
             }
         }
     }
+    return significant < _numColors;
+}
+
+bool poInterferenceGraph::george(const int u, const int v) const
+{
+    // Every neighbour of v is either insignificant or already a neighbour of u
+
+    for (const int neighbour : _adjacent[v])
+    {
+        if (_states[neighbour] == poColorState::Stack ||
+            _states[neighbour] == poColorState::Coalesced)
+        {
+            continue;
+        }
+
+        if (_degree[neighbour] >= _numColors &&
+            !_adjacentMatrix.test(neighbour, u))
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-void poInterferenceGraph::removeFromNeighbours(poInterferenceGraph_Node& node, int i)
+int poInterferenceGraph::getAlias(const int id) const
 {
-    const int numNeighbours = int(node.getNeighbours().size());
-    for (int j = 0; j < numNeighbours; j++)
+    int alias = id;
+    while (_states[alias] == poColorState::Coalesced)
     {
-        const int neighbourId = node.getNeighbours()[j];
-        auto& neighbour = _nodes[neighbourId];
-        neighbour.removeNeighbour(i);
+        alias = _alias[alias];
     }
+    return alias;
 }
 
 const int poInterferenceGraph::findNode(const int variable, const int pos) const
@@ -269,6 +721,12 @@ const int poInterferenceGraph::findNode(const int variable, const int pos) const
     return -1;
 }
 
+const int poInterferenceGraph::findVariable(const int variable) const
+{
+    const auto& it = _variables.find(variable);
+    return it != _variables.end() ? it->second : -1;
+}
+
 //
 // poRegGraph
 //
@@ -327,9 +785,24 @@ void poRegGraph::allocateRegisters(poFlowGraph& cfg)
         _colorToRegister.push_back(i);
     }
 
+    // Phis whose variables interfere get copies before the graph is built
+    poSSA_Destruction ssaDestruction;
+    ssaDestruction.isolate(cfg);
+
     poLiveRange liveRange;
     liveRange.compute(cfg);
 
+    poDom dom;
+    dom.compute(cfg);
+    poNLF nlf;
+    nlf.compute(dom);
+
+    std::unordered_map<poBasicBlock*, int> loopDepth;
+    for (int i = dom.start(); i < dom.num(); i++)
+    {
+        loopDepth[dom.get(i).getBasicBlock()] = nlf.getDepth(i);
+    }
+
     int pos = 0;
     poBasicBlock* bb = cfg.getFirst();
     while (bb)
@@ -363,7 +836,7 @@ void poRegGraph::allocateRegisters(poFlowGraph& cfg)
 
                 const int elements = ins.left();
                 const int size = _module.types()[baseType.id()].size();
-                _stackAllocator.allocateSlot(ins.name(), size * elements);
+                _stackColoring.addAlloca(ins.name(), size * elements, baseType.alignment());
                 continue;
             }
 
@@ -377,6 +850,16 @@ void poRegGraph::allocateRegisters(poFlowGraph& cfg)
                     pos,
                     pos + live));
                 break;
+            case TYPE_F32X4:
+            case TYPE_F64X2:
+            case TYPE_I32X4:
+            case TYPE_U8X16:
+                _vectors.insert(ins.name());
+                _sse.insert(poInterferenceGraph_Node(ins.name(),
+                    ins.code() == IR_PHI,
+                    pos,
+                    pos + live));
+                break;
             case TYPE_BOOLEAN:
             case TYPE_I64:
             case TYPE_I32:
@@ -411,6 +894,36 @@ void poRegGraph::allocateRegisters(poFlowGraph& cfg)
         bb = bb->getNext();
     }
 
+    // Weight the definitions and uses by the depth of the loop they are in. A rematerialized
+    // value is never stored, and regenerating it is cheaper than loading it.
+    _remat.analyze(cfg);
+    bb = cfg.getFirst();
+    while (bb)
+    {
+        const float weight = std::pow(10.0f, float(std::min(loopDepth[bb], MAX_LOOP_DEPTH)));
+        const float rematWeight = weight * 0.5f;
+        for (const poInstruction& ins : bb->instructions())
+        {
+            if (!_remat.isRematerializable(ins.name()))
+            {
+                addCost(ins.name(), weight);
+            }
+            if (ins.isSpecialInstruction() || ins.code() == IR_PHI)
+            {
+                continue;
+            }
+
+            if (ins.left() != -1) { addCost(ins.left(), _remat.isRematerializable(ins.left()) ? rematWeight : weight); }
+            if (ins.right() != -1) { addCost(ins.right(), _remat.isRematerializable(ins.right()) ? rematWeight : weight); }
+            if (ins.code() == IR_COPY)
+            {
+                addMove(ins.name(), ins.left());
+            }
+        }
+
+        bb = bb->getNext();
+    }
+
     // Calculate phi webs
     poPhiWeb web;
     web.findPhiWebs(cfg);
@@ -422,12 +935,12 @@ void poRegGraph::allocateRegisters(poFlowGraph& cfg)
     _sse.colorGraph(_maxRegistersUsedByType[int(poRegType::SSE)], 2);
 
     // SSA destruction
-    poSSA_Destruction ssaDestruction;
     ssaDestruction.destruct(cfg);
 
     // Analyze uses
     poUses uses;
     uses.analyze(cfg);
+    _remat.analyze(cfg);
 
     // Generate spills and restores
     generateSpillsAndRestores(_general, uses, poRegType::General);
@@ -437,7 +950,43 @@ void poRegGraph::allocateRegisters(poFlowGraph& cfg)
     gatherUsedRegisters(_general, poRegType::General);
     gatherUsedRegisters(_sse, poRegType::SSE);
 
-    // TODO: We may need to insert copy instructions where there were PHI nodes
+    colorStackSlots();
+}
+
+void poRegGraph::addCost(const int variable, const float cost)
+{
+    const int general = _general.findVariable(variable);
+    if (general != -1)
+    {
+        _general.addCost(general, cost);
+        return;
+    }
+
+    const int sse = _sse.findVariable(variable);
+    if (sse != -1)
+    {
+        _sse.addCost(sse, cost);
+    }
+}
+
+void poRegGraph::addMove(const int dst, const int src)
+{
+    // Only copies within the same register class can be coalesced
+
+    const int generalDst = _general.findVariable(dst);
+    const int generalSrc = _general.findVariable(src);
+    if (generalDst != -1 && generalSrc != -1)
+    {
+        _general.addMove(generalDst, generalSrc);
+        return;
+    }
+
+    const int sseDst = _sse.findVariable(dst);
+    const int sseSrc = _sse.findVariable(src);
+    if (sseDst != -1 && sseSrc != -1)
+    {
+        _sse.addMove(sseDst, sseSrc);
+    }
 }
 
 void poRegGraph::gatherUsedRegisters(const poInterferenceGraph& graph, const poRegType type)
@@ -457,6 +1006,13 @@ void poRegGraph::gatherUsedRegisters(const poInterferenceGraph& graph, const poR
     }
 }
 
+void poRegGraph::colorStackSlots()
+{
+    _stackAllocator = poStackAllocator();
+    _stackColoring.color(_stackAllocator);
+    _stackColoring.rewrite(_spills, _restores);
+}
+
 void poRegGraph::generateSpillsAndRestores(const poInterferenceGraph& graph, const poUses& uses, const poRegType& type)
 {
     int registerOffset = 0;
@@ -476,6 +1032,20 @@ void poRegGraph::generateSpillsAndRestores(const poInterferenceGraph& graph, con
             continue;
         }
 
+        // The registers used to spill and restore are callee saved, so they must be
+        // preserved by the prologue as well
+        _registersSet[reg1] = true;
+        _registersSet[reg2] = true;
+
+        // Constants and stack addresses are regenerated at each use, so they need neither a slot nor a spill
+        const bool isRematerialized = _remat.isRematerializable(node.name()) &&
+            !node.isPhi() &&
+            node.getMerged().size() == 0;
+        if (isRematerialized)
+        {
+            _rematerialized.insert(node.name());
+        }
+
         int slot = -1;
 
         // Merged nodes should share the same slot
@@ -491,9 +1061,16 @@ void poRegGraph::generateSpillsAndRestores(const poInterferenceGraph& graph, con
             }
         }
 
-        if (slot == -1)
+        if (slot == -1 && !isRematerialized)
+        {
+            const int size = _vectors.find(node.name()) != _vectors.end() ? 16 : 8;
+            slot = _stackAllocator.allocateSlot(node.name(), size, size);
+        }
+
+        if (slot != -1)
         {
-            slot = _stackAllocator.allocateSlot(node.name(), 8); // TODO: size based on type
+            _stackColoring.addSpill(node.name(), slot, _vectors.find(node.name()) != _vectors.end() ? 16 : 8);
+            _stackColoring.addRange(slot, node.liveStart(), node.liveEnd());
         }
 
         if (uses.hasUses(node.name()))
@@ -506,22 +1083,17 @@ void poRegGraph::generateSpillsAndRestores(const poInterferenceGraph& graph, con
                     continue; // PHI nodes are handled separately
                 }
 
+                // A spilled result is written to the first register once the left operand is copied into it,
+                // so only the left operand may be restored there
+                const poInstruction& useIns = use.getInstruction();
+                const int reg = useIns.right() == node.name() && useIns.left() != node.name() ? reg2 : reg1;
+
                 const int usePos = use.getRef();
-                const auto& it = _restores.find(usePos);
-                if (it != _restores.end())
-                {
-                    const int reg = reg1;
-                    it->second.push_back(poRegRestore(reg, node.name(), slot));
-                }
-                else
-                {
-                    const int reg = reg2;
-                    _restores[usePos] = std::vector<poRegRestore>{ poRegRestore(reg, node.name(), slot) };
-                }
+                _restores[usePos].push_back(poRegRestore(reg, node.name(), slot, isRematerialized));
             }
         }
 
-        if (node.isPhi())
+        if (node.isPhi() || isRematerialized)
         {
             continue;
         }
@@ -535,7 +1107,7 @@ void poRegGraph::generateSpillsAndRestores(const poInterferenceGraph& graph, con
     }
 }
 
-const bool poRegGraph::spillAt(const int index, const int element, poRegSpill* spill) const
+bool poRegGraph::spillAt(const int index, const int element, poRegSpill* spill) const
 {
     const auto& it = _spills.find(index);
     if (it != _spills.end())
@@ -553,7 +1125,7 @@ const bool poRegGraph::spillAt(const int index, const int element, poRegSpill* s
     return false;
 }
 
-const bool poRegGraph::restoreAt(const int index, const int element, poRegRestore* spill) const
+bool poRegGraph::restoreAt(const int index, const int element, poRegRestore* spill) const
 {
     const auto& it = _restores.find(index);
     if (it != _restores.end())
@@ -571,6 +1143,26 @@ const bool poRegGraph::restoreAt(const int index, const int element, poRegRestor
     return false;
 }
 
+int poRegGraph::numSpills() const
+{
+    int numSpills = 0;
+    for (const auto& spills : _spills)
+    {
+        numSpills += int(spills.second.size());
+    }
+    return numSpills;
+}
+
+int poRegGraph::numRestores() const
+{
+    int numRestores = 0;
+    for (const auto& restores : _restores)
+    {
+        numRestores += int(restores.second.size());
+    }
+    return numRestores;
+}
+
 int poRegGraph::getStackSlotByVariable(const int variable) const
 {
     return _stackAllocator.findSlot(variable);
@@ -1,8 +1,42 @@
 #pragma once
 #include <vector>
+#include <set>
+#include <queue>
+#include <cstdint>
 #include <algorithm>
 #include "poRegLinear.h"
 
+//
+// Graph coloring register allocator based on iterated register coalescing
+// (George and Appel, "Iterated Register Coalescing").
+//
+// Interference is held both as a triangular bit matrix, to test for an edge in constant time,
+// and as an array of neighbours per node to iterate over them. Nodes are inserted in order of
+// the start of their live range, and each interferes with the nodes in a bitset of those still
+// live at that point.
+//
+// Members of a phi web always share a register, so they are merged before coloring starts.
+// Copies are coalesced conservatively, using the Briggs test (the merged node has fewer
+// than K neighbours of significant degree) or the George test (every neighbour of one node
+// already interferes with the other or is of insignificant degree). The worklists of
+// simplify, coalesce, freeze and spill are processed until the graph is empty. Nodes which
+// are spilled are pushed onto the stack optimistically and only become actual spills if no
+// color is left for them in select.
+//
+// The spill cost of a node is the number of definitions and uses, each weighted by 10 to the
+// power of the loop depth from the nested loop forest, divided by the length of the live range.
+// The node with the lowest cost for its degree is chosen to be spilled. Constants and stack
+// addresses are rematerialized at each use when spilled, so their definitions are free and
+// their uses count half.
+//
+// Spilled nodes are given a provisional stack slot each, and the slots of nodes whose live
+// ranges don't overlap are shared once all the spills are placed (see poStackColoring).
+//
+// Colors are mapped onto callee saved registers only, as the volatile registers are used by
+// the code generator for arguments and temporaries. Select prefers the color of a move partner
+// and then the lowest free color, so that few callee saved registers need saving in the prologue.
+//
+
 namespace po
 {
     class poModule;
@@ -13,11 +47,12 @@ namespace po
     {
     public:
         poInterferenceGraph_Node(const int name, const bool isPhi, const int liveStart, const int liveEnd)
-            : _name(name), _isPhi(isPhi), _liveStart(liveStart), _liveEnd(liveEnd), _color(-1), _spilled(false) {
+            : _name(name), _isPhi(isPhi), _liveStart(liveStart), _liveEnd(liveEnd), _color(-1), _spilled(false), _cost(0.0f) {
         }
 
         inline void setSpilled(const bool spilled) { _spilled = spilled; }
         inline void setColor(const int color) { _color = color; }
+        inline void addCost(const float cost) { _cost += cost; }
 
         inline const bool isPhi() const { return _isPhi; }
         inline const bool spilled() const { return _spilled; }
@@ -25,20 +60,11 @@ namespace po
         inline const int name() const { return _name; }
         inline const int liveStart() const { return _liveStart; }
         inline const int liveEnd() const { return _liveEnd; }
-        inline std::vector<int>& getNeighbours() { return _neighbours; }
-        inline const std::vector<int>& getNeighbours() const { return _neighbours; }
+        inline const float cost() const { return _cost; }
         inline std::vector<int>& getAffinities() { return _affinities; }
         inline std::vector<int>& getMerged() { return _merged; }
         inline const std::vector<int>& getMerged() const { return _merged; }
 
-        inline void clearNeightbours() { _neighbours.clear(); }
-        void removeNeighbour(const int id) {
-            const auto& it = std::find(_neighbours.begin(), _neighbours.end(), id);
-            if (it != _neighbours.end()) {
-                _neighbours.erase(it);
-            }
-        }
-
     private:
         bool _spilled;
         bool _isPhi;
@@ -46,27 +72,119 @@ namespace po
         int _name;
         int _liveStart;
         int _liveEnd;
-        std::vector<int> _neighbours;
+        float _cost; /* definitions and uses weighted by loop depth */
         std::vector<int> _affinities;
         std::vector<int> _merged;
     };
 
+    class poInterferenceMatrix
+    {
+    public:
+        poInterferenceMatrix() : _size(0) {}
+        void resize(const int size); /* the rows of new nodes are appended, so existing edges are kept */
+        void clear();
+        inline const int size() const { return _size; }
+        inline const bool test(const int u, const int v) const { const int64_t bit = index(u, v); return (_bits[bit / 64] >> (bit % 64)) & 1; }
+        inline void set(const int u, const int v) { const int64_t bit = index(u, v); _bits[bit / 64] |= uint64_t(1) << (bit % 64); }
+        inline void reset(const int u, const int v) { const int64_t bit = index(u, v); _bits[bit / 64] &= ~(uint64_t(1) << (bit % 64)); }
+
+    private:
+        static inline const int64_t index(const int u, const int v) { return u > v ? int64_t(u) * (u - 1) / 2 + v : int64_t(v) * (v - 1) / 2 + u; }
+
+        int _size;
+        std::vector<uint64_t> _bits; /* lower triangle, without the diagonal */
+    };
+
+    enum class poColorState
+    {
+        Initial,
+        Simplify,
+        Freeze,
+        Spill,
+        Coalesced,
+        Stack,
+        Colored,
+        Spilled
+    };
+
+    enum class poMoveState
+    {
+        Worklist,
+        Active,
+        Coalesced,
+        Constrained,
+        Frozen
+    };
+
     class poInterferenceGraph
     {
     public:
         void insert(const poInterferenceGraph_Node& node);
         void calculateAffinity(const poPhiWeb& web);
+        void addMove(const int dst, const int src);
+        void addCost(const int id, const float cost);
         void colorGraph(const int numColors, const int numSpills);
-        void removeFromNeighbours(po::poInterferenceGraph_Node& node, int i);
         inline const std::vector<poInterferenceGraph_Node>& nodes() const { return _nodes; }
+        inline const int numMoves() const { return int(_moves.size()); }
+        inline const bool interferes(const int u, const int v) const { return u != v && _interference.test(u, v); }
+        inline const int degree(const int id) const { return _numNeighbours[id]; }
         const int findNode(const int variable, const int pos) const;
+        const int findVariable(const int variable) const;
 
     private:
+        void addInterference(const int u, const int v);
+        void removeInterference(const int u, const int v);
+        void compactNeighbours();
+        void mergeAffinities();
+        bool color(const int numColors);
+        void build();
+        void makeWorklist();
+        void simplify();
+        void coalesce();
+        void freeze();
+        void selectSpill();
+        void assignColors();
+        void addEdge(const int u, const int v);
+        void decrementDegree(const int id);
+        void enableMoves(const int id);
+        void freezeMoves(const int id);
+        void combine(const int u, const int v);
+        void addWorklist(const int id);
+        void setState(const int id, const poColorState state);
+        bool moveRelated(const int id) const;
+        bool briggs(const int u, const int v) const;
+        bool george(const int u, const int v) const;
+        int getAlias(const int id) const;
+
         std::vector<poInterferenceGraph_Node> _nodes;
-        std::vector<int> _liveNodes;
+        std::unordered_map<int, int> _variables; /* a mapping from variable -> first node */
+        poInterferenceMatrix _interference;
+        std::vector<std::vector<int>> _neighbours; /* may hold removed edges until compacted */
+        std::vector<int> _numNeighbours;
+        std::vector<uint64_t> _live; /* bitset of the nodes live at the start of the last node inserted */
+        std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> _liveEnds; /* live end -> node */
+        std::vector<std::pair<int, int>> _moves; /* copies between nodes which don't otherwise interfere */
+
+        // Working state of the coloring, indexed by node
+        int _numColors;
+        poInterferenceMatrix _adjacentMatrix;
+        std::vector<std::vector<int>> _adjacent;
+        std::vector<int> _degree;
+        std::vector<int> _alias;
+        std::vector<int> _colors;
+        std::vector<float> _costs;
+        std::vector<int> _spans;
+        std::vector<poColorState> _states;
+        std::vector<std::vector<int>> _nodeMoves;
+        std::vector<poMoveState> _moveStates;
+        std::set<int> _simplifyWorklist;
+        std::set<int> _freezeWorklist;
+        std::set<int> _spillWorklist;
+        std::set<int> _moveWorklist;
+        std::vector<int> _stack;
     };
 
-    class poRegGraph
+    class poRegGraph : public poRegAlloc
     {
     public:
         poRegGraph(poModule& module);
@@ -80,17 +198,24 @@ namespace po
         int getStackSlotByVariable(const int variable) const;
 
         inline int stackSize() const { return _stackAllocator.numSlots(); }
-        inline const bool isRegisterSet(const int index) const { return _registersSet[index]; }
-        inline const bool isVolatile(const int index) const { return _volatile[index]; }
+        inline bool isRegisterSet(const int index) const { return _registersSet[index]; }
+        inline bool isVolatile(const int index) const { return _volatile[index]; }
 
-        const bool spillAt(const int index, const int element, poRegSpill* spill) const;
-        const bool restoreAt(const int index, const int element, poRegRestore* spill) const;
+        bool spillAt(const int index, const int element, poRegSpill* spill) const;
+        bool restoreAt(const int index, const int element, poRegRestore* spill) const;
+        inline bool spillsAfterDefinition() const { return true; }
+        inline bool isRematerialized(const int variable) const { return _rematerialized.find(variable) != _rematerialized.end(); }
+        int numSpills() const;
+        int numRestores() const;
 
         inline poRegLinearIterator& iterator() { return _iterator; }
 
     private:
+        void addCost(const int variable, const float cost);
+        void addMove(const int dst, const int src);
         void generateSpillsAndRestores(const poInterferenceGraph& graph, const poUses& uses, const poRegType& type);
         void gatherUsedRegisters(const poInterferenceGraph& graph, const poRegType type);
+        void colorStackSlots();
 
         int _numRegisters;
         std::vector<bool> _volatile;
@@ -107,5 +232,9 @@ namespace po
         poInterferenceGraph _general;
         poInterferenceGraph _sse;
         poRegLinearIterator _iterator;
+        std::unordered_set<int> _vectors; /* variables which need a 16 byte slot when spilled */
+        std::unordered_set<int> _rematerialized; /* spilled variables which are regenerated at each use */
+        poRemat _remat;
+        poStackColoring _stackColoring;
     };
 }
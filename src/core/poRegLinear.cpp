@@ -7,6 +7,8 @@
 #include "poModule.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <climits>
 
 using namespace po;
 
@@ -21,10 +23,11 @@ poStackAllocator::poStackAllocator()
 {
 }
 
-const int poStackAllocator::allocateSlot(const int variable, const int size)
+const int poStackAllocator::allocateSlot(const int variable, const int size, const int alignment)
 {
     const int remainder = size % 8;
     const int numSlots = (size / 8) + (remainder > 0 ? 1 : 0);
+    const int slotAlignment = alignment > 8 ? alignment / 8 : 1; /* the stack pointer is 16 byte aligned so slots are aligned by index */
 
     // Sliding window algorithm: we start with a window the size of the num slots AAABBAAA
     // where A=free slot B=used slot
@@ -50,7 +53,7 @@ const int poStackAllocator::allocateSlot(const int variable, const int size)
 
         while (end < _numSlots)
         {
-            if (numUsed == 0)
+            if (numUsed == 0 && start % slotAlignment == 0)
             {
                 break;
             }
@@ -63,18 +66,18 @@ const int poStackAllocator::allocateSlot(const int variable, const int size)
             start++;
             end++;
 
-            if (_slots[start])
+            if (_slots[end - 1])
             {
                 numUsed++;
             }
         }
 
-        if (numUsed == 0)
+        if (numUsed == 0 && start % slotAlignment == 0)
         {
             slot = start;
             for (int i = start; i < end; i++)
             {
-                _slots[slot] = true;
+                _slots[i] = true;
             }
             _occupancy.insert(std::pair<int, int>(variable, slot));
         }
@@ -82,6 +85,12 @@ const int poStackAllocator::allocateSlot(const int variable, const int size)
 
     if (slot == -1)
     {
+        while (_numSlots % slotAlignment != 0)
+        {
+            _slots.push_back(false);
+            _numSlots++;
+        }
+
         slot = int(_slots.size());
         for (int i = 0; i < numSlots; i++)
         {
@@ -101,6 +110,15 @@ const void poStackAllocator::freeSlot(const int variable)
         _occupancy.erase(it);
     }
 }
+const void poStackAllocator::shareSlot(const int variable, const int other)
+{
+    const int slot = findSlot(other);
+    if (slot != -1)
+    {
+        _occupancy.insert(std::pair<int, int>(variable, slot));
+    }
+}
+
 const int poStackAllocator::findSlot(const int variable) const
 {
     int index = -1;
@@ -140,45 +158,236 @@ poRegRestore::poRegRestore()
     :
     _restoreRegister(0),
     _restoreVariable(0),
-    _restoreStackSlot(0)
+    _restoreStackSlot(0),
+    _isRematerialized(false)
 {
 }
 
-poRegRestore::poRegRestore(const int restoreRegister, const int restoreVariable, const int restoreStackSlot)
+poRegRestore::poRegRestore(const int restoreRegister, const int restoreVariable, const int restoreStackSlot, const bool isRematerialized)
     :
     _restoreRegister(restoreRegister),
     _restoreVariable(restoreVariable),
-    _restoreStackSlot(restoreStackSlot)
+    _restoreStackSlot(restoreStackSlot),
+    _isRematerialized(isRematerialized)
 {
 }
 
 //
-// poRegLinearEntry
+// poRegLinearInterval
 //
 
-poRegLinearEntry::poRegLinearEntry(const std::vector<int>& variables,
-    const std::vector<bool>& registerUsed,
-    const std::vector<int>& registersUsedByType,
-    const int pos)
+poRegLinearInterval::poRegLinearInterval(const int variable, const poRegType type)
     :
-    _variables(variables),
-    _registerUsed(registerUsed),
-    _registersUsedByType(registersUsedByType),
-    _pos(pos)
+    _variable(variable),
+    _type(type),
+    _reg(-1)
+{
+}
+
+void poRegLinearInterval::addRange(const int from, const int to)
+{
+    // The ranges are added in reverse order, so the last range is the earliest one
+    if (_ranges.size() > 0)
+    {
+        poRegLinearRange& earliest = _ranges.back();
+        if (to + 1 >= earliest.from())
+        {
+            earliest.setFrom(std::min(from, earliest.from()));
+            earliest.setTo(std::max(to, earliest.to()));
+            return;
+        }
+    }
+
+    _ranges.push_back(poRegLinearRange(from, to));
+}
+
+void poRegLinearInterval::setFrom(const int pos)
+{
+    // A definition shortens the range opened for the block, unless the value is never used
+    if (_ranges.size() > 0 &&
+        _ranges.back().from() <= pos &&
+        _ranges.back().to() >= pos)
+    {
+        _ranges.back().setFrom(pos);
+        return;
+    }
+
+    addRange(pos, pos);
+}
+
+void poRegLinearInterval::addUse(const int pos, const bool isDef)
+{
+    _uses.push_back(poRegLinearUse(pos, isDef));
+}
+
+void poRegLinearInterval::finish()
+{
+    std::reverse(_ranges.begin(), _ranges.end());
+    std::sort(_uses.begin(), _uses.end(), [](const poRegLinearUse& a, const poRegLinearUse& b) {
+        return a.pos() < b.pos() || (a.pos() == b.pos() && a.isDef() < b.isDef());
+    });
+    _uses.erase(std::unique(_uses.begin(), _uses.end(), [](const poRegLinearUse& a, const poRegLinearUse& b) {
+        return a.pos() == b.pos() && a.isDef() == b.isDef();
+    }), _uses.end());
+}
+
+bool poRegLinearInterval::covers(const int pos) const
+{
+    const auto& it = std::lower_bound(_ranges.begin(), _ranges.end(), pos, [](const poRegLinearRange& range, const int pos) {
+        return range.to() < pos;
+    });
+    return it != _ranges.end() && it->from() <= pos;
+}
+
+bool poRegLinearInterval::hasDef() const
+{
+    for (const poRegLinearUse& use : _uses)
+    {
+        if (use.isDef())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool poRegLinearInterval::startsWithDef() const
+{
+    // The value is written at the start without being read, so nothing has to be moved into it
+    bool isDef = false;
+    for (const poRegLinearUse& use : _uses)
+    {
+        if (use.pos() != start())
+        {
+            break;
+        }
+
+        if (!use.isDef())
+        {
+            return false;
+        }
+        isDef = true;
+    }
+    return isDef;
+}
+
+int poRegLinearInterval::nextUse(const int pos) const
+{
+    const auto& it = std::lower_bound(_uses.begin(), _uses.end(), pos, [](const poRegLinearUse& use, const int pos) {
+        return use.pos() < pos;
+    });
+    return it != _uses.end() ? it->pos() : INT_MAX;
+}
+
+int poRegLinearInterval::lastUseBefore(const int pos) const
+{
+    for (int i = int(_uses.size()) - 1; i >= 0; i--)
+    {
+        if (_uses[i].pos() < pos)
+        {
+            return _uses[i].pos();
+        }
+    }
+    return -1;
+}
+
+int poRegLinearInterval::nextIntersection(const poRegLinearInterval& other) const
 {
+    size_t i = 0;
+    size_t j = 0;
+    while (i < _ranges.size() && j < other._ranges.size())
+    {
+        const poRegLinearRange& a = _ranges[i];
+        const poRegLinearRange& b = other._ranges[j];
+        if (a.to() < b.from())
+        {
+            i++;
+        }
+        else if (b.to() < a.from())
+        {
+            j++;
+        }
+        else
+        {
+            return std::max(a.from(), b.from());
+        }
+    }
+    return INT_MAX;
 }
 
+void poRegLinearInterval::split(const int pos, poRegLinearInterval& child)
+{
+    // Everything from pos onwards moves to the child
+
+    std::vector<poRegLinearRange> ranges;
+    for (const poRegLinearRange& range : _ranges)
+    {
+        if (range.to() < pos)
+        {
+            ranges.push_back(range);
+        }
+        else if (range.from() < pos)
+        {
+            ranges.push_back(poRegLinearRange(range.from(), pos - 1));
+            child._ranges.push_back(poRegLinearRange(pos, range.to()));
+        }
+        else
+        {
+            child._ranges.push_back(range);
+        }
+    }
+    _ranges = ranges;
 
+    std::vector<poRegLinearUse> uses;
+    for (const poRegLinearUse& use : _uses)
+    {
+        if (use.pos() < pos)
+        {
+            uses.push_back(use);
+        }
+        else
+        {
+            child._uses.push_back(use);
+        }
+    }
+    _uses = uses;
+}
 
 //
 // poRegLinear
 //
 
+static int numArguments(const poInstruction& ins)
+{
+    // These instructions are followed by their arguments
+    switch (ins.code())
+    {
+    case IR_CALL:
+    case IR_COPY_MEMORY:
+    case IR_FILL_MEMORY:
+    case IR_VECTOR_SUM:
+    case IR_VECTOR_MAP:
+    case IR_VECTOR_FIND:
+        return ins.left();
+    }
+    return 0;
+}
+
+static inline bool testBit(const std::vector<uint64_t>& bits, const int index)
+{
+    return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+static inline void setBit(std::vector<uint64_t>& bits, const int index)
+{
+    bits[index / 64] |= uint64_t(1) << (index % 64);
+}
 
 poRegLinear::poRegLinear(poModule& module)
     :
+    _module(module),
     _numRegisters(0),
-    _module(module)
+    _nextName(0)
 {
 }
 
@@ -187,10 +396,7 @@ void poRegLinear::setNumRegisters(const int numRegisters)
     _numRegisters = numRegisters;
     _volatile.resize(_numRegisters);
     _type.resize(_numRegisters);
-    _registerUsed.resize(_numRegisters);
-    _registerExpiry.resize(_numRegisters);
     _registersSet.resize(_numRegisters);
-    _variables.resize(_numRegisters);
 }
 
 void poRegLinear::setVolatile(const int reg, const bool isVolatile)
@@ -213,636 +419,1078 @@ void poRegLinear::setType(const int reg, const poRegType type)
     _type[reg] = type;
 }
 
-void poRegLinear::spillRegisters(const int pos, const poRegType type, const poInstruction& ins, poUses& uses)
+bool poRegLinear::isAllocatable(const int reg, const poRegType type) const
 {
-    // This function looks at the left and right operands of the instruction and spills registers to make room to restore the registers (if they are required).
-    // If the instruction is a variable assignment, it will need to spill a register to make space for the new variable.
-    //
+    return !_volatile[reg] && _type[reg] == type;
+}
 
-    std::vector<int> spillTypes(int(poRegType::MAX), 0);
+int poRegLinear::getOperands(const poInstruction& ins, int operands[2]) const
+{
+    // The variables read by the instruction which live in registers
+    int numOperands = 0;
+    if (ins.isSpecialInstruction() || ins.code() == IR_PHI)
+    {
+        return numOperands;
+    }
 
-    if (ins.left() != -1 && !ins.isSpecialInstruction())
+    const int values[2] = { ins.left(), ins.right() };
+    for (int i = 0; i < 2; i++)
     {
-        const int slot = _stackAlloc.findSlot(ins.left());
-        if (slot != -1 && _stackSlots.find(slot) != _stackSlots.end())
+        if (values[i] == -1 || (i == 1 && values[1] == values[0]))
+        {
+            continue;
+        }
+
+        const auto& it = _variableIndex.find(values[i]);
+        if (it != _variableIndex.end())
         {
-            spillTypes[int(_stackSlots[slot].type())]++;
+            operands[numOperands++] = it->second;
         }
     }
+    return numOperands;
+}
 
-    if (ins.right() != -1 &&
-        ins.left() != ins.right() &&
-        !ins.isSpecialInstruction())
+void poRegLinear::numberInstructions(poFlowGraph& cfg)
+{
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
     {
-        const int slot = _stackAlloc.findSlot(ins.right());
-        if (slot != -1 && _stackSlots.find(slot) != _stackSlots.end())
+        for (const poInstruction& ins : bb->instructions())
         {
-            spillTypes[int(_stackSlots[slot].type())]++;
+            _nextName = std::max(_nextName, ins.name() + 1);
         }
     }
 
-    if (ins.code() != IR_ARG &&
-        ins.code() != IR_CMP)
+    // Blocks without instructions jump to the next one, so every block has a position
+    std::unordered_map<poBasicBlock*, int> blockIndex;
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
     {
-        const int variable = ins.name();
-        const auto& foundRegister = _registerMap.find(variable);
-        const int usedVariable = foundRegister == _registerMap.end() ? -1 : _variables[_registerMap[variable]];
-
-        if (usedVariable != variable)  /* we only need to spill if the variable used is not already in a register */
+        if (bb->numInstructions() == 0 && bb->getNext() && !bb->getBranch())
         {
-            spillTypes[int(type)]++;
+            bb->addInstruction(poInstruction(_nextName++, 0, IR_JUMP_UNCONDITIONAL, -1, IR_BR));
+            bb->setBranch(bb->getNext(), true);
         }
+
+        blockIndex.insert(std::pair<poBasicBlock*, int>(bb, int(_blocks.size())));
+        _blocks.push_back(bb);
     }
 
-    for (size_t j = 0; j < spillTypes.size(); j++)
+    const int numBlocks = int(_blocks.size());
+    _blockFirst.resize(numBlocks);
+    _blockLast.resize(numBlocks);
+    _branch.resize(numBlocks);
+    _fallthrough.resize(numBlocks);
+    for (int i = 0; i < numBlocks; i++)
     {
-        const poRegType type = (poRegType)j;
-        const int numAvailable = _maxRegistersUsedByType[j] - _registersUsedByType[j];
-        const int numToSpill = spillTypes[j] - numAvailable;
-
-        for (int k = 0; k < numToSpill; k++)
+        poBasicBlock* bb = _blocks[i];
+        _blockFirst[i] = int(_instructions.size());
+        for (const poInstruction& ins : bb->instructions())
         {
-            // We need to evict a register; ideally the one which is next used furthest away
+            _instructions.push_back(&ins);
+            _blockOf.push_back(i);
+        }
+        _blockLast[i] = int(_instructions.size()) - 1;
 
-            int variableToSpill = -1;
-            int registerToSpill = -1;
-            int longestDistance = -1;
+        const bool returns = _blockLast[i] >= _blockFirst[i] && _instructions[_blockLast[i]]->code() == IR_RETURN;
+        _branch[i] = bb->getBranch() ? blockIndex[bb->getBranch()] : -1;
+        _fallthrough[i] = bb->getNext() && !bb->unconditionalBranch() && !returns ? i + 1 : -1;
+    }
 
-            for (int i = 0; i < _numRegisters; i++)
+    // A block is in as many loops as there are back edges around it
+    std::vector<int> depth(numBlocks + 1, 0);
+    for (int i = 0; i < numBlocks; i++)
+    {
+        const int successors[2] = { _branch[i], _fallthrough[i] };
+        for (const int successor : successors)
+        {
+            if (successor != -1 && successor <= i)
             {
-                if (_registerUsed[i] && _type[i] == type)
-                {
-                    // Search for the next use
-
-                    const int nextUse = uses.findNextUse(_variables[i], pos);
-                    if (nextUse == -1 || nextUse == pos)
-                    {
-                        // If it is -1 then it MAY be live during a loop, so we opt to not spill it.
-                        // If it is pos, then it is used in this instruction, so we can't spill it.
-                        continue;
-                    }
-
-                    const int distance = nextUse - pos;
-
-                    if (distance > longestDistance)
-                    {
-                        longestDistance = distance;
-                        registerToSpill = i;
-                        variableToSpill = _variables[i];
-                    }
-                }
+                depth[successor]++;
+                depth[i + 1]--;
             }
+        }
+    }
+    _loopDepth.resize(numBlocks);
+    for (int i = 0, loopDepth = 0; i < numBlocks; i++)
+    {
+        loopDepth += depth[i];
+        _loopDepth[i] = loopDepth;
+    }
 
-            if (registerToSpill == -1)
+    // Find the variables which are kept in registers
+    _defs.resize(_instructions.size(), -1);
+    for (int i = 0; i < int(_instructions.size()); i++)
+    {
+        const poInstruction& ins = *_instructions[i];
+        switch (ins.code())
+        {
+        case IR_BR:
+        case IR_ARG:
+        case IR_CMP:
+        case IR_RETURN:
+        case IR_PHI:
+            continue;
+        case IR_ALLOCA:
             {
-                // Fallback: spill any register of the correct type
-                for (int i = 0; i < _numRegisters; i++)
-                {
-                    if (_registerUsed[i] && _type[i] == type)
-                    {
-                        // We can't spill a register we are about to restore
-                        const int nextUse = uses.findNextUse(_variables[i], pos);
-                        if (nextUse == pos)
-                        {
-                            continue;
-                        }
-
-                        registerToSpill = i;
-                        variableToSpill = _variables[i];
-                        break;
-                    }
-                }
-            }
+                const poType& type = _module.types()[ins.type()];
+                assert(type.isPointer() || type.isArray());
 
-            assert(registerToSpill != -1);
-            const poRegType spillType = _type[registerToSpill];
-            _registerUsed[registerToSpill] = false;
-            _registersUsedByType[int(spillType)]--;
+                const poType& baseType = _module.types()[type.baseType()];
 
-            int stackSlot = _stackAlloc.findSlot(variableToSpill);
-            if (stackSlot == -1)
-            {
-                stackSlot = _stackAlloc.allocateSlot(variableToSpill, 8); // FIXME: should be size of type
+                const int elements = ins.left();
+                const int size = _module.types()[baseType.id()].size();
+                _stackColoring.addAlloca(ins.name(), size * elements, baseType.alignment());
             }
-
-            spill(pos, poRegSpill(registerToSpill, variableToSpill, stackSlot));
-            _stackSlots.insert(std::pair<int, poStackSlot>(stackSlot, poStackSlot(spillType, _registerExpiry[registerToSpill])));
+            continue;
+        default:
+            break;
         }
-    }
 
-    if (ins.left() != -1 &&
-        !ins.isSpecialInstruction())
-    {
-        const int slot = _stackAlloc.findSlot(ins.left());
-        if (slot != -1 && _stackSlots.find(slot) != _stackSlots.end())
+        poRegType type = poRegType::General;
+        switch (ins.type())
         {
-            const auto& stackSlot = _stackSlots[slot];
-
-            allocateRegister(pos, stackSlot.type(), stackSlot.live() - pos, ins.left());
-            restore(pos, poRegRestore(
-                _registerMap[ins.left()],
-                ins.left(),
-                slot));
-            _stackSlots.erase(slot);
+        case TYPE_BOOLEAN:
+        case TYPE_I64:
+        case TYPE_I32:
+        case TYPE_I16:
+        case TYPE_I8:
+        case TYPE_U64:
+        case TYPE_U32:
+        case TYPE_U16:
+        case TYPE_U8:
+            type = poRegType::General;
+            break;
+        case TYPE_F64:
+        case TYPE_F32:
+            type = poRegType::SSE;
+            break;
+        case TYPE_F32X4:
+        case TYPE_F64X2:
+        case TYPE_I32X4:
+        case TYPE_U8X16:
+            type = poRegType::SSE;
+            _vectors.insert(ins.name());
+            break;
+        default:
+            if (!_module.types()[ins.type()].isPointer() &&
+                _module.types()[ins.type()].baseType() != TYPE_ENUM)
+            {
+                continue;
+            }
+            type = poRegType::General;
+            break;
         }
-    }
 
-    if (ins.right() != -1 &&
-        ins.left() != ins.right() &&
-        !ins.isSpecialInstruction())
-    {
-        const int slot = _stackAlloc.findSlot(ins.right());
-        if (slot != -1 && _stackSlots.find(slot) != _stackSlots.end())
+        const auto& it = _variableIndex.find(ins.name());
+        if (it != _variableIndex.end())
         {
-            const auto& stackSlot = _stackSlots[slot];
-
-            allocateRegister(pos, stackSlot.type(), stackSlot.live() - pos, ins.right());
-            restore(pos, poRegRestore(
-                _registerMap[ins.right()],
-                ins.right(),
-                slot));
-            _stackSlots.erase(slot);
+            _defs[i] = it->second;
+            continue;
         }
+
+        _defs[i] = int(_variables.size());
+        _variableIndex.insert(std::pair<int, int>(ins.name(), int(_variables.size())));
+        _variables.push_back(ins.name());
+        _variableTypes.push_back(type);
     }
 }
 
-void poRegLinear::balanceRegisters(const int pos, poBasicBlock* bb)
+void poRegLinear::computeLiveness()
 {
-    // We need to look at our basic block successors and see if we have visited them already,
-    // then we need to make sure that the variable stored in registers and stack slots
-    // match what is expected in the successor basic block.
-    //
-    // Example:
-    // Current basic block: [R1=A, R2=B, R3=C] [S1=D]
-    // Successor basic block: [R1=D, R2=B, R3=C] [S1=A]
-    // In this case we need to spill A to a stack slot and restore D from the stack slot.
+    const int numBlocks = int(_blocks.size());
+    const int numWords = (int(_variables.size()) + 63) / 64;
 
-    if (bb->getBranch())
+    std::vector<std::vector<uint64_t>> gen(numBlocks, std::vector<uint64_t>(numWords));
+    std::vector<std::vector<uint64_t>> kill(numBlocks, std::vector<uint64_t>(numWords));
+    for (int i = 0; i < numBlocks; i++)
     {
-        const auto& it = _entries.find(bb->getBranch());
-        if (it == _entries.end())
-        {
-            return;
-        }
-
-        const poRegLinearEntry& entry = it->second;
-
-        // First we need to spill any registers which are not the same as the successor basic block
-        for (int i = 0; i < _numRegisters; i++)
+        int pending = -1;
+        int pendingUntil = -1;
+        for (int j = _blockFirst[i]; j <= _blockLast[i]; j++)
         {
-            // Skip volatile registers.
-            if (_volatile[i])
+            int operands[2];
+            const int numOperands = getOperands(*_instructions[j], operands);
+            for (int k = 0; k < numOperands; k++)
             {
-                continue;
+                if (!testBit(kill[i], operands[k]))
+                {
+                    setBit(gen[i], operands[k]);
+                }
             }
 
-            if (!_registerUsed[i])
+            // The result of a call is written after its arguments have been read
+            const int def = _defs[j];
+            const int numArgs = numArguments(*_instructions[j]);
+            if (def != -1 && numArgs > 0)
             {
-                continue;
+                pending = def;
+                pendingUntil = j + numArgs;
             }
-
-            if (entry.getRegister(i) == _variables[i])
+            else if (def != -1)
             {
-                continue;
+                setBit(kill[i], def);
             }
 
-            // The register is not the same as the one we have in the successor basic block,
-            // so we need to spill it.
-
-            const int variable = _variables[i];
-            int slot = _stackAlloc.findSlot(variable);
-            if (slot == -1)
+            if (pending != -1 && pendingUntil == j)
             {
-                slot = _stackAlloc.allocateSlot(variable, 8);
+                setBit(kill[i], pending);
+                pending = -1;
             }
-            spill(pos, poRegSpill(i, variable, slot));
-            _stackSlots.insert(std::pair<int, poStackSlot>(slot, poStackSlot(_type[i], _registerExpiry[i])));
-            _registerUsed[i] = false;
-            _registersUsedByType[int(_type[i])]--;
         }
+    }
 
-        // Now we need to restore any registers which are not the same as the successor basic block
-        for (int i = 0; i < _numRegisters; i++)
-        {
-            // Skip volatile registers.
-            if (_volatile[i])
-            {
-                continue;
-            }
+    _liveIn.assign(numBlocks, std::vector<uint64_t>(numWords));
+    _liveOut.assign(numBlocks, std::vector<uint64_t>(numWords));
 
-            if (!entry.isUsed(i))
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = numBlocks - 1; i >= 0; i--)
+        {
+            std::vector<uint64_t>& liveOut = _liveOut[i];
+            const int successors[2] = { _branch[i], _fallthrough[i] };
+            for (const int successor : successors)
             {
-                continue;
-            }
+                if (successor == -1)
+                {
+                    continue;
+                }
 
-            if (entry.getRegister(i) == _variables[i])
-            {
-                continue;
+                for (int k = 0; k < numWords; k++)
+                {
+                    liveOut[k] |= _liveIn[successor][k];
+                }
             }
 
-            // Restore the register if it is not already set
-
-            const int variable = entry.getRegister(i);
-            const int slot = getStackSlotByVariable(variable);
-
-            if (slot != -1)
+            for (int k = 0; k < numWords; k++)
             {
-                const poStackSlot& stackSlot = _stackSlots[slot];
-
-                assert(!_registerUsed[i]);
-
-                _registersUsedByType[(int)stackSlot.type()]++;
-                _registerUsed[i] = true;
-                _registersSet[i] = true;
-                _registerExpiry[i] = stackSlot.live();
-                _variables[i] = variable;
-                mapRegister(poRegLinearAssignment(pos, stackSlot.live(), variable, i));
-                _registerMap.insert(std::pair<int, int>(variable, i));
-
-                restore(pos, poRegRestore(
-                    _registerMap[variable],
-                    variable,
-                    slot));
-                _stackSlots.erase(slot);
+                const uint64_t liveIn = gen[i][k] | (liveOut[k] & ~kill[i][k]);
+                if (liveIn != _liveIn[i][k])
+                {
+                    _liveIn[i][k] = liveIn;
+                    changed = true;
+                }
             }
         }
     }
 }
 
-void poRegLinear::repairSpills(poBasicBlock* bb)
+void poRegLinear::buildIntervals()
 {
-    // Examine the next basic block for its predecessors (only check what has already been visited)
-    // and make sure that the registers and stack slots match.
-
-    poBasicBlock* next = bb->getNext();
-    if (!next)
+    for (int i = 0; i < int(_variables.size()); i++)
     {
-        return;
+        _intervals.push_back(poRegLinearInterval(i, _variableTypes[i]));
     }
 
-    std::vector<poBasicBlock*> preds = next->getIncoming();
-    preds.push_back(bb);
-
-    // First we need to gather all the stack slots which are live in the predecessor basic blocks
-
-    for (poBasicBlock* bb : next->getIncoming())
+    // The blocks and instructions are visited backwards, opening a range at each use and closing it at the definition
+    for (int i = int(_blocks.size()) - 1; i >= 0; i--)
     {
-        const auto& it = _exits.find(bb);
-        if (it == _exits.end())
+        if (_blockLast[i] < _blockFirst[i])
         {
             continue;
         }
 
-        for (const auto& slot : it->second.stackSlots())
+        const int from = 2 * _blockFirst[i];
+        const int to = 2 * _blockLast[i] + 1;
+        for (int k = 0; k < int(_variables.size()); k++)
         {
-            if (_stackSlots.find(slot.first) != _stackSlots.end())
+            if (testBit(_liveOut[i], k))
             {
-                continue;
+                _intervals[k].addRange(from, to);
             }
-            _stackSlots.insert(slot);
-        }
-    }
-
-    for (poBasicBlock* pred : preds)
-    {
-        poBasicBlock* next = pred->getNext();
-
-        const auto& it = _entries.find(next);
-        if (it == _entries.end())
-        {
-            continue;
         }
 
-        const auto& it2 = _exits.find(pred);
-        if (it2 == _exits.end())
+        for (int j = _blockLast[i]; j >= _blockFirst[i]; j--)
         {
-            continue;
-        }
-
-        const poRegLinearEntry& entry = it->second;
-        poRegLinearExit& exit = it2->second;
-        for (int i = 0; i < _numRegisters; i++)
-        {
-            // Skip volatile registers.
-            if (_volatile[i])
-            {
-                continue;
-            }
-            if (!entry.isUsed(i))
+            const poInstruction& ins = *_instructions[j];
+            const int def = _defs[j];
+            if (def != -1)
             {
-                continue;
-            }
+                poRegLinearInterval& interval = _intervals[def];
+                const int numArgs = numArguments(ins);
+                if (numArgs > 0)
+                {
+                    // The result is written after the arguments, so it keeps one register from the call until then
+                    bool isArgument = false;
+                    for (int k = 1; k <= numArgs; k++)
+                    {
+                        int operands[2];
+                        const int numOperands = getOperands(*_instructions[j + k], operands);
+                        isArgument = isArgument || (numOperands > 0 && operands[0] == def);
+                        interval.addUse(2 * (j + k), false);
+                    }
 
-            const int variable = entry.getRegister(i);
-            int slot = getStackSlotByVariable(variable);
-            if (slot == -1)
-            {
-                slot = _stackAlloc.allocateSlot(variable, 8);
+                    interval.addRange(from, 2 * (j + numArgs));
+                    if (!isArgument)
+                    {
+                        interval.setFrom(2 * j);
+                    }
+                    interval.addUse(2 * j, true);
+                }
+                else
+                {
+                    const int pos = ins.code() == IR_COPY ? 2 * j + 1 : 2 * j;
+                    interval.setFrom(pos);
+                    interval.addUse(pos, true);
+                }
             }
 
-            if (exit.stackSlots().find(slot) == exit.stackSlots().end() &&
-                _stackSlots.find(slot) != _stackSlots.end())
+            int operands[2];
+            const int numOperands = getOperands(ins, operands);
+            for (int k = 0; k < numOperands; k++)
             {
-                spill(entry.position() - 1, poRegSpill(i, variable, slot));
-                exit.addStackSlot(slot, poStackSlot(_type[i], _registerExpiry[i]));
-
-                // TODO: we may need to remove the register assignment
+                _intervals[operands[k]].addRange(from, 2 * j);
+                _intervals[operands[k]].addUse(2 * j, false);
             }
         }
     }
+
+    for (poRegLinearInterval& interval : _intervals)
+    {
+        interval.finish();
+    }
 }
 
-void poRegLinear::spill(const int pos, const poRegSpill& spill)
+int poRegLinear::findPinnedEnd(const int interval) const
 {
-    const auto& it = _spills.find(pos);
-    if (it != _spills.end())
+    // The result of a call can't move to another register before it has been written
+    const poRegLinearInterval& it = _intervals[interval];
+    if (it.start() % 2 == 1)
     {
-        _spills[pos].push_back(spill);
+        return -1;
     }
-    else
+
+    const int index = it.start() / 2;
+    const int numArgs = numArguments(*_instructions[index]);
+    if (numArgs == 0 || _defs[index] != it.variable())
     {
-        _spills.insert(std::pair<int, std::vector<poRegSpill>>(pos, std::vector<poRegSpill>(1, spill)));
+        return -1;
     }
+    return 2 * (index + numArgs);
 }
 
-void poRegLinear::restore(const int pos, const poRegRestore& restore)
+int poRegLinear::splitInterval(const int interval, const int pos)
 {
-    const auto& it = _restores.find(pos);
-    if (it != _restores.end())
-    {
-        _restores[pos].push_back(restore);
-    }
-    else
+    poRegLinearInterval child(_intervals[interval].variable(), _intervals[interval].type());
+    _intervals[interval].split(pos, child);
+    if (child.isEmpty())
     {
-        _restores.insert(std::pair<int, std::vector<poRegRestore>>(pos, std::vector<poRegRestore>(1, restore)));
+        return -1;
     }
+
+    _intervals.push_back(child);
+    return int(_intervals.size()) - 1;
 }
 
-void poRegLinear::mapRegister(const poRegLinearAssignment& assignment)
+int poRegLinear::findSplitPosition(const int minPos, const int maxPos) const
 {
-    const auto& it = _registers.find(assignment.variable());
-    if (it != _registers.end())
+    // Moves are only made before an instruction, so the position is even. Out of the
+    // allowed range, the split is made at the end of the block with the lowest loop depth.
+
+    const int first = (minPos + 1) & ~1;
+    const int last = maxPos & ~1;
+    if (first > last)
     {
-        it->second.push_back(assignment);
+        return -1;
     }
-    else
+
+    const int minBlock = _blockOf[first / 2];
+    const int maxBlock = _blockOf[last / 2];
+    int pos = last;
+    int depth = _loopDepth[maxBlock];
+    for (int i = maxBlock - 1; i >= minBlock; i--)
+    {
+        if (_loopDepth[i] < depth)
+        {
+            depth = _loopDepth[i];
+            pos = 2 * _blockFirst[i + 1];
+        }
+    }
+    return pos;
+}
+
+void poRegLinear::spillUntilUse(const int interval, const int minPos)
+{
+    // The interval lives on the stack until it is next used, when the rest of it is reloaded
+
+    const poRegLinearInterval& it = _intervals[interval];
+    const int use = it.nextUse(it.start());
+    if (use == INT_MAX)
+    {
+        return;
+    }
+
+    if (use <= it.start())
     {
-        _registers.insert(std::pair<int, std::vector<poRegLinearAssignment>>(assignment.variable(), std::vector<poRegLinearAssignment>(1, assignment)));
+        _unhandled.push(std::pair<int, int>(it.start(), interval));
+        return;
+    }
+
+    // A copy redefines the variable without reading it, so nothing is reloaded
+    const int pos = use % 2 == 1 ? use : findSplitPosition(std::max(it.start() + 1, minPos), use);
+    assert(pos != -1);
+
+    const int child = splitInterval(interval, pos);
+    if (child != -1)
+    {
+        _unhandled.push(std::pair<int, int>(_intervals[child].start(), child));
     }
 }
 
-void poRegLinear::freeRegisters(const int pos)
+void poRegLinear::evictInterval(const int interval, const int pos, const bool isActive)
 {
-    // Free any registers which are no longer live
-    
+    if (!isActive)
+    {
+        // The position is in a lifetime hole, so the interval is split there
+        const int child = splitInterval(interval, pos);
+        if (child != -1)
+        {
+            spillUntilUse(child, pos + 1);
+        }
+        return;
+    }
+
+    const poRegLinearInterval& it = _intervals[interval];
+    const int minPos = std::max(it.lastUseBefore(pos) + 1, it.start() + 1);
+    const int splitPos = minPos > pos ? -1 : findSplitPosition(minPos, pos);
+    if (splitPos == -1)
+    {
+        // Nothing of the interval comes before the position, so all of it goes to the stack
+        _intervals[interval].setReg(-1);
+        spillUntilUse(interval, pos + 1);
+        return;
+    }
+
+    const int child = splitInterval(interval, splitPos);
+    if (child != -1)
+    {
+        spillUntilUse(child, pos + 1);
+    }
+}
+
+bool poRegLinear::tryAllocateFreeRegister(const int current)
+{
+    const poRegLinearInterval& interval = _intervals[current];
+
+    std::vector<int> freeUntil(_numRegisters, 0);
     for (int i = 0; i < _numRegisters; i++)
     {
-        // Skip volatile registers.
-        if (_volatile[i])
+        if (isAllocatable(i, interval.type()))
         {
-            continue;
+            freeUntil[i] = INT_MAX;
         }
+    }
+
+    for (const int active : _active)
+    {
+        freeUntil[_intervals[active].reg()] = 0;
+    }
 
-        // Check if the live range has expired
-        if (_registerUsed[i] && _registerExpiry[i] < pos)
+    for (const int inactive : _inactive)
+    {
+        const int reg = _intervals[inactive].reg();
+        if (freeUntil[reg] > 0)
         {
-            _registerUsed[i] = false;
-            _registersUsedByType[(int)_type[i]]--;
-            // TODO: can possibly free up a stack slot if used? not sure if it is safe if a pointer is taken to it for instance, or worthwhile?
+            freeUntil[reg] = std::min(freeUntil[reg], interval.nextIntersection(_intervals[inactive]));
         }
     }
-}
 
-void poRegLinear::freeStackSlots(const int pos)
-{
-    // Free any stack slots which are no longer live
+    // Prefer the register of the previous part of the variable, or of the source of a copy which ends here
+    int hint = -1;
+    const int last = _lastInterval[interval.variable()];
+    if (last != -1)
+    {
+        hint = _intervals[last].reg();
+    }
+    if (interval.start() % 2 == 1)
+    {
+        const auto& source = _variableIndex.find(_instructions[interval.start() / 2]->left());
+        if (source != _variableIndex.end() &&
+            _lastInterval[source->second] != -1 &&
+            _intervals[_lastInterval[source->second]].reg() != -1)
+        {
+            hint = _intervals[_lastInterval[source->second]].reg();
+        }
+    }
+
+    int reg = -1;
+    if (hint != -1 && freeUntil[hint] > interval.end())
+    {
+        reg = hint;
+    }
+    else
+    {
+        // Registers which are already saved by the prologue cost nothing more
+        for (int i = 0; i < _numRegisters; i++)
+        {
+            if (freeUntil[i] > interval.end() &&
+                (reg == -1 || (_registersSet[i] && !_registersSet[reg])))
+            {
+                reg = i;
+            }
+        }
+    }
+
+    if (reg != -1)
+    {
+        _intervals[current].setReg(reg);
+        return true;
+    }
 
-    std::vector<int> toFree;
-    for (const auto& slot : _stackSlots)
+    // No register is free for all of the interval, so use the one which is free the longest for its first part
+    for (int i = 0; i < _numRegisters; i++)
     {
-        if (slot.second.live() < pos)
+        if (freeUntil[i] > 0 &&
+            (reg == -1 || freeUntil[i] > freeUntil[reg] || (i == hint && freeUntil[i] == freeUntil[reg])))
         {
-            toFree.push_back(slot.first);
+            reg = i;
         }
     }
 
-    for (const int slot : toFree)
+    if (reg == -1 ||
+        interval.nextUse(interval.start()) >= freeUntil[reg] ||
+        findPinnedEnd(current) >= freeUntil[reg])
+    {
+        return false;
+    }
+
+    const int pos = findSplitPosition(interval.start() + 1, freeUntil[reg]);
+    if (pos == -1)
     {
-        _stackSlots.erase(slot);
+        return false;
     }
+
+    const int child = splitInterval(current, pos);
+    if (child != -1)
+    {
+        _unhandled.push(std::pair<int, int>(_intervals[child].start(), child));
+    }
+
+    _intervals[current].setReg(reg);
+    return true;
 }
 
-void poRegLinear::allocateRegister(const int pos, const poRegType type, const int live, const int variable)
+void poRegLinear::allocateBlockedRegister(const int current)
 {
-    // If the variable already exists, extend the live range
-    const auto& foundRegister = _registerMap.find(variable);
-    if (foundRegister != _registerMap.end() &&
-        (!_registerUsed[foundRegister->second] || _variables[foundRegister->second] == variable))
+    // A copy can take a register from an interval which ends before it, so registers are taken at the instruction's even position
+
+    const poRegLinearInterval& interval = _intervals[current];
+    const int position = interval.start() & ~1;
+
+    std::vector<int> usePos(_numRegisters, -1);
+    for (int i = 0; i < _numRegisters; i++)
     {
-        if (!_registerUsed[foundRegister->second])
+        if (isAllocatable(i, interval.type()))
         {
-            assert(_registersSet[foundRegister->second]);
-            _registerUsed[foundRegister->second] = true;
-            _variables[foundRegister->second] = variable;
-            _registersUsedByType[(int)type]++;
+            usePos[i] = INT_MAX;
+        }
+    }
+
+    for (const int active : _active)
+    {
+        const int reg = _intervals[active].reg();
+        usePos[reg] = std::min(usePos[reg], _intervals[active].nextUse(position));
+    }
+
+    for (const int inactive : _inactive)
+    {
+        const int reg = _intervals[inactive].reg();
+        if (interval.nextIntersection(_intervals[inactive]) != INT_MAX)
+        {
+            usePos[reg] = std::min(usePos[reg], _intervals[inactive].nextUse(position));
         }
-        _registerExpiry[foundRegister->second] = std::max(
-            _registerExpiry[foundRegister->second],
-            pos + live);
-        mapRegister(poRegLinearAssignment(pos, pos + live, variable, foundRegister->second));
-        return;
     }
 
-    bool allocated = false;
+    int reg = -1;
     for (int i = 0; i < _numRegisters; i++)
     {
-        // Do not attempt to use volatile registers.
-        if (_volatile[i])
+        if (usePos[i] >= 0 && (reg == -1 || usePos[i] > usePos[reg]))
         {
-            continue;
+            reg = i;
         }
+    }
+
+    if (reg == -1)
+    {
+        abort();
+    }
+
+    const int firstUse = interval.nextUse(interval.start());
+    if (firstUse > interval.start() && firstUse > usePos[reg])
+    {
+        // Every register is needed before the interval is, so it waits on the stack
+        _intervals[current].setReg(-1);
+        spillUntilUse(current, interval.start() + 1);
+        return;
+    }
+
+    if (usePos[reg] <= position)
+    {
+        // More values are needed at once than there are registers
+        abort();
+    }
+
+    _intervals[current].setReg(reg);
 
-        // Check for the correct register type.
-        if (_type[i] != type)
+    // The intervals holding the register are split, and the parts which overlap go to the stack
+
+    const std::vector<int> active = _active;
+    _active.clear();
+    for (const int it : active)
+    {
+        if (_intervals[it].reg() == reg)
         {
-            continue;
+            evictInterval(it, position, true);
         }
+        else
+        {
+            _active.push_back(it);
+        }
+    }
 
-        // Use the register if it is available.
-        if (!_registerUsed[i])
+    const std::vector<int> inactive = _inactive;
+    _inactive.clear();
+    for (const int it : inactive)
+    {
+        if (_intervals[it].reg() == reg &&
+            _intervals[current].nextIntersection(_intervals[it]) != INT_MAX)
         {
-            _registersUsedByType[(int)type]++;
-            _registerUsed[i] = true;
-            _registersSet[i] = true;
-            _registerExpiry[i] = pos + live;
-            _variables[i] = variable;
-            mapRegister(poRegLinearAssignment(pos, pos + live, variable, i));
+            evictInterval(it, position, false);
+        }
+        else
+        {
+            _inactive.push_back(it);
+        }
+    }
+}
 
-            if (foundRegister != _registerMap.end())
+void poRegLinear::walkIntervals()
+{
+    _lastInterval.assign(_variables.size(), -1);
+    for (int i = 0; i < int(_intervals.size()); i++)
+    {
+        if (!_intervals[i].isEmpty())
+        {
+            _unhandled.push(std::pair<int, int>(_intervals[i].start(), i));
+        }
+    }
+
+    while (!_unhandled.empty())
+    {
+        const int current = _unhandled.top().second;
+        const int position = _unhandled.top().first;
+        _unhandled.pop();
+
+        // Intervals which have ended are handled, and those in a lifetime hole are inactive
+
+        for (size_t i = 0; i < _active.size();)
+        {
+            const poRegLinearInterval& it = _intervals[_active[i]];
+            if (it.end() < position)
+            {
+                _active.erase(_active.begin() + i);
+            }
+            else if (!it.covers(position))
             {
-                _registerMap.erase(foundRegister);
+                _inactive.push_back(_active[i]);
+                _active.erase(_active.begin() + i);
             }
-            _registerMap.insert(std::pair<int, int>(variable, i));
-            allocated = true;
+            else
+            {
+                i++;
+            }
+        }
 
-            const int slot = _stackAlloc.findSlot(variable);
-            if (slot != -1)
+        for (size_t i = 0; i < _inactive.size();)
+        {
+            const poRegLinearInterval& it = _intervals[_inactive[i]];
+            if (it.end() < position)
             {
-                _stackSlots.erase(slot);
+                _inactive.erase(_inactive.begin() + i);
             }
+            else if (it.covers(position))
+            {
+                _active.push_back(_inactive[i]);
+                _inactive.erase(_inactive.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
 
-            break;
+        if (!tryAllocateFreeRegister(current))
+        {
+            allocateBlockedRegister(current);
         }
+
+        const poRegLinearInterval& interval = _intervals[current];
+        if (interval.reg() != -1)
+        {
+            _active.push_back(current);
+            _registersSet[interval.reg()] = true;
+        }
+        _lastInterval[interval.variable()] = current;
     }
+}
 
-    if (!allocated)
+int poRegLinear::findInterval(const int variable, const int pos) const
+{
+    // The last part of the variable starting at or before the position
+    const std::vector<int>& children = _children[variable];
+    const auto& it = std::upper_bound(children.begin(), children.end(), pos, [this](const int pos, const int child) {
+        return pos < _intervals[child].start();
+    });
+    return it == children.begin() ? -1 : *(it - 1);
+}
+
+void poRegLinear::addMove(std::vector<poRegLinearMove>& moves, const int variable, const int from, const int to)
+{
+    // Moves of the same variable at the same position are joined into one
+    for (poRegLinearMove& move : moves)
     {
-        abort();
+        if (move.variable() != variable)
+        {
+            continue;
+        }
+
+        if (move.to() == from)
+        {
+            move.setTo(to);
+            return;
+        }
+        if (move.from() == to)
+        {
+            move.setFrom(from);
+            return;
+        }
     }
+
+    moves.push_back(poRegLinearMove(variable, from, to));
 }
 
-void poRegLinear::allocateRegisters(poFlowGraph& cfg)
+void poRegLinear::insertEdgeBlock(poFlowGraph& cfg, const int pred, const int succ, const bool isBranch, const std::vector<poRegLinearMove>& moves)
 {
-    // Compute live range.
-    poLiveRange liveRange;
-    liveRange.compute(cfg);
+    // The edge is critical, so the moves go in a block of their own which jumps to the successor
 
-    // Perform SSA destruction
-    poSSA_Destruction ssa;
-    ssa.destruct(cfg);
+    poBasicBlock* from = _blocks[pred];
+    poBasicBlock* to = _blocks[succ];
+    poBasicBlock* edge = new poBasicBlock();
+    edge->addInstruction(poInstruction(_nextName++, 0, IR_JUMP_UNCONDITIONAL, -1, IR_BR));
+    edge->setBranch(to, true);
 
-    // Compute uses.
-    poUses uses;
-    uses.analyze(cfg);
+    if (isBranch)
+    {
+        from->setBranch(edge, from->unconditionalBranch());
+        cfg.addBasicBlock(edge);
+    }
+    else
+    {
+        cfg.insertBasicBlock(from, edge);
+    }
+
+    to->removeIncoming(from);
+    if (from->getBranch() == to ||
+        (from->getNext() == to && !from->unconditionalBranch()))
+    {
+        to->addIncoming(from);
+    }
+    to->addIncoming(edge);
+    edge->addIncoming(from);
 
-    // Setup
-    _registersUsedByType.resize(int(poRegType::MAX));
-    _maxRegistersUsedByType.resize(int(poRegType::MAX));
+    _edgeMoves.insert(std::pair<poBasicBlock*, std::vector<poRegLinearMove>>(edge, moves));
+}
 
-    for (int i = 0; i < _numRegisters; i++)
+void poRegLinear::resolveDataFlow(poFlowGraph& cfg)
+{
+    _children.resize(_variables.size());
+    for (int i = 0; i < int(_intervals.size()); i++)
     {
-        if (_volatile[i])
+        if (!_intervals[i].isEmpty())
         {
-            continue;
+            _children[_intervals[i].variable()].push_back(i);
         }
-
-        _maxRegistersUsedByType[int(_type[i])]++;
     }
 
-    // Allocate the registers
-    int pos = 0;
-    poBasicBlock* bb = cfg.getFirst();
-    while (bb)
+    for (std::vector<int>& children : _children)
     {
-        _entries.insert(std::pair<poBasicBlock*, poRegLinearEntry>(
-            bb,
-            poRegLinearEntry(_variables, _registerUsed, _registersUsedByType, pos)));
+        std::sort(children.begin(), children.end(), [this](const int a, const int b) {
+            return _intervals[a].start() < _intervals[b].start();
+        });
+    }
+
+    // Moves between the parts of a variable which was split inside a block. A part which is
+    // reloaded, or moved from a part whose slot was up to date, and never redefined before the
+    // end of its block leaves the stack slot up to date.
 
-        auto& instructions = bb->instructions();
-        for (int i = 0; i < int(instructions.size()); i++)
+    _clean.resize(_intervals.size(), false);
+    for (int i = 0; i < int(_children.size()); i++)
+    {
+        const std::vector<int>& children = _children[i];
+        for (int j = 1; j < int(children.size()); j++)
         {
-            const poInstruction& ins = instructions[i];
-            const int live = liveRange.getLiveRange(pos);
+            const poRegLinearInterval& from = _intervals[children[j - 1]];
+            const poRegLinearInterval& to = _intervals[children[j]];
+            const int block = _blockOf[to.start() / 2];
+            if (to.start() == 2 * _blockFirst[block] || to.startsWithDef())
+            {
+                continue;
+            }
+
+            addMove(_moves[to.start() / 2], i, children[j - 1], children[j]);
+            _clean[children[j]] = !to.hasDef() &&
+                to.end() <= 2 * _blockLast[block] + 1 &&
+                (from.reg() == -1 || _clean[children[j - 1]]);
+        }
+    }
+
+    // Moves on the edges between blocks, where the location of a variable differs at the end of
+    // the predecessor and the start of the successor. The entry block is also entered from the caller.
 
-            freeRegisters(pos);
-            freeStackSlots(pos);
+    const int numBlocks = int(_blocks.size());
+    std::vector<int> numIncoming(numBlocks, 0);
+    numIncoming[0]++;
+    for (int i = 0; i < numBlocks; i++)
+    {
+        if (_branch[i] != -1) { numIncoming[_branch[i]]++; }
+        if (_fallthrough[i] != -1) { numIncoming[_fallthrough[i]]++; }
+    }
 
-            switch (ins.code())
+    for (int i = 0; i < numBlocks; i++)
+    {
+        const int successors[2] = { _branch[i], _fallthrough[i] };
+        const int numSuccessors = (successors[0] != -1) + (successors[1] != -1);
+        for (int j = 0; j < 2; j++)
+        {
+            const int successor = successors[j];
+            if (successor == -1)
             {
-            case IR_BR:
-                balanceRegisters(pos, bb);
-                pos++;
-                continue;
-            case IR_ARG:
-            case IR_CMP:
-                spillRegisters(pos, poRegType::General, ins, uses);
-                pos++;
-                continue;
-            case IR_RETURN:
-                pos++;
                 continue;
-            default:
-                break;
             }
 
-            if (ins.code() == IR_ALLOCA)
+            std::vector<poRegLinearMove> moves;
+            for (int k = 0; k < int(_variables.size()); k++)
             {
-                pos++;
+                if (!testBit(_liveIn[successor], k))
+                {
+                    continue;
+                }
 
-                const poType& type = _module.types()[ins.type()];
-                assert(type.isPointer() || type.isArray());
+                const int from = findInterval(k, 2 * _blockLast[i] + 1);
+                const int to = findInterval(k, 2 * _blockFirst[successor]);
+                if (from == -1 || to == -1 || _intervals[from].reg() == _intervals[to].reg())
+                {
+                    continue;
+                }
 
-                const poType& baseType = _module.types()[type.baseType()];
+                moves.push_back(poRegLinearMove(k, from, to));
+            }
 
-                const int elements = ins.left();
-                const int size = _module.types()[baseType.id()].size();
-                _stackAlloc.allocateSlot(ins.name(), size * elements);
+            if (moves.size() == 0)
+            {
                 continue;
             }
 
-            const int type_ = ins.type();
-            poRegType type;
-            switch (type_)
-            {
-            case TYPE_BOOLEAN:
-            case TYPE_I64:
-            case TYPE_I32:
-            case TYPE_I16:
-            case TYPE_I8:
-            case TYPE_U64:
-            case TYPE_U32:
-            case TYPE_U16:
-            case TYPE_U8:
-                type = poRegType::General;
-                break;
-            case TYPE_F64:
-            case TYPE_F32:
-                type = poRegType::SSE;
-                break;
-            default:
-                if (!_module.types()[type_].isPointer())
+            if (numSuccessors == 1 && _instructions[_blockLast[i]]->code() == IR_BR)
+            {
+                for (const poRegLinearMove& move : moves)
                 {
-                    pos++;
-                    continue;
+                    addMove(_moves[_blockLast[i]], move.variable(), move.from(), move.to());
+                }
+            }
+            else if (numIncoming[successor] == 1)
+            {
+                for (const poRegLinearMove& move : moves)
+                {
+                    addMove(_moves[_blockFirst[successor]], move.variable(), move.from(), move.to());
                 }
-                type = poRegType::General;
-                break;
             }
+            else
+            {
+                insertEdgeBlock(cfg, i, successor, j == 0, moves);
+            }
+        }
+    }
+
+    // Number the instructions as the code generator will see them, with the inserted branches
+
+    std::unordered_map<poBasicBlock*, int> blockIndex;
+    for (int i = 0; i < numBlocks; i++)
+    {
+        blockIndex.insert(std::pair<poBasicBlock*, int>(_blocks[i], i));
+    }
+
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        const auto& edge = _edgeMoves.find(bb);
+        if (edge != _edgeMoves.end())
+        {
+            emitMoves(int(_positions.size()), edge->second);
+            _positions.push_back(-1);
+            continue;
+        }
+
+        const int block = blockIndex[bb];
+        for (int i = _blockFirst[block]; i <= _blockLast[block]; i++)
+        {
+            const auto& moves = _moves.find(i);
+            if (moves != _moves.end())
+            {
+                emitMoves(int(_positions.size()), moves->second);
+            }
+            _positions.push_back(i);
+        }
+    }
+}
+
+void poRegLinear::emitMoves(const int pos, const std::vector<poRegLinearMove>& moves)
+{
+    // Moves between registers are kept in registers, anything else goes through the stack slot
+
+    poParallelCopy copy;
+    for (const poRegLinearMove& move : moves)
+    {
+        const poRegLinearInterval& from = _intervals[move.from()];
+        const poRegLinearInterval& to = _intervals[move.to()];
+        if (from.reg() == to.reg())
+        {
+            continue;
+        }
 
-            spillRegisters(pos, type, ins, uses);
-            allocateRegister(pos, type, live, ins.name());
+        // Constants and stack addresses are regenerated rather than stored and loaded
+        const int variable = _variables[move.variable()];
+        if (_remat.isRematerializable(variable))
+        {
+            if (to.reg() != -1)
+            {
+                restore(pos, poRegRestore(to.reg(), variable, -1, true));
+            }
+            continue;
+        }
 
-            pos++;
+        if (from.reg() != -1 && to.reg() != -1)
+        {
+            copy.add(to.reg(), from.reg());
+            continue;
         }
 
-        _exits.insert(std::pair<poBasicBlock*, poRegLinearExit>(
-            bb,
-            poRegLinearExit(_stackSlots)));
+        int slot = _stackAlloc.findSlot(variable);
+        if (slot == -1)
+        {
+            slot = allocateSpillSlot(variable);
+        }
+
+        if (from.reg() != -1 && !_clean[move.from()])
+        {
+            spill(pos, poRegSpill(from.reg(), variable, slot));
+        }
+        if (to.reg() != -1)
+        {
+            restore(pos, poRegRestore(to.reg(), variable, slot));
+        }
+    }
 
-        repairSpills(bb);
-        bb = bb->getNext();
+    if (!copy.isEmpty())
+    {
+        copy.sequentialize(_registerMoves[pos]);
     }
 }
 
-int poRegLinear::getRegisterByVariable(const int variable, const int pos) const
+void poRegLinear::allocateRegisters(poFlowGraph& cfg)
 {
-    const auto& it = _registers.find(variable);
+    // Perform SSA destruction
+    poSSA_Destruction ssa;
+    ssa.isolate(cfg);
+    ssa.destruct(cfg);
 
-    if (it != _registers.end())
+    _remat.analyze(cfg);
+    numberInstructions(cfg);
+    computeLiveness();
+    buildIntervals();
+    walkIntervals();
+    resolveDataFlow(cfg);
+    colorStackSlots();
+}
+
+void poRegLinear::colorStackSlots()
+{
+    // A slot is live wherever its variable is
+    for (int i = 0; i < int(_variables.size()); i++)
     {
-        for (int i = int(it->second.size()) - 1; i >= 0; i--)
+        const int slot = _stackAlloc.findSlot(_variables[i]);
+        if (slot == -1)
         {
-            const poRegLinearAssignment& assign = it->second[i];
-            if (pos >= assign.pos() && pos <= assign.live())
+            continue;
+        }
+
+        _stackColoring.addSpill(_variables[i], slot, _vectors.find(_variables[i]) != _vectors.end() ? 16 : 8);
+        for (const int child : _children[i])
+        {
+            for (const poRegLinearRange& range : _intervals[child].ranges())
             {
-                return assign.reg();
+                _stackColoring.addRange(slot, range.from(), range.to());
             }
         }
+    }
 
-        abort();
+    _stackAlloc = poStackAllocator();
+    _stackColoring.color(_stackAlloc);
+    _stackColoring.rewrite(_spills, _restores);
+}
+
+void poRegLinear::spill(const int pos, const poRegSpill& spill)
+{
+    const auto& it = _spills.find(pos);
+    if (it != _spills.end())
+    {
+        _spills[pos].push_back(spill);
     }
+    else
+    {
+        _spills.insert(std::pair<int, std::vector<poRegSpill>>(pos, std::vector<poRegSpill>(1, spill)));
+    }
+}
 
-    return -1;
+void poRegLinear::restore(const int pos, const poRegRestore& restore)
+{
+    const auto& it = _restores.find(pos);
+    if (it != _restores.end())
+    {
+        _restores[pos].push_back(restore);
+    }
+    else
+    {
+        _restores.insert(std::pair<int, std::vector<poRegRestore>>(pos, std::vector<poRegRestore>(1, restore)));
+    }
+}
+
+int poRegLinear::allocateSpillSlot(const int variable)
+{
+    const int size = _vectors.find(variable) != _vectors.end() ? 16 : 8;
+    return _stackAlloc.allocateSlot(variable, size, size);
+}
+
+int poRegLinear::getRegisterByVariable(const int variable, const int pos) const
+{
+    // The register at the instruction, or the one the instruction defines a copy into
+    const auto& it = _variableIndex.find(variable);
+    if (it == _variableIndex.end() ||
+        pos < 0 ||
+        pos >= int(_positions.size()) ||
+        _positions[pos] == -1)
+    {
+        return -1;
+    }
+
+    const int index = _positions[pos];
+    const int use = findInterval(it->second, 2 * index);
+    if (use != -1 && _intervals[use].covers(2 * index) && _intervals[use].reg() != -1)
+    {
+        return _intervals[use].reg();
+    }
+
+    const int def = findInterval(it->second, 2 * index + 1);
+    return def == -1 ? -1 : _intervals[def].reg();
 }
 
 int poRegLinear::getRegisterByVariable(const int variable) const
@@ -850,11 +1498,11 @@ int poRegLinear::getRegisterByVariable(const int variable) const
     return getRegisterByVariable(variable, _iterator.position());
 }
 
-const bool poRegLinear::spillAt(const int index, const int element, poRegSpill* spill) const
+bool poRegLinear::spillAt(const int index, const int element, poRegSpill* spill) const
 {
     const auto& it = _spills.find(index);
     if (it != _spills.end() &&
-        it->second.size() > element)
+        int(it->second.size()) > element)
     {
         *spill = it->second[element];
         return true;
@@ -862,11 +1510,11 @@ const bool poRegLinear::spillAt(const int index, const int element, poRegSpill*
     return false;
 }
 
-const bool poRegLinear::restoreAt(const int index, const int element, poRegRestore* spill) const
+bool poRegLinear::restoreAt(const int index, const int element, poRegRestore* spill) const
 {
     const auto& it = _restores.find(index);
     if (it != _restores.end() &&
-        it->second.size() > element)
+        int(it->second.size()) > element)
     {
         *spill = it->second[element];
         return true;
@@ -874,7 +1522,73 @@ const bool poRegLinear::restoreAt(const int index, const int element, poRegResto
     return false;
 }
 
-const int poRegLinear::getStackSlotByVariable(const int variable) const
+bool poRegLinear::moveAt(const int index, const int element, poRegMove* move) const
+{
+    const auto& it = _registerMoves.find(index);
+    if (it != _registerMoves.end() &&
+        int(it->second.size()) > element)
+    {
+        *move = it->second[element];
+        return true;
+    }
+    return false;
+}
+
+bool poRegLinear::isRematerialized(const int variable) const
+{
+    // The definition of a constant or stack address can be dropped when nothing reads it from the
+    // defining register, as every later part of the variable regenerates the value when it is entered
+
+    if (!_remat.isRematerializable(variable))
+    {
+        return false;
+    }
+
+    const auto& it = _variableIndex.find(variable);
+    if (it == _variableIndex.end())
+    {
+        return false;
+    }
+
+    const poRegLinearInterval& def = _intervals[it->second];
+    if (def.reg() == -1 || def.nextUse(def.start() + 1) != INT_MAX)
+    {
+        return false;
+    }
+
+    // A part in the same register is entered without a move, so it would read the dropped value
+    for (const int child : _children[it->second])
+    {
+        if (child != it->second && _intervals[child].reg() == def.reg())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int poRegLinear::numSpills() const
+{
+    int numSpills = 0;
+    for (const auto& spills : _spills)
+    {
+        numSpills += int(spills.second.size());
+    }
+    return numSpills;
+}
+
+int poRegLinear::numRestores() const
+{
+    int numRestores = 0;
+    for (const auto& restores : _restores)
+    {
+        numRestores += int(restores.second.size());
+    }
+    return numRestores;
+}
+
+int poRegLinear::getStackSlotByVariable(const int variable) const
 {
     return _stackAlloc.findSlot(variable);
 }
@@ -1,16 +1,48 @@
 #pragma once
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <cstdint>
+#include "poRegAlloc.h"
+#include "poRemat.h"
+#include "poStackColoring.h"
+#include "poParallelCopy.h"
 
 namespace po
 {
     //
-    // Linear register allocator.
-    // 
-    // A linear register allocator is fairly quick due to treating the flow graph
-    // as a "hyperblock" and therefore able to allocate the registers using only few
-    // simple loops. However, the does not produce optimal register allocation
-    // or spilling.
+    // Linear scan register allocator on lifetime intervals (Wimmer and Mossenbock,
+    // "Optimized Interval Splitting in a Linear Scan Register Allocator").
+    //
+    // Liveness is computed by data flow after SSA destruction, so the interval of a variable
+    // is a list of ranges with holes where it is dead, together with the positions where it
+    // is used or defined. Each instruction takes two positions, the operands are read at the
+    // even one and copies define their result at the odd one, so a copy can share the
+    // register of a source which dies there.
+    //
+    // The intervals are walked in order of their start. An interval takes a register which
+    // is free for all of it, or for the first part of it, in which case it is split. When no
+    // register is free, either the interval itself or the intervals holding the register whose
+    // next use is furthest away are spilled. A spilled part is split again before its next use,
+    // so only the parts without uses are kept on the stack. Split positions are moved to the
+    // boundary of the block with the lowest loop depth in the allowed range.
+    //
+    // Moves between the parts of an interval are inserted at the split position inside a block.
+    // At block boundaries the location at the end of each predecessor is resolved against the
+    // location at the start of the successor. Those moves are placed before the branch of a
+    // predecessor with a single successor, at the start of a successor with a single predecessor,
+    // or otherwise in a new block on the edge. The moves at a position are parallel: the stores
+    // to stack slots are performed first, then the moves between registers, which are ordered
+    // so no source is overwritten before it is read (see poParallelCopy), and then the loads.
+    // A store is skipped when the slot is known to be up to date, and constants and stack
+    // addresses are rematerialized rather than stored and loaded. Once every move is placed,
+    // the stack slots of variables which are never live at the same time are shared
+    // (see poStackColoring).
+    //
+    // Only callee saved registers are allocated, as the volatile registers are used by the code
+    // generator for arguments and temporaries. Calls therefore preserve every allocated register
+    // and intervals are not split around them.
     //
 
     class poLive;
@@ -34,8 +66,9 @@ namespace po
         poStackAllocator();
         inline const int numSlots() const { return _numSlots; }
         inline const std::vector<bool>& slots() const { return _slots; }
-        const int allocateSlot(const int variable, const int size);
+        const int allocateSlot(const int variable, const int size, const int alignment = 8);
         const void freeSlot(const int variable);
+        const void shareSlot(const int variable, const int other); /* variable takes the slot of other */
         const int findSlot(const int variable) const;
 
     private:
@@ -64,101 +97,111 @@ namespace po
     {
     public:
         poRegRestore();
-        poRegRestore(const int restoreRegister, const int restoreVariable, const int restoreStackSlot);
+        poRegRestore(const int restoreRegister, const int restoreVariable, const int restoreStackSlot, const bool isRematerialized = false);
 
         const int restoreRegister() const { return _restoreRegister; }
         const int restoreVariable() const { return _restoreVariable; }
         const int restoreStackSlot() const { return _restoreStackSlot; }
+        const bool isRematerialized() const { return _isRematerialized; }
 
     private:
         int _restoreRegister;
         int _restoreVariable;
-        int _restoreStackSlot;
+        int _restoreStackSlot; /* -1 when rematerialized */
+        bool _isRematerialized;
     };
 
-    class poStackSlot
+    class poRegLinearIterator
     {
     public:
-        poStackSlot() :
-            _type(poRegType::General), _live(0) {
-        }
-        poStackSlot(const poRegType type, const int live)
-            : _type(type), _live(live) {
-        }
-
-        inline const poRegType type() const { return _type; }
-        inline const int live() const { return _live; }
+        poRegLinearIterator() : _pos(0) {}
+        inline const void next() { _pos++; }
+        inline const void advance(const int n) { _pos += n; }
+        inline const int position() const { return _pos; }
+        inline void reset() { _pos = 0; }
 
     private:
-        poRegType _type;
-        int _live;
+        int _pos;
     };
 
-    class poRegLinearExit
+    class poRegLinearRange
     {
     public:
-        poRegLinearExit(const std::unordered_map<int, poStackSlot>& stackSlots) : _stackSlots(stackSlots) {}
-        void addStackSlot(const int slot, const poStackSlot& stackSlot) { _stackSlots.insert(std::pair<int, poStackSlot>(slot, stackSlot)); }
-        inline const std::unordered_map<int, poStackSlot>& stackSlots() const { return _stackSlots; }
+        poRegLinearRange(const int from, const int to) : _from(from), _to(to) {}
+        inline void setFrom(const int from) { _from = from; }
+        inline void setTo(const int to) { _to = to; }
+        inline const int from() const { return _from; }
+        inline const int to() const { return _to; }
 
     private:
-        std::unordered_map<int, poStackSlot> _stackSlots; /* slot -> stack slot */
+        int _from;
+        int _to; /* inclusive */
     };
 
-    class poRegLinearEntry
+    class poRegLinearUse
     {
     public:
-        poRegLinearEntry(const std::vector<int>& variables,
-            const std::vector<bool>& registerUsed,
-            const std::vector<int>& registersUsedByType,
-            const int pos);
-        inline const int getRegister(const int index) const { return _variables[index]; }
-        inline const int getRegisterType(const int index) const { return _registersUsedByType[index]; }
-        inline const int isUsed(const int index) const { return _registerUsed[index]; }
-        inline const int position() const { return _pos; }
+        poRegLinearUse(const int pos, const bool isDef) : _pos(pos), _isDef(isDef) {}
+        inline const int pos() const { return _pos; }
+        inline const bool isDef() const { return _isDef; }
 
     private:
-        std::vector<int> _variables; /* a list indicating which register is used by which variable (register -> variable) */
-        std::vector<int> _registersUsedByType;
-        std::vector<bool> _registerUsed;
         int _pos;
+        bool _isDef;
     };
 
-    class poRegLinearIterator
+    class poRegLinearInterval
     {
     public:
-        poRegLinearIterator() : _pos(0) {}
-        inline const void next() { _pos++; }
-        inline const void advance(const int n) { _pos += n; }
-        inline const int position() const { return _pos; }
-        inline void reset() { _pos = 0; }
+        poRegLinearInterval(const int variable, const poRegType type); /* variable index */
+        inline const int variable() const { return _variable; }
+        inline const poRegType type() const { return _type; }
+        inline const int reg() const { return _reg; }
+        inline void setReg(const int reg) { _reg = reg; }
+        inline const int start() const { return _ranges.front().from(); }
+        inline const int end() const { return _ranges.back().to(); }
+        inline const bool isEmpty() const { return _ranges.empty(); }
+        inline const std::vector<poRegLinearRange>& ranges() const { return _ranges; }
+        inline const std::vector<poRegLinearUse>& uses() const { return _uses; }
+
+        void addRange(const int from, const int to); /* ranges are added in reverse order while building */
+        void setFrom(const int pos);
+        void addUse(const int pos, const bool isDef);
+        void finish();
+
+        bool covers(const int pos) const;
+        bool hasDef() const;
+        bool startsWithDef() const;
+        int nextUse(const int pos) const;
+        int lastUseBefore(const int pos) const;
+        int nextIntersection(const poRegLinearInterval& other) const;
+        void split(const int pos, poRegLinearInterval& child);
 
     private:
-        int _pos;
+        int _variable;
+        poRegType _type;
+        int _reg;
+        std::vector<poRegLinearRange> _ranges;
+        std::vector<poRegLinearUse> _uses;
     };
 
-    class poRegLinearAssignment
+    class poRegLinearMove
     {
     public:
-        poRegLinearAssignment(const int pos, const int live, const int variable, const int reg) :
-            _pos(pos),
-            _live(live),
-            _variable(variable),
-            _reg(reg) {
-        }
+        poRegLinearMove(const int variable, const int from, const int to) /* variable index, intervals */ : _variable(variable), _from(from), _to(to) {}
         inline const int variable() const { return _variable; }
-        inline const int reg() const { return _reg; }
-        inline const int pos() const { return _pos; }
-        inline const int live() const { return _live; }
+        inline const int from() const { return _from; }
+        inline const int to() const { return _to; }
+        inline void setFrom(const int from) { _from = from; }
+        inline void setTo(const int to) { _to = to; }
 
     private:
-        int _pos;
         int _variable;
-        int _reg;
-        int _live;
+        int _from; /* interval */
+        int _to; /* interval */
     };
 
-    class poRegLinear
+    class poRegLinear : public poRegAlloc
     {
     public:
         poRegLinear(poModule& module);
@@ -168,49 +211,88 @@ namespace po
         void allocateRegisters(poFlowGraph& cfg);
         int getRegisterByVariable(const int variable, const int pos) const;
         int getRegisterByVariable(const int variable) const;
-        const bool spillAt(const int index, const int element, poRegSpill* spill) const;
-        const bool restoreAt(const int index, const int element, poRegRestore* spill) const;
-        const int getStackSlotByVariable(const int pos) const;
+        bool spillAt(const int index, const int element, poRegSpill* spill) const;
+        bool restoreAt(const int index, const int element, poRegRestore* spill) const;
+        bool moveAt(const int index, const int element, poRegMove* move) const;
+        int getStackSlotByVariable(const int pos) const;
+        inline bool spillsAfterDefinition() const { return false; }
+        bool isRematerialized(const int variable) const;
+        int numSpills() const;
+        int numRestores() const;
 
         //inline const int getRegister(const int index) const { return _registers[index].reg(); }
         inline const int numRegisters() const { return _numRegisters; }
-        inline const int numInstructions() const { return int(_registers.size()); }
-        inline const bool isRegisterSet(const int index) const { return _registersSet[index]; }
-        inline const bool isVolatile(const int index) const { return _volatile[index]; }
-        inline const int stackSize() const { return _stackAlloc.numSlots(); }
+        inline bool isRegisterSet(const int index) const { return _registersSet[index]; }
+        inline bool isVolatile(const int index) const { return _volatile[index]; }
+        inline int stackSize() const { return _stackAlloc.numSlots(); }
 
         inline poRegLinearIterator& iterator() { return _iterator; }
 
     private:
-        void allocateRegister(const int pos, const poRegType type, const int live, const int variable);
-        void freeRegisters(const int pos);
-        void spillRegisters(const int pos, const poRegType type, const poInstruction& ins, poUses& uses);
-        void balanceRegisters(const int pos, poBasicBlock* bb);
-        void repairSpills(poBasicBlock* bb);
+        void numberInstructions(poFlowGraph& cfg);
+        void computeLiveness();
+        void buildIntervals();
+        int getOperands(const poInstruction& ins, int operands[2]) const;
+        int findPinnedEnd(const int interval) const;
+        void walkIntervals();
+        bool tryAllocateFreeRegister(const int current);
+        void allocateBlockedRegister(const int current);
+        void evictInterval(const int interval, const int pos, const bool isActive);
+        void spillUntilUse(const int interval, const int minPos);
+        int splitInterval(const int interval, const int pos);
+        int findSplitPosition(const int minPos, const int maxPos) const;
+        int findInterval(const int variable, const int pos) const;
+        bool isAllocatable(const int reg, const poRegType type) const;
+        void resolveDataFlow(poFlowGraph& cfg);
+        void insertEdgeBlock(poFlowGraph& cfg, const int pred, const int succ, const bool isBranch, const std::vector<poRegLinearMove>& moves);
+        void addMove(std::vector<poRegLinearMove>& moves, const int variable, const int from, const int to);
+        void emitMoves(const int pos, const std::vector<poRegLinearMove>& moves);
         void spill(const int pos, const poRegSpill& spill);
         void restore(const int pos, const poRegRestore& restore);
-        void mapRegister(const poRegLinearAssignment& assignment);
-        void freeStackSlots(const int pos);
+        int allocateSpillSlot(const int variable);
+        void colorStackSlots();
 
         poStackAllocator _stackAlloc;
         poModule& _module;
         poRegLinearIterator _iterator;
 
         int _numRegisters;
+        int _nextName; /* the name given to branches which are added */
         std::vector<bool> _volatile;
         std::vector<poRegType> _type;
-        std::vector<int> _variables; /* a list indicating which register is used by which variable (register -> variable) */
-        std::vector<bool> _registerUsed;
-        std::vector<int> _registerExpiry;
-        std::vector<int> _registersUsedByType;
-        std::vector<int> _maxRegistersUsedByType;
         std::vector<bool> _registersSet; /* the registers which have been used at any point */
-        std::unordered_map<int, std::vector<poRegLinearAssignment>> _registers; /* a mapping from variable -> (last) instruction index */
-        std::unordered_map<poBasicBlock*, poRegLinearEntry> _entries; /* a list of entries associated with basic blocks */
-        std::unordered_map<poBasicBlock*, poRegLinearExit> _exits; /* a list of entries associated with basic blocks */
+
+        std::vector<const poInstruction*> _instructions; /* instruction index -> instruction */
+        std::vector<int> _blockOf; /* instruction index -> block */
+        std::vector<int> _defs; /* instruction index -> variable defined */
+        std::vector<poBasicBlock*> _blocks;
+        std::vector<int> _blockFirst; /* block -> first instruction index */
+        std::vector<int> _blockLast; /* block -> last instruction index */
+        std::vector<int> _branch; /* block -> branch successor */
+        std::vector<int> _fallthrough; /* block -> fallthrough successor */
+        std::vector<int> _loopDepth;
+        std::vector<std::vector<uint64_t>> _liveIn; /* block -> variables live on entry */
+        std::vector<std::vector<uint64_t>> _liveOut; /* block -> variables live on exit */
+
+        std::unordered_map<int, int> _variableIndex; /* variable -> index */
+        std::vector<int> _variables; /* index -> variable */
+        std::vector<poRegType> _variableTypes;
+        std::vector<poRegLinearInterval> _intervals; /* the first intervals are the whole variables, followed by the split children */
+        std::vector<std::vector<int>> _children; /* variable index -> intervals ordered by start */
+        std::vector<int> _lastInterval; /* variable index -> last interval allocated */
+        std::vector<bool> _clean; /* interval -> whether the stack slot holds its value */
+        std::vector<int> _active;
+        std::vector<int> _inactive;
+        std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> _unhandled;
+
+        std::unordered_map<int, std::vector<poRegLinearMove>> _moves; /* instruction index -> moves performed before it */
+        std::unordered_map<poBasicBlock*, std::vector<poRegLinearMove>> _edgeMoves; /* blocks inserted on edges -> moves */
+        std::vector<int> _positions; /* position -> instruction index, or -1 for inserted branches */
         std::unordered_map<int, std::vector<poRegSpill>> _spills; /* a mapping from instruction index -> spill */
         std::unordered_map<int, std::vector<poRegRestore>> _restores; /* a mapping from instruction index -> restore */
-        std::unordered_map<int, int> _registerMap; /* mapping from variable -> register  */
-        std::unordered_map<int, poStackSlot> _stackSlots; /* slot -> stack slot */
+        std::unordered_map<int, std::vector<poRegMove>> _registerMoves; /* position -> moves between registers, in order */
+        std::unordered_set<int> _vectors; /* variables which need a 16 byte slot when spilled */
+        poRemat _remat;
+        poStackColoring _stackColoring;
     };
 }
@@ -0,0 +1,55 @@
+#include "poRemat.h"
+#include "poCFG.h"
+
+#include <unordered_map>
+
+using namespace po;
+
+void poRemat::analyze(poFlowGraph& cfg)
+{
+    _variables.clear();
+
+    std::unordered_map<int, int> definitions;
+    std::unordered_set<int> allocas;
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            definitions[ins.name()]++;
+            if (ins.code() == IR_ALLOCA)
+            {
+                allocas.insert(ins.name());
+            }
+        }
+    }
+
+    for (poBasicBlock* bb = cfg.getFirst(); bb; bb = bb->getNext())
+    {
+        for (const poInstruction& ins : bb->instructions())
+        {
+            if (definitions[ins.name()] != 1)
+            {
+                continue;
+            }
+
+            switch (ins.code())
+            {
+            case IR_CONSTANT:
+                if (ins.constant() != -1)
+                {
+                    _variables.insert(ins.name());
+                }
+                break;
+            case IR_PTR:
+            case IR_ELEMENT_PTR:
+                // The stack pointer plus an offset
+                if (ins.right() == -1 &&
+                    allocas.find(ins.left()) != allocas.end())
+                {
+                    _variables.insert(ins.name());
+                }
+                break;
+            }
+        }
+    }
+}
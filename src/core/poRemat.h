@@ -0,0 +1,24 @@
+#pragma once
+#include <unordered_set>
+
+namespace po
+{
+    //
+    // Finds the variables which can be recomputed where they are used instead of being
+    // spilled and restored: constants, which are a move of an immediate or a load from
+    // the read only data, and the addresses of stack allocations. Each must be defined
+    // exactly once and depend on no other register.
+    //
+
+    class poFlowGraph;
+
+    class poRemat
+    {
+    public:
+        void analyze(poFlowGraph& cfg);
+        inline bool isRematerializable(const int variable) const { return _variables.find(variable) != _variables.end(); }
+
+    private:
+        std::unordered_set<int> _variables;
+    };
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <stack>
+#include <cstddef>
 
 // This is a file for computing the strongly connected components of a directed graph
 // based on the paper "Depth First Search and Linear Algorithms" by Tarjan.
@@ -4,6 +4,7 @@
 #include "poLive.h"
 
 #include <assert.h>
+#include <algorithm>
 
 using namespace po;
 
@@ -791,6 +792,426 @@ void poSSA_Reconstruct::rebuildPhiInstructions(poDom& dom)
 // poSSA_Destruction
 //=========================
 
+poSSA_Destruction::poSSA_Destruction()
+    :
+    _nextName(0)
+{
+}
+
+void poSSA_Destruction::isolate(poFlowGraph& cfg)
+{
+    // Destruction gives every variable in a phi web the same name, which is only
+    // correct when none of them are live at the same time (e.g. a swap in a loop).
+    // Phis whose variables would interfere are isolated with copies instead.
+
+    poDom dom;
+    dom.compute(cfg);
+
+    bool hasPhis = false;
+    for (int i = dom.start(); i < dom.num(); i++)
+    {
+        poBasicBlock* bb = dom.get(i).getBasicBlock();
+        hasPhis |= bb->phis().size() > 0;
+        for (const poInstruction& ins : bb->instructions())
+        {
+            _nextName = std::max(_nextName, ins.name() + 1);
+        }
+        for (const poPhi& phi : bb->phis())
+        {
+            _nextName = std::max(_nextName, phi.name() + 1);
+        }
+    }
+
+    if (!hasPhis)
+    {
+        return;
+    }
+
+    computeLiveness(dom);
+
+    for (int i = dom.start(); i < dom.num(); i++)
+    {
+        poBasicBlock* bb = dom.get(i).getBasicBlock();
+        for (int j = 0; j < int(bb->phis().size()); j++)
+        {
+            const poPhi& phi = bb->phis()[j];
+            if (!isLivePhi(bb, phi))
+            {
+                continue;
+            }
+
+            std::vector<int> classes = { findClass(phi.name()) };
+            for (const int value : phi.values())
+            {
+                const int id = findClass(value);
+                if (std::find(classes.begin(), classes.end(), id) == classes.end())
+                {
+                    classes.push_back(id);
+                }
+            }
+
+            // Members of the same class are already known not to interfere
+            bool interference = false;
+            for (int k = 0; k < int(classes.size()) && !interference; k++)
+            {
+                for (int l = k + 1; l < int(classes.size()) && !interference; l++)
+                {
+                    for (const int left : _members[classes[k]])
+                    {
+                        for (const int right : _members[classes[l]])
+                        {
+                            if (interferes(left, right))
+                            {
+                                interference = true;
+                                break;
+                            }
+                        }
+                        if (interference)
+                        {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (!interference || !isolatePhi(dom, i, j))
+            {
+                // Either the web is safe to share one name, or the phi cannot be mapped
+                // onto its predecessors and is left as it was
+                for (int k = 1; k < int(classes.size()); k++)
+                {
+                    std::vector<int>& members = _members[classes[k]];
+                    for (const int member : members)
+                    {
+                        _classes[member] = classes[0];
+                    }
+                    _members[classes[0]].insert(_members[classes[0]].end(), members.begin(), members.end());
+                    members.clear();
+                }
+            }
+        }
+    }
+}
+
+void poSSA_Destruction::computeLiveness(poDom& dom)
+{
+    // Only the variables which take part in phis are tracked
+
+    const int numBlocks = dom.num();
+    std::unordered_set<int> variables;
+    for (int i = dom.start(); i < numBlocks; i++)
+    {
+        poBasicBlock* bb = dom.get(i).getBasicBlock();
+        for (const poPhi& phi : bb->phis())
+        {
+            if (!isLivePhi(bb, phi))
+            {
+                continue;
+            }
+
+            variables.insert(phi.name());
+            _defs[phi.name()] = std::pair<int, int>(i, -1);
+            variables.insert(phi.values().begin(), phi.values().end());
+        }
+    }
+
+    _lastUse.resize(numBlocks);
+    std::vector<std::unordered_set<int>> uses(numBlocks);
+    for (int i = dom.start(); i < numBlocks; i++)
+    {
+        const auto& instructions = dom.get(i).getBasicBlock()->instructions();
+        for (int j = 0; j < int(instructions.size()); j++)
+        {
+            const poInstruction& ins = instructions[j];
+            if (ins.code() == IR_PHI)
+            {
+                continue;
+            }
+
+            if (!ins.isSpecialInstruction())
+            {
+                const int operands[2] = { ins.left(), ins.right() };
+                for (const int operand : operands)
+                {
+                    if (operand == -1 || !variables.contains(operand))
+                    {
+                        continue;
+                    }
+
+                    _lastUse[i][operand] = j;
+                    const auto& def = _defs.find(operand);
+                    if (def == _defs.end() || def->second.first != i)
+                    {
+                        uses[i].insert(operand);
+                    }
+                }
+            }
+
+            if (variables.contains(ins.name()))
+            {
+                _defs[ins.name()] = std::pair<int, int>(i, j);
+            }
+        }
+    }
+
+    // The phi operands are used on the edge from the predecessor
+
+    std::vector<std::unordered_set<int>> edgeUses(numBlocks);
+    for (int i = dom.start(); i < numBlocks; i++)
+    {
+        poBasicBlock* bb = dom.get(i).getBasicBlock();
+        for (const poPhi& phi : bb->phis())
+        {
+            if (!isLivePhi(bb, phi))
+            {
+                continue;
+            }
+
+            for (const int predecessor : dom.get(i).predecessors())
+            {
+                const int value = findValue(dom, phi, predecessor);
+                if (value != -1)
+                {
+                    edgeUses[predecessor].insert(phi.values()[value]);
+                }
+            }
+        }
+    }
+
+    _liveOut.resize(numBlocks);
+    std::vector<std::unordered_set<int>> liveIn(numBlocks);
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = numBlocks - 1; i >= dom.start(); i--)
+        {
+            std::unordered_set<int>& liveOut = _liveOut[i];
+            const size_t numOut = liveOut.size();
+            liveOut.insert(edgeUses[i].begin(), edgeUses[i].end());
+            for (const int successor : dom.get(i).successors())
+            {
+                for (const int variable : liveIn[successor])
+                {
+                    const auto& def = _defs.find(variable);
+                    if (def == _defs.end() || def->second != std::pair<int, int>(successor, -1))
+                    {
+                        liveOut.insert(variable);
+                    }
+                }
+            }
+
+            const size_t numIn = liveIn[i].size();
+            liveIn[i].insert(uses[i].begin(), uses[i].end());
+            for (const int variable : liveOut)
+            {
+                const auto& def = _defs.find(variable);
+                if (def == _defs.end() || def->second.first != i || def->second.second == -1)
+                {
+                    liveIn[i].insert(variable);
+                }
+            }
+
+            changed |= numOut != liveOut.size() || numIn != liveIn[i].size();
+        }
+    }
+}
+
+bool poSSA_Destruction::isLiveAfter(const int variable, const int block, const int index) const
+{
+    const auto& def = _defs.find(variable);
+    if (def != _defs.end() && def->second.first == block && def->second.second > index)
+    {
+        return false;
+    }
+
+    if (_liveOut[block].contains(variable))
+    {
+        return true;
+    }
+
+    const auto& use = _lastUse[block].find(variable);
+    return use != _lastUse[block].end() && use->second > index;
+}
+
+bool poSSA_Destruction::interferes(const int left, const int right) const
+{
+    // Two SSA variables interfere if either is live where the other is defined
+
+    if (left == right)
+    {
+        return false;
+    }
+
+    const auto& leftDef = _defs.find(left);
+    const auto& rightDef = _defs.find(right);
+    if (leftDef == _defs.end() || rightDef == _defs.end())
+    {
+        return true;
+    }
+
+    return isLiveAfter(left, rightDef->second.first, rightDef->second.second) ||
+        isLiveAfter(right, leftDef->second.first, leftDef->second.second);
+}
+
+int poSSA_Destruction::findClass(const int name)
+{
+    const auto& it = _classes.find(name);
+    if (it == _classes.end())
+    {
+        _classes.insert(std::pair<int, int>(name, name));
+        _members[name].push_back(name);
+        return name;
+    }
+
+    int root = it->second;
+    while (_classes[root] != root)
+    {
+        root = _classes[root];
+    }
+    it->second = root;
+    return root;
+}
+
+int poSSA_Destruction::findValue(poDom& dom, const poPhi& phi, const int block) const
+{
+    // The value is recorded against the predecessor or the closest dominator of it which defines it
+
+    const auto& basicBlocks = phi.getBasicBlock();
+    int node = block;
+    while (node != -1)
+    {
+        poBasicBlock* bb = dom.get(node).getBasicBlock();
+        for (int i = 0; i < int(basicBlocks.size()); i++)
+        {
+            if (basicBlocks[i] == bb)
+            {
+                return i;
+            }
+        }
+
+        const int imm = dom.get(node).immediateDominator();
+        node = imm != node ? imm : -1;
+    }
+    return -1;
+}
+
+bool poSSA_Destruction::isolatePhi(poDom& dom, const int block, const int phiIndex)
+{
+    // p = phi(x1, x2) becomes p' = phi(x1', x2') with x1' = x1 at the end of each predecessor and p = p'
+    // after the phis. The copies are fresh variables, so critical edges do not need to be split.
+
+    poBasicBlock* bb = dom.get(block).getBasicBlock();
+    const poPhi& phi = bb->phis()[phiIndex];
+
+    std::vector<int> predecessors;
+    for (const int predecessor : dom.get(block).predecessors())
+    {
+        if (std::find(predecessors.begin(), predecessors.end(), predecessor) != predecessors.end())
+        {
+            continue;
+        }
+
+        // Values which are undefined on some path only work when they share the name of the phi
+        const int value = findValue(dom, phi, predecessor);
+        if (value == -1 || !_defs.contains(phi.values()[value]))
+        {
+            return false;
+        }
+        predecessors.push_back(predecessor);
+    }
+
+    if (predecessors.size() < 2)
+    {
+        return false;
+    }
+
+    const int type = phi.getType();
+    const int name = phi.name();
+    poPhi isolated(_nextName++, type);
+    for (const int predecessor : predecessors)
+    {
+        const int value = phi.values()[findValue(dom, phi, predecessor)];
+        poBasicBlock* predecessorBB = dom.get(predecessor).getBasicBlock();
+
+        const int copy = _nextName++;
+        insertCopy(predecessorBB, poInstruction(copy, type, value, -1, IR_COPY));
+        isolated.addValue(copy, predecessorBB);
+    }
+
+    bb->phis()[phiIndex] = isolated;
+    replacePhiInstructions(bb, name, isolated);
+
+    int pos = 0;
+    while (pos < int(bb->numInstructions()) && bb->getInstruction(pos).code() == IR_PHI)
+    {
+        pos++;
+    }
+    bb->insertInstruction(poInstruction(name, type, isolated.name(), -1, IR_COPY), pos);
+    return true;
+}
+
+void poSSA_Destruction::insertCopy(poBasicBlock* bb, const poInstruction& copy)
+{
+    // Copies go before the branch, and before the compare which sets the flags for it
+
+    int pos = int(bb->numInstructions());
+    if (pos > 0 && bb->getInstruction(pos - 1).code() == IR_BR)
+    {
+        pos--;
+        if (pos > 0 && bb->getInstruction(pos - 1).code() == IR_CMP)
+        {
+            pos--;
+        }
+    }
+    bb->insertInstruction(copy, pos);
+}
+
+bool poSSA_Destruction::isLivePhi(poBasicBlock* bb, const poPhi& phi) const
+{
+    // Dead code elimination removes the phi instructions but leaves the phi behind
+    for (const poInstruction& ins : bb->instructions())
+    {
+        if (ins.code() != IR_PHI)
+        {
+            break;
+        }
+        if (ins.name() == phi.name())
+        {
+            return phi.values().size() >= 2;
+        }
+    }
+    return false;
+}
+
+void poSSA_Destruction::replacePhiInstructions(poBasicBlock* bb, const int name, const poPhi& phi)
+{
+    // The phi is a chain of binary phi instructions ending in its name
+
+    int pos = -1;
+    int target = name;
+    for (int i = int(bb->numInstructions()) - 1; i >= 0; i--)
+    {
+        const poInstruction& ins = bb->getInstruction(i);
+        if (ins.code() == IR_PHI && ins.name() == target)
+        {
+            target = ins.left();
+            bb->removeInstruction(i);
+            pos = i;
+        }
+    }
+
+    const auto& values = phi.values();
+    int left = values[0];
+    for (int i = 1; i < int(values.size()) - 1; i++)
+    {
+        const int newName = _nextName++;
+        bb->insertInstruction(poInstruction(newName, phi.getType(), left, values[i], IR_PHI), pos++);
+        left = newName;
+    }
+    bb->insertInstruction(poInstruction(phi.name(), phi.getType(), left, values[values.size() - 1], IR_PHI), pos);
+}
+
 void poSSA_Destruction::destruct(poFlowGraph& cfg)
 {
     _web.findPhiWebs(cfg);
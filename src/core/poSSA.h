@@ -85,8 +85,26 @@ namespace po
     class poSSA_Destruction
     {
     public:
+        poSSA_Destruction();
+        void isolate(poFlowGraph& cfg);
         void destruct(poFlowGraph& cfg);
     private:
+        void computeLiveness(poDom& dom);
+        bool isLiveAfter(const int variable, const int block, const int index) const;
+        bool interferes(const int left, const int right) const;
+        int findClass(const int name);
+        int findValue(poDom& dom, const poPhi& phi, const int block) const;
+        bool isolatePhi(poDom& dom, const int block, const int phiIndex);
+        void insertCopy(poBasicBlock* bb, const poInstruction& copy);
+        bool isLivePhi(poBasicBlock* bb, const poPhi& phi) const;
+        void replacePhiInstructions(poBasicBlock* bb, const int name, const poPhi& phi);
+
         poPhiWeb _web;
+        int _nextName;
+        std::unordered_map<int, std::pair<int, int>> _defs; /* variable -> (block, index), phis are defined at index -1 */
+        std::vector<std::unordered_map<int, int>> _lastUse; /* per block: variable -> index of the last use */
+        std::vector<std::unordered_set<int>> _liveOut;
+        std::unordered_map<int, int> _classes; /* union-find over the names of phis which share a variable */
+        std::unordered_map<int, std::vector<int>> _members;
     };
 }
@@ -0,0 +1,149 @@
+#include "poStackColoring.h"
+#include "poRegLinear.h"
+
+#include <algorithm>
+
+using namespace po;
+
+void poStackColoring::addAlloca(const int variable, const int size, const int alignment)
+{
+    _allocas.push_back(std::pair<int, std::pair<int, int>>(variable, std::pair<int, int>(size, alignment)));
+}
+
+void poStackColoring::addSpill(const int variable, const int slot, const int size)
+{
+    poStackColoringSlot& coloringSlot = _slots[slot];
+    coloringSlot.setSize(std::max(coloringSlot.size(), size));
+    coloringSlot.variables().push_back(variable);
+}
+
+void poStackColoring::addRange(const int slot, const int from, const int to)
+{
+    _slots[slot].ranges().push_back(std::pair<int, int>(from, to));
+}
+
+bool poStackColoring::interferes(const poStackColoringSlot& slot, const poStackColoringSlot& other) const
+{
+    // Both lists of ranges are sorted, so walk them together
+
+    const auto& ranges = slot.ranges();
+    const auto& otherRanges = other.ranges();
+    size_t i = 0;
+    size_t j = 0;
+    while (i < ranges.size() && j < otherRanges.size())
+    {
+        if (ranges[i].first <= otherRanges[j].second + 1 &&
+            otherRanges[j].first <= ranges[i].second + 1)
+        {
+            return true;
+        }
+
+        if (ranges[i].second < otherRanges[j].second)
+        {
+            i++;
+        }
+        else
+        {
+            j++;
+        }
+    }
+    return false;
+}
+
+void poStackColoring::color(poStackAllocator& stackAllocator)
+{
+    for (const auto& alloca : _allocas)
+    {
+        stackAllocator.allocateSlot(alloca.first, alloca.second.first, alloca.second.second);
+    }
+
+    std::vector<int> order;
+    for (auto& it : _slots)
+    {
+        auto& ranges = it.second.ranges();
+        std::sort(ranges.begin(), ranges.end());
+        order.push_back(it.first);
+    }
+
+    std::sort(order.begin(), order.end(), [this](const int a, const int b) {
+        const int startA = _slots[a].start();
+        const int startB = _slots[b].start();
+        return startA != startB ? startA < startB : a < b;
+    });
+
+    // Each value takes the first shared slot of its size which is free for all of its ranges
+
+    std::vector<poStackColoringSlot> colors;
+    for (const int id : order)
+    {
+        const poStackColoringSlot& slot = _slots[id];
+        int color = -1;
+        for (int i = 0; i < int(colors.size()); i++)
+        {
+            if (colors[i].size() == slot.size() && !interferes(colors[i], slot))
+            {
+                color = i;
+                break;
+            }
+        }
+
+        if (color == -1)
+        {
+            color = int(colors.size());
+            colors.push_back(poStackColoringSlot());
+            colors.back().setSize(slot.size());
+        }
+
+        poStackColoringSlot& shared = colors[color];
+        auto& ranges = shared.ranges();
+        const size_t middle = ranges.size();
+        ranges.insert(ranges.end(), slot.ranges().begin(), slot.ranges().end());
+        std::inplace_merge(ranges.begin(), ranges.begin() + middle, ranges.end());
+        shared.variables().insert(shared.variables().end(), slot.variables().begin(), slot.variables().end());
+        _mapping[id] = color;
+    }
+
+    std::vector<int> finalSlots(colors.size(), -1);
+    for (int i = 0; i < int(colors.size()); i++)
+    {
+        const std::vector<int>& variables = colors[i].variables();
+        finalSlots[i] = stackAllocator.allocateSlot(variables[0], colors[i].size(), colors[i].size());
+        for (size_t j = 1; j < variables.size(); j++)
+        {
+            stackAllocator.shareSlot(variables[j], variables[0]);
+        }
+    }
+
+    for (auto& it : _mapping)
+    {
+        it.second = finalSlots[it.second];
+    }
+}
+
+void poStackColoring::rewrite(std::unordered_map<int, std::vector<poRegSpill>>& spills, std::unordered_map<int, std::vector<poRegRestore>>& restores) const
+{
+    for (auto& it : spills)
+    {
+        for (poRegSpill& spill : it.second)
+        {
+            spill = poRegSpill(spill.spillRegister(), spill.spillVariable(), getSlot(spill.spillStackSlot()));
+        }
+    }
+
+    for (auto& it : restores)
+    {
+        for (poRegRestore& restore : it.second)
+        {
+            if (!restore.isRematerialized())
+            {
+                restore = poRegRestore(restore.restoreRegister(), restore.restoreVariable(), getSlot(restore.restoreStackSlot()));
+            }
+        }
+    }
+}
+
+int poStackColoring::getSlot(const int slot) const
+{
+    const auto& it = _mapping.find(slot);
+    return it != _mapping.end() ? it->second : -1;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+
+namespace po
+{
+    //
+    // Stack slot coloring, run once a register allocator has placed its spills and restores.
+    //
+    // The allocator hands out a provisional slot per spilled value, together with the positions
+    // where that value is live. Slots of the same size whose values are never live at the same
+    // time are then given the same stack memory. They are visited in order of their first position
+    // and each takes the first shared slot it doesn't interfere with, as in a linear scan. Ranges
+    // which only touch are kept apart, as the moves at that position may read one while writing
+    // the other.
+    //
+    // Stack allocations keep a slot of their own for the whole function, as their address may be
+    // taken, and are laid out first with the alignment of their type.
+    //
+
+    class poStackAllocator;
+    class poRegSpill;
+    class poRegRestore;
+
+    class poStackColoringSlot
+    {
+    public:
+        poStackColoringSlot() : _size(0) {}
+        inline void setSize(const int size) { _size = size; }
+        inline const int size() const { return _size; }
+        inline const int start() const { return _ranges.size() > 0 ? _ranges.front().first : 0; }
+        inline std::vector<int>& variables() { return _variables; }
+        inline const std::vector<int>& variables() const { return _variables; }
+        inline std::vector<std::pair<int, int>>& ranges() { return _ranges; }
+        inline const std::vector<std::pair<int, int>>& ranges() const { return _ranges; }
+
+    private:
+        int _size;
+        std::vector<int> _variables;
+        std::vector<std::pair<int, int>> _ranges; /* inclusive, sorted by start */
+    };
+
+    class poStackColoring
+    {
+    public:
+        void addAlloca(const int variable, const int size, const int alignment);
+        void addSpill(const int variable, const int slot, const int size); /* slot is the provisional slot */
+        void addRange(const int slot, const int from, const int to); /* inclusive */
+        void color(poStackAllocator& stackAllocator);
+        void rewrite(std::unordered_map<int, std::vector<poRegSpill>>& spills, std::unordered_map<int, std::vector<poRegRestore>>& restores) const;
+        int getSlot(const int slot) const; /* provisional slot -> final slot */
+
+    private:
+        bool interferes(const poStackColoringSlot& slot, const poStackColoringSlot& other) const;
+
+        std::vector<std::pair<int, std::pair<int, int>>> _allocas; /* variable, size and alignment */
+        std::unordered_map<int, poStackColoringSlot> _slots; /* provisional slot -> values */
+        std::unordered_map<int, int> _mapping; /* provisional slot -> final slot */
+    };
+}
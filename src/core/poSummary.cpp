@@ -0,0 +1,382 @@
+#include "poSummary.h"
+#include "poModule.h"
+#include "poCycle.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+using namespace po;
+
+constexpr int ORIGIN_PRIVATE = -1; // the function's own stack
+constexpr int ORIGIN_UNKNOWN = -2; // anything which isn't private or a parameter
+constexpr int MAX_ORIGIN_DEPTH = 8;
+
+//=================
+// poSummary
+//=================
+
+poSummary::poSummary()
+    :
+    _readsMemory(true),
+    _writesMemory(true),
+    _callsExtern(true),
+    _alwaysReturns(false)
+{
+}
+
+bool poSummary::writesParameter(const int index) const
+{
+    return index >= 0 &&
+        index < int(_writtenParameters.size()) &&
+        _writtenParameters[index];
+}
+
+void poSummary::setWritesParameter(const int index)
+{
+    if (index >= int(_writtenParameters.size()))
+    {
+        _writtenParameters.resize(index + 1, false);
+    }
+    _writtenParameters[index] = true;
+}
+
+bool poSummary::hasSideEffects() const
+{
+    // Reading memory is not a side effect, so a call with an unused result can still be removed
+    return _writesMemory ||
+        _callsExtern ||
+        !_alwaysReturns ||
+        std::find(_writtenParameters.begin(), _writtenParameters.end(), true) != _writtenParameters.end();
+}
+
+bool poSummary::accessesMemory() const
+{
+    return _readsMemory ||
+        _writesMemory ||
+        std::find(_writtenParameters.begin(), _writtenParameters.end(), true) != _writtenParameters.end();
+}
+
+bool poSummary::operator==(const poSummary& other) const
+{
+    return _readsMemory == other._readsMemory &&
+        _writesMemory == other._writesMemory &&
+        _callsExtern == other._callsExtern &&
+        _alwaysReturns == other._alwaysReturns &&
+        _writtenParameters == other._writtenParameters;
+}
+
+//=================
+// poSummaryAnalysis
+//=================
+
+poSummaryAnalysis::poSummaryAnalysis()
+    :
+    _numFunctions(0),
+    _numPure(0),
+    _numNoSideEffects(0)
+{
+}
+
+void poSummaryAnalysis::analyze(poModule& module)
+{
+    _graph = poCallGraph();
+    _graph.analyze(module);
+
+    // Functions with a body start with no side effects and only gain those which are seen
+
+    const int numFunctions = int(module.functions().size());
+    _summaries.assign(numFunctions, poSummary());
+    _functions.clear();
+    for (int i = 0; i < numFunctions; i++)
+    {
+        poFunction& func = module.functions()[i];
+        _functions.insert(std::pair<std::string, int>(func.fullname(), i));
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC) ||
+            func.cfg().getFirst() == nullptr)
+        {
+            continue;
+        }
+
+        poSummary& summary = _summaries[i];
+        summary.setReadsMemory(false);
+        summary.setWritesMemory(false);
+        summary.setCallsExtern(false);
+        summary.setAlwaysReturns(true);
+    }
+
+    // A component is finished once its last function is, which puts callees before callers
+
+    std::vector<bool> visited(numFunctions, false);
+    std::vector<int> finished;
+    for (poCallGraphNode* node : _graph.nodes())
+    {
+        if (!visited[node->id()])
+        {
+            order(node, visited, finished);
+        }
+    }
+
+    std::unordered_map<int, int> components;
+    for (int i = 0; i < int(finished.size()); i++)
+    {
+        components[_graph.nodes()[finished[i]]->sccId()] = i;
+    }
+
+    std::vector<std::vector<int>> members(finished.size());
+    for (poCallGraphNode* node : _graph.nodes())
+    {
+        members[components[node->sccId()]].push_back(node->id());
+    }
+
+    for (const std::vector<int>& component : members)
+    {
+        bool recursive = component.size() > 1;
+        for (const int id : component)
+        {
+            for (poCallGraphNode* child : _graph.nodes()[id]->children())
+            {
+                recursive |= child->id() == id;
+            }
+        }
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const int id : component)
+            {
+                changed |= summarize(module, id, recursive);
+            }
+        }
+    }
+
+    _numFunctions = 0;
+    _numPure = 0;
+    _numNoSideEffects = 0;
+    for (int i = 0; i < numFunctions; i++)
+    {
+        const poFunction& func = module.functions()[i];
+        if (func.hasAttribute(poAttributes::EXTERN) ||
+            func.hasAttribute(poAttributes::GENERIC))
+        {
+            continue;
+        }
+
+        const poSummary& summary = _summaries[i];
+        module.setSummary(func.fullname(), summary);
+        _numFunctions++;
+        if (!summary.hasSideEffects())
+        {
+            _numNoSideEffects++;
+            if (!summary.readsMemory())
+            {
+                _numPure++;
+            }
+        }
+    }
+}
+
+void poSummaryAnalysis::order(poCallGraphNode* node, std::vector<bool>& visited, std::vector<int>& finished)
+{
+    visited[node->id()] = true;
+    for (poCallGraphNode* child : node->children())
+    {
+        if (!visited[child->id()])
+        {
+            order(child, visited, finished);
+        }
+    }
+    finished.push_back(node->id());
+}
+
+bool poSummaryAnalysis::summarize(poModule& module, const int id, const bool recursive)
+{
+    poFunction& func = module.functions()[id];
+    poFlowGraph& cfg = func.cfg();
+    if (func.hasAttribute(poAttributes::EXTERN) ||
+        func.hasAttribute(poAttributes::GENERIC) ||
+        cfg.getFirst() == nullptr)
+    {
+        return false;
+    }
+
+    _defs.clear();
+    std::unordered_map<poBasicBlock*, int> blocks;
+    for (int i = 0; i < int(cfg.numBlocks()); i++)
+    {
+        poBasicBlock* bb = cfg.getBasicBlock(i);
+        blocks.insert(std::pair<poBasicBlock*, int>(bb, i));
+        for (const poInstruction& ins : bb->instructions())
+        {
+            _defs[ins.name()] = &ins;
+        }
+    }
+
+    poSummary summary;
+    summary.setReadsMemory(false);
+    summary.setWritesMemory(false);
+    summary.setCallsExtern(false);
+
+    poCycle cycle;
+    cycle.init(int(blocks.size()));
+    for (int i = 0; i < int(cfg.numBlocks()); i++)
+    {
+        poBasicBlock* bb = cfg.getBasicBlock(i);
+        if (bb->getNext() && !bb->unconditionalBranch())
+        {
+            cycle.addEdge(i, blocks[bb->getNext()]);
+        }
+        if (bb->getBranch())
+        {
+            cycle.addEdge(i, blocks[bb->getBranch()]);
+        }
+    }
+    cycle.compute();
+    summary.setAlwaysReturns(!recursive && !cycle.hasCycle());
+
+    for (int i = 0; i < int(cfg.numBlocks()); i++)
+    {
+        poBasicBlock* bb = cfg.getBasicBlock(i);
+        for (int j = 0; j < int(bb->numInstructions()); j++)
+        {
+            const poInstruction& ins = bb->getInstruction(j);
+            switch (ins.code())
+            {
+            case IR_LOAD:
+                access(ins.left(), false, summary);
+                break;
+            case IR_STORE:
+                access(ins.left(), true, summary);
+                if ((module.types()[ins.type()].isPointer() || module.types()[ins.type()].isArray()) &&
+                    getOrigin(ins.left(), 0) != ORIGIN_PRIVATE &&
+                    getOrigin(ins.right(), 0) != ORIGIN_UNKNOWN)
+                {
+                    // A pointer to the stack or a parameter is kept where someone else can reach it
+                    summary.setWritesMemory(true);
+                }
+                break;
+            case IR_LOAD_GLOBAL:
+                summary.setReadsMemory(true);
+                break;
+            case IR_STORE_GLOBAL:
+            case IR_MALLOC:
+                summary.setWritesMemory(true);
+                break;
+            case IR_COPY_MEMORY:
+            case IR_FILL_MEMORY:
+            case IR_VECTOR_MAP:
+            case IR_VECTOR_SUM:
+            case IR_VECTOR_FIND:
+                // The destination comes first, the other pointers are only read
+                for (int k = 0; k < ins.left() && j + 1 + k < int(bb->numInstructions()); k++)
+                {
+                    const poInstruction& arg = bb->getInstruction(j + 1 + k);
+                    const poType& type = module.types()[arg.type()];
+                    if (type.isPointer() || type.isArray())
+                    {
+                        const bool write = k == 0 && (ins.code() == IR_COPY_MEMORY || ins.code() == IR_FILL_MEMORY || ins.code() == IR_VECTOR_MAP);
+                        access(arg.left(), write, summary);
+                    }
+                }
+                break;
+            case IR_CALL:
+            {
+                std::string symbol;
+                const auto& callee = module.getSymbol(ins.right(), symbol) ? _functions.find(symbol) : _functions.end();
+                if (callee == _functions.end() ||
+                    module.functions()[callee->second].hasAttribute(poAttributes::EXTERN))
+                {
+                    summary.setReadsMemory(true);
+                    summary.setWritesMemory(true);
+                    summary.setCallsExtern(true);
+                    break;
+                }
+
+                const poSummary& calleeSummary = _summaries[callee->second];
+                summary.setReadsMemory(summary.readsMemory() || calleeSummary.readsMemory());
+                summary.setWritesMemory(summary.writesMemory() || calleeSummary.writesMemory());
+                summary.setCallsExtern(summary.callsExtern() || calleeSummary.callsExtern());
+                summary.setAlwaysReturns(summary.alwaysReturns() && calleeSummary.alwaysReturns());
+                for (int k = 0; k < ins.left() && j + 1 + k < int(bb->numInstructions()); k++)
+                {
+                    if (calleeSummary.writesParameter(k))
+                    {
+                        access(bb->getInstruction(j + 1 + k).left(), true, summary);
+                    }
+                }
+                break;
+            }
+            }
+        }
+    }
+
+    if (summary == _summaries[id])
+    {
+        return false;
+    }
+
+    _summaries[id] = summary;
+    return true;
+}
+
+void poSummaryAnalysis::access(const int pointer, const bool write, poSummary& summary)
+{
+    const int origin = getOrigin(pointer, 0);
+    if (origin == ORIGIN_PRIVATE)
+    {
+        return;
+    }
+
+    if (!write)
+    {
+        summary.setReadsMemory(true);
+    }
+    else if (origin == ORIGIN_UNKNOWN)
+    {
+        summary.setWritesMemory(true);
+    }
+    else
+    {
+        summary.setWritesParameter(origin);
+    }
+}
+
+int poSummaryAnalysis::getOrigin(const int name, const int depth)
+{
+    const auto& it = _defs.find(name);
+    if (it == _defs.end() || depth > MAX_ORIGIN_DEPTH)
+    {
+        return ORIGIN_UNKNOWN;
+    }
+
+    const poInstruction& ins = *it->second;
+    switch (ins.code())
+    {
+    case IR_ALLOCA:
+        return ORIGIN_PRIVATE;
+    case IR_PARAM:
+        return ins.left();
+    case IR_PTR:
+    case IR_ELEMENT_PTR:
+    case IR_COPY:
+    case IR_BITWISE_CAST:
+        return getOrigin(ins.left(), depth + 1);
+    case IR_PHI:
+    {
+        const int left = getOrigin(ins.left(), depth + 1);
+        return left == getOrigin(ins.right(), depth + 1) ? left : ORIGIN_UNKNOWN;
+    }
+    }
+
+    return ORIGIN_UNKNOWN;
+}
+
+void poSummaryAnalysis::dump() const
+{
+    std::cout << "Side effect summaries:" << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "functions" << _numFunctions << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "no side effects" << _numNoSideEffects << std::endl;
+    std::cout << "    " << std::left << std::setw(20) << "pure" << _numPure << std::endl;
+}
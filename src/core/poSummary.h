@@ -0,0 +1,84 @@
+#pragma once
+#include "poCallGraph.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//
+// Interprocedural summary of the side effects of each function.
+//
+// The strongly connected components of the call graph are visited bottom up, so each
+// callee is summarized before its callers, and the functions of a recursive component
+// are iterated together until their summaries stop changing.
+//
+// Memory reached only through the function's own IR_ALLOCA is private and isn't counted.
+// Pointers derived from a parameter record the parameter as written through, anything
+// else (globals, pointers loaded from memory or returned by a call) counts as reading or
+// writing memory. Calls to functions without a body, which includes the allocator, are
+// assumed to read and write anything, but to return. A function always returns if it
+// has no loops, isn't recursive and only calls functions which always return.
+//
+// The summaries are attached to the module by function name. A function without a
+// summary has to be treated as having every side effect. This is performed in SSA form.
+//
+
+namespace po
+{
+    class poModule;
+    class poFlowGraph;
+    class poInstruction;
+
+    class poSummary
+    {
+    public:
+        poSummary();
+
+        inline bool readsMemory() const { return _readsMemory; }
+        inline bool writesMemory() const { return _writesMemory; }
+        inline bool callsExtern() const { return _callsExtern; }
+        inline bool alwaysReturns() const { return _alwaysReturns; }
+        inline const std::vector<bool>& writtenParameters() const { return _writtenParameters; }
+        bool writesParameter(const int index) const;
+        bool hasSideEffects() const;
+        bool accessesMemory() const;
+
+        inline void setReadsMemory(const bool readsMemory) { _readsMemory = readsMemory; }
+        inline void setWritesMemory(const bool writesMemory) { _writesMemory = writesMemory; }
+        inline void setCallsExtern(const bool callsExtern) { _callsExtern = callsExtern; }
+        inline void setAlwaysReturns(const bool alwaysReturns) { _alwaysReturns = alwaysReturns; }
+        void setWritesParameter(const int index);
+
+        bool operator==(const poSummary& other) const;
+        bool operator!=(const poSummary& other) const { return !(*this == other); }
+
+    private:
+        bool _readsMemory; // Memory other than its own stack, including through parameters
+        bool _writesMemory; // Memory other than its own stack or through its parameters
+        bool _callsExtern;
+        bool _alwaysReturns;
+        std::vector<bool> _writtenParameters;
+    };
+
+    class poSummaryAnalysis
+    {
+    public:
+        poSummaryAnalysis();
+        void analyze(poModule& module);
+        void dump() const;
+
+    private:
+        void order(poCallGraphNode* node, std::vector<bool>& visited, std::vector<int>& finished);
+        bool summarize(poModule& module, const int id, const bool recursive);
+        void access(const int pointer, const bool write, poSummary& summary);
+        int getOrigin(const int name, const int depth);
+
+        poCallGraph _graph;
+        std::vector<poSummary> _summaries;
+        std::unordered_map<std::string, int> _functions;
+        std::unordered_map<int, const poInstruction*> _defs;
+        int _numFunctions;
+        int _numPure;
+        int _numNoSideEffects;
+    };
+}
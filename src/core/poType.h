@@ -24,7 +24,13 @@ namespace po
     constexpr int TYPE_PARAMETRIC_3 = 17;
     constexpr int TYPE_PARAMETRIC_4 = 18;
     constexpr int TYPE_TRAIT_NEW = 19;
-    constexpr int TYPE_OBJECT = 20; /* values above this are user defined (non primitive) */
+    constexpr int TYPE_F32X4 = 20; /* 128 bit vectors, held in sse registers */
+    constexpr int TYPE_F64X2 = 21;
+    constexpr int TYPE_I32X4 = 22;
+    constexpr int TYPE_U8X16 = 23;
+    constexpr int TYPE_OBJECT = 24; /* values above this are user defined (non primitive) */
+
+    inline bool isVectorType(const int type) { return type >= TYPE_F32X4 && type <= TYPE_U8X16; }
 
     enum class poTypeKind
     {
@@ -203,7 +209,9 @@ namespace po
 
         inline const std::vector<poParametricArgument>& parametricArgs() const { return _parametricArgs; }
         inline const std::vector<poField>& fields() const { return _fields; }
+        inline std::vector<poMemberFunction>& functions() { return _methods; }
         inline const std::vector<poMemberFunction>& functions() const { return _methods; }
+        inline std::vector<poConstructor>& constructors() { return _constructors; }
         inline const std::vector<poConstructor>& constructors() const { return _constructors; }
         inline const std::vector<poOperator>& operators() const { return _operators; }
         inline const std::vector<poMemberProperty>& properties() const { return _properties; }
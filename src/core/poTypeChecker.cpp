@@ -50,6 +50,11 @@ bool poTypeChecker::check(const std::vector<poNode*>& nodes)
             break;
         }
     }
+
+    if (!isError())
+    {
+        checkPending();
+    }
     return !isError();
 }
 
@@ -233,6 +238,12 @@ bool poTypeChecker::checkCompare(const int lhs, const int rhs)
         return false;
     }
 
+    if (isVectorType(lhs))
+    {
+        // Vectors are compared lane by lane with the std::cmp* intrinsics
+        return false;
+    }
+
     return true;
 }
 
@@ -263,44 +274,19 @@ void poTypeChecker::checkNamespaces(poNode* node, const std::vector<poNode*> imp
     assert(node->type() == poNodeType::NAMESPACE);
     poListNode* ns = static_cast<poListNode*>(node);
 
-    _imports.clear();
-    _imports.push_back(ns->token().string());
-    for (poNode* import : importNodes)
-    {
-        assert(import->type() == poNodeType::IMPORT);
-        _imports.push_back(import->token().string());
-    }
-    
-    // Add static variables to the scope
-    pushScope();
-    for (const poNamespace& ns : _module.namespaces()) {
-        if (ns.name() == node->token().string())
-        {
-            for (const int staticVarId : ns.staticVariables())
-            {
-                const poStaticVariable& staticVar = _module.staticVariables()[staticVarId];
-                addVariable(staticVar.name(), staticVar.type());
-            }
-        }
-    }
+    enterNamespace(node, importNodes);
 
     for (poNode* child : ns->list())
     {
-        if (child->type() == poNodeType::FUNCTION)
+        if (child->type() == poNodeType::FUNCTION ||
+            child->type() == poNodeType::CONSTRUCTOR)
         {
-            checkFunctions(child);
-            if (isError())
-            {
-                break;
-            }
-        }
-        else if (child->type() == poNodeType::CONSTRUCTOR)
-        {
-            checkConstructor(child);
-            if (isError())
-            {
-                break;
-            }
+            // Bodies are only checked once something reachable refers to them
+            const int index = int(_pending.size());
+            _pending.push_back(child);
+            _pendingNamespaces.push_back(node);
+            _pendingImports.push_back(importNodes);
+            _pendingNames[child->token().string()].push_back(index);
         }
         else if (child->type() == poNodeType::CLASS)
         {
@@ -323,10 +309,13 @@ void poTypeChecker::checkNamespaces(poNode* node, const std::vector<poNode*> imp
             }
             popGenericParameters();
         }
+        else if (child->type() == poNodeType::STATEMENT)
+        {
+            checkStaticInitializer(child);
+        }
         else if (child->type() == poNodeType::STRUCT ||
             child->type() == poNodeType::TRAIT ||
             child->type() == poNodeType::EXTERN ||
-            child->type() == poNodeType::STATEMENT ||
             child->type() == poNodeType::ENUM)
         {
             continue;
@@ -340,6 +329,131 @@ void poTypeChecker::checkNamespaces(poNode* node, const std::vector<poNode*> imp
     popScope();
 }
 
+void poTypeChecker::enterNamespace(poNode* node, const std::vector<poNode*>& importNodes)
+{
+    _imports.clear();
+    _imports.push_back(node->token().string());
+    for (poNode* import : importNodes)
+    {
+        assert(import->type() == poNodeType::IMPORT);
+        _imports.push_back(import->token().string());
+    }
+
+    // Add static variables to the scope
+    pushScope();
+    for (const poNamespace& ns : _module.namespaces()) {
+        if (ns.name() == node->token().string())
+        {
+            for (const int staticVarId : ns.staticVariables())
+            {
+                const poStaticVariable& staticVar = _module.staticVariables()[staticVarId];
+                addVariable(staticVar.name(), staticVar.type());
+            }
+        }
+    }
+}
+
+void poTypeChecker::checkPending()
+{
+    // Work outwards from the functions called by the entry stub, checking the bodies
+    // of anything they refer to by name. Without an entry point, such as a library
+    // on its own, every body is checked.
+
+    demand("main");
+    demand("pora_open");
+    demand("pora_close");
+
+    bool hasEntryPoint = false;
+    for (const std::string& name : _demanded)
+    {
+        if (_pendingNames.find(name) != _pendingNames.end())
+        {
+            hasEntryPoint = true;
+        }
+    }
+
+    if (!hasEntryPoint)
+    {
+        for (int i = 0; i < int(_pending.size()); i++)
+        {
+            checkPending(i);
+            if (isError())
+            {
+                break;
+            }
+        }
+        return;
+    }
+
+    // Calls the code generator adds which don't appear in the source
+
+    demand("malloc2");
+    demand("malloc3");
+    demand("panic");
+
+    while (_demanded.size() > 0 && !isError())
+    {
+        const std::string name = _demanded.back();
+        _demanded.pop_back();
+
+        const auto& it = _pendingNames.find(name);
+        if (it == _pendingNames.end())
+        {
+            continue;
+        }
+
+        for (const int index : it->second)
+        {
+            checkPending(index);
+            if (isError())
+            {
+                break;
+            }
+        }
+    }
+}
+
+void poTypeChecker::checkPending(const int index)
+{
+    poNode* node = _pending[index];
+    enterNamespace(_pendingNamespaces[index], _pendingImports[index]);
+    if (node->type() == poNodeType::FUNCTION)
+    {
+        checkFunctions(node);
+    }
+    else
+    {
+        checkConstructor(node);
+    }
+    popScope();
+}
+
+void poTypeChecker::demand(const std::string& name)
+{
+    if (!_demandedNames.insert(name).second)
+    {
+        return;
+    }
+
+    _demanded.push_back(name);
+
+    // Constructing a type also constructs its fields
+
+    const int type = _module.getTypeFromName(name);
+    if (type != -1)
+    {
+        for (const poField& field : _module.types()[type].fields())
+        {
+            const poType& fieldType = _module.types()[field.type()];
+            demand(fieldType.name());
+            if (fieldType.baseType() != -1)
+            {
+                demand(_module.types()[fieldType.baseType()].name());
+            }
+        }
+    }
+}
+
 void poTypeChecker::checkExpression(poNode* classNode, poNode* node)
 {
     assert(node->type() == poNodeType::EXPRESSION);
@@ -411,6 +525,37 @@ void poTypeChecker::checkExpression(poNode* classNode, poNode* node)
     }
 }
 
+void poTypeChecker::checkStaticInitializer(poNode* node)
+{
+    poUnaryNode* statement = static_cast<poUnaryNode*>(node);
+    if (statement->child()->type() != poNodeType::ASSIGNMENT)
+    {
+        return;
+    }
+
+    // Literals were resolved along with the variable, anything else is
+    // evaluated at compile time by the code generator.
+
+    poBinaryNode* assignment = static_cast<poBinaryNode*>(statement->child());
+    if (assignment->right()->type() == poNodeType::CONSTANT)
+    {
+        return;
+    }
+
+    const int rhs = checkExpr(assignment->right());
+    if (rhs == -1)
+    {
+        setError("Error checking types in static initializer.", assignment->token());
+        return;
+    }
+
+    const poToken& token = assignment->left()->token();
+    if (!checkEquivalence(getVariable(token.string()), rhs))
+    {
+        setError("Error checking types in static initializer.", token);
+    }
+}
+
 void poTypeChecker::checkConstructor(poNode* node)
 {
     assert(node->type() == poNodeType::CONSTRUCTOR);
@@ -857,6 +1002,18 @@ int poTypeChecker::getType(const poToken& token)
     case poTokenType::F32_TYPE:
         type = TYPE_F32;
         break;
+    case poTokenType::F32X4_TYPE:
+        type = TYPE_F32X4;
+        break;
+    case poTokenType::F64X2_TYPE:
+        type = TYPE_F64X2;
+        break;
+    case poTokenType::I32X4_TYPE:
+        type = TYPE_I32X4;
+        break;
+    case poTokenType::U8X16_TYPE:
+        type = TYPE_U8X16;
+        break;
     case poTokenType::VOID:
         type = TYPE_VOID;
         break;
@@ -1011,6 +1168,7 @@ void poTypeChecker::checkConstructorCall(poNode* decl)
 void poTypeChecker::checkDecl(poNode* node)
 {
     poUnaryNode* decl = static_cast<poUnaryNode*>(node);
+    demand(decl->token().string());
     if (decl->child()->type() == poNodeType::ASSIGNMENT)
     {
         poBinaryNode* assignment = static_cast<poBinaryNode*>(decl->child());
@@ -1498,11 +1656,22 @@ int poTypeChecker::checkExpr(poNode* node)
         case TYPE_I64:
         case TYPE_F64:
         case TYPE_F32:
+        case TYPE_F32X4:
+        case TYPE_F64X2:
             if (!checkEquivalence(type, checkExpr(binary->right())))
             {
                 type = -1;
             }
             break;
+        case TYPE_I32X4:
+        case TYPE_U8X16:
+            // SSE2 has no packed multiply or divide for these lanes
+            if ((node->type() != poNodeType::ADD && node->type() != poNodeType::SUB) ||
+                !checkEquivalence(type, checkExpr(binary->right())))
+            {
+                type = -1;
+            }
+            break;
         default:
             type = -1; // binary arithmetic not allowed
             break;
@@ -1720,6 +1889,8 @@ int poTypeChecker::checkMemberCall(poNode* node)
 {
     poBinaryNode* memberCall = static_cast<poBinaryNode*>(node);
     assert(memberCall->type() == poNodeType::MEMBER_CALL);
+    demand(memberCall->token().string());
+    demand(memberCall->right()->token().string());
 
     const int expr = checkExpr(memberCall->left());
     if (expr == -1)
@@ -2003,6 +2174,7 @@ int poTypeChecker::checkNew(poNode* node)
 {
     poUnaryNode* newNode = static_cast<poUnaryNode*>(node);
     assert(newNode->type() == poNodeType::NEW);
+    demand(newNode->token().string());
 
     if (newNode->child()->type() == poNodeType::CONSTRUCTOR)
     {
@@ -2037,6 +2209,7 @@ int poTypeChecker::checkNew(poNode* node)
 int poTypeChecker::checkCall(poNode* node)
 {
     const std::string& name = node->token().string();
+    demand(name);
 
     poListNode* function = getFunction(name);
     if (function == nullptr)
@@ -33,8 +33,13 @@ namespace po
         bool checkCompare(const int lhs, const int rhs);
         void checkModules(poNode* node);
         void checkNamespaces(poNode* node, const std::vector<poNode*> importNodes);
+        void enterNamespace(poNode* node, const std::vector<poNode*>& importNodes);
+        void checkPending();
+        void checkPending(const int index);
+        void demand(const std::string& name);
         void checkFunctions(poNode* node);
         void checkExpression(poNode* classNode, poNode* node);
+        void checkStaticInitializer(poNode* node);
         void checkConstructor(poNode* node);
         void pushGenericParameters(poListNode* genericArgs);
         void popGenericParameters();
@@ -73,6 +78,12 @@ namespace po
         std::unordered_map<std::string, poListNode*> _functions;
         std::vector<std::string> _imports;
         std::vector<std::string> _genericParameters;
+        std::vector<poNode*> _pending; /* function and constructor bodies waiting to be checked */
+        std::vector<poNode*> _pendingNamespaces;
+        std::vector<std::vector<poNode*>> _pendingImports;
+        std::unordered_map<std::string, std::vector<int>> _pendingNames; /* short name -> pending bodies */
+        std::unordered_set<std::string> _demandedNames;
+        std::vector<std::string> _demanded;
         poListNode* _genericArgs;
         std::string _errorText;
         int _errorLine;
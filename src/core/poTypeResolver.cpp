@@ -129,6 +129,18 @@ void poTypeResolver::resolveStatics(poNode* namespaceNode)
                 const int resultType = getPointerType(dataType, pointerCount);
                 poType& resultTypeInfo = _module.types()[resultType];
                 int constantId = -1;
+                if (constant != nullptr && constant->type() != poNodeType::CONSTANT)
+                {
+                    // The initializer is run at compile time by the code generator, until
+                    // then the variable is zero. Only integers can be stored in .data.
+                    if (!resultTypeInfo.isPointer() &&
+                        token.token() != poTokenType::F32_TYPE &&
+                        token.token() != poTokenType::F64_TYPE)
+                    {
+                        constant = nullptr;
+                    }
+                }
+
                 if (constant == nullptr)
                 {
                     poConstantPool& pool = _module.constants();
@@ -392,7 +404,7 @@ void poTypeResolver::getFunction(poNode* node, poNamespace& ns)
                 fullname,
                 int(args->list().size()),
                 (poAttributes)attributes,
-                poCallConvention::X86_64));
+                poCallConvention::Pora));
         }
         else if (child->type() == poNodeType::RESOLVER)
         {
@@ -448,7 +460,7 @@ void poTypeResolver::getConstructor(poNode* node, poNamespace& ns)
                 fullname,
                 int(args->list().size()),
                 poAttributes(attributes),
-                poCallConvention::X86_64));
+                poCallConvention::Pora));
         }
         else if (child->type() == poNodeType::RESOLVER)
         {
@@ -1186,7 +1198,7 @@ void poTypeResolver::resolveType(const std::string& name, poNamespace& ns, poLis
                 type.fullname() + "::" + type.name(),
                 0,
                 poAttributes::PUBLIC,
-                poCallConvention::X86_64));
+                poCallConvention::Pora));
         }
     }
 
@@ -42,6 +42,18 @@ int poUtil::getType(poToken& token) {
     case poTokenType::F32_TYPE:
         type = TYPE_F32;
         break;
+    case poTokenType::F32X4_TYPE:
+        type = TYPE_F32X4;
+        break;
+    case poTokenType::F64X2_TYPE:
+        type = TYPE_F64X2;
+        break;
+    case poTokenType::I32X4_TYPE:
+        type = TYPE_I32X4;
+        break;
+    case poTokenType::U8X16_TYPE:
+        type = TYPE_U8X16;
+        break;
     case poTokenType::VOID:
         type = TYPE_VOID;
         break;
@@ -219,6 +219,14 @@ int main(const int numArgs, const char** const args)
                 }
                 compiler.setDebugDump(true);
             }
+            else if (arg == "/stats")
+            {
+                compiler.setStats(true);
+            }
+            else if (arg == "/stats:regalloc")
+            {
+                compiler.setAllocationStats(true);
+            }
             else if (arg == "/O0")
             {
                 // No optimizations
@@ -232,6 +240,21 @@ int main(const int numArgs, const char** const args)
             {
                 compiler.setOptimizationLevel(OPTIMIZATION_LEVEL_2);
             }
+            else if (arg == "/regalloc:graph")
+            {
+                compiler.setAllocator(poRegAllocType::Graph);
+                compiler.setLinearScanThreshold(0);
+            }
+            else if (arg == "/regalloc:linear")
+            {
+                compiler.setAllocator(poRegAllocType::Linear);
+            }
+            else if (arg == "/regalloc:auto")
+            {
+                // Graph coloring, except for very large functions (the default)
+                compiler.setAllocator(poRegAllocType::Graph);
+                compiler.setLinearScanThreshold(LINEAR_SCAN_THRESHOLD);
+            }
             else if (arg.starts_with("/std:"))
             {
                 if (arg.size() > 5)
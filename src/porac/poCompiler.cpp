@@ -10,8 +10,14 @@
 #include "poOptMemToReg.h"
 #include "poOptDCE.h"
 #include "poOptCopy.h"
+#include "poOptEscape.h"
+#include "poOptIdiom.h"
 #include "poOptInline.h"
+#include "poOptVectorize.h"
+#include "poOptGlobalDCE.h"
+#include "poOptEval.h"
 #include "poOptProp.h"
+#include "poSummary.h"
 #include "poSSA.h"
 #include "poTypeResolver.h"
 #include "poTypeValidator.h"
@@ -116,6 +122,11 @@ int poCompiler:: compile()
     }
     if (_debugDump) { module.dump(_debugDumpName); }
 
+    // Remove functions which can't be reached from the entry point
+    poOptGlobalDCE globalDCE;
+    globalDCE.optimize(module);
+    if (_stats) { globalDCE.dump(); }
+
     // Convert to SSA form and insert PHI nodes
     poSSA ssa;
     ssa.construct(module);
@@ -130,6 +141,44 @@ int poCompiler:: compile()
     poOptCopy copy;
     copy.optimize(module);
 
+    // Summarize the side effects of each function for the passes which follow
+    poSummaryAnalysis summaries;
+    if (_optimizationLevel >= OPTIMIZATION_LEVEL_1)
+    {
+        summaries.analyze(module);
+    }
+
+    // Evaluate calls with constant arguments to functions without side effects
+    if (_optimizationLevel >= OPTIMIZATION_LEVEL_1)
+    {
+        poOptEval eval;
+        eval.optimize(module);
+        if (_stats) { eval.dump(); }
+    }
+
+    // Replace loops which copy or fill arrays element by element with block memory operations
+    if (_optimizationLevel >= OPTIMIZATION_LEVEL_1)
+    {
+        poOptIdiom idiom;
+        idiom.optimize(module);
+    }
+
+    // Move objects which never leave the function that created them onto the stack,
+    // and then split them into registers where possible
+    if (_optimizationLevel >= OPTIMIZATION_LEVEL_1)
+    {
+        poOptEscape escape;
+        escape.optimize(module);
+        for (const int id : escape.functions())
+        {
+            regToMem.optimize(module, module.functions()[id].cfg());
+        }
+
+        // Objects moved onto the stack no longer count against their function
+        summaries.analyze(module);
+        if (_stats) { summaries.dump(); }
+    }
+
     // Inline small functions
     if (_optimizationLevel >= OPTIMIZATION_LEVEL_2)
     {
@@ -137,6 +186,13 @@ int poCompiler:: compile()
         inliner.optimize(module);
     }
 
+    // Turn simple loops over arrays into SSE2 vector loops
+    if (_optimizationLevel >= OPTIMIZATION_LEVEL_2)
+    {
+        poOptVectorize vectorize;
+        vectorize.optimize(module);
+    }
+
     // Perform constant propagation
     if (_optimizationLevel >= OPTIMIZATION_LEVEL_1)
     {
@@ -155,6 +211,13 @@ int poCompiler:: compile()
 
     // Convert the basic blocks/cfg to machine code
     //_assembler.setDebugDump(_debugDump);
+    _assembler.setBlockLayout(_optimizationLevel >= OPTIMIZATION_LEVEL_1);
+    _assembler.setBranchRelaxation(_optimizationLevel >= OPTIMIZATION_LEVEL_1);
+    _assembler.setPeephole(_optimizationLevel >= OPTIMIZATION_LEVEL_1);
+    _assembler.setTailCalls(_optimizationLevel >= OPTIMIZATION_LEVEL_1);
+    _assembler.setOmitFramePointer(_optimizationLevel >= OPTIMIZATION_LEVEL_1);
+    _assembler.setAllocator(_allocator);
+    _assembler.setLinearScanThreshold(_linearScanThreshold);
     _assembler.generate(module);
     //module.dump(_debugDumpName);
 
@@ -164,6 +227,9 @@ int poCompiler:: compile()
         return 0;
     }
 
+    if (_stats) { _assembler.peepholeOptimizer().dump(); }
+    if (_stats || _allocationStats) { _assembler.dumpAllocations(_allocationStats); }
+
     return 1;
 }
 
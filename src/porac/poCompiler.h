@@ -16,13 +16,21 @@ namespace po
         poCompiler()
             :
             _debugDump(false),
-            _optimizationLevel(OPTIMIZATION_LEVEL_2)
+            _stats(false),
+            _allocationStats(false),
+            _optimizationLevel(OPTIMIZATION_LEVEL_2),
+            _allocator(poRegAllocType::Graph),
+            _linearScanThreshold(LINEAR_SCAN_THRESHOLD)
         {
         }
         void addFile(const std::string& file);
         inline void setDebugDump(const bool debugDump) { _debugDump = debugDump; }
         inline void setDebugDumpName(const std::string& name) { _debugDumpName = name; }
+        inline void setStats(const bool stats) { _stats = stats; }
+        inline void setAllocationStats(const bool allocationStats) { _allocationStats = allocationStats; }
         inline void setOptimizationLevel(const int optimizationLevel) { _optimizationLevel = optimizationLevel; }
+        inline void setAllocator(const poRegAllocType allocator) { _allocator = allocator; }
+        inline void setLinearScanThreshold(const int numInstructions) { _linearScanThreshold = numInstructions; }
         int compile();
         inline const std::vector<std::string>& errors() const { return _errors; }
         inline poAsm& assembler() { return _assembler; }
@@ -35,7 +43,11 @@ namespace po
 
         poAsm _assembler;
         bool _debugDump;
+        bool _stats;
+        bool _allocationStats; /* statistics for each function's register allocation */
         int _optimizationLevel;
+        poRegAllocType _allocator;
+        int _linearScanThreshold;
         std::string _debugDumpName;
     };
 }
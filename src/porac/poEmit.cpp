@@ -2,6 +2,8 @@
 #include "poAST.h"
 #include "poModule.h"
 #include "poUtil.h"
+#include "poInterpreter.h"
+#include "poAggregate.h"
 
 #include <assert.h>
 #include <algorithm>
@@ -13,6 +15,43 @@ constexpr int EMIT_ERROR = -1;
 constexpr int QUALIFIER_NONE = 0;
 constexpr int QUALIFIER_CONST = 1;
 
+static const char* const COPY_MEMORY_SYMBOL = "std::copy_memory";
+static const char* const FILL_MEMORY_SYMBOL = "std::fill_memory";
+
+// Functions in std/simd.po which are replaced by a single vector instruction
+static const struct { const char* symbol; int code; } VECTOR_INTRINSICS[] = {
+    { "std::splat_f32x4", IR_VECTOR_SPLAT },
+    { "std::splat_f64x2", IR_VECTOR_SPLAT },
+    { "std::splat_i32x4", IR_VECTOR_SPLAT },
+    { "std::splat_u8x16", IR_VECTOR_SPLAT },
+    { "std::cmpeq_f32x4", IR_VECTOR_EQUALS },
+    { "std::cmpeq_f64x2", IR_VECTOR_EQUALS },
+    { "std::cmpeq_i32x4", IR_VECTOR_EQUALS },
+    { "std::cmpeq_u8x16", IR_VECTOR_EQUALS },
+    { "std::cmpgt_f32x4", IR_VECTOR_GREATER },
+    { "std::cmpgt_f64x2", IR_VECTOR_GREATER },
+    { "std::cmpgt_i32x4", IR_VECTOR_GREATER },
+    { "std::shuffle_f32x4", IR_VECTOR_SHUFFLE },
+    { "std::shuffle_f64x2", IR_VECTOR_SHUFFLE },
+    { "std::shuffle_i32x4", IR_VECTOR_SHUFFLE },
+    { "std::movemask_f32x4", IR_VECTOR_MOVEMASK },
+    { "std::movemask_f64x2", IR_VECTOR_MOVEMASK },
+    { "std::movemask_i32x4", IR_VECTOR_MOVEMASK },
+    { "std::movemask_u8x16", IR_VECTOR_MOVEMASK },
+};
+
+static int getVectorIntrinsic(const std::string& symbol)
+{
+    for (const auto& intrinsic : VECTOR_INTRINSICS)
+    {
+        if (symbol == intrinsic.symbol)
+        {
+            return intrinsic.code;
+        }
+    }
+    return -1;
+}
+
 //=====================
 // Variable
 //=====================
@@ -25,6 +64,24 @@ poVariable::poVariable(const int id, const int type, const int size)
 {
 }
 
+poPendingFunction::poPendingFunction(const std::string& ns, const int id, const int type, poNode* node)
+    :
+    _ns(ns),
+    _id(id),
+    _type(type),
+    _node(node)
+{
+}
+
+poStaticInitializer::poStaticInitializer(const std::string& ns, const int variable, poNode* node, const std::vector<poNode*>& imports)
+    :
+    _ns(ns),
+    _variable(variable),
+    _node(node),
+    _imports(imports)
+{
+}
+
 //=========================
 // poConditionGraphNode
 //=========================
@@ -425,6 +482,35 @@ int poEmitter::emitArg(const int type, const int arg, poFlowGraph& cfg)
     return instructionId;
 }
 
+int poEmitter::emitArg(const int type, const int arg, const int numEightbytes, poFlowGraph& cfg)
+{
+    // The first eightbyte of a struct passed by value holds the number of eightbytes, which are placed together
+    const int instructionId = _instructionCount;
+    emitInstruction(poInstruction(_instructionCount++, int16_t(type), int16_t(arg), -1, int16_t(numEightbytes), IR_ARG), cfg.getLast());
+    return instructionId;
+}
+
+int poEmitter::emitResult(const int type, const int index, poFlowGraph& cfg)
+{
+    const int instructionId = _instructionCount;
+    emitInstruction(poInstruction(_instructionCount++, int16_t(type), int16_t(index), -1, IR_RESULT), cfg.getLast());
+    return instructionId;
+}
+
+int poEmitter::emitBlockMemory(const int code, const int numArgs, poFlowGraph& cfg)
+{
+    const int instructionId = _instructionCount;
+    emitInstruction(poInstruction(_instructionCount++, TYPE_VOID, int16_t(numArgs), -1, int16_t(code)), cfg.getLast());
+    return instructionId;
+}
+
+int poEmitter::emitVector(const int code, const int type, const int left, const int right, const int immediate, poFlowGraph& cfg)
+{
+    const int instructionId = _instructionCount;
+    emitInstruction(poInstruction(_instructionCount++, int16_t(type), int16_t(left), int16_t(right), int16_t(immediate), int16_t(code)), cfg.getLast());
+    return instructionId;
+}
+
 int poEmitter::emitReturn(const int type, const int value, poFlowGraph& cfg)
 {
     const int instructionId = _instructionCount;
@@ -432,6 +518,13 @@ int poEmitter::emitReturn(const int type, const int value, poFlowGraph& cfg)
     return instructionId;
 }
 
+int poEmitter::emitReturn(const int type, const int value, const int secondType, const int second, poFlowGraph& cfg)
+{
+    const int instructionId = _instructionCount;
+    emitInstruction(poInstruction(_instructionCount++, int16_t(type), int16_t(value), int16_t(second), int16_t(secondType), IR_RETURN), cfg.getLast());
+    return instructionId;
+}
+
 int poEmitter::emitReturn(poFlowGraph& cfg)
 {
     const int instructionId = _instructionCount;
@@ -538,6 +631,13 @@ int poEmitter::emitParam(const int type, const int paramIndex, poFlowGraph& cfg)
     return id;
 }
 
+int poEmitter::emitParam(const int type, const int paramIndex, const int numEightbytes, poFlowGraph& cfg)
+{
+    const int id = _instructionCount++;
+    emitInstruction(poInstruction(id, type, paramIndex, -1, numEightbytes, IR_PARAM), cfg.getLast());
+    return id;
+}
+
 int poEmitter::emitStoreGlobal(const int type, const int value, const int globalId, poFlowGraph& cfg)
 {
     const int store = _instructionCount++;
@@ -605,6 +705,7 @@ poCodeGenerator::poCodeGenerator(poModule& module)
     _loopIndexPtrBody(-1),
     _loopIndexVar(-1),
     _returnType(-1),
+    _callConvention(poCallConvention::Pora),
     _isError(false),
     _errorCol(0),
     _errorLine(0),
@@ -643,11 +744,177 @@ void poCodeGenerator::generate(const std::vector<poNode*>& ast)
         getModules(node);
     }
 
-    for (auto& ns : _module.namespaces())
+    std::vector<poPendingFunction> pending;
+    getPending(pending);
+
+    std::unordered_map<std::string, int> pendingNames;
+    for (int i = 0; i < int(pending.size()); i++)
     {
-        _namespace = ns.name();
+        pendingNames.insert(std::pair<std::string, int>(_module.functions()[pending[i].id()].fullname(), i));
+    }
+
+    // Static variables initialized with an expression get a function of their own, which
+    // is run once everything it calls has been generated
+
+    std::vector<int> initializers;
+    for (const poStaticInitializer& initializer : _staticInitializers)
+    {
+        initializers.push_back(emitStaticInitializer(initializer));
+    }
+
+    // Only emit the functions the entry stub calls and whatever they call in turn,
+    // the rest are left without a body. Without an entry point everything is emitted.
+
+    std::vector<bool> queued(pending.size(), false);
+    std::vector<int> worklist;
+    for (int i = 0; i < int(pending.size()); i++)
+    {
+        const std::string& name = _module.functions()[pending[i].id()].name();
+        if (name == "main" || name == "pora_open" || name == "pora_close")
+        {
+            queued[i] = true;
+            worklist.push_back(i);
+        }
+    }
+
+    if (worklist.size() == 0)
+    {
+        for (const poPendingFunction& function : pending)
+        {
+            emitPending(function);
+        }
+        evaluateStaticInitializers(initializers);
+        return;
+    }
 
-        // Emit static functions
+    std::vector<std::string> symbols;
+    for (const int initializer : initializers)
+    {
+        getCalls(_module.functions()[initializer].cfg(), symbols);
+    }
+
+    while (!isError())
+    {
+        for (const std::string& symbol : symbols)
+        {
+            const auto& it = pendingNames.find(symbol);
+            if (it != pendingNames.end() && !queued[it->second])
+            {
+                queued[it->second] = true;
+                worklist.push_back(it->second);
+            }
+        }
+        symbols.clear();
+
+        if (worklist.size() == 0)
+        {
+            break;
+        }
+
+        const poPendingFunction& function = pending[worklist.back()];
+        worklist.pop_back();
+        emitPending(function);
+        getCalls(_module.functions()[function.id()].cfg(), symbols);
+    }
+
+    evaluateStaticInitializers(initializers);
+}
+
+void poCodeGenerator::getCalls(poFlowGraph& cfg, std::vector<std::string>& symbols)
+{
+    for (int i = 0; i < int(cfg.numBlocks()); i++)
+    {
+        for (const poInstruction& ins : cfg.getBasicBlock(i)->instructions())
+        {
+            std::string symbol;
+            if (ins.code() == IR_CALL &&
+                _module.getSymbol(ins.right(), symbol))
+            {
+                symbols.push_back(symbol);
+            }
+        }
+    }
+}
+
+int poCodeGenerator::emitStaticInitializer(const poStaticInitializer& initializer)
+{
+    const poStaticVariable& variable = _module.staticVariables()[initializer.variable()];
+    const std::string name = variable.name() + "$init";
+    _module.addFunction(poFunction(
+        name,
+        initializer.ns() + "::" + name,
+        0,
+        poAttributes::PRIVATE,
+        poCallConvention::Pora));
+    const int id = int(_module.functions().size()) - 1;
+
+    _namespace = initializer.ns();
+    _imports.clear();
+    _imports.push_back(_namespace);
+    for (poNode* importNode : initializer.imports())
+    {
+        _imports.push_back(importNode->token().string());
+    }
+
+    // Reset the variable emitter.
+    _variables.clear();
+    _emitter.reset();
+
+    poFunction& function = _module.functions()[id];
+    poFlowGraph& cfg = function.cfg();
+    cfg.addBasicBlock(new poBasicBlock());
+
+    _returnInstruction = -1;
+    _thisInstruction = -1;
+    _returnType = variable.type();
+    _callConvention = function.callConvention();
+
+    const int value = emitExpr(initializer.node(), cfg);
+    if (value == EMIT_ERROR)
+    {
+        setError("Static initializer could not be evaluated.", initializer.node()->token());
+        return id;
+    }
+    _emitter.emitReturn(variable.type(), value, cfg);
+
+    for (auto& local : _variables)
+    {
+        function.addVariable(local.second.id());
+    }
+    return id;
+}
+
+void poCodeGenerator::evaluateStaticInitializers(const std::vector<int>& functions)
+{
+    // The results are stored in .data, nothing is run when the program starts
+
+    poInterpreter interpreter(_module);
+    for (int i = 0; i < int(functions.size()) && !isError(); i++)
+    {
+        const poStaticInitializer& initializer = _staticInitializers[i];
+        poStaticVariable& variable = _module.staticVariables()[initializer.variable()];
+
+        uint64_t value = 0;
+        int constantId = -1;
+        if (interpreter.call(functions[i], std::vector<uint64_t>(), value))
+        {
+            constantId = interpreter.addConstant(variable.type(), value);
+        }
+
+        if (constantId == -1 || _module.types()[variable.type()].isPointer())
+        {
+            setError("Static initializer can't be evaluated at compile time.", initializer.node()->token());
+            break;
+        }
+        variable.setConstantId(constantId);
+    }
+}
+
+void poCodeGenerator::getPending(std::vector<poPendingFunction>& pending)
+{
+    for (auto& ns : _module.namespaces())
+    {
+        // Static functions
         for (const int staticFunction : ns.functions())
         {
             poFunction& function = _module.functions()[staticFunction];
@@ -656,15 +923,7 @@ void poCodeGenerator::generate(const std::vector<poNode*>& ast)
             if (node != _functions.end() &&
                 node->second->type() == poNodeType::FUNCTION)
             {
-                _imports.clear();
-                _imports.push_back(_namespace);
-                const std::vector<poNode*> importNodes = _functionImports.find(fullName)->second;
-                for (poNode* importNode : importNodes)
-                {
-                    _imports.push_back(importNode->token().string());
-                }
-
-                emitFunction(node->second, function);
+                pending.push_back(poPendingFunction(ns.name(), staticFunction, -1, node->second));
             }
         }
 
@@ -674,66 +933,62 @@ void poCodeGenerator::generate(const std::vector<poNode*>& ast)
                 continue;
             }
 
-            // Emit constructors
-            const int numConstructors = int(_module.types()[type].constructors().size());
-            for (int i = 0; i < numConstructors; i++)
+            // Constructors
+            const poType& typeData = _module.types()[type];
+            for (const poConstructor& constructor : typeData.constructors())
             {
-                const poType& typeData = _module.types()[type];
-                const std::vector<poConstructor>& constructors = typeData.constructors();
-                auto& constructor = constructors[i];
-                const std::string fullName = ns.name() + "::" + typeData.name() + "::" + constructor.name();
-
                 if (constructor.isDefault())
                 {
-                    _imports.clear();
-                    emitDefaultConstructor(_module.functions()[constructor.id()], type);
+                    pending.push_back(poPendingFunction(ns.name(), constructor.id(), type, nullptr));
+                    continue;
                 }
-                else
-                {
-                    _imports.clear();
-                    _imports.push_back(_namespace);
-                    const std::vector<poNode*> importNodes = _functionImports.find(fullName)->second;
-                    for (poNode* importNode : importNodes)
-                    {
-                        _imports.push_back(importNode->token().string());
-                    }
 
-                    const auto& node = _functions.find(fullName);
-                    if (node != _functions.end() &&
-                        node->second->type() == poNodeType::CONSTRUCTOR)
-                    {
-                        emitFunction(node->second, _module.functions()[constructor.id()]);
-                    }
+                const std::string fullName = ns.name() + "::" + typeData.name() + "::" + constructor.name();
+                const auto& node = _functions.find(fullName);
+                if (node != _functions.end() &&
+                    node->second->type() == poNodeType::CONSTRUCTOR)
+                {
+                    pending.push_back(poPendingFunction(ns.name(), constructor.id(), type, node->second));
                 }
             }
 
-            // Emit member functions
-            const int numMethods = int(_module.types()[type].functions().size());
-            for (int i = 0; i < numMethods; i++)
+            // Member functions
+            for (const poMemberFunction& method : typeData.functions())
             {
-                const poType& typeData = _module.types()[type];
-                const std::vector<poMemberFunction>& methods = typeData.functions();
-                auto& method = methods[i];
                 const std::string fullName = ns.name() + "::" + typeData.name() + "::" + method.name();
                 const auto& node = _functions.find(fullName);
                 if (node != _functions.end() &&
                     node->second->type() == poNodeType::FUNCTION)
                 {
-                    _imports.clear();
-                    _imports.push_back(_namespace);
-                    const std::vector<poNode*> importNodes = _functionImports.find(fullName)->second;
-                    for (poNode* importNode : importNodes)
-                    {
-                        _imports.push_back(importNode->token().string());
-                    }
-
-                    emitFunction(node->second, _module.functions()[method.id()]);
+                    pending.push_back(poPendingFunction(ns.name(), method.id(), type, node->second));
                 }
             }
         }
     }
 }
 
+void poCodeGenerator::emitPending(const poPendingFunction& pending)
+{
+    _namespace = pending.ns();
+    _imports.clear();
+
+    poFunction& function = _module.functions()[pending.id()];
+    if (pending.node() == nullptr)
+    {
+        emitDefaultConstructor(function, pending.type());
+        return;
+    }
+
+    _imports.push_back(_namespace);
+    const std::vector<poNode*>& importNodes = _functionImports.find(function.fullname())->second;
+    for (poNode* importNode : importNodes)
+    {
+        _imports.push_back(importNode->token().string());
+    }
+
+    emitFunction(pending.node(), function);
+}
+
 int poCodeGenerator::getArrayType(const int baseType, const int arrayRank)
 {
     return _module.getArrayType(baseType);
@@ -779,6 +1034,18 @@ int poCodeGenerator::getType(const poToken& token)
     case poTokenType::F32_TYPE:
         type = TYPE_F32;
         break;
+    case poTokenType::F32X4_TYPE:
+        type = TYPE_F32X4;
+        break;
+    case poTokenType::F64X2_TYPE:
+        type = TYPE_F64X2;
+        break;
+    case poTokenType::I32X4_TYPE:
+        type = TYPE_I32X4;
+        break;
+    case poTokenType::U8X16_TYPE:
+        type = TYPE_U8X16;
+        break;
     case poTokenType::VOID:
         type = TYPE_VOID;
         break;
@@ -865,7 +1132,7 @@ void poCodeGenerator::emitCopy(const int src, const int dst, poFlowGraph& cfg)
     assert(srcType.isPointer());
 
     const poType& baseType = _module.types()[srcType.baseType()];
-    const int numCopies = std::max(1, baseType.size() / 8);
+    const int numCopies = baseType.size() / 8;
     for (int i = 0; i < numCopies; i++)
     {
         const int ptrSrc = _emitter.emitPtr(srcType.id(), src, i * 8, cfg);
@@ -873,6 +1140,22 @@ void poCodeGenerator::emitCopy(const int src, const int dst, poFlowGraph& cfg)
         const int ptrDst = _emitter.emitPtr(dstType.id(), dst, i * 8, cfg);
         _emitter.emitStore(TYPE_I64, ptrDst, loadVar, cfg);
     }
+
+    // Copy what is left of objects which aren't a whole number of eightbytes
+    int offset = numCopies * 8;
+    const int tailTypes[] = { TYPE_I32, TYPE_I16, TYPE_I8 };
+    for (const int tailType : tailTypes)
+    {
+        const int size = _module.types()[tailType].size();
+        if (baseType.size() - offset >= size)
+        {
+            const int ptrSrc = _emitter.emitPtr(srcType.id(), src, offset, cfg);
+            const int loadVar = _emitter.emitLoad(tailType, ptrSrc, cfg);
+            const int ptrDst = _emitter.emitPtr(dstType.id(), dst, offset, cfg);
+            _emitter.emitStore(tailType, ptrDst, loadVar, cfg);
+            offset += size;
+        }
+    }
 }
 
 void poCodeGenerator::emitConstructor(poFlowGraph& cfg)
@@ -981,6 +1264,7 @@ void poCodeGenerator::emitDefaultConstructor(poFunction& function, const int typ
 
     _returnInstruction = -1;
     _returnType = TYPE_VOID;
+    _callConvention = function.callConvention();
 
     const poType& typeData = _module.types()[type];
     const int ptrType = poUtil::getPointerType(_module, poUtil::getPointerType(_module, type));
@@ -1049,6 +1333,7 @@ void poCodeGenerator::emitFunction(poNode* node, poFunction& function)
     _returnInstruction = -1;
     _thisInstruction = -1;
     _returnType = retType;
+    _callConvention = function.callConvention();
 
     if (resolver)
     {
@@ -1080,10 +1365,11 @@ void poCodeGenerator::emitFunction(poNode* node, poFunction& function)
     }
 
     poType& type = _module.types()[retType];
-    if (type.size() > 8)
+    if (type.baseType() == TYPE_OBJECT &&
+        poAggregate(_module, retType, _callConvention).isMemory())
     {
-        // X64 calling convention the return value
-        // should be passed in the first parameter
+        // A struct which isn't returned in registers
+        // is written through a pointer passed in the first parameter
         _returnInstruction = _emitter.addVariable(poUtil::getPointerType(_module, retType), QUALIFIER_NONE);
     }
 
@@ -1181,51 +1467,54 @@ void poCodeGenerator::emitBody(poNode* node, poFlowGraph& cfg, poBasicBlock* loo
     }
 }
 
-void poCodeGenerator::emitParameter(const int type, poFlowGraph& cfg, const int paramIndex, const int varName)
+int poCodeGenerator::emitParameter(const int type, poFlowGraph& cfg, const int paramIndex, const int varName)
 {
     /*
      * type = the type of varName
      * bb = the basic block to emit the parameter into
      * paramIndex = the index of the parameter in the function call
      * varName = the variable name to store the parameter into
+     * returns the number of parameters used
      */
 
     const poType& typeData = _module.types()[type];
-    const int size = typeData.size();
     if (typeData.isPointer() &&
         _module.types()[typeData.baseType()].baseType() == TYPE_OBJECT)
     {
         const poType& baseType = _module.types()[typeData.baseType()];
 
-        if (baseType.size() <= 8)
-        {
-            // X86_64 calling convention is to pass this in via a register
-
-            const int param = _emitter.emitParam(type, paramIndex, cfg);
-            _emitter.emitAlloca(type, varName, cfg.getLast());
-            const int pointerType = _emitter.getType(varName);
-            const int ptr = _emitter.emitPtr(pointerType, varName, 0, cfg);
-            _emitter.emitStore(TYPE_I64, ptr, param, cfg);
-        }
-        else
+        const poAggregate aggregate(_module, baseType.id(), _callConvention);
+        if (aggregate.isMemory())
         {
             // X86_64 calling convention this will be passed in as a pointer
 
             cfg.getLast()->addInstruction(poInstruction(varName, type, paramIndex, -1, IR_PARAM));
+            return 1;
         }
-    }
-    else
-    {
-        /* We need to store this on the stack, in case it is referenced */
-        /* TODO: the emitAlloca isn't working properly as varName is created with 'type' rather than the pointer version */
 
-        const int baseType = typeData.baseType();
-        const int param = _emitter.emitParam(baseType, paramIndex, cfg);
-        _emitter.emitAlloca(baseType, varName, cfg.getLast());
-        const int pointerType = _emitter.getType(varName);
-        const int ptr = _emitter.emitPtr(pointerType, varName, 0, cfg);
-        _emitter.emitStore(baseType, ptr, param, cfg);
+        // Each eightbyte is passed in a register of its own, put them back together on the stack
+
+        const std::vector<int>& eightbytes = aggregate.types();
+        _emitter.emitAlloca(baseType.id(), varName, cfg.getLast());
+        for (int i = 0; i < int(eightbytes.size()); i++)
+        {
+            const int param = _emitter.emitParam(eightbytes[i], paramIndex + i, i == 0 ? int(eightbytes.size()) : 0, cfg);
+            const int ptr = _emitter.emitPtr(poUtil::getPointerType(_module, eightbytes[i]), varName, i * 8, cfg);
+            _emitter.emitStore(eightbytes[i], ptr, param, cfg);
+        }
+        return int(eightbytes.size());
     }
+
+    /* We need to store this on the stack, in case it is referenced */
+    /* TODO: the emitAlloca isn't working properly as varName is created with 'type' rather than the pointer version */
+
+    const int baseType = typeData.baseType();
+    const int param = _emitter.emitParam(baseType, paramIndex, cfg);
+    _emitter.emitAlloca(baseType, varName, cfg.getLast());
+    const int pointerType = _emitter.getType(varName);
+    const int ptr = _emitter.emitPtr(pointerType, varName, 0, cfg);
+    _emitter.emitStore(baseType, ptr, param, cfg);
+    return 1;
 }
 
 void poCodeGenerator::emitArgs(poNode* node, poFlowGraph& cfg)
@@ -1265,9 +1554,7 @@ void poCodeGenerator::emitArgs(poNode* node, poFlowGraph& cfg)
 
             const int pointerType = poUtil::getPointerType(_module, baseType.id());
             const int var = getOrAddVariable(name, pointerType, QUALIFIER_NONE, 1);
-            emitParameter(pointerType, cfg, paramCount, var);
-
-            paramCount++;
+            paramCount += emitParameter(pointerType, cfg, paramCount, var);
         }
     }
 }
@@ -1479,15 +1766,17 @@ void poCodeGenerator::emitIfExpression(poConditionGraphNode& cgn, poFlowGraph& c
     }
 }
 
-int poCodeGenerator::emitPassByValue(const int expr, poFlowGraph& cfg)
+void poCodeGenerator::emitPassByValue(const int expr, const std::vector<int>& eightbytes, std::vector<int>& args, std::vector<int>& argTypes, std::vector<int>& argStructs, poFlowGraph& cfg)
 {
-    const int type = _emitter.getType(expr);
-    const poType& typeData = _module.types()[type];
+    /* load each eightbyte of the struct, which are passed as separate arguments */
 
-    const int ptr = _emitter.emitPtr(typeData.id(), expr, 0, cfg);
-    const int load = _emitter.emitLoad(TYPE_I64, ptr, cfg);
-
-    return load; /* return the value loaded from the pointer */
+    for (int i = 0; i < int(eightbytes.size()); i++)
+    {
+        const int ptr = _emitter.emitPtr(poUtil::getPointerType(_module, eightbytes[i]), expr, i * 8, cfg);
+        args.push_back(_emitter.emitLoad(eightbytes[i], ptr, cfg));
+        argTypes.push_back(eightbytes[i]);
+        argStructs.push_back(i == 0 ? int(eightbytes.size()) : 0);
+    }
 }
 
 int poCodeGenerator::emitPassByReference(const int expr, poFlowGraph& cfg)
@@ -1652,6 +1941,7 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
 
     std::vector<int> args;
     std::vector<int> argTypes;
+    std::vector<int> argStructs; /* the number of eightbytes of a struct starting at each arg */
     int returnType = 0;
     poListNode* argsNode = nullptr;
     
@@ -1685,6 +1975,7 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
 
     std::string fullName = name;
     poListNode* functionNode = nullptr;
+    poCallConvention convention = poCallConvention::Pora;
     for (const std::string& import : _imports)
     {
         const auto& it = _functions.find(import + "::" + name);
@@ -1694,6 +1985,7 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
             {
                 poUnaryNode* externNode = static_cast<poUnaryNode*>(it->second);
                 functionNode = static_cast<poListNode*>(externNode->child());
+                convention = poCallConvention::X86_64;
             }
             else
             {
@@ -1735,6 +2027,7 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
 
     /* Extract the expected types from the AST */
 
+    std::vector<int> paramTypes;
     for (int i = 0; i < int(argsNode->list().size()); i++)
     {
         poNode* node = argsNode->list()[i];
@@ -1744,7 +2037,7 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
             type = getType(param->child()->token());
         }
 
-        argTypes.push_back(type);
+        paramTypes.push_back(type);
     }
 
     /* Determine what should be passed into the function */
@@ -1758,7 +2051,7 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
             return EMIT_ERROR;
         }
 
-        const int targetType = argTypes[i];
+        const int targetType = paramTypes[i];
         const poType& targetTypeData = _module.types()[targetType];
 
         const int type = _emitter.getType(expr);
@@ -1767,46 +2060,59 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
             _module.types()[typeData.baseType()].baseType() == TYPE_OBJECT &&
             !targetTypeData.isPointer())
         {
-            // X86_64 calling convention: structs smaller/equal to 8 bytes can be passed by value
-            // Greater than that pass in via a pointer to a IR_ALLOCA
+            // Structs which are classed as being in registers are passed an eightbyte at a time,
+            // otherwise pass in via a pointer to a IR_ALLOCA
 
-            assert(typeData.isPointer());
-
-            const poType& baseType = _module.types()[typeData.baseType()];
-            if (baseType.size() <= 8)
+            const poAggregate aggregate(_module, typeData.baseType(), convention);
+            if (!aggregate.isMemory())
             {
-                args.push_back(emitPassByValue(expr, cfg));
+                emitPassByValue(expr, aggregate.types(), args, argTypes, argStructs, cfg);
             }
             else
             {
                 args.push_back(emitPassByReference(expr, cfg));
+                argTypes.push_back(type);
+                argStructs.push_back(0);
             }
         }
         else
         {
             args.push_back(expr);
+            argTypes.push_back(targetType);
+            argStructs.push_back(0);
         }
     }
 
-    int numArgs = int(call->list().size());
+    int numArgs = int(args.size());
 
     /* Insert instance param */
     if (instance != -1)
     {
         args.insert(args.begin(), instance);
         argTypes.insert(argTypes.begin(), _emitter.getType(instance));
+        argStructs.insert(argStructs.begin(), 0);
         numArgs++;
     }
 
+    /* Vector intrinsics become a single instruction rather than a call */
+
+    const int vectorCode = getVectorIntrinsic(fullName);
+    if (vectorCode != -1)
+    {
+        return emitVectorIntrinsic(vectorCode, node, args, argTypes, returnType, cfg);
+    }
+
     /* Generate the call instruction also handle the return variable */
 
     int retVariable = -1;
+    std::vector<int> results;
     const poType& typeData = _module.types()[returnType];
     if (typeData.baseType() == TYPE_OBJECT)
     {
-        if (typeData.size() > 8)
+        const poAggregate aggregate(_module, returnType, convention);
+        if (aggregate.isMemory())
         {
-            // X86_64 calling convention: the return value is passed in as the first arg
+            // The return value is written through a pointer passed in as the first arg
             numArgs++;
 
             const int returnPtr = poUtil::getPointerType(_module, returnType);
@@ -1819,10 +2125,18 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
         }
         else
         {
+            // The call gives the first eightbyte and an IR_RESULT the second
+            results = aggregate.types();
+
             const int symbol = _module.addSymbol(fullName);
-            retVariable = _emitter.emitCall(TYPE_I64, numArgs, symbol, cfg);
+            retVariable = _emitter.emitCall(results[0], numArgs, symbol, cfg);
         }
     }
+    else if (fullName == COPY_MEMORY_SYMBOL || fullName == FILL_MEMORY_SYMBOL)
+    {
+        // Intrinsics which become a block memory operation rather than a call
+        retVariable = _emitter.emitBlockMemory(fullName == COPY_MEMORY_SYMBOL ? IR_COPY_MEMORY : IR_FILL_MEMORY, numArgs, cfg);
+    }
     else
     {
         const int symbol = _module.addSymbol(fullName);
@@ -1833,41 +2147,27 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
 
     for (int i = 0; i < int(args.size()); i++)
     {
-        const int type = argTypes[i];
-        const poType& typeData = _module.types()[type];
-        if (typeData.baseType() == TYPE_OBJECT)
-        {
-            if (typeData.size() > 8)
-            {
-                // X86_64 pass in via a pointer
-
-                const int pointerType = poUtil::getPointerType(_module, type);
-                _emitter.emitArg(pointerType, args[i], cfg);
-            }
-            else
-            {
-                // X86_64 - it fits in a register (packed into a I64)
-
-                _emitter.emitArg(TYPE_I64, args[i], cfg);
-            }
-        }
-        else
-        {
-            _emitter.emitArg(type, args[i], cfg);
-        }
+        _emitter.emitArg(argTypes[i], args[i], argStructs[i], cfg);
     }
 
     /* Complete any further handling of the return value */
 
-    if (typeData.baseType() == TYPE_OBJECT && typeData.size() <= 8)
+    if (results.size() > 0)
     {
-        // X86_64 - we need to load the value into a struct
+        // We need to store the eightbytes back into a struct
 
-        const int stackAlloc = _emitter.emitAlloca(typeData.id(), cfg.getLast());
-        const int pointerType = poUtil::getPointerType(_module, typeData.id());
+        std::vector<int> values = { retVariable };
+        if (results.size() > 1)
+        {
+            values.push_back(_emitter.emitResult(results[1], 1, cfg));
+        }
 
-        const int ptr = _emitter.emitPtr(pointerType, stackAlloc, 0, cfg);
-        _emitter.emitStore(TYPE_I64, ptr, retVariable, cfg);
+        const int stackAlloc = _emitter.emitAlloca(typeData.id(), cfg.getLast());
+        for (int i = 0; i < int(results.size()); i++)
+        {
+            const int ptr = _emitter.emitPtr(poUtil::getPointerType(_module, results[i]), stackAlloc, i * 8, cfg);
+            _emitter.emitStore(results[i], ptr, values[i], cfg);
+        }
 
         return stackAlloc;
     }
@@ -1875,6 +2175,36 @@ int poCodeGenerator::emitCall(poNode* node, poFlowGraph& cfg, const int instance
     return retVariable;
 }
 
+int poCodeGenerator::emitVectorIntrinsic(const int code, poNode* node, const std::vector<int>& args, const std::vector<int>& argTypes, const int returnType, poFlowGraph& cfg)
+{
+    poListNode* call = static_cast<poListNode*>(node);
+    switch (code)
+    {
+    case IR_VECTOR_SPLAT:
+        return _emitter.emitVector(code, returnType, args[0], -1, 0, cfg);
+    case IR_VECTOR_EQUALS:
+    case IR_VECTOR_GREATER:
+        return _emitter.emitVector(code, returnType, args[0], args[1], 0, cfg);
+    case IR_VECTOR_SHUFFLE:
+    {
+        // The lane order is encoded in the instruction so must be known now
+        poNode* order = call->list()[1];
+        if (order->type() != poNodeType::CONSTANT ||
+            static_cast<poConstantNode*>(order)->constant() != TYPE_I64)
+        {
+            setError("Shuffle order must be a constant.", order->token());
+            return EMIT_ERROR;
+        }
+        const int immediate = int(static_cast<poConstantNode*>(order)->i64() & 0xFF);
+        return _emitter.emitVector(code, returnType, args[0], -1, immediate, cfg);
+    }
+    case IR_VECTOR_MOVEMASK:
+        // The source vector type selects the lane width of the mask
+        return _emitter.emitVector(code, returnType, args[0], -1, argTypes[0], cfg);
+    }
+    return EMIT_ERROR;
+}
+
 void poCodeGenerator::emitLoopPreHeader(poFlowGraph& cfg, const int instanceExpr)
 {
     // Generate a loop to call a function for each element in the array (generally the constructor)
@@ -2174,17 +2504,12 @@ void poCodeGenerator::emitReturn(poNode* node, poFlowGraph& cfg)
         const poType& typeData = _module.types()[type];
         if (_returnInstruction != -1)
         {
-            const poType& baseType = _module.types()[typeData.baseType()];
+            // We need to return the value through the return variable instead of the return statement.
+            // This is done by copying the data in 64-bit chunks.
+            //
+            emitCopy(expr, _returnInstruction, cfg);
 
-            if (baseType.size() > 8)
-            {
-                // We need to return the value through the return variable instead of the return statement.
-                // This is done by copying the data in 64-bit chunks.
-                //
-                emitCopy(expr, _returnInstruction, cfg);
-
-                _emitter.emitReturn(cfg);
-            }
+            _emitter.emitReturn(cfg);
         }
         else
         {
@@ -2198,11 +2523,25 @@ void poCodeGenerator::emitReturn(poNode* node, poFlowGraph& cfg)
 
             if (isObject)
             {
-                // We need to pack the struct data into a I64 and return this.
+                // We need to load each eightbyte of the struct and return them in registers.
+
+                const poAggregate aggregate(_module, _returnType, _callConvention);
+                const std::vector<int>& eightbytes = aggregate.types();
+                std::vector<int> values;
+                for (int i = 0; i < int(eightbytes.size()); i++)
+                {
+                    const int ptr = _emitter.emitPtr(poUtil::getPointerType(_module, eightbytes[i]), expr, i * 8, cfg);
+                    values.push_back(_emitter.emitLoad(eightbytes[i], ptr, cfg));
+                }
 
-                const int ptr = _emitter.emitPtr(type, expr, 0, cfg);
-                const int load = _emitter.emitLoad(TYPE_I64, ptr, cfg);
-                _emitter.emitReturn(TYPE_I64, load, cfg);
+                if (values.size() > 1)
+                {
+                    _emitter.emitReturn(eightbytes[0], values[0], eightbytes[1], values[1], cfg);
+                }
+                else
+                {
+                    _emitter.emitReturn(eightbytes[0], values[0], cfg);
+                }
             }
             else
             {
@@ -2477,6 +2816,14 @@ void poCodeGenerator::emitDefaultValue(const int type, poFlowGraph& cfg, const i
         constant = pool.getConstant(0.0);
         if (constant == -1) constant = pool.addConstant(0.0);
         break;
+    case TYPE_F32X4:
+    case TYPE_F64X2:
+    case TYPE_I32X4:
+    case TYPE_U8X16:
+        // Vectors are cleared by the backend, the constant only marks the value as zero
+        constant = pool.getConstant((int64_t)0);
+        if (constant == -1) constant = pool.addConstant((int64_t)0);
+        break;
     }
 
     if (constant != -1)
@@ -3481,6 +3828,12 @@ void poCodeGenerator::getNamespaces(poNode* node, const std::vector<poNode*>& im
             functionNode = static_cast<poListNode*>(static_cast<poUnaryNode*>(child)->child());
         }
 
+        if (child->type() == poNodeType::STATEMENT)
+        {
+            getStaticInitializer(child, namespaceName, importNodes);
+            continue;
+        }
+
         if (functionNode->type() != poNodeType::FUNCTION &&
             functionNode->type() != poNodeType::CONSTRUCTOR)
         {
@@ -3520,3 +3873,36 @@ void poCodeGenerator::getNamespaces(poNode* node, const std::vector<poNode*>& im
     }
 }
 
+void poCodeGenerator::getStaticInitializer(poNode* node, const std::string& namespaceName, const std::vector<poNode*>& importNodes)
+{
+    poUnaryNode* statement = static_cast<poUnaryNode*>(node);
+    if (statement->child()->type() != poNodeType::ASSIGNMENT)
+    {
+        return;
+    }
+
+    poBinaryNode* assignment = static_cast<poBinaryNode*>(statement->child());
+    if (assignment->right()->type() == poNodeType::CONSTANT)
+    {
+        return;
+    }
+
+    const std::string& name = assignment->left()->token().string();
+    for (const poNamespace& ns : _module.namespaces())
+    {
+        if (ns.name() != namespaceName)
+        {
+            continue;
+        }
+
+        for (const int id : ns.staticVariables())
+        {
+            if (_module.staticVariables()[id].name() == name)
+            {
+                _staticInitializers.push_back(poStaticInitializer(namespaceName, id, assignment->right(), importNodes));
+                return;
+            }
+        }
+    }
+}
+
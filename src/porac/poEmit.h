@@ -16,6 +16,7 @@ namespace po
     class poToken;
     class poBasicBlock;
     class poInstruction;
+    enum class poCallConvention;
 
     class poVariable
     {
@@ -113,7 +114,12 @@ namespace po
         int emitCmp(const int type, const int left, const int right, poFlowGraph& cfg);
         int emitCall(const int returnType, const int numArgs, const int symbolId, poFlowGraph& cfg);
         int emitArg(const int type, const int arg, poFlowGraph& cfg);
+        int emitArg(const int type, const int arg, const int numEightbytes, poFlowGraph& cfg);
+        int emitResult(const int type, const int index, poFlowGraph& cfg);
+        int emitBlockMemory(const int code, const int numArgs, poFlowGraph& cfg);
+        int emitVector(const int code, const int type, const int left, const int right, const int immediate, poFlowGraph& cfg);
         int emitReturn(const int type, const int value, poFlowGraph& cfg);
+        int emitReturn(const int type, const int value, const int secondType, const int second, poFlowGraph& cfg);
         int emitReturn(poFlowGraph& cfg);
         int emitSignExtend(const int dstType, const int srcType, const int value, poFlowGraph& cfg);
         int emitZeroExtend(const int dstType, const int srcType, const int value, poFlowGraph& cfg);
@@ -129,6 +135,7 @@ namespace po
         int emitBranch(const int branchType, poFlowGraph& cfg);
         int emitBranch(const int type, const int branchType, poFlowGraph& cfg);
         int emitParam(const int type, const int paramIndex, poFlowGraph& cfg);
+        int emitParam(const int type, const int paramIndex, const int numEightbytes, poFlowGraph& cfg);
         int emitStoreGlobal(const int type, const int value, const int globalId, poFlowGraph& cfg);
         int emitLoadGlobal(const int type, const int globalId, poFlowGraph& cfg);
 
@@ -148,6 +155,38 @@ namespace po
         int _instructionCount;
     };
 
+    class poPendingFunction
+    {
+    public:
+        poPendingFunction(const std::string& ns, const int id, const int type, poNode* node);
+        inline const std::string& ns() const { return _ns; }
+        inline const int id() const { return _id; }
+        inline const int type() const { return _type; }
+        inline poNode* node() const { return _node; }
+
+    private:
+        std::string _ns;
+        int _id;
+        int _type;
+        poNode* _node; /* nullptr for a default constructor */
+    };
+
+    class poStaticInitializer
+    {
+    public:
+        poStaticInitializer(const std::string& ns, const int variable, poNode* node, const std::vector<poNode*>& imports);
+        inline const std::string& ns() const { return _ns; }
+        inline const int variable() const { return _variable; }
+        inline poNode* node() const { return _node; }
+        inline const std::vector<poNode*>& imports() const { return _imports; }
+
+    private:
+        std::string _ns;
+        int _variable;
+        poNode* _node; /* the initializer expression */
+        std::vector<poNode*> _imports;
+    };
+
     class poCodeGenerator
     {
     public:
@@ -172,6 +211,12 @@ namespace po
         int getArrayType(const int baseType, const int arrayRank);
         void getModules(poNode* node);
         void getNamespaces(poNode* node, const std::vector<poNode*>& importNodes);
+        void getStaticInitializer(poNode* node, const std::string& namespaceName, const std::vector<poNode*>& importNodes);
+        void getPending(std::vector<poPendingFunction>& pending);
+        void emitPending(const poPendingFunction& pending);
+        void getCalls(poFlowGraph& cfg, std::vector<std::string>& symbols);
+        int emitStaticInitializer(const poStaticInitializer& initializer);
+        void evaluateStaticInitializers(const std::vector<int>& functions);
         void emitArrayCopy(const int src, const int dst, poFlowGraph& cfg, const int size);
         void emitCopy(const int src, const int dst, poFlowGraph& cfg);
         void emitFunction(poNode* node, poFunction& function);
@@ -179,9 +224,9 @@ namespace po
         void emitDefaultConstructor(poFunction& function, const int type);
         void emitBody(poNode* node, poFlowGraph& cfg, poBasicBlock* loopHeader, poBasicBlock* loopEnd);
         void emitArgs(poNode* node, poFlowGraph& cfg);
-        void emitParameter(const int type, poFlowGraph& cfg, const int paramIndex, const int varName);
+        int emitParameter(const int type, poFlowGraph& cfg, const int paramIndex, const int varName);
         void emitStatement(poNode* node, poFlowGraph& cfg);
-        int emitPassByValue(const int expr, poFlowGraph& cfg);
+        void emitPassByValue(const int expr, const std::vector<int>& eightbytes, std::vector<int>& args, std::vector<int>& argTypes, std::vector<int>& argStructs, poFlowGraph& cfg);
         int emitPassByReference(const int expr, poFlowGraph& cfg);
         int emitNew(poNode* node, poFlowGraph& cfg);
         int emitNewArray(poNode* node, poFlowGraph& cfg);
@@ -209,6 +254,7 @@ namespace po
         int emitLoadMember(poNode* node, poFlowGraph& cfg);
         void emitStoreMember(poNode* node, poFlowGraph& cfg, const int id);
         int emitLoadThis(poFlowGraph& cfg);
+        int emitVectorIntrinsic(const int code, poNode* node, const std::vector<int>& args, const std::vector<int>& argTypes, const int returnType, poFlowGraph& cfg);
         int emitLoadVariable(poNode* node, poFlowGraph& cfg);
         int emitSizeof(poNode* node, poFlowGraph& cfg);
         int emitBoundsCheck(poFlowGraph& cfg, const int var, const int accessor);
@@ -245,11 +291,13 @@ namespace po
         std::unordered_map<std::string, poNode*> _functions;
         std::unordered_map<std::string, poVariable> _variables;
         std::unordered_map<std::string, std::vector<poNode*>> _functionImports;
+        std::vector<poStaticInitializer> _staticInitializers;
         std::vector<std::string> _imports;
         std::string _namespace;
         int _returnInstruction;
         int _thisInstruction;
         int _returnType;
+        poCallConvention _callConvention;
         bool _isError;
         int _errorLine;
         int _errorCol;
@@ -238,10 +238,31 @@ static bool compareOutput(const std::string& sourceFile, const std::string& actu
     return true;
 }
 
+static bool isEnabled(const std::string& path, const std::string& optimizationLevel)
+{
+    // A test which relies on an optimization, such as tail calls, names the lowest level it runs at in a .opt file
+
+    std::ifstream stream(path + ".opt");
+    if (!stream.is_open())
+    {
+        return true;
+    }
+
+    std::string level;
+    stream >> level;
+    return optimizationLevel >= level;
+}
+
 static void runIntegrationTest(const std::string& name, const std::string& path, const std::string& compiler, const std::string& std, const bool interactive, const std::string& optimizationLevel)
 {
     std::cout << "Integration Test " << name;
 
+    if (!isEnabled(path, optimizationLevel))
+    {
+        std::cout << " SKIPPED" << std::endl;
+        return;
+    }
+
 #ifdef WIN32
     const std::vector<std::string> app = { "app.exe" };
 #else
@@ -281,6 +302,7 @@ static void runIntegrationTest(const std::string& name, const std::string& path,
     args.push_back(dir + "map.po");
     args.push_back(dir + "numeric.po");
     args.push_back(dir + "traits.po");
+    args.push_back(dir + "simd.po");
 
     if (!executeCommand(args, true))
     {
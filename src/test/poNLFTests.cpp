@@ -296,6 +296,53 @@ static void nestedLoopForestTest7()
     }
 }
 
+static void nestedLoopForestTest8()
+{
+    // Tests the loop depth of a self loop nested in another loop
+
+    std::cout << "Nested Loop Forest #8 ";
+
+    poFlowGraph cfg;
+    poBasicBlock* bb1 = new poBasicBlock();
+    poBasicBlock* bb2 = new poBasicBlock();
+    poBasicBlock* bb3 = new poBasicBlock();
+    poBasicBlock* bb4 = new poBasicBlock();
+    poBasicBlock* bb5 = new poBasicBlock();
+
+    bb1->setBranch(bb5, false);
+    bb2->setBranch(bb5, false);
+    bb3->setBranch(bb3, false);
+    bb4->setBranch(bb2, true);
+
+    cfg.addBasicBlock(bb1);
+    cfg.addBasicBlock(bb2);
+    cfg.addBasicBlock(bb3);
+    cfg.addBasicBlock(bb4);
+    cfg.addBasicBlock(bb5);
+
+    poDom dom;
+    dom.compute(cfg);
+
+    poNLF nlf;
+    nlf.compute(dom);
+
+    const bool ok =
+        nlf.getDepth(0) == 0 &&
+        nlf.getDepth(1) == 1 &&
+        nlf.getDepth(2) == 2 &&
+        nlf.getDepth(3) == 1 &&
+        nlf.getDepth(4) == 0;
+
+    if (ok)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
 void po::runNestedLoopForestsTests()
 {
     nestedLoopForestTest1();
@@ -305,4 +352,5 @@ void po::runNestedLoopForestsTests()
     nestedLoopForestTest5();
     nestedLoopForestTest6();
     nestedLoopForestTest7();
+    nestedLoopForestTest8();
 }
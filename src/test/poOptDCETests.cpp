@@ -1,5 +1,7 @@
 #include "poOptDCETests.h"
 #include "poOptDCE.h"
+#include "poSummary.h"
+#include "poUtil.h"
 #include "poModule.h"
 
 #include <iostream>
@@ -249,6 +251,75 @@ static void runDCETest5()
     }
 }
 
+static void runDCETest6()
+{
+    std::cout << "DCE Test #6 ";
+
+    // An unused call to a function without side effects is removed along with its
+    // arguments, while a call which writes through its parameter is kept.
+
+    poModule module;
+    poNamespace ns("Example");
+    const int ptrType = poUtil::getPointerType(module, TYPE_I64);
+    const int squareSymbol = module.addSymbol("Example::square");
+    const int storeSymbol = module.addSymbol("Example::store");
+
+    poFunction square("square", "Example::square", 1, poAttributes::PUBLIC, poCallConvention::X86_64);
+    poBasicBlock* squareBB = new poBasicBlock();
+    squareBB->addInstruction(poInstruction(0, TYPE_I64, 0, -1, IR_PARAM));
+    squareBB->addInstruction(poInstruction(1, TYPE_I64, 0, 0, IR_MUL));
+    squareBB->addInstruction(poInstruction(2, TYPE_I64, 1, -1, IR_RETURN));
+    square.cfg().addBasicBlock(squareBB);
+
+    poFunction store("store", "Example::store", 1, poAttributes::PUBLIC, poCallConvention::X86_64);
+    poBasicBlock* storeBB = new poBasicBlock();
+    storeBB->addInstruction(poInstruction(0, int16_t(ptrType), 0, -1, IR_PARAM));
+    storeBB->addInstruction(poInstruction(1, TYPE_I64, 1, IR_CONSTANT));
+    storeBB->addInstruction(poInstruction(2, TYPE_I64, 0, 1, IR_STORE));
+    storeBB->addInstruction(poInstruction(3, TYPE_VOID, -1, -1, IR_RETURN));
+    store.cfg().addBasicBlock(storeBB);
+
+    poFunction func("testFunc", "Example::testFunc", 1, poAttributes::PUBLIC, poCallConvention::X86_64);
+    poBasicBlock* bb1 = new poBasicBlock();
+    bb1->addInstruction(poInstruction(0, int16_t(ptrType), 0, -1, IR_PARAM));
+    bb1->addInstruction(poInstruction(1, TYPE_I64, 1, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(2, TYPE_I64, 1, int16_t(squareSymbol), IR_CALL));
+    bb1->addInstruction(poInstruction(3, TYPE_I64, 1, -1, IR_ARG));
+    bb1->addInstruction(poInstruction(4, TYPE_VOID, 1, int16_t(storeSymbol), IR_CALL));
+    bb1->addInstruction(poInstruction(5, int16_t(ptrType), 0, -1, IR_ARG));
+    bb1->addInstruction(poInstruction(6, TYPE_VOID, -1, -1, IR_RETURN));
+    func.cfg().addBasicBlock(bb1);
+
+    ns.addFunction(0);
+    ns.addFunction(1);
+    ns.addFunction(2);
+    module.addFunction(square);
+    module.addFunction(store);
+    module.addFunction(func);
+    module.addNamespace(ns);
+
+    poSummaryAnalysis summaries;
+    summaries.analyze(module);
+
+    poOptDCE dce;
+    dce.optimize(module);
+
+    const poSummary* storeSummary = module.getSummary("Example::store");
+    if (bb1->numInstructions() == 4 &&
+        bb1->getInstruction(1).code() == IR_CALL &&
+        bb1->getInstruction(1).right() == storeSymbol &&
+        storeSummary != nullptr &&
+        storeSummary->writesParameter(0) &&
+        !storeSummary->writesMemory())
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
 void po::runOptDCETests()
 {
     runDCETest1();
@@ -256,5 +327,6 @@ void po::runOptDCETests()
     runDCETest3();
     runDCETest4();
     runDCETest5();
+    runDCETest6();
 }
 
@@ -219,10 +219,180 @@ static void memToRegTest3()
     }
 }
 
+static int addStructTypes(poModule& mod, int& fieldPtrType)
+{
+    // struct { i64 x; i64 y; } and pointers to it and to its fields
+
+    const int structType = int(mod.types().size());
+    poType type(structType, TYPE_OBJECT, "vec");
+    type.setSize(16);
+    type.addField(poField(poAttributes::PUBLIC, 0, TYPE_I64, 1, "x"));
+    type.addField(poField(poAttributes::PUBLIC, 8, TYPE_I64, 1, "y"));
+    mod.addType(type);
+
+    const int structPtrType = int(mod.types().size());
+    poType ptrType(structPtrType, structType, "vec*");
+    ptrType.setKind(poTypeKind::POINTER);
+    mod.addType(ptrType);
+
+    fieldPtrType = int(mod.types().size());
+    poType intPtrType(fieldPtrType, TYPE_I64, "I64*");
+    intPtrType.setKind(poTypeKind::POINTER);
+    mod.addType(intPtrType);
+
+    return structPtrType;
+}
+
+static int countCode(poBasicBlock* bb, const int code)
+{
+    int count = 0;
+    for (const poInstruction& ins : bb->instructions())
+    {
+        if (ins.code() == code)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void memToRegTest4()
+{
+    // Tests the struct is split into a variable per field:
+    // 0 IR_ALLOCA vec*
+    // 1 IR_PTR I64* 0 #0
+    // 2 IR_CONSTANT I64 100
+    // 3 IR_STORE I64 1 2
+    // 4 IR_PTR I64* 0 #8
+    // 5 IR_CONSTANT I64 10
+    // 6 IR_STORE I64 4 5
+    // 7 IR_PTR I64* 0 #0
+    // 8 IR_LOAD I64 7
+    // 9 IR_PTR I64* 0 #8
+    // 10 IR_LOAD I64 9
+    // 11 IR_ADD I64 8 10
+    // 12 IR_RETURN I64 11
+
+    std::cout << "MemToReg #4 ";
+
+    poModule mod;
+    int intPtrType = -1;
+    const int structPtrType = addStructTypes(mod, intPtrType);
+    const int constant = mod.constants().addConstant(int64_t(100));
+    const int constant2 = mod.constants().addConstant(int64_t(10));
+
+    poFlowGraph fg;
+    poBasicBlock* bb1 = new poBasicBlock();
+
+    bb1->addInstruction(poInstruction(0, structPtrType, 1 /*num elements*/, -1, IR_ALLOCA));
+    bb1->addInstruction(poInstruction(1, intPtrType, 0, -1, 0, IR_PTR));
+    bb1->addInstruction(poInstruction(2, TYPE_I64, constant, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(3, TYPE_I64, 1, 2, IR_STORE));
+    bb1->addInstruction(poInstruction(4, intPtrType, 0, -1, 8, IR_PTR));
+    bb1->addInstruction(poInstruction(5, TYPE_I64, constant2, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(6, TYPE_I64, 4, 5, IR_STORE));
+    bb1->addInstruction(poInstruction(7, intPtrType, 0, -1, 0, IR_PTR));
+    bb1->addInstruction(poInstruction(8, TYPE_I64, 7, -1, IR_LOAD));
+    bb1->addInstruction(poInstruction(9, intPtrType, 0, -1, 8, IR_PTR));
+    bb1->addInstruction(poInstruction(10, TYPE_I64, 9, -1, IR_LOAD));
+    bb1->addInstruction(poInstruction(11, TYPE_I64, 8, 10, IR_ADD));
+    bb1->addInstruction(poInstruction(12, TYPE_I64, 11, -1, IR_RETURN));
+
+    fg.addBasicBlock(bb1);
+
+    poOptMemToReg reg;
+    reg.optimize(mod, fg);
+
+    bool ok = true;
+    ok &= bb1->numInstructions() == 10;
+    ok &= countCode(bb1, IR_ALLOCA) == 0 &&
+        countCode(bb1, IR_PTR) == 0 &&
+        countCode(bb1, IR_LOAD) == 0 &&
+        countCode(bb1, IR_STORE) == 0;
+    ok &= countCode(bb1, IR_CONSTANT) == 4 &&
+        countCode(bb1, IR_COPY) == 4;
+
+    if (ok)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void memToRegTest5()
+{
+    // Tests only the field whose address escapes stays in memory:
+    // 0 IR_ALLOCA vec*
+    // 1 IR_PTR I64* 0 #0
+    // 2 IR_CONSTANT I64 100
+    // 3 IR_STORE I64 1 2
+    // 4 IR_PTR I64* 0 #8
+    // 5 IR_CALL VOID 1
+    // 6 IR_ARG I64* 4
+    // 7 IR_PTR I64* 0 #0
+    // 8 IR_LOAD I64 7
+    // 9 IR_PTR I64* 0 #8
+    // 10 IR_LOAD I64 9
+    // 11 IR_ADD I64 8 10
+    // 12 IR_RETURN I64 11
+
+    std::cout << "MemToReg #5 ";
+
+    poModule mod;
+    int intPtrType = -1;
+    const int structPtrType = addStructTypes(mod, intPtrType);
+    const int constant = mod.constants().addConstant(int64_t(100));
+
+    poFlowGraph fg;
+    poBasicBlock* bb1 = new poBasicBlock();
+
+    bb1->addInstruction(poInstruction(0, structPtrType, 1 /*num elements*/, -1, IR_ALLOCA));
+    bb1->addInstruction(poInstruction(1, intPtrType, 0, -1, 0, IR_PTR));
+    bb1->addInstruction(poInstruction(2, TYPE_I64, constant, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(3, TYPE_I64, 1, 2, IR_STORE));
+    bb1->addInstruction(poInstruction(4, intPtrType, 0, -1, 8, IR_PTR));
+    bb1->addInstruction(poInstruction(5, TYPE_VOID, 1, 0, IR_CALL));
+    bb1->addInstruction(poInstruction(6, intPtrType, 4, -1, IR_ARG));
+    bb1->addInstruction(poInstruction(7, intPtrType, 0, -1, 0, IR_PTR));
+    bb1->addInstruction(poInstruction(8, TYPE_I64, 7, -1, IR_LOAD));
+    bb1->addInstruction(poInstruction(9, intPtrType, 0, -1, 8, IR_PTR));
+    bb1->addInstruction(poInstruction(10, TYPE_I64, 9, -1, IR_LOAD));
+    bb1->addInstruction(poInstruction(11, TYPE_I64, 8, 10, IR_ADD));
+    bb1->addInstruction(poInstruction(12, TYPE_I64, 11, -1, IR_RETURN));
+
+    fg.addBasicBlock(bb1);
+
+    poOptMemToReg reg;
+    reg.optimize(mod, fg);
+
+    bool ok = true;
+    ok &= bb1->numInstructions() == 12;
+    ok &= countCode(bb1, IR_ALLOCA) == 1 &&
+        countCode(bb1, IR_PTR) == 2 &&
+        countCode(bb1, IR_LOAD) == 1 &&
+        countCode(bb1, IR_STORE) == 0;
+    ok &= bb1->getInstruction(0).code() == IR_CONSTANT &&
+        bb1->getInstruction(1).code() == IR_ALLOCA;
+
+    if (ok)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
 void po::runOptMemoryToRegTests()
 {
     memToRegTest1();
     memToRegTest2();
     memToRegTest3();
+    memToRegTest4();
+    memToRegTest5();
 }
 
@@ -19,17 +19,14 @@ static void regGraphTest1()
     graph.insert(poInterferenceGraph_Node(1002, false, 4, 6));
     graph.insert(poInterferenceGraph_Node(1003, false, 5, 7));
 
-    const auto& nodes = graph.nodes();
-    const auto& n1 = nodes[0].getNeighbours();
-    const auto& n2 = nodes[1].getNeighbours();
-    const auto& n3 = nodes[2].getNeighbours();
-    const auto& n4 = nodes[3].getNeighbours();
-    if (n1.size() == 3 &&
-        n1[0] == 1 &&
-        n2.size() == 1 &&
-        n2[0] == 0 &&
-        n3.size() == 2 &&
-        n4.size() == 2)
+    if (graph.degree(0) == 3 &&
+        graph.interferes(0, 1) &&
+        graph.interferes(1, 0) &&
+        graph.degree(1) == 1 &&
+        !graph.interferes(1, 2) &&
+        graph.degree(2) == 2 &&
+        graph.interferes(2, 3) &&
+        graph.degree(3) == 2)
     {
         std::cout << "OK" << std::endl;
     }
@@ -169,7 +166,7 @@ static void regGraphTest5()
     graph.colorGraph(8, 2);
 
     if (graph.nodes()[0].getMerged().size() == 2 &&
-        graph.nodes()[0].getNeighbours().size() == 2 &&
+        graph.degree(0) == 2 &&
         graph.nodes()[0].color() == 0 &&
         graph.nodes()[1].color() == 0 &&
         graph.nodes()[2].color() == 0)
@@ -207,7 +204,7 @@ static void regGraphTest6()
     graph.colorGraph(8, 2);
 
     if (graph.nodes()[0].getMerged().size() == 2 &&
-        graph.nodes()[0].getNeighbours().size() == 2 &&
+        graph.degree(0) == 2 &&
         graph.nodes()[0].color() == 0 &&
         graph.nodes()[1].color() == 0 &&
         graph.nodes()[2].color() == 0)
@@ -228,8 +225,8 @@ static void regGraphTest7()
     poBasicBlock* bb = new poBasicBlock();
     cfg.addBasicBlock(bb);
 
-    bb->addInstruction(poInstruction(1000, TYPE_I64, 0, IR_CONSTANT));
-    bb->addInstruction(poInstruction(1001, TYPE_I64, 0, IR_CONSTANT));
+    bb->addInstruction(poInstruction(1000, TYPE_I64, 0, -1, IR_PARAM));
+    bb->addInstruction(poInstruction(1001, TYPE_I64, 1, -1, IR_PARAM));
     bb->addInstruction(poInstruction(1002, TYPE_I64, 1000, 1001, IR_ADD));
     bb->addInstruction(poInstruction(1003, TYPE_I64, 0, IR_CONSTANT));
     bb->addInstruction(poInstruction(1004, TYPE_I64, 0, IR_CONSTANT));
@@ -238,10 +235,12 @@ static void regGraphTest7()
     bb->addInstruction(poInstruction(1007, TYPE_I64, 1006, 1000, IR_ADD));
     bb->addInstruction(poInstruction(1008, TYPE_I64, 1007, 1001, IR_ADD));
 
+    // Six variables are live at 5, which is one more than there are registers
+
     poModule mod;
     poRegGraph graph(mod);
-    graph.setNumRegisters(8);
-    for (int i = 0; i < 8; i++)
+    graph.setNumRegisters(5);
+    for (int i = 0; i < 5; i++)
     {
         graph.setType(i, poRegType::General);
     }
@@ -358,6 +357,158 @@ static void regGraphTest8() {
     }
 }
 
+static void regGraphTest9()
+{
+    // Test coalescing a copy whose source dies at the copy
+
+    std::cout << "Reg Graph Test #9 ";
+
+    poInterferenceGraph graph;
+    graph.insert(poInterferenceGraph_Node(1000, false, 0, 2));
+    graph.insert(poInterferenceGraph_Node(1001, false, 0, 2));
+    graph.insert(poInterferenceGraph_Node(1002, false, 1, 3));
+    graph.insert(poInterferenceGraph_Node(1003, false, 3, 5));
+    graph.insert(poInterferenceGraph_Node(1004, false, 3, 4));
+    graph.addMove(3, 2);
+    graph.addMove(4, 0); // 1000 is dead before the copy
+
+    graph.colorGraph(4, 2);
+
+    const auto& nodes = graph.nodes();
+    if (graph.numMoves() == 1 &&
+        nodes[2].color() != -1 &&
+        nodes[2].color() == nodes[3].color() &&
+        nodes[3].color() != nodes[4].color())
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void regGraphTest10()
+{
+    // Test the spill costs keep the variables used in loops in registers
+
+    std::cout << "Reg Graph Test #10 ";
+
+    poInterferenceGraph graph;
+    graph.insert(poInterferenceGraph_Node(1000, false, 0, 10));
+    graph.insert(poInterferenceGraph_Node(1001, false, 1, 10));
+    graph.insert(poInterferenceGraph_Node(1002, false, 2, 10));
+    graph.insert(poInterferenceGraph_Node(1003, false, 3, 10));
+    graph.addCost(0, 1000.0f);
+    graph.addCost(1, 1.0f);
+    graph.addCost(2, 1.0f);
+    graph.addCost(3, 100.0f);
+
+    graph.colorGraph(3, 1);
+
+    const auto& nodes = graph.nodes();
+    if (nodes[0].color() != -1 &&
+        nodes[1].spilled() &&
+        nodes[2].spilled() &&
+        nodes[3].color() != -1 &&
+        nodes[0].color() != nodes[3].color())
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void regGraphTest11()
+{
+    // Test spilled constants are rematerialized rather than stored and loaded
+
+    std::cout << "Reg Graph Test #11 ";
+
+    poFlowGraph cfg;
+    poBasicBlock* bb = new poBasicBlock();
+    cfg.addBasicBlock(bb);
+
+    bb->addInstruction(poInstruction(1000, TYPE_I64, 0, IR_CONSTANT));
+    bb->addInstruction(poInstruction(1001, TYPE_I64, 0, IR_CONSTANT));
+    bb->addInstruction(poInstruction(1002, TYPE_I64, 1000, 1001, IR_ADD));
+    bb->addInstruction(poInstruction(1003, TYPE_I64, 0, IR_CONSTANT));
+    bb->addInstruction(poInstruction(1004, TYPE_I64, 0, IR_CONSTANT));
+    bb->addInstruction(poInstruction(1005, TYPE_I64, 1003, 1004, IR_ADD));
+    bb->addInstruction(poInstruction(1006, TYPE_I64, 1005, 1002, IR_ADD));
+    bb->addInstruction(poInstruction(1007, TYPE_I64, 1006, 1000, IR_ADD));
+    bb->addInstruction(poInstruction(1008, TYPE_I64, 1007, 1001, IR_ADD));
+
+    poModule mod;
+    poRegGraph graph(mod);
+    graph.setNumRegisters(5);
+    for (int i = 0; i < 5; i++)
+    {
+        graph.setType(i, poRegType::General);
+    }
+    graph.allocateRegisters(cfg);
+
+    bool ok = graph.numSpills() == 0;
+    poRegRestore restore;
+    int numRematerialized = 0;
+    for (int pos = 0; pos < 9; pos++)
+    {
+        int element = 0;
+        while (graph.restoreAt(pos, element++, &restore))
+        {
+            ok &= restore.isRematerialized();
+            ok &= restore.restoreStackSlot() == -1;
+            ok &= graph.isRematerialized(restore.restoreVariable());
+            numRematerialized++;
+        }
+    }
+    ok &= numRematerialized > 0;
+
+    if (ok)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void regGraphTest12()
+{
+    // Test the interference matrix across many words, and removing an edge for a copy
+
+    std::cout << "Reg Graph Test #12 ";
+
+    poInterferenceGraph graph;
+    for (int i = 0; i < 200; i++)
+    {
+        graph.insert(poInterferenceGraph_Node(1000 + i, false, i, 200));
+    }
+    graph.insert(poInterferenceGraph_Node(1200, false, 200, 300));
+    graph.insert(poInterferenceGraph_Node(1201, false, 201, 300));
+    graph.addMove(200, 199);
+
+    if (graph.degree(0) == 200 &&
+        graph.interferes(0, 199) &&
+        graph.interferes(198, 130) &&
+        graph.degree(199) == 199 &&
+        !graph.interferes(200, 199) &&
+        graph.degree(200) == 200 &&
+        graph.interferes(200, 201) &&
+        graph.degree(201) == 1 &&
+        graph.numMoves() == 1)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
 void po::runRegGraphTests()
 {
     regGraphTest1();
@@ -368,5 +519,9 @@ void po::runRegGraphTests()
     regGraphTest6();
     regGraphTest7();
     regGraphTest8();
+    regGraphTest9();
+    regGraphTest10();
+    regGraphTest11();
+    regGraphTest12();
 }
 
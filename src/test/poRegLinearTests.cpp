@@ -1,6 +1,8 @@
 #include "poRegLinearTests.h"
 #include "poCFG.h"
 #include "poRegLinear.h"
+#include "poStackColoring.h"
+#include "poParallelCopy.h"
 #include "poType.h"
 #include "poModule.h"
 
@@ -153,7 +155,7 @@ static void regLinearTest3()
     poFlowGraph cfg;
     poBasicBlock* bb1 = new poBasicBlock();
 
-    bb1->addInstruction(poInstruction(1000, TYPE_I64, 100, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1000, TYPE_I64, 0, -1, IR_PARAM));
     bb1->addInstruction(poInstruction(1001, TYPE_I64, 200, IR_CONSTANT));
     bb1->addInstruction(poInstruction(1002, TYPE_I64, 300, IR_CONSTANT));
     bb1->addInstruction(poInstruction(1003, TYPE_I64, 1002, 1001, IR_ADD));
@@ -178,6 +180,170 @@ static void regLinearTest3()
     }
 }
 
+static void regLinearTest4()
+{
+    std::cout << "Reg Linear Test #4 ";
+
+    poFlowGraph cfg;
+    poBasicBlock* bb1 = new poBasicBlock();
+
+    bb1->addInstruction(poInstruction(1000, TYPE_I64, 0, -1, IR_PARAM));
+    bb1->addInstruction(poInstruction(1001, TYPE_I64, 200, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1002, TYPE_I64, 300, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1003, TYPE_I64, 1002, 1001, IR_ADD));
+    bb1->addInstruction(poInstruction(1004, TYPE_I64, 1003, 1003, IR_ADD));
+    bb1->addInstruction(poInstruction(1005, TYPE_I64, 1004, 1000, IR_ADD));
+
+    cfg.addBasicBlock(bb1);
+
+    poModule mod;
+    poRegLinear linear(mod);
+    linear.setNumRegisters(3);
+    linear.allocateRegisters(cfg);
+
+    // 1000 is split when the registers run out, and only reloaded where it is used
+    poRegSpill spill;
+    poRegRestore restore;
+    if (linear.spillAt(3, 0, &spill) &&
+        spill.spillVariable() == 1000 &&
+        linear.restoreAt(5, 0, &restore) &&
+        restore.restoreVariable() == 1000 &&
+        linear.numSpills() == 1 &&
+        linear.numRestores() == 1)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void regLinearTest5()
+{
+    std::cout << "Reg Linear Test #5 ";
+
+    poFlowGraph cfg;
+    poBasicBlock* bb1 = new poBasicBlock();
+
+    bb1->addInstruction(poInstruction(1000, TYPE_I64, 100, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1001, TYPE_I64, 1000, -1, IR_COPY));
+    bb1->addInstruction(poInstruction(1000, TYPE_I64, 1001, -1, IR_COPY));
+    bb1->addInstruction(poInstruction(1002, TYPE_I64, 1000, -1, IR_RETURN));
+
+    cfg.addBasicBlock(bb1);
+
+    poModule mod;
+    poRegLinear linear(mod);
+    linear.setNumRegisters(1);
+    linear.allocateRegisters(cfg);
+
+    // 1001 fits in the hole between the two definitions of 1000
+    if (linear.getRegisterByVariable(1000, 0) == 0 &&
+        linear.getRegisterByVariable(1001, 1) == 0 &&
+        linear.getRegisterByVariable(1000, 3) == 0 &&
+        linear.numSpills() == 0 &&
+        linear.numRestores() == 0)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void regLinearTest6()
+{
+    std::cout << "Reg Linear Test #6 ";
+
+    poFlowGraph cfg;
+    poBasicBlock* bb1 = new poBasicBlock();
+    poBasicBlock* bb2 = new poBasicBlock();
+    poBasicBlock* bb3 = new poBasicBlock();
+
+    bb1->addInstruction(poInstruction(1000, TYPE_I64, 100, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1001, TYPE_I64, 200, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1002, TYPE_I64, 1001, 1001, IR_CMP));
+    bb1->addInstruction(poInstruction(1003, 0, -1, -1, IR_BR));
+    bb1->setBranch(bb3, false);
+
+    bb2->addInstruction(poInstruction(1004, TYPE_I64, 300, IR_CONSTANT));
+    bb2->addInstruction(poInstruction(1005, TYPE_I64, 400, IR_CONSTANT));
+    bb2->addInstruction(poInstruction(1006, TYPE_I64, 1004, 1005, IR_ADD));
+
+    bb3->addInstruction(poInstruction(1007, TYPE_I64, 1000, -1, IR_RETURN));
+
+    cfg.addBasicBlock(bb1);
+    cfg.addBasicBlock(bb2);
+    cfg.addBasicBlock(bb3);
+    bb2->addIncoming(bb1);
+    bb3->addIncoming(bb1);
+    bb3->addIncoming(bb2);
+
+    poModule mod;
+    poRegLinear linear(mod);
+    linear.setNumRegisters(3);
+    linear.allocateRegisters(cfg);
+
+    // 1000 is spilled in bb2 only, so it is reloaded on the critical edge into bb3, in a block of its own
+    poRegRestore restore;
+    poBasicBlock* edge = bb2->getNext();
+    if (edge != bb3 &&
+        edge->getBranch() == bb3 &&
+        bb3->getIncoming().size() == 2 &&
+        linear.restoreAt(7, 0, &restore) &&
+        restore.restoreVariable() == 1000 &&
+        linear.getRegisterByVariable(1000, 8) == restore.restoreRegister())
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void regLinearTest7()
+{
+    std::cout << "Reg Linear Test #7 ";
+
+    poFlowGraph cfg;
+    poBasicBlock* bb1 = new poBasicBlock();
+
+    bb1->addInstruction(poInstruction(1000, TYPE_I64, 100, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1001, TYPE_I64, 200, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1002, TYPE_I64, 300, IR_CONSTANT));
+    bb1->addInstruction(poInstruction(1003, TYPE_I64, 1002, 1001, IR_ADD));
+    bb1->addInstruction(poInstruction(1004, TYPE_I64, 1003, 1003, IR_ADD));
+    bb1->addInstruction(poInstruction(1005, TYPE_I64, 1004, 1000, IR_ADD));
+
+    cfg.addBasicBlock(bb1);
+
+    poModule mod;
+    poRegLinear linear(mod);
+    linear.setNumRegisters(3);
+    linear.allocateRegisters(cfg);
+
+    // The constant is regenerated where it is used, so it is never stored and its definition is dropped
+    poRegSpill spill;
+    poRegRestore restore;
+    if (!linear.spillAt(3, 0, &spill) &&
+        linear.restoreAt(5, 0, &restore) &&
+        restore.restoreVariable() == 1000 &&
+        restore.isRematerialized() &&
+        linear.isRematerialized(1000) &&
+        !linear.isRematerialized(1001) &&
+        linear.numSpills() == 0)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
 static void stackAllocatorTest1()
 {
     std::cout << "Stack Allocator Test #1 ";
@@ -254,15 +420,170 @@ static void stackAllocatorTest4()
     }
 }
 
+static void stackColoringTest1()
+{
+    std::cout << "Stack Coloring Test #1 ";
+
+    // 1 and 3 are never live together so they share, 2 overlaps both, and 4 only touches 3
+    poStackColoring coloring;
+    coloring.addAlloca(100, 24, 8);
+    coloring.addSpill(1, 0, 8);
+    coloring.addRange(0, 0, 4);
+    coloring.addSpill(2, 1, 8);
+    coloring.addRange(1, 2, 12);
+    coloring.addSpill(3, 2, 8);
+    coloring.addRange(2, 6, 10);
+    coloring.addSpill(4, 3, 8);
+    coloring.addRange(3, 11, 14);
+
+    poStackAllocator allocator;
+    coloring.color(allocator);
+
+    if (allocator.findSlot(100) == 0 &&
+        coloring.getSlot(0) == coloring.getSlot(2) &&
+        coloring.getSlot(0) != coloring.getSlot(1) &&
+        coloring.getSlot(2) != coloring.getSlot(3) &&
+        coloring.getSlot(0) >= 3 &&
+        allocator.findSlot(3) == coloring.getSlot(2) &&
+        allocator.numSlots() == 6)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void stackColoringTest2()
+{
+    std::cout << "Stack Coloring Test #2 ";
+
+    // Values of different sizes don't share, and vectors are aligned
+    poStackColoring coloring;
+    coloring.addSpill(1, 0, 8);
+    coloring.addRange(0, 0, 4);
+    coloring.addSpill(2, 1, 16);
+    coloring.addRange(1, 8, 12);
+    coloring.addSpill(3, 2, 16);
+    coloring.addRange(2, 20, 24);
+
+    poStackAllocator allocator;
+    coloring.color(allocator);
+
+    if (coloring.getSlot(0) == 0 &&
+        coloring.getSlot(1) == 2 &&
+        coloring.getSlot(2) == 2 &&
+        allocator.numSlots() == 4)
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void performMoves(const std::vector<poRegMove>& moves, std::vector<int>& registers)
+{
+    // Carries out the moves one after the other on the values in the registers
+    for (const poRegMove& move : moves)
+    {
+        if (move.isSwap())
+        {
+            std::swap(registers[move.dst()], registers[move.src()]);
+        }
+        else
+        {
+            registers[move.dst()] = registers[move.src()];
+        }
+    }
+}
+
+static void parallelCopyTest1()
+{
+    std::cout << "Parallel Copy Test #1 ";
+
+    // r2 = r1, r1 = r0, r3 = r1: r1 must be read before it is written
+    poParallelCopy copy;
+    copy.add(2, 1);
+    copy.add(1, 0);
+    copy.add(3, 1);
+    copy.add(4, 4);
+
+    std::vector<poRegMove> moves;
+    copy.sequentialize(moves);
+
+    std::vector<int> registers = { 10, 11, 12, 13, 14 };
+    performMoves(moves, registers);
+
+    if (moves.size() == 3 &&
+        !moves[0].isSwap() && !moves[1].isSwap() && !moves[2].isSwap() &&
+        registers == std::vector<int>({ 10, 10, 11, 11, 14 }))
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
+static void parallelCopyTest2()
+{
+    std::cout << "Parallel Copy Test #2 ";
+
+    // A rotation of three registers takes two swaps, and the copy out of the cycle goes first
+    poParallelCopy copy;
+    copy.add(0, 1);
+    copy.add(1, 2);
+    copy.add(2, 0);
+    copy.add(3, 0);
+
+    std::vector<poRegMove> moves;
+    copy.sequentialize(moves);
+
+    std::vector<int> registers = { 10, 11, 12, 13 };
+    performMoves(moves, registers);
+
+    int numSwaps = 0;
+    for (const poRegMove& move : moves)
+    {
+        numSwaps += move.isSwap();
+    }
+
+    if (moves.size() == 3 &&
+        numSwaps == 2 &&
+        !moves[0].isSwap() &&
+        registers == std::vector<int>({ 11, 12, 10, 10 }))
+    {
+        std::cout << "OK" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAILED" << std::endl;
+    }
+}
+
 void po::runRegLinearTests()
 {
     regLinearTest1();
     regLinearTest2();
     regLinearTest3();
+    regLinearTest4();
+    regLinearTest5();
+    regLinearTest6();
+    regLinearTest7();
 
     stackAllocatorTest1();
     stackAllocatorTest2();
     stackAllocatorTest3();
     stackAllocatorTest4();
+
+    stackColoringTest1();
+    stackColoringTest2();
+
+    parallelCopyTest1();
+    parallelCopyTest2();
 }
 
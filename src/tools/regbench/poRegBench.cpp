@@ -0,0 +1,323 @@
+#include "poRegBench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//
+// Register allocator benchmark.
+//
+// Compiles each test case with every register allocator, using porac's /stats:regalloc
+// to collect the allocation time, number of spills, restores and register moves and the
+// size of the code emitted for every function. Functions from the standard library are compiled once per
+// test case, so their times are averaged.
+//
+// Usage: regbench <test dir> <porac> <std dir> [-O0|-O1|-O2]
+//
+
+using namespace po;
+
+static const char* const ALLOCATORS[] = { "graph", "linear" };
+constexpr int NUM_ALLOCATORS = 2;
+
+class poRegBenchSample
+{
+public:
+    poRegBenchSample() : _numSamples(0), _milliseconds(0.0), _numSpills(0), _numRestores(0), _numMoves(0), _numEliminatedMoves(0), _codeSize(0) {}
+
+    void add(const double milliseconds, const int numSpills, const int numRestores, const int numMoves, const int numEliminatedMoves, const int codeSize)
+    {
+        _numSamples++;
+        _milliseconds += milliseconds;
+        _numSpills = numSpills;
+        _numRestores = numRestores;
+        _numMoves = numMoves;
+        _numEliminatedMoves = numEliminatedMoves;
+        _codeSize = codeSize;
+    }
+
+    inline const bool isSet() const { return _numSamples > 0; }
+    inline const double milliseconds() const { return _numSamples > 0 ? _milliseconds / _numSamples : 0.0; }
+    inline const int numSpills() const { return _numSpills; }
+    inline const int numRestores() const { return _numRestores; }
+    inline const int numMoves() const { return _numMoves; }
+    inline const int numEliminatedMoves() const { return _numEliminatedMoves; }
+    inline const int codeSize() const { return _codeSize; }
+
+private:
+    int _numSamples;
+    double _milliseconds;
+    int _numSpills;
+    int _numRestores;
+    int _numMoves;
+    int _numEliminatedMoves;
+    int _codeSize;
+};
+
+class poRegBenchFunction
+{
+public:
+    poRegBenchFunction() : _numInstructions(0) {}
+
+    inline void setNumInstructions(const int numInstructions) { _numInstructions = numInstructions; }
+    inline const int numInstructions() const { return _numInstructions; }
+    inline poRegBenchSample& sample(const int allocator) { return _samples[allocator]; }
+    inline const poRegBenchSample& sample(const int allocator) const { return _samples[allocator]; }
+
+private:
+    int _numInstructions;
+    poRegBenchSample _samples[NUM_ALLOCATORS];
+};
+
+static bool compile(const std::string& compiler, const std::string& test, const std::string& std, const int allocator, const std::string& optimizationLevel, const std::string& outputFile)
+{
+#ifdef WIN32
+    const std::string os = "win\\";
+    const std::string dir = std + "\\";
+#else
+    const std::string os = "unix/";
+    const std::string dir = std + "/";
+#endif
+
+    const std::vector<std::string> files = {
+        test,
+        dir + os + "os.po",
+        dir + os + "io.po",
+        dir + os + "clock.po",
+        dir + os + "memory.po",
+        dir + os + "control.po",
+        dir + os + "date.po",
+        dir + os + "native_socket.po",
+        dir + "string.po",
+        dir + "string_class.po",
+        dir + "pora.po",
+        dir + "calendar.po",
+        dir + "socket.po",
+        dir + "list.po",
+        dir + "map.po",
+        dir + "numeric.po",
+        dir + "traits.po",
+        dir + "simd.po"
+    };
+
+    std::stringstream ss;
+    ss << "\"" << compiler << "\" build " << optimizationLevel << " /regalloc:" << ALLOCATORS[allocator] << " /stats:regalloc";
+    for (const std::string& file : files)
+    {
+        ss << " \"" << file << "\"";
+    }
+    ss << " > \"" << outputFile << "\"";
+
+#ifdef WIN32
+    const std::string command = "\"" + ss.str() + "\""; // cmd strips the outer quotes
+#else
+    const std::string command = ss.str();
+#endif
+
+    std::system(command.c_str());
+
+    // The compiler doesn't return an error code, so check that it finished
+    std::ifstream output(outputFile);
+    std::string line;
+    while (std::getline(output, line))
+    {
+        if (line.starts_with("Program compiled successfully"))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void readResults(const std::string& outputFile, const int allocator, std::map<std::string, poRegBenchFunction>& functions)
+{
+    std::ifstream output(outputFile);
+    std::string line;
+    bool inStats = false;
+    while (std::getline(output, line))
+    {
+        if (line == "Register allocation:")
+        {
+            inStats = true;
+            continue;
+        }
+        if (!inStats)
+        {
+            continue;
+        }
+
+        // name, allocator, instructions, time (ms), spills, restores, moves, eliminated moves, code size
+        std::istringstream row(line);
+        std::string name;
+        std::string type;
+        int numInstructions = 0;
+        double milliseconds = 0.0;
+        int numSpills = 0;
+        int numRestores = 0;
+        int numMoves = 0;
+        int numEliminatedMoves = 0;
+        int codeSize = 0;
+        if (!(row >> name >> type >> numInstructions >> milliseconds >> numSpills >> numRestores >> numMoves >> numEliminatedMoves >> codeSize))
+        {
+            inStats = false;
+            continue;
+        }
+
+        if (type != ALLOCATORS[allocator])
+        {
+            continue;
+        }
+
+        poRegBenchFunction& function = functions[name];
+        function.setNumInstructions(numInstructions);
+        function.sample(allocator).add(milliseconds, numSpills, numRestores, numMoves, numEliminatedMoves, codeSize);
+    }
+}
+
+static void report(const std::map<std::string, poRegBenchFunction>& functions, const int failed[NUM_ALLOCATORS], const int numTests)
+{
+    std::cout << std::left << std::setw(40) << "function" << std::right << std::setw(8) << "ins";
+    for (int i = 0; i < NUM_ALLOCATORS; i++)
+    {
+        std::cout << " | " << std::left << std::setw(8) << ALLOCATORS[i] << std::right
+            << std::setw(10) << "ms" << std::setw(8) << "spills" << std::setw(9) << "restores"
+            << std::setw(7) << "moves" << std::setw(7) << "elim" << std::setw(8) << "bytes";
+    }
+    std::cout << std::endl;
+
+    double totalMilliseconds[NUM_ALLOCATORS] = {};
+    int totalSpills[NUM_ALLOCATORS] = {};
+    int totalRestores[NUM_ALLOCATORS] = {};
+    int totalMoves[NUM_ALLOCATORS] = {};
+    int totalEliminatedMoves[NUM_ALLOCATORS] = {};
+    int totalCodeSize[NUM_ALLOCATORS] = {};
+    for (const auto& it : functions)
+    {
+        const poRegBenchFunction& function = it.second;
+        std::cout << std::left << std::setw(40) << it.first << std::right << std::setw(8) << function.numInstructions();
+        for (int i = 0; i < NUM_ALLOCATORS; i++)
+        {
+            const poRegBenchSample& sample = function.sample(i);
+            std::cout << " | " << std::setw(8) << "";
+            if (!sample.isSet())
+            {
+                std::cout << std::setw(10) << "-" << std::setw(8) << "-" << std::setw(9) << "-"
+                    << std::setw(7) << "-" << std::setw(7) << "-" << std::setw(8) << "-";
+                continue;
+            }
+
+            std::cout << std::setw(10) << std::fixed << std::setprecision(3) << sample.milliseconds()
+                << std::setw(8) << sample.numSpills()
+                << std::setw(9) << sample.numRestores()
+                << std::setw(7) << sample.numMoves()
+                << std::setw(7) << sample.numEliminatedMoves()
+                << std::setw(8) << sample.codeSize();
+
+            totalMilliseconds[i] += sample.milliseconds();
+            totalSpills[i] += sample.numSpills();
+            totalRestores[i] += sample.numRestores();
+            totalMoves[i] += sample.numMoves();
+            totalEliminatedMoves[i] += sample.numEliminatedMoves();
+            totalCodeSize[i] += sample.codeSize();
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << std::endl;
+    for (int i = 0; i < NUM_ALLOCATORS; i++)
+    {
+        std::cout << std::left << std::setw(8) << ALLOCATORS[i] << std::right
+            << " time " << std::fixed << std::setprecision(3) << totalMilliseconds[i] << " ms"
+            << ", spills " << totalSpills[i]
+            << ", restores " << totalRestores[i]
+            << ", moves " << totalMoves[i]
+            << ", eliminated " << totalEliminatedMoves[i]
+            << ", code size " << totalCodeSize[i]
+            << ", builds failed " << failed[i] << "/" << numTests << std::endl;
+    }
+}
+
+int po::main(const int numArgs, const char** const args)
+{
+    if (numArgs < 4)
+    {
+        std::cout << "Usage: regbench <test dir> <porac> <std dir> [-O0|-O1|-O2]" << std::endl;
+        return 0;
+    }
+
+    std::string optimizationLevel = "/O2";
+    for (int i = 4; i < numArgs; i++)
+    {
+        if (std::strcmp(args[i], "-O0") == 0)
+        {
+            optimizationLevel = "/O0";
+        }
+        else if (std::strcmp(args[i], "-O1") == 0)
+        {
+            optimizationLevel = "/O1";
+        }
+        else if (std::strcmp(args[i], "-O2") == 0)
+        {
+            optimizationLevel = "/O2";
+        }
+    }
+
+    const std::filesystem::path rootDir(args[1]);
+    if (!std::filesystem::exists(rootDir))
+    {
+        std::cout << "Unable to find test directory." << std::endl;
+        return 0;
+    }
+
+    std::vector<std::string> tests;
+    for (const auto& item : std::filesystem::directory_iterator(rootDir))
+    {
+        if (!item.is_directory())
+        {
+            continue;
+        }
+
+        for (const auto& test : std::filesystem::directory_iterator(item))
+        {
+            if (test.path().extension() == ".po")
+            {
+                tests.push_back(test.path().string());
+            }
+        }
+    }
+
+    const std::string outputFile = "regbench.txt";
+    std::map<std::string, poRegBenchFunction> functions;
+    int failed[NUM_ALLOCATORS] = {};
+    for (const std::string& test : tests)
+    {
+        std::cout << "Compiling " << test << std::endl;
+        for (int i = 0; i < NUM_ALLOCATORS; i++)
+        {
+            if (!compile(args[2], test, args[3], i, optimizationLevel, outputFile))
+            {
+                std::cout << "    " << ALLOCATORS[i] << " build failed" << std::endl;
+                failed[i]++;
+                continue;
+            }
+
+            readResults(outputFile, i, functions);
+        }
+    }
+
+    std::cout << std::endl;
+    report(functions, failed, int(tests.size()));
+    return 0;
+}
+
+int main(const int numArgs, const char** const args)
+{
+    return po::main(numArgs, args);
+}
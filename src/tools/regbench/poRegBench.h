@@ -0,0 +1,6 @@
+#pragma once
+
+namespace po
+{
+    int main(const int numArgs, const char** const args);
+}